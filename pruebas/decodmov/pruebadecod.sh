@@ -0,0 +1,63 @@
+#!/bin/sh
+# prueba de regresion de la decodificacion de movimientos PGN de genbasfich.
+#
+# Genera el fichero indexado de partidas.pgn con el genbasfich de la copia del proyecto
+# indicada (por defecto la que contiene esta prueba, con bin/ ya compilado) en formato
+# MOVBIN_t y compacto, con uno y con varios hilos, vuelca sus partidas decodificadas a
+# MOVBIN_t con volcadomovs (compilado con los fuentes de la misma copia) y compara el
+# volcado con esperado.txt. Con varios hilos los trozos son de 1 KB ('-k1'), de forma que
+# partidas.pgn se reparte en varios, y el fichero indexado debe ser identico al de un hilo.
+#
+# esperado.txt se obtuvo con el genbasfich anterior al decodificador SAN por tabla y a la
+# resolucion de origenes con bitboards. Con -r se regenera con la copia indicada, p.e.
+#		git worktree add /tmp/ref <commit> && make -C /tmp/ref/src && pruebadecod.sh -r /tmp/ref
+#
+# uso: pruebadecod.sh [-r] [carpeta del proyecto]
+cd `dirname $0`
+REGENERA=0
+if [ "$1" = "-r" ]; then
+	REGENERA=1
+	shift
+fi
+RAIZ=${1:-../..}
+GENBASFICH=$RAIZ/bin/genbasfich
+TMP=${TMPDIR:-/tmp}/pruebadecod.$$
+FILEID=24277
+
+if [ ! -x $GENBASFICH ]; then
+	echo "No existe $GENBASFICH"
+	exit 1
+fi
+make -s -B SRC=$RAIZ/src volcadomovs || exit 1
+mkdir -p $TMP
+if [ $REGENERA = 1 ]; then
+	mkdir -p $TMP/ref
+	$GENBASFICH $TMP/ref $FILEID 0 < partidas.pgn > /dev/null 2>&1
+	./volcadomovs $TMP/ref | sort -n > esperado.txt
+	echo "esperado.txt regenerado: `wc -l < esperado.txt` partidas"
+	rm -rf $TMP
+	exit 0
+fi
+ERRORES=0
+for formato in 0 1; do
+	for hilos in -h1 -h3; do
+		mkdir -p $TMP/$formato$hilos
+		$GENBASFICH $hilos -k1 $TMP/$formato$hilos $FILEID $formato < partidas.pgn > /dev/null 2>&1
+		./volcadomovs $TMP/$formato$hilos | sort -n > $TMP/$formato$hilos.txt
+		if cmp -s esperado.txt $TMP/$formato$hilos.txt; then
+			echo "formato $formato $hilos: OK"
+		else
+			echo "formato $formato $hilos: DIFERENCIAS"
+			diff esperado.txt $TMP/$formato$hilos.txt | head -20
+			ERRORES=1
+		fi
+	done
+	for f in part.id campos.id data.bin; do
+		if ! cmp -s $TMP/$formato-h1/$f $TMP/$formato-h3/$f; then
+			echo "formato $formato: $f distinto con -h1 y -h3"
+			ERRORES=1
+		fi
+	done
+done
+rm -rf $TMP
+exit $ERRORES
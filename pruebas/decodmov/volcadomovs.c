@@ -0,0 +1,53 @@
+// programa de prueba que vuelca en texto las partidas de un fichero indexado generado por
+// genbasfich, con sus movimientos decodificados a MOVBIN_t.
+//
+// Se escribe una linea por partida con su indice en el fichero PGN, elomed, ganador y
+// numero de movimientos, seguida de los movimientos como piezaorg/piezadest/origen/destino.
+// Solo se vuelcan campos presentes en todas las versiones de la cabecera de partida, de
+// forma que el volcado no depende del formato del fichero indexado. El orden de las lineas
+// es el del fichero indexado; pruebadecod.sh las ordena por indice para comparar con el
+// volcado de referencia.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "ajedrez.h"
+#include "basfichdrv.h"
+
+BASFICH_t bdfch;
+CPARTIDA_t cabpartida;
+MOVBIN_t movimientos[MAXMOV];
+
+int main(int argc, char *argv[])
+{
+	PARTFICH_t *partfch;
+	PARTIDA_t *partidafch;
+	int i;
+
+	if(argc < 2)
+	{
+		fprintf(stderr,"Usage: %s <fichbas>\n",argv[0]);
+		exit(1);
+	}
+	if(basfichOpenR(argv[1],&bdfch) == 0)
+	{
+		fprintf(stderr,"No se puede abrir %s\n",argv[1]);
+		exit(1);
+	}
+	for(partfch=bdfch.particiones;((uint8_t *)partfch - (uint8_t *)(bdfch.particiones)) < bdfch.lenparticiones;partfch++)
+	{
+		cargaPartidas(&bdfch,partfch);
+		cargaDatos(&bdfch);
+		for(partidafch=bdfch.partidas;((uint8_t *)partidafch - (uint8_t *)(bdfch.partidas)) < bdfch.lenpartidas;partidafch++)
+		{
+			loadPartida(&bdfch,partidafch,&cabpartida,movimientos);
+			printf("%u %d %d%d %d",cabpartida.ind,cabpartida.elomed,cabpartida.flags.ganablanca,
+					cabpartida.flags.gananegra,cabpartida.nmov);
+			for(i=0;i<cabpartida.nmov;i++)
+				printf(" %d/%d/%d/%d",movimientos[i].piezaorg,movimientos[i].piezadest,
+						movimientos[i].origen,movimientos[i].destino);
+			printf("\n");
+		}
+	}
+	basfichClose(&bdfch);
+	return 0;
+}
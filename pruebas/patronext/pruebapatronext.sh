@@ -0,0 +1,49 @@
+#!/bin/sh
+# prueba de regresion de la cuenta de jugadas de la extension patronext de sqlite.
+#
+# Usa la partida 1.e4 e5 2.Nf3 d6 3.Bb5+ Nc6 4.O-O Ne7 (nueve movimientos MOVBIN_t, el
+# enroque se anota como torre y rey) y comprueba que board_at y pattern_match cuentan el
+# enroque como una sola jugada, no devuelven el tablero a medio enrocar y dan el color
+# que juega correcto tras el enroque.
+#
+# Necesita el shell sqlite3 y la copia del proyecto indicada (por defecto la que contiene
+# esta prueba) con bin/ ya compilado.
+#
+# uso: pruebapatronext.sh [carpeta del proyecto]
+cd `dirname $0`
+RAIZ=${1:-../..}
+TMP=${TMPDIR:-/tmp}/pruebapatronext.$$
+MOVS="X'0101342409090c1c02023e2d09090b1303033d190a0a011204043f3d06063c3e0a0a060c'"
+
+if [ ! -f $RAIZ/bin/patronext.so ] || [ ! -x $RAIZ/bin/gpatronbin ]; then
+	echo "No existe $RAIZ/bin/patronext.so o $RAIZ/bin/gpatronbin"
+	exit 1
+fi
+mkdir -p $TMP
+echo "Kg1, Rf1 1..." | $RAIZ/bin/gpatronbin > $TMP/enrocado.bin 2>/dev/null
+echo "Ke1, Rf1 1..." | $RAIZ/bin/gpatronbin > $TMP/medio.bin 2>/dev/null
+sqlite3 :memory: ".load $RAIZ/bin/patronext" \
+	"SELECT board_at($MOVS,6);" \
+	"SELECT board_at($MOVS,7);" \
+	"SELECT board_at($MOVS,8);" \
+	"SELECT board_at($MOVS,9) IS NULL;" \
+	"SELECT pattern_match($MOVS,readfile('$TMP/enrocado.bin'));" \
+	"SELECT pattern_match($MOVS,readfile('$TMP/medio.bin')) IS NULL;" > $TMP/salida.txt
+cat > $TMP/esperado.txt <<FIN
+r1bqkbnr/ppp2ppp/2np4/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R w
+r1bqkbnr/ppp2ppp/2np4/1B2p3/4P3/5N2/PPPP1PPP/RNBQ1RK1 b
+r1bqkb1r/ppp1nppp/2np4/1B2p3/4P3/5N2/PPPP1PPP/RNBQ1RK1 w
+1
+7
+1
+FIN
+if cmp -s $TMP/esperado.txt $TMP/salida.txt; then
+	echo "patronext: OK"
+	ERRORES=0
+else
+	echo "patronext: DIFERENCIAS"
+	diff $TMP/esperado.txt $TMP/salida.txt
+	ERRORES=1
+fi
+rm -rf $TMP
+exit $ERRORES
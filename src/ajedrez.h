@@ -39,31 +39,13 @@ static uint8_t tablaini[64] = {0x0c,0x0a,0x0b,0x0d,0x0e,0x0b,0x0a,0x0c,
 
 //============ Estructuras Interpretacion PGN =============================
 
-// lista de piezas activas de un determinado color.
-// su contenido es la posicion absoluta en el tablero (0:63) de cada pieza activa.
-// Se utiliza para acelerar la localizacion de piezas en el tablero.
-// Su contenido debe corresponder en todo momento con el tablero virtual.	
-typedef struct {
-	uint8_t	rey;				// posicion rey.
-	uint8_t	reina[9];		// posiciones reinas, varias debido a promociones.
-	uint8_t	nreina;			// numero de reinas activas.
-	uint8_t	torre[10];		// posiciones torres, puede ser mas de dos por promociones.
-	uint8_t	ntorre;			// numero de torres activas.
-	uint8_t	alfil[10];		// posiciones alfiles, puede ser mas de dos por promociones.
-	uint8_t	nalfil;			// numero alfiles activos.
-	uint8_t	caballo[10];	// posiciones caballos, puede ser mas de dos por promociones.
-	uint8_t	ncaballo;		// numero caballos activos.
-	uint8_t	peon[8];			// posiciones peones.
-	uint8_t	npeon;			// numero peones activos.
-} PIEZAS_t;
-
-// Tablero. Contiene el tablero propiamente dicho
-// y la lista de piezas blancas y negras activas
-// para acelerar operaciones.
+// Tablero. Contiene el tablero propiamente dicho y las casillas ocupadas por cada pieza
+// (bitboards, bit 'n' => posicion 'n' del tablero) para acelerar operaciones.
+// Su contenido debe corresponder en todo momento con el tablero virtual.
 typedef struct {
 	uint8_t	tab[64];		// tablero. Contenido pieza que ocupa esa casilla.
-	PIEZAS_t blancas;		// lista piezas blancas.
-	PIEZAS_t negras;		// lista piezas negras.
+	uint64_t	bb[16];		// casillas de cada pieza, indexado por codigo de pieza con color.
+	uint64_t	ocupadas;	// casillas ocupadas por cualquier pieza.
 } TABLERO_t;
 
 // Movimiento de una pieza.
@@ -94,16 +76,79 @@ typedef struct {
 	uint8_t	reser : 5;			// reservado para futuro uso.
 } FLAGS_t;
 
+// Formatos de codificacion de la lista de movimientos de una partida.
+#define FORMATO_MOVBIN		0	// array de MOVBIN_t, 4 bytes por movimiento.
+#define FORMATO_COMPACTO	1	// array de MOVCOMP_t, 2 bytes por movimiento.
+#define FORMATO_ARCHIVO		2	// indice en la lista de movimientos posibles, 1 byte por movimiento.
+
+// movimiento compacto en 16 bits. Las piezas se deducen del tablero en el momento de moverse.
+//		bits 0-5 => posicion origen (0:63).
+//		bits 6-11 => posicion destino (0:63).
+//		bits 12-14 => pieza de promocion sin color (NADA si no hay promocion).
+//		bit 15 => color de la pieza que mueve (1 => NEGRA).
+typedef uint16_t MOVCOMP_t;
+
+// Ritmos de juego. Se deducen del TimeControl del PGN ('base+incremento' en segundos) por la
+// duracion estimada de la partida base + 40 * incremento.
+#define RITMO_DESCONOCIDO		0
+#define RITMO_BALA				1	// menos de 3 minutos.
+#define RITMO_RELAMPAGO			2	// menos de 8 minutos.
+#define RITMO_RAPIDA				3	// menos de 25 minutos.
+#define RITMO_CLASICA			4
+#define RITMO_CORRESPONDENCIA	5	// sin control de tiempo ('-').
+
+// Tipos de terminacion de la partida (Termination del PGN).
+#define TERMINA_DESCONOCIDA	0
+#define TERMINA_NORMAL			1	// 'Normal'.
+#define TERMINA_TIEMPO			2	// 'Time forfeit'.
+#define TERMINA_ABANDONO		3	// 'Abandoned'.
+#define TERMINA_INFRACCION		4	// 'Rules infraction'.
+#define TERMINA_INCONCLUSA		5	// 'Unterminated'.
+
+// Codigo de apertura: 1 + indice del codigo ECO (A00 => 1 ... E99 => 500), 0 => desconocida.
+#define ECOMAXIMO	500
+
+// Codificacion de los metadatos de la partida en 16 bits.
+typedef struct {
+	uint16_t	eco : 9;				// codigo de apertura.
+	uint16_t	ritmo : 3;			// ritmo de juego (RITMO_xxx).
+	uint16_t	terminacion : 3;	// tipo de terminacion (TERMINA_xxx).
+	uint16_t	reser : 1;			// reservado para futuro uso.
+} META_t;
+
 // Estructura de cabecera de partida en binario	
 typedef struct {
 	uint16_t	magic;
-	uint8_t	reser;
+	uint8_t	formato;	// formato de codificacion de los movimientos (FORMATO_xxx).
 	FLAGS_t	flags;	// flags de la partida.
 	uint16_t	nmov;		// numero de movimientos de la partida en lista de movimientos.
 	uint16_t	elomed;	// elo media de los jugadores,
 	uint32_t	ind;		// indice de la partida en el fichero PGN original.
+	META_t	meta;		// metadatos de la partida (apertura, ritmo y terminacion).
+	int16_t	difelo;	// diferencia de elo blancas - negras.
 } CPARTIDA_t;
 
+// Filtro de metadatos de las partidas a buscar (ver job.conf). Las partidas sin metadatos
+// (bases anteriores a ellos o almacenes que no los graban) los tienen a cero (desconocidos).
+typedef struct {
+	int		ritmos;			// mascara de ritmos admitidos (bit RITMO_xxx).
+	int		terminaciones;	// mascara de terminaciones admitidas (bit TERMINA_xxx).
+	int		ecomin;			// rango de codigos de apertura admitidos.
+	int		ecomax;
+	int		difmin;			// rango de diferencia de elo blancas - negras admitido.
+	int		difmax;
+} FILTROMETA_t;
+
+// Funcion que retorna si los metadatos de una partida cumplen el filtro (NULL => sin filtro).
+static inline int cumpleMeta(FILTROMETA_t *f,META_t meta,int difelo)
+{
+	if(f == NULL)
+		return 1;
+	return(((f->ritmos >> meta.ritmo) & 1) && ((f->terminaciones >> meta.terminacion) & 1) &&
+			(meta.eco >= f->ecomin) && (meta.eco <= f->ecomax) &&
+			(difelo >= f->difmin) && (difelo <= f->difmax));
+}
+
 // Estructura de posibilidad de enroque.
 typedef struct {
 	uint8_t reinaw : 1;	// posibilidad enroque lado reina blancas.
@@ -11,7 +11,13 @@
 //		-campos.id => indices de partidas. Campos para ordenar las partidas de una particion, contiene los datos
 //						de ELOMED y ganador asi como el offset de la partida en el fichero de datos y su longitud.
 //						Esta ordenado por ELOMED, ganador.
-//		-data.bin => contiene los datos de cabecera de partida y movimientos de cada partida. Esta ordenado por orden de entrada.
+//		-data.bin => contiene los datos de cabecera de partida y movimientos de cada partida (en el formato
+//						indicado en la cabecera, MOVBIN_t o compacto). Dentro de cada particion
+//						esta en el mismo orden que campos.id (ELOMED, ganador).
+//		-manifiesto => una linea por cada fileid anhadido completo con la longitud de los tres ficheros
+//						tras anhadirlo. Permite descartar lo grabado por una carga interrumpida y
+//						no volver a anhadir un fileid ya cargado. Se crea antes de anhadir el primer
+//						fileid con una entrada inicial (MANIFIESTO_INICIO) con las longitudes de partida.
 //
 #include <stdio.h>
 #include <fcntl.h>
@@ -21,7 +27,41 @@
 #include <stdint.h>
 #include <string.h>
 #include "basfichdrv.h"
+#include "codmov.h"
+
+#define LENBUFDATOS	(1024*1024)	// tamanho buffer de escritura al reordenar data.bin
+#define LENMAXPARTIDA	(sizeof(CPARTIDA_t) + MAXMOV * sizeof(MOVBIN_t))	// cota de la longitud de una partida.
+#define ALINBUFESC		4096	// alineamiento de los buffers de escritura diferida.
 			
+// funcion de comparacion para QSORT para ordenar particiones por
+// fileid, particion.
+int compaParticion(const void *uno,const void *otro)
+{
+	int res;
+	
+	res = ((PARTFICH_t *)uno)->fileid - ((PARTFICH_t *)otro)->fileid;
+	if(res != 0)
+		return res;
+	res = ((PARTFICH_t *)uno)->particion - ((PARTFICH_t *)otro)->particion;
+	return res;
+}
+
+// Funcion para ordenar en memoria los indices de particiones por fileid, particion. Cada fileid se
+// anhade en orden de particion, solo hay que ordenar si los fileid se han anhadido desordenados.
+static void ordenaParticiones(PARTFICH_t *particiones,int nparticiones)
+{
+	int i;
+	
+	for(i=1;i<nparticiones;i++)
+	{
+		if(compaParticion(&particiones[i-1],&particiones[i]) > 0)
+		{
+			qsort(particiones,nparticiones,sizeof(PARTFICH_t),compaParticion);
+			return;
+		}
+	}
+}
+
 // Abre la base de datos para lectura.
 int basfichOpenR(char *path,BASFICH_t *bd)
 {
@@ -42,8 +82,17 @@ int basfichOpenR(char *path,BASFICH_t *bd)
 				lseek(bd->fdparticiones,0,SEEK_SET);	// posicionamos principio fichero.
 				bd->particiones = malloc(bd->lenparticiones);	// reservamos memoria para contener el fichero de particiones.
 				res = read(bd->fdparticiones,bd->particiones,bd->lenparticiones); // volcamos a memoria fichero particiones.
+				ordenaParticiones(bd->particiones,bd->lenparticiones/sizeof(PARTFICH_t));	// para buscaParticion.
 				bd->partidas = NULL;
 				bd->lenpartidas = 0;
+				bd->datos = NULL;
+				bd->lendatos = 0;
+				bd->siglote = -1;
+				bd->escdatos = NULL;
+				bd->lenescdatos = 0;
+				bd->partcur = NULL;
+				bd->npartcur = 0;
+				bd->maxpartcur = 0;
 				return 1;
 			}
 			else  // fallo de apertura fichero de datos.
@@ -64,6 +113,11 @@ int basfichOpenR(char *path,BASFICH_t *bd)
 	bd->particiones = NULL;
 	bd->partidas = NULL;
 	bd->lenpartidas = 0;
+	bd->escdatos = NULL;
+	bd->lenescdatos = 0;
+	bd->partcur = NULL;
+	bd->npartcur = 0;
+	bd->maxpartcur = 0;
 	return 0;
 }
 
@@ -81,15 +135,25 @@ int basfichOpenW(char *path,BASFICH_t *bd)
 		sprintf(nomtmp,"%s/campos.id",path);	// fichero de partidas.
 		if((bd->fdpartidas=open(nomtmp,O_RDWR | O_CREAT,0666)) >= 0)	// apertura para lectura-escritura.
 		{
-			lseek(bd->fdpartidas,0,SEEK_END);	// posicionamos final partidas.
+			bd->finpartidas = lseek(bd->fdpartidas,0,SEEK_END);	// posicionamos final partidas.
 			sprintf(nomtmp,"%s/data.bin",path);	// fichero de datos.
 			if((bd->fddata=open(nomtmp,O_RDWR | O_CREAT,0666)) >= 0)	// apertura para lectura-escritura.
 			{
-				lseek(bd->fddata,0,SEEK_END);	// posicionamos final datos.
+				bd->findatos = lseek(bd->fddata,0,SEEK_END);	// posicionamos final datos.
 				bd->particiones = NULL;
 				bd->partidas = NULL;
 				bd->lenparticiones = 0;
 				bd->lenpartidas = 0;
+				bd->datos = NULL;
+				bd->lendatos = 0;
+				bd->siglote = -1;
+				// buffer de escritura diferida, alineado a pagina. Sin el se escribe directamente.
+				if(posix_memalign((void **)&bd->escdatos,ALINBUFESC,LENBUFESC) != 0)
+					bd->escdatos = NULL;
+				bd->lenescdatos = 0;
+				bd->partcur = NULL;
+				bd->npartcur = 0;
+				bd->maxpartcur = 0;
 				return 1;
 			}
 			else // fallo apertura datos.
@@ -110,6 +174,14 @@ int basfichOpenW(char *path,BASFICH_t *bd)
 	bd->particiones = NULL;
 	bd->partidas = NULL;
 	bd->lenpartidas = 0;
+	bd->datos = NULL;
+	bd->lendatos = 0;
+	bd->siglote = -1;
+	bd->escdatos = NULL;
+	bd->lenescdatos = 0;
+	bd->partcur = NULL;
+	bd->npartcur = 0;
+	bd->maxpartcur = 0;
 	
 	return 0;
 }
@@ -117,11 +189,19 @@ int basfichOpenW(char *path,BASFICH_t *bd)
 // cierre de la base.
 void basfichClose(BASFICH_t *bd)
 {
+	// vuelca lo pendiente de escribir.
+	vuelcaEscritura(bd);
+	if(bd->escdatos != NULL)
+		free(bd->escdatos);
+	if(bd->partcur != NULL)
+		free(bd->partcur);
 	// libera las memorias utilizadas.
 	if(bd->particiones != NULL)
 		free(bd->particiones);
 	if(bd->partidas != NULL)
 		free(bd->partidas);
+	if(bd->datos != NULL)
+		free(bd->datos);
 	// cierra ficheros abiertos.
 	if(bd->fdparticiones >= 0)
 		close(bd->fdparticiones);
@@ -136,90 +216,312 @@ void basfichClose(BASFICH_t *bd)
 	bd->particiones = NULL;
 	bd->partidas = NULL;
 	bd->lenpartidas = 0;
+	bd->datos = NULL;
+	bd->lendatos = 0;
+	bd->siglote = -1;
+	bd->escdatos = NULL;
+	bd->lenescdatos = 0;
+	bd->partcur = NULL;
+	bd->npartcur = 0;
+	bd->maxpartcur = 0;
 }
 
-// funcion de comparacion para QSORT para ordenar particiones por
-// fileid, particion.
-int compaParticion(const void *uno,const void *otro)
+// lectura completa de una zona del fichero de datos (pread puede leer menos de lo pedido).
+static int leeZona(int fd,uint8_t *buf,uint64_t len,uint64_t offset)
 {
-	int res;
+	ssize_t res;
 	
-	res = ((PARTFICH_t *)uno)->fileid - ((PARTFICH_t *)otro)->fileid;
-	if(res != 0)
-		return res;
-	res = ((PARTFICH_t *)uno)->particion - ((PARTFICH_t *)otro)->particion;
-	return res;
+	while(len > 0)
+	{
+		if((res = pread(fd,buf,len,offset)) <= 0)
+			return 0;
+		buf += res;
+		offset += res;
+		len -= res;
+	}
+	return 1;
 }
 
-// Funcion para ordenar los indices de particiones por fileid, particion.
-void ordenaParticiones(BASFICH_t *bd)
+// escritura completa de una zona del fichero (pwrite puede escribir menos de lo pedido).
+static int escribeZona(int fd,uint8_t *buf,uint64_t len,uint64_t offset)
 {
-	uint8_t *particiones;
-	int res;
+	ssize_t res;
 	
-	// cargamos en memoria el fichero de particiones.
-	bd->lenparticiones = lseek(bd->fdparticiones,0,SEEK_END);	// longitud fichero.
-	particiones = malloc(bd->lenparticiones);	// reserva de memoria.
-	lseek(bd->fdparticiones,0,SEEK_SET);		// posicionado al principio fichero.
-	res = read(bd->fdparticiones,particiones,bd->lenparticiones);	// volcado a memoria.
-	qsort(particiones,bd->lenparticiones/sizeof(PARTFICH_t),sizeof(PARTFICH_t),compaParticion);	// ordenacion.
-	lseek(bd->fdparticiones,0,SEEK_SET);	// posicionado al principio fichero.
-	res = write(bd->fdparticiones,particiones,bd->lenparticiones);	// volcado de memoria al fichero.
-	free(particiones);	// liberacion memoria reservada.
+	while(len > 0)
+	{
+		if((res = pwrite(fd,buf,len,offset)) <= 0)
+			return 0;
+		buf += res;
+		len -= res;
+		offset += res;
+	}
+	return 1;
 }
 
-// funcion de comparacion para QSORT para ordenar partidas por
-// elomed, ganador.
-int compaPartidas(const void *uno,const void *otro)
+// anhade datos al final de un fichero a traves de su buffer de escritura diferida. El offset de
+// escritura es la longitud del fichero llevada en memoria (*fin), sin lseek. Si el buffer se
+// llena se vuelca con una sola escritura.
+static int anhadeBuffer(int fd,uint8_t *buf,int *lenbuf,uint64_t *fin,void *datos,int len)
 {
-	int res;
+	int ok = 1;
 	
-	res = ((PARTIDA_t *)uno)->elomed - ((PARTIDA_t *)otro)->elomed;
-	if(res != 0)
-		return res;
-	res = ((PARTIDA_t *)uno)->ganador - ((PARTIDA_t *)otro)->ganador;
-	return res;
+	if((buf == NULL) || (len > LENBUFESC))	// sin buffer o datos mayores que el buffer.
+	{
+		if(*lenbuf > 0)
+			ok = escribeZona(fd,buf,*lenbuf,*fin - *lenbuf);
+		*lenbuf = 0;
+		ok &= escribeZona(fd,datos,len,*fin);
+		*fin += len;
+		return ok;
+	}
+	if((*lenbuf + len) > LENBUFESC)	// buffer lleno, lo volcamos.
+	{
+		ok = escribeZona(fd,buf,*lenbuf,*fin - *lenbuf);
+		*lenbuf = 0;
+	}
+	memcpy(buf + *lenbuf,datos,len);
+	*lenbuf += len;
+	*fin += len;
+	return ok;
+}
+
+// vuelca el buffer de escritura diferida de data.bin.
+static int vuelcaDatos(BASFICH_t *bd)
+{
+	int ok = 1;
+	
+	if(bd->lenescdatos > 0)
+		ok = escribeZona(bd->fddata,bd->escdatos,bd->lenescdatos,bd->findatos - bd->lenescdatos);
+	bd->lenescdatos = 0;
+	return ok;
 }
 
-// ordena las partidas de una determinada particion por elomed y ganador.
-void ordenaPartidas(BASFICH_t *bd,int fileid,int particion)
+// ordena en memoria las partidas por elomed, ganador con una ordenacion radix LSD estable de
+// tres pasadas de 8 bits (ganador, byte bajo y byte alto de elomed). Se saltan las pasadas
+// en las que todas las partidas tienen el mismo digito (p.e. elomed < 256).
+static int ordenaPartidas(PARTIDA_t *partidas,int npartidas)
 {
-	PARTFICH_t *partmp;
-	uint8_t *particiones;
-	uint8_t *partidas;
+	PARTIDA_t *aux,*org,*des,*tmp;
+	int cuenta[3][256];
+	int pasada,i,acum,n;
+	uint8_t dig;
+	
+	if(npartidas < 2)
+		return 1;
+	if((aux = malloc((size_t)npartidas * sizeof(PARTIDA_t))) == NULL)
+		return 0;
+	// histogramas de los tres digitos en un solo recorrido.
+	memset(cuenta,0,sizeof(cuenta));
+	for(i=0;i<npartidas;i++)
+	{
+		cuenta[0][partidas[i].ganador]++;
+		cuenta[1][partidas[i].elomed & 0xff]++;
+		cuenta[2][partidas[i].elomed >> 8]++;
+	}
+	org = partidas;
+	des = aux;
+	for(pasada=0;pasada<3;pasada++)
+	{
+		switch(pasada)
+		{
+			case 0: dig = org[0].ganador; break;
+			case 1: dig = org[0].elomed & 0xff; break;
+			default: dig = org[0].elomed >> 8; break;
+		}
+		if(cuenta[pasada][dig] == npartidas)	// todas con el mismo digito.
+			continue;
+		// posicion inicial de cada digito.
+		for(i=0,acum=0;i<256;i++)
+		{
+			n = cuenta[pasada][i];
+			cuenta[pasada][i] = acum;
+			acum += n;
+		}
+		for(i=0;i<npartidas;i++)
+		{
+			switch(pasada)
+			{
+				case 0: dig = org[i].ganador; break;
+				case 1: dig = org[i].elomed & 0xff; break;
+				default: dig = org[i].elomed >> 8; break;
+			}
+			des[cuenta[pasada][dig]++] = org[i];
+		}
+		tmp = org;
+		org = des;
+		des = tmp;
+	}
+	if(org != partidas)	// numero impar de pasadas.
+		memcpy(partidas,org,(size_t)npartidas * sizeof(PARTIDA_t));
+	free(aux);
+	return 1;
+}
+
+// reordena fisicamente en data.bin los datos de las partidas de la particion en curso para que
+// sigan el orden (elomed, ganador) de sus indices, actualizando los offsets.
+// Asi el recorrido de una particion o de un rango de elo es una lectura secuencial.
+// La particion debe ser la ultima grabada en data.bin y sus partidas ya estar ordenadas.
+static int ordenaDatos(BASFICH_t *bd)
+{
+	PARTIDA_t *partidas;
+	uint8_t *datos;
+	uint8_t *salida;
+	int lensalida;
+	CPARTIDA_t *cabtmp;
+	uint64_t offini;
+	uint64_t lendatos;
+	uint64_t offsal;
+	int npartidas;
+	int lenpartida;
+	int ok;
 	int i;
-	int res;
 	
-	bd->lenparticiones = lseek(bd->fdparticiones,0,SEEK_END); // longitud particiones.
-	lseek(bd->fdparticiones,0,SEEK_SET);	// posicionamos principio particiones.
-	particiones = malloc(bd->lenparticiones);	// reservamos memoria para particiones.
-	res = read(bd->fdparticiones,particiones,bd->lenparticiones);	// volcamos a memoria las particiones.
-	// buscamos el fileid, particion indicada. NOTA: podria acelerarse con busqueda dicotomica.
-	for(i=0,partmp =(PARTFICH_t *)particiones;i<bd->lenparticiones/sizeof(PARTFICH_t);i++,partmp++)
+	partidas = bd->partcur;
+	npartidas = bd->npartcur;
+	if(npartidas == 0)
+		return 1;
+	ok = vuelcaDatos(bd);	// los datos de la particion deben estar en el fichero.
+	
+	// la zona de datos de la particion va desde su partida de menor offset al final de data.bin.
+	offini = partidas[0].offset;
+	for(i=1;i<npartidas;i++)
 	{
-		if((partmp->fileid == fileid) && (partmp->particion == particion))
-			break;
+		if(partidas[i].offset < offini)
+			offini = partidas[i].offset;
+	}
+	lendatos = bd->findatos - offini;
+	if((datos = malloc(lendatos)) == NULL)
+		return 0;
+	if(!leeZona(bd->fddata,datos,lendatos,offini))
+	{
+		free(datos);
+		return 0;
+	}
+	
+	// copiamos las partidas en el orden de los indices sobre la misma zona de data.bin
+	// a traves de un buffer de salida, anotando su nuevo offset.
+	salida = malloc(LENBUFDATOS);
+	lensalida = 0;
+	for(i=0,offsal=offini;i<npartidas;i++)
+	{
+		cabtmp = (CPARTIDA_t *)(datos + (partidas[i].offset - offini));
+		lenpartida = sizeof(CPARTIDA_t) + lenMovs(cabtmp->formato,cabtmp->nmov);
+		if((lensalida + lenpartida) > LENBUFDATOS)	// buffer lleno, lo volcamos.
+		{
+			ok &= escribeZona(bd->fddata,salida,lensalida,offsal - lensalida);
+			lensalida = 0;
+		}
+		memcpy(salida + lensalida,cabtmp,lenpartida);
+		lensalida += lenpartida;
+		partidas[i].offset = offsal;
+		offsal += lenpartida;
 	}
-	partidas = malloc(partmp->len);	// reservamos memoria para partidas.
-	lseek(bd->fdpartidas,partmp->offset,SEEK_SET);	// posicionamos en primera partida de la particion.
-	res = read(bd->fdpartidas,partidas,partmp->len);		// volcamos partidas a memoria.
-	qsort(partidas,partmp->len/sizeof(PARTIDA_t),sizeof(PARTIDA_t),compaPartidas);	// ordenamos partidas.
-	lseek(bd->fdpartidas,partmp->offset,SEEK_SET);	// situamos en primera partida de la particion
-	res = write(bd->fdpartidas,partidas,partmp->len);	// volcamos partidas ordenadas a fichero.
-	free(particiones);	// liberamos memoria particiones.
-	free(partidas);		// liberamos memoria partidas.
+	ok &= escribeZona(bd->fddata,salida,lensalida,offsal - lensalida);
+	free(datos);
+	free(salida);
+	return ok;
+}
+
+// Funcion que cierra la particion en curso.
+int cierraParticion(BASFICH_t *bd,PARTFICH_t *particion)
+{
+	uint64_t len;
+	int ok;
+	
+	ok = ordenaPartidas(bd->partcur,bd->npartcur);	// ordena en memoria sus indices.
+	ok &= ordenaDatos(bd);										// reordena sus datos en data.bin.
+	// graba de una vez los indices ordenados.
+	len = (uint64_t)bd->npartcur * sizeof(PARTIDA_t);
+	if(len > 0)
+		ok &= escribeZona(bd->fdpartidas,(uint8_t *)bd->partcur,len,bd->finpartidas - len);
+	particion->len = len;
+	particion->elomin = (bd->npartcur > 0) ? bd->partcur[0].elomed : 0;	// partidas ya ordenadas.
+	particion->elomax = (bd->npartcur > 0) ? bd->partcur[bd->npartcur - 1].elomed : 0;
+	particion->reser = 0;
+	bd->npartcur = 0;
+	ok &= anhadeParticion(bd,particion);
+	return ok;
+}
+
+// Funcion que copia una particion de otro fichero indexado. Su zona de data.bin es contigua y
+// esta en el orden de sus indices (ordenaDatos), se copia por trozos y sus offsets se desplazan.
+int copiaParticion(BASFICH_t *bd,BASFICH_t *org,PARTFICH_t *particion)
+{
+	PARTFICH_t partmp;
+	PARTIDA_t *partidas;
+	CPARTIDA_t cab;
+	uint8_t *buf;
+	uint64_t offini,offfin,off,len;
+	int npartidas;
+	int i;
+	int ok;
+	
+	npartidas = particion->len / sizeof(PARTIDA_t);
+	partmp = *particion;
+	partmp.offset = bd->finpartidas;
+	if(npartidas == 0)
+		return anhadeParticion(bd,&partmp);
+	if(((partidas = malloc(particion->len)) == NULL) || ((buf = malloc(LENBUFDATOS)) == NULL))
+	{
+		free(partidas);
+		return 0;
+	}
+	ok = leeZona(org->fdpartidas,(uint8_t *)partidas,particion->len,particion->offset);
+	// limites de la zona de datos: menor offset y final de la partida de mayor offset.
+	offini = offfin = partidas[0].offset;
+	for(i=1;i<npartidas;i++)
+	{
+		if(partidas[i].offset < offini)
+			offini = partidas[i].offset;
+		if(partidas[i].offset > offfin)
+			offfin = partidas[i].offset;
+	}
+	ok &= leeZona(org->fddata,(uint8_t *)&cab,sizeof(CPARTIDA_t),offfin);
+	offfin += sizeof(CPARTIDA_t) + lenMovs(cab.formato,cab.nmov);
+	// copia de la zona al final de data.bin.
+	ok &= vuelcaDatos(bd);
+	for(off=offini;ok && (off < offfin);off+=len)
+	{
+		len = ((offfin - off) > LENBUFDATOS) ? LENBUFDATOS : (offfin - off);
+		ok = leeZona(org->fddata,buf,len,off) && escribeZona(bd->fddata,buf,len,bd->findatos + (off - offini));
+	}
+	// indices con los offsets desplazados.
+	for(i=0;i<npartidas;i++)
+		partidas[i].offset = bd->findatos + (partidas[i].offset - offini);
+	ok = ok && escribeZona(bd->fdpartidas,(uint8_t *)partidas,particion->len,bd->finpartidas);
+	if(ok)
+	{
+		bd->findatos += offfin - offini;
+		bd->finpartidas += particion->len;
+		ok = anhadeParticion(bd,&partmp);
+	}
+	free(partidas);
+	free(buf);
+	return ok;
 }
 
 // busca una particion en el fichero de indices de particiones.
+// el fichero esta ordenado por fileid, particion => busqueda dicotomica.
 PARTFICH_t *buscaParticion(BASFICH_t *bd,int fileid,int particion)
 {
-	int i;
-	PARTFICH_t *partmp;
+	int ini,fin,med;
+	int res;
+	PARTFICH_t clave;
 	
-	for(i=0,partmp = bd->particiones;i<(bd->lenparticiones/sizeof(PARTFICH_t));i++,partmp++)
+	clave.fileid = fileid;
+	clave.particion = particion;
+	ini = 0;
+	fin = (bd->lenparticiones/sizeof(PARTFICH_t)) - 1;
+	while(ini <= fin)
 	{
-		if((partmp->fileid == fileid) && (partmp->particion == particion))
-			return(partmp);
+		med = (ini + fin)/2;
+		res = compaParticion(&clave,&bd->particiones[med]);
+		if(res == 0)
+			return(&bd->particiones[med]);
+		if(res < 0)
+			fin = med - 1;
+		else
+			ini = med + 1;
 	}
 	return NULL;
 }
@@ -231,6 +533,12 @@ int cargaPartidas(BASFICH_t *bd,PARTFICH_t *particion)
 	
 	if(bd->partidas != NULL)
 		free(bd->partidas);
+	// los datos en memoria corresponden a la particion anterior.
+	if(bd->datos != NULL)
+		free(bd->datos);
+	bd->datos = NULL;
+	bd->lendatos = 0;
+	bd->siglote = -1;
 	bd->partidas = malloc(particion->len);
 	lseek(bd->fdpartidas,particion->offset,SEEK_SET);
 	res = read(bd->fdpartidas,bd->partidas,particion->len);
@@ -238,18 +546,151 @@ int cargaPartidas(BASFICH_t *bd,PARTFICH_t *particion)
 	return 1;
 }
 
+// Busqueda dicotomica de la primera partida con (elomed, ganador) >= (elo, gana)
+// en una lista de partidas ordenada por elomed, ganador.
+// retorna el puntero a dicha partida o a fin si no existe ninguna.
+static PARTIDA_t *cotaInferior(PARTIDA_t *ini,PARTIDA_t *fin,int elo,int gana)
+{
+	PARTIDA_t *med;
+	
+	while(ini < fin)
+	{
+		med = ini + (fin - ini)/2;
+		if((med->elomed < elo) || ((med->elomed == elo) && (med->ganador < gana)))
+			ini = med + 1;
+		else
+			fin = med;
+	}
+	return ini;
+}
+
 // busca la primera partida que cumpla con elomin y ganador en las partidas de una particion cargada.
 PARTIDA_t *buscaPartida(BASFICH_t *bd,int elomin,int gana)
 {
-	int i;
+	PARTIDA_t *fin = bd->partidas + (bd->lenpartidas/sizeof(PARTIDA_t));
 	PARTIDA_t *partmp;
 	
-	for(i=0,partmp = bd->partidas;i<(bd->lenpartidas/sizeof(PARTIDA_t));i++,partmp++)
+	partmp = cotaInferior(bd->partidas,fin,elomin,gana);
+	if((partmp < fin) && (partmp->elomed == elomin) && (partmp->ganador == gana))
+		return(partmp);
+	return NULL;
+}
+
+// lee la ultima entrada del manifiesto del fichero indexado.
+int ultimoManifiesto(char *path,MANIFICH_t *man)
+{
+	char nomtmp[1000];
+	char linea[200];
+	FILE *fd;
+	int hay = 0;
+	
+	sprintf(nomtmp,"%s/manifiesto",path);
+	if((fd = fopen(nomtmp,"r")) == NULL)
+		return 0;
+	while(fgets(linea,sizeof(linea),fd) != NULL)
 	{
-		if((partmp->elomed == elomin) && (partmp->ganador == gana))
-			return(partmp);
+		if(sscanf(linea,"%d %d %d %ju %ju %ju",&man->fileid,&man->nparticiones,&man->npartidas,
+					&man->lenparticiones,&man->lenpartidas,&man->lendatos) == 6)
+			hay = 1;
 	}
-	return NULL;
+	fclose(fd);
+	return hay;
+}
+
+// anota en el manifiesto el fileid completado.
+int anotaManifiesto(char *path,BASFICH_t *bd,int fileid,int nparticiones,int npartidas)
+{
+	char nomtmp[1000];
+	char nomman[1000];
+	char linea[200];
+	FILE *fd,*fdtmp;
+	
+	// los datos deben estar en disco antes de anotarlos.
+	vuelcaEscritura(bd);
+	fsync(bd->fddata);
+	fsync(bd->fdpartidas);
+	fsync(bd->fdparticiones);
+	sprintf(nomman,"%s/manifiesto",path);
+	sprintf(nomtmp,"%s/manifiesto.tmp",path);
+	if((fdtmp = fopen(nomtmp,"w")) == NULL)
+		return 0;
+	if((fd = fopen(nomman,"r")) != NULL)	// copiamos las entradas anteriores.
+	{
+		while(fgets(linea,sizeof(linea),fd) != NULL)
+			fputs(linea,fdtmp);
+		fclose(fd);
+	}
+	fprintf(fdtmp,"%d %d %d %ju %ju %ju\n",fileid,nparticiones,npartidas,
+				(uintmax_t)lseek(bd->fdparticiones,0,SEEK_END),(uintmax_t)lseek(bd->fdpartidas,0,SEEK_END),
+				(uintmax_t)lseek(bd->fddata,0,SEEK_END));
+	fflush(fdtmp);
+	fsync(fileno(fdtmp));
+	fclose(fdtmp);
+	return(rename(nomtmp,nomman) == 0);
+}
+
+// recorta los ficheros a las longitudes del manifiesto.
+void recortaBasfich(BASFICH_t *bd,MANIFICH_t *man)
+{
+	int res;
+	
+	bd->lenescdatos = 0;	// lo pendiente de escribir se descarta.
+	bd->npartcur = 0;
+	res = ftruncate(bd->fdparticiones,man->lenparticiones);
+	res = ftruncate(bd->fdpartidas,man->lenpartidas);
+	res = ftruncate(bd->fddata,man->lendatos);
+	bd->finpartidas = man->lenpartidas;
+	bd->findatos = man->lendatos;
+	// quedan posicionados al final para seguir anhadiendo.
+	lseek(bd->fdparticiones,0,SEEK_END);
+	lseek(bd->fdpartidas,0,SEEK_END);
+	lseek(bd->fddata,0,SEEK_END);
+}
+
+// prepara el fichero indexado para anhadir fileids a partir de su manifiesto.
+int preparaManifiesto(char *path,BASFICH_t *bd)
+{
+	MANIFICH_t man;
+	
+	if(ultimoManifiesto(path,&man))
+	{
+		recortaBasfich(bd,&man);
+		return 1;
+	}
+	// sin manifiesto solo se admite un fichero sin particiones, lo grabado en campos.id o
+	// data.bin sin particion que lo indexe son restos y se descartan.
+	if(lseek(bd->fdparticiones,0,SEEK_END) != 0)
+		return -1;
+	memset(&man,0,sizeof(MANIFICH_t));
+	recortaBasfich(bd,&man);
+	return anotaManifiesto(path,bd,MANIFIESTO_INICIO,0,0);
+}
+
+// busca el fileid en las entradas del manifiesto.
+int fileidCargado(char *path,int fileid)
+{
+	MANIFICH_t man;
+	char nomtmp[1000];
+	char linea[200];
+	FILE *fd;
+	int hay = 0;
+	
+	if(fileid == MANIFIESTO_INICIO)
+		return 0;
+	sprintf(nomtmp,"%s/manifiesto",path);
+	if((fd = fopen(nomtmp,"r")) == NULL)
+		return 0;
+	while(fgets(linea,sizeof(linea),fd) != NULL)
+	{
+		if((sscanf(linea,"%d %d %d %ju %ju %ju",&man.fileid,&man.nparticiones,&man.npartidas,
+					&man.lenparticiones,&man.lenpartidas,&man.lendatos) == 6) && (man.fileid == fileid))
+		{
+			hay = 1;
+			break;
+		}
+	}
+	fclose(fd);
+	return hay;
 }
 
 // Funcion que anhade una particion al final del fichero de indices de particiones.
@@ -259,23 +700,155 @@ int anhadeParticion(BASFICH_t *bd,PARTFICH_t *particion)
 	
 	lseek(bd->fdparticiones,0,SEEK_END);
 	res = write(bd->fdparticiones,particion,sizeof(PARTFICH_t));
+	return (res == sizeof(PARTFICH_t));
 }
 
-// funcion que ahade una partida al final del fichero de indices de partidas.
+// funcion que ahade una partida a la particion en curso.
 int anhadePartida(BASFICH_t *bd,PARTIDA_t *partida)
 {
-	int res;
+	PARTIDA_t *partmp;
+	int maxtmp;
 	
-	lseek(bd->fdpartidas,0,SEEK_END);
-	res = write(bd->fdpartidas,partida,sizeof(PARTIDA_t));
+	if(bd->npartcur == bd->maxpartcur)
+	{
+		maxtmp = (bd->maxpartcur == 0) ? 65536 : 2 * bd->maxpartcur;
+		if((partmp = realloc(bd->partcur,(size_t)maxtmp * sizeof(PARTIDA_t))) == NULL)
+			return 0;
+		bd->partcur = partmp;
+		bd->maxpartcur = maxtmp;
+	}
+	bd->partcur[bd->npartcur++] = *partida;
+	bd->finpartidas += sizeof(PARTIDA_t);
+	return 1;
+}
+
+// funcion que anhade datos de partida al final del fichero de datos.
+int anhadeDatos(BASFICH_t *bd,void *datos,int len,uint64_t *offset)
+{
+	*offset = bd->findatos;
+	return anhadeBuffer(bd->fddata,bd->escdatos,&bd->lenescdatos,&bd->findatos,datos,len);
+}
+
+// Funcion que vuelca lo pendiente de escribir a los ficheros. Las partidas de una particion sin
+// cerrar se graban sin ordenar (solo ocurre si la carga no se completa).
+int vuelcaEscritura(BASFICH_t *bd)
+{
+	uint64_t len;
+	int ok;
+	
+	ok = vuelcaDatos(bd);
+	len = (uint64_t)bd->npartcur * sizeof(PARTIDA_t);
+	if(len > 0)
+		ok &= escribeZona(bd->fdpartidas,(uint8_t *)bd->partcur,len,bd->finpartidas - len);
+	bd->npartcur = 0;
+	return ok;
+}
+
+// Funcion que vuelca los buffers de escritura y sincroniza los datos en disco.
+int sincronizaBasfich(BASFICH_t *bd)
+{
+	int ok;
+	
+	ok = vuelcaEscritura(bd);
+	if((fdatasync(bd->fddata) != 0) || (fdatasync(bd->fdpartidas) != 0) || (fdatasync(bd->fdparticiones) != 0))
+		ok = 0;
+	return ok;
+}
+
+// comparacion de offsets para QSORT.
+static int compaOffset(const void *uno,const void *otro)
+{
+	uint64_t a = *(uint64_t *)uno;
+	uint64_t b = *(uint64_t *)otro;
+	
+	return((a > b) - (a < b));
+}
+
+// Funcion que carga en memoria la zona de data.bin de la particion cargada.
+int cargaDatos(BASFICH_t *bd)
+{
+	PARTIDA_t *partida,*fin;
+	CPARTIDA_t cab;
+	uint64_t offmin,offmax;
+	
+	fin = bd->partidas + (bd->lenpartidas / sizeof(PARTIDA_t));
+	if(bd->partidas == fin)
+		return 0;
+	// zona de data.bin ocupada por la particion, desde la primera partida al final de la ultima.
+	offmin = offmax = bd->partidas->offset;
+	for(partida=bd->partidas;partida<fin;partida++)
+	{
+		if(partida->offset < offmin)
+			offmin = partida->offset;
+		if(partida->offset > offmax)
+			offmax = partida->offset;
+	}
+	if(leeZona(bd->fddata,(uint8_t *)&cab,sizeof(CPARTIDA_t),offmax) == 0)
+		return 0;
+	bd->offdatos = offmin;
+	bd->lendatos = offmax - offmin + sizeof(CPARTIDA_t) + lenMovs(cab.formato,cab.nmov);
+	if(bd->lendatos <= MAXDATOSMEM)
+	{
+		if((bd->datos = malloc(bd->lendatos)) != NULL)
+		{
+			posix_fadvise(bd->fddata,bd->offdatos,bd->lendatos,POSIX_FADV_SEQUENTIAL);
+			if(leeZona(bd->fddata,bd->datos,bd->lendatos,bd->offdatos))
+				return 1;
+			free(bd->datos);
+			bd->datos = NULL;
+		}
+	}
+	// no cabe en memoria, lectura por lotes.
+	bd->lendatos = 0;
+	bd->siglote = 0;
+	return 0;
+}
+
+// anticipa al sistema la lectura de las LOTEDATOS partidas siguientes a la indicada. Los offsets
+// se ordenan y se agrupan los contiguos para que el disco los lea en una sola pasada mientras
+// se decodifican las anteriores.
+static void anticipaLote(BASFICH_t *bd,int ind)
+{
+	static uint64_t offsets[LOTEDATOS];
+	uint64_t ini,fin;
+	int i,n,npartidas;
+	
+	npartidas = bd->lenpartidas / sizeof(PARTIDA_t);
+	for(n=0;(n < LOTEDATOS) && ((ind + n) < npartidas);n++)
+		offsets[n] = bd->partidas[ind + n].offset;
+	bd->siglote = ind + n;
+	qsort(offsets,n,sizeof(uint64_t),compaOffset);
+	for(i=0;i<n;)
+	{
+		ini = offsets[i];
+		fin = offsets[i] + LENMAXPARTIDA;
+		for(i++;(i < n) && (offsets[i] <= fin);i++)
+			fin = offsets[i] + LENMAXPARTIDA;
+		posix_fadvise(bd->fddata,ini,fin - ini,POSIX_FADV_WILLNEED);
+	}
 }
 
 // Funcion para leer los datos de una determinada partida (cabpartida y movimientos).
+// Los movimientos se devuelven siempre como MOVBIN_t sea cual sea el formato grabado.
 void loadPartida(BASFICH_t *bd,PARTIDA_t *partida,CPARTIDA_t *cabpartida,MOVBIN_t *movimientos)
 {
-	int res;
+	static MOVBIN_t movtmp[MAXMOV];	// movimientos en el formato grabado.
+	uint8_t *datos;
+	int ind;
 	
-	lseek(bd->fddata,partida->offset,SEEK_SET);
-	res = read(bd->fddata,cabpartida,sizeof(CPARTIDA_t));
-	res = read(bd->fddata,movimientos,cabpartida->nmov * sizeof(MOVBIN_t));
+	// zona de la particion en memoria (cargaDatos).
+	if((bd->datos != NULL) && (partida->offset >= bd->offdatos) && ((partida->offset - bd->offdatos) < bd->lendatos))
+	{
+		datos = bd->datos + (partida->offset - bd->offdatos);
+		memcpy(cabpartida,datos,sizeof(CPARTIDA_t));
+		decodificaMovs(datos + sizeof(CPARTIDA_t),cabpartida->nmov,cabpartida->formato,movimientos);
+		return;
+	}
+	// lectura por lotes.
+	ind = partida - bd->partidas;
+	if((bd->siglote >= 0) && (ind >= bd->siglote) && (ind < (bd->lenpartidas / sizeof(PARTIDA_t))))
+		anticipaLote(bd,ind);
+	leeZona(bd->fddata,(uint8_t *)cabpartida,sizeof(CPARTIDA_t),partida->offset);
+	leeZona(bd->fddata,(uint8_t *)movtmp,lenMovs(cabpartida->formato,cabpartida->nmov),partida->offset + sizeof(CPARTIDA_t));
+	decodificaMovs((uint8_t *)movtmp,cabpartida->nmov,cabpartida->formato,movimientos);
 }
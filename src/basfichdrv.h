@@ -6,12 +6,20 @@
 //
 // La carpeta del fichero indexado contiene tres ficheros: 
 //		-part.id => indices de particiones, contiene fileid (identificador de fichero), particion (trozo del fichero)
-//						offset en campos.id donde comienza las patidas de esta particion y la longitud de los mismos.
-//						Esta ordenado por fileid, particion.
+//						offset en campos.id donde comienza las patidas de esta particion y la longitud de los mismos,
+//						y el rango de elomed de sus partidas.
+//						Se anhade por fileid, particion y se ordena al cargarlo en memoria.
 //		-campos.id => indices de partidas. Campos para ordenar las partidas de una particion, contiene los datos
 //						de ELOMED y ganador asi como el offset de la partida en el fichero de datos y su longitud.
+//						Lleva ademas una copia de los metadatos de la cabecera de la partida.
 //						Esta ordenado por ELOMED, ganador.
-//		-data.bin => contiene los datos de cabecera de partida y movimientos de cada partida. Esta ordenado por orden de entrada.
+//		-data.bin => contiene los datos de cabecera de partida y movimientos de cada partida (en el formato
+//						indicado en la cabecera, MOVBIN_t o compacto). Dentro de cada particion
+//						esta en el mismo orden que campos.id (ELOMED, ganador).
+//		-manifiesto => una linea por cada fileid anhadido completo con la longitud de los tres ficheros
+//						tras anhadirlo. Permite descartar lo grabado por una carga interrumpida y
+//						no volver a anhadir un fileid ya cargado. Se crea antes de anhadir el primer
+//						fileid con una entrada inicial (MANIFIESTO_INICIO) con las longitudes de partida.
 //
 #ifndef BASFICHDRV_H
 #define BASFICHDRV_H
@@ -19,11 +27,19 @@
 #include <stdint.h>
 #include "ajedrez.h"
 
+#define MAXDATOSMEM	(512*1024*1024)	// maximo de data.bin de una particion que se carga en memoria.
+#define LOTEDATOS		4096				// partidas anticipadas por lote si la particion no cabe en memoria.
+#define LENBUFESC		(4*1024*1024)	// buffers de escritura diferida de data.bin y campos.id.
+#define MANIFIESTO_INICIO	-1			// fileid de la entrada inicial del manifiesto.
+
 typedef struct {
 	uint16_t		fileid;		// identificador de fichero (fecha yyyy*12+mm)
-	uint16_t		particion;	// N. particion de max 1000000 de partidas.
+	uint16_t		particion;	// N. particion (ver politica de particion en genbasfich).
 	uint32_t		len;			// Longitud en bytes zona PARTIDASID de esta particion.
 	uint64_t		offset;		// offset en PARTIDASID de esta particion.
+	uint16_t		elomin;		// rango de elomed de las partidas de esta particion.
+	uint16_t		elomax;
+	uint32_t		reser;
 } PARTFICH_t;
 
 typedef struct {
@@ -31,8 +47,20 @@ typedef struct {
 	uint8_t		ganador;		// Ganador partida (0=>inval,1=>blancas,2=>Negras,3=>tablas).
 	uint8_t		flags;		// No usado de momento.
 	uint64_t		offset;		// offset en DATA de la partida.
+	META_t		meta;			// metadatos de la partida (copia de los de su cabecera).
+	int16_t		difelo;		// diferencia de elo blancas - negras.
 } __attribute__((packed)) PARTIDA_t;
 
+// entrada del manifiesto: estado del fichero indexado tras anhadir un fileid.
+typedef struct {
+	int			fileid;
+	int			nparticiones;	// particiones del fileid.
+	int			npartidas;		// partidas del fileid.
+	uint64_t		lenparticiones;	// longitud de part.id.
+	uint64_t		lenpartidas;		// longitud de campos.id.
+	uint64_t		lendatos;			// longitud de data.bin.
+} MANIFICH_t;
+
 typedef struct {
 	int fdparticiones;
 	PARTFICH_t *particiones;
@@ -42,6 +70,19 @@ typedef struct {
 	int fdpartidas;
 	int fddata;
 //	FILE *fddata;
+	uint8_t *datos;		// zona de data.bin de la particion cargada (cargaDatos), NULL si no esta en memoria.
+	uint64_t offdatos;	// offset en data.bin del comienzo de la zona.
+	uint64_t lendatos;	// longitud de la zona.
+	int siglote;			// primera partida sin anticipar en lectura por lotes (-1 => sin lotes).
+	// escritura diferida (apertura para escritura): lo anhadido se acumula en memoria y las
+	// longitudes de los ficheros se llevan en memoria, incluido lo pendiente de volcar.
+	uint8_t *escdatos;		// buffer de escritura de data.bin.
+	int lenescdatos;
+	uint64_t findatos;		// longitud de data.bin.
+	PARTIDA_t *partcur;		// partidas de la particion en curso, se graban en campos.id al cerrarla.
+	int npartcur;
+	int maxpartcur;
+	uint64_t finpartidas;	// longitud de campos.id.
 } BASFICH_t;
 
 // Abre la base de datos para lectura.
@@ -50,21 +91,53 @@ extern int basfichOpenR(char *path,BASFICH_t *bd);
 extern int basfichOpenW(char *path,BASFICH_t *bd);
 // cierra base de datos.
 extern void basfichClose(BASFICH_t *bd);
-// ordena el fichero de particiones por fileid, particion
-extern void ordenaParticiones(BASFICH_t *bd);
-// ordena las partidas de una determinada particion por elomed y ganador.
-extern void ordenaPartidas(BASFICH_t *bd,int fileid,int particion);
+// anhade al fichero indexado abierto para escritura (sin particion en curso) una particion de otro
+// abierto para lectura, copiando sus indices y su zona de data.bin sin reordenar. retorna 0 si falla.
+extern int copiaParticion(BASFICH_t *bd,BASFICH_t *org,PARTFICH_t *particion);
+// cierra la particion en curso: ordena en memoria sus partidas por elomed y ganador, reordena
+// sus datos en data.bin, graba sus indices en campos.id y la anhade a part.id con la longitud
+// de sus indices y su rango de elomed. retorna 0 si falla la escritura.
+extern int cierraParticion(BASFICH_t *bd,PARTFICH_t *particion);
 // busca una particion en el fichero de particiones.
 extern PARTFICH_t *buscaParticion(BASFICH_t *bd,int fileid,int particion);
 // Carga en memoria los indices de partidas de una particion.
 extern int cargaPartidas(BASFICH_t *bd,PARTFICH_t *particion);
+// Carga en memoria con una lectura secuencial la zona de data.bin de la particion cargada
+// (cargaPartidas) si no supera MAXDATOSMEM. Si la supera activa la lectura por lotes, que
+// anticipa al sistema las partidas siguientes en orden de offset. Retorna 1 si la zona
+// queda en memoria.
+extern int cargaDatos(BASFICH_t *bd);
 // busca la primera partida que cumpla elomed, ganador en las partidas cargadas en memoria.
 extern PARTIDA_t *buscaPartida(BASFICH_t *bd,int elomin,int gana);
 // anhade una particion al fichero indices de particiones.
 extern int anhadeParticion(BASFICH_t *bd,PARTFICH_t *particion);
-// anhade una partida al fichero indice de partidas (campos).
+// lee la ultima entrada del manifiesto (la inicial si aun no se ha completado ningun fileid).
+// retorna 0 si no hay manifiesto.
+extern int ultimoManifiesto(char *path,MANIFICH_t *man);
+// sincroniza los ficheros y anhade al manifiesto el fileid completado (con 'rename' del
+// manifiesto reescrito, de forma que una interrupcion deja el manifiesto anterior).
+extern int anotaManifiesto(char *path,BASFICH_t *bd,int fileid,int nparticiones,int npartidas);
+// recorta los ficheros abiertos para escritura a las longitudes de la entrada del manifiesto,
+// descartando lo grabado por una carga posterior interrumpida.
+extern void recortaBasfich(BASFICH_t *bd,MANIFICH_t *man);
+// prepara el fichero indexado abierto para escritura para anhadir fileids: lo recorta a la ultima
+// entrada del manifiesto o, si no tiene manifiesto, lo crea con la entrada inicial antes de grabar
+// nada. retorna 1 si es correcto, 0 si no puede grabar el manifiesto y -1 si el fichero tiene
+// particiones sin manifiesto (no se sabe que fileids estan completos).
+extern int preparaManifiesto(char *path,BASFICH_t *bd);
+// retorna 1 si el fileid esta anotado como completo en el manifiesto.
+extern int fileidCargado(char *path,int fileid);
+// anhade una partida a la particion en curso, se graba en campos.id al cerrarla (cierraParticion).
+// retorna 0 si no hay memoria.
 extern int anhadePartida(BASFICH_t *bd,PARTIDA_t *partida);
-// Lee los datos de una partida (cabpartida, movimientos).
+// anhade datos de partida al final de data.bin a traves del buffer de escritura, en *offset
+// su offset en data.bin. retorna 0 si falla la escritura.
+extern int anhadeDatos(BASFICH_t *bd,void *datos,int len,uint64_t *offset);
+// vuelca a los ficheros lo pendiente de escribir. retorna 0 si falla.
+extern int vuelcaEscritura(BASFICH_t *bd);
+// vuelca los buffers de escritura y sincroniza los datos de los ficheros en disco (fdatasync).
+extern int sincronizaBasfich(BASFICH_t *bd);
+// Lee los datos de una partida (cabpartida, movimientos decodificados a MOVBIN_t).
 extern void loadPartida(BASFICH_t *bd,PARTIDA_t *partida,CPARTIDA_t *cabpartida,MOVBIN_t *movimientos);
 
 #endif // BASFICHDRV_H
@@ -0,0 +1,353 @@
+// modulo : cargabase.c
+// autor  : Antonio Pardo Redondo
+//
+// Modulo de carga de particiones de partidas en las bases configuradas en base.conf.
+// Ver cargabase.h.
+//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "ajedrez.h"
+#include "config.h"
+#include "sqlitedrv.h"
+#include "colpart.h"
+#include "kvdrv.h"
+#include "cargabase.h"
+
+// escritor de una base.
+typedef struct {
+	int				nbase;
+	char				path[1000];		// base SQLITE.
+	char				carpeta[1000];	// carpeta de la base (ficheros columnares).
+	BASEKV_t			*basekv;			// almacen clave-valor.
+	pthread_t		hilo;
+	pthread_mutex_t mutex;
+	pthread_cond_t	cond;
+	PARTMEM_t		*primera;		// cola de particiones pendientes.
+	PARTMEM_t		*ultima;
+	int				npend;
+	int				fin;				// no hay mas particiones.
+} ESCRITOR_t;
+
+static CONF_BAS_t *cnfcarga;		// configuracion de las bases en carga.
+static ESCRITOR_t *esc = NULL;		// escritores de las bases.
+static PARTCARGA_t *cargadas = NULL;	// particiones entregadas a la carga.
+static int ncargadas = 0;
+static int maxcargadas = 0;
+static int errcarga = 0;			// particiones con numero de partidas erroneo.
+
+//-----------------------------------------------------------
+PARTMEM_t *nuevaParticionMem(int fileid,int particion)
+{
+	PARTMEM_t *pm;
+
+	if((pm = calloc(1,sizeof(PARTMEM_t))) == NULL)
+		exit(2);
+	pm->fileid = fileid;
+	pm->particion = particion;
+	return pm;
+}
+
+void anhadePartidaMem(PARTMEM_t *pm,CPARTIDA_t *cab,MOVBIN_t *movs)
+{
+	if(pm->npartidas >= pm->maxpartidas)
+	{
+		pm->maxpartidas = pm->maxpartidas ? pm->maxpartidas * 2 : 4096;
+		pm->cab = realloc(pm->cab,pm->maxpartidas * sizeof(CPARTIDA_t));
+		pm->offmov = realloc(pm->offmov,pm->maxpartidas * sizeof(uint32_t));
+	}
+	if((pm->movs == NULL) || ((pm->nmovs + cab->nmov) > pm->maxmovs))
+	{
+		pm->maxmovs = pm->maxmovs ? pm->maxmovs * 2 : 4096 * 64;
+		if(pm->maxmovs < (pm->nmovs + cab->nmov))
+			pm->maxmovs = pm->nmovs + cab->nmov;
+		pm->movs = realloc(pm->movs,pm->maxmovs * sizeof(MOVBIN_t));
+	}
+	if((pm->cab == NULL) || (pm->offmov == NULL) || (pm->movs == NULL))
+	{
+		fprintf(stderr,"Sin memoria para la particion %d\n",pm->particion);
+		exit(2);
+	}
+	pm->cab[pm->npartidas] = *cab;
+	pm->offmov[pm->npartidas] = pm->nmovs;
+	memcpy(pm->movs + pm->nmovs,movs,cab->nmov * sizeof(MOVBIN_t));
+	pm->nmovs += cab->nmov;
+	pm->npartidas++;
+}
+
+void liberaParticion(PARTMEM_t *pm)
+{
+	free(pm->cab);
+	free(pm->offmov);
+	free(pm->movs);
+	free(pm);
+}
+
+//-----------------------------------------------------------
+int finCargaMasiva(sqlite3 *db,int nb,CONF_BAS_t *cnf,PARTCARGA_t *cargadas,int ncargadas)
+{
+	sqlite3_stmt *stmt1;
+	int ind,cuenta,errores = 0;
+	const char *query;
+
+	if(creaIndices(db) == 0)
+		errores++;
+	sqlite3_exec(db,"ANALYZE",NULL,NULL,NULL);
+	if(cnf->partbloque > 0)
+		query = "SELECT total(npartidas) FROM bloques WHERE fileid = ? and particion = ?";
+	else if(versionSqlite(db) >= ESQUEMAV2)
+		query = "SELECT count(*) FROM cabpartidas WHERE fileid = ? and particion = ?";
+	else
+		query = "SELECT count(*) FROM partidas WHERE fileid = ? and particion = ?";
+	if(sqlite3_prepare(db, query, -1, &stmt1, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
+		exit(2);
+	}
+	for(ind=0;ind<ncargadas;ind++)
+	{
+		if((cargadas[ind].particion % cnf->numbases) != nb)
+			continue;
+		sqlite3_bind_int(stmt1, 1, cargadas[ind].fileid);
+		sqlite3_bind_int(stmt1, 2, cargadas[ind].particion);
+		cuenta = -1;
+		if(sqlite3_step(stmt1) == SQLITE_ROW)
+			cuenta = sqlite3_column_int(stmt1, 0);
+		sqlite3_reset(stmt1);
+		if(cuenta != cargadas[ind].esperadas)
+		{
+			fprintf(stderr,"Base %d particion %d-%d: %d partidas grabadas de %d\n",nb,
+						cargadas[ind].fileid,cargadas[ind].particion,cuenta,cargadas[ind].esperadas);
+			errores++;
+		}
+	}
+	sqlite3_finalize(stmt1);
+	return errores;
+}
+
+// compara dos partidas de una particion en memoria por la clave (elomed, ganador, partidaid).
+static int compaClave(const void *a,const void *b,void *arg)
+{
+	CPARTIDA_t *ca = &((CPARTIDA_t *)arg)[*(int *)a];
+	CPARTIDA_t *cb = &((CPARTIDA_t *)arg)[*(int *)b];
+	int ga = ca->flags.ganablanca + ca->flags.gananegra * 2;
+	int gb = cb->flags.ganablanca + cb->flags.gananegra * 2;
+
+	if(ca->elomed != cb->elomed)
+		return(ca->elomed - cb->elomed);
+	if(ga != gb)
+		return(ga - gb);
+	return((ca->ind > cb->ind) - (ca->ind < cb->ind));
+}
+
+//-----------------------------------------------------------
+// Funcion que obtiene la siguiente particion de la cola del escritor.
+// retorna NULL si no hay mas particiones.
+static PARTMEM_t *desencolaParticion(ESCRITOR_t *esc)
+{
+	PARTMEM_t *pm;
+
+	pthread_mutex_lock(&esc->mutex);
+	while((esc->primera == NULL) && (esc->fin == 0))
+		pthread_cond_wait(&esc->cond,&esc->mutex);
+	if((pm = esc->primera) != NULL)
+	{
+		esc->primera = pm->sig;
+		if(esc->primera == NULL)
+			esc->ultima = NULL;
+		esc->npend--;
+		pthread_cond_broadcast(&esc->cond);
+	}
+	pthread_mutex_unlock(&esc->mutex);
+	return pm;
+}
+
+// Hilo escritor de una base. Graba las particiones que recibe en el almacen configurado,
+// en SQLITE con una sola conexion y transacciones de hasta LOTEPARTIDAS partidas.
+static void *escritor(void *arg)
+{
+	ESCRITOR_t *esc = (ESCRITOR_t *)arg;
+	PARTMEM_t *pm;
+	COLESC_t colesc;
+	sqlite3 *db = NULL;
+	sqlite3_stmt *stmt;
+	char nomcol[1100];
+	int i,j,nlote = 0;
+	int *orden = NULL;
+
+	while((pm = desencolaParticion(esc)) != NULL)
+	{
+		if(cnfcarga->columnar)
+		{
+			sprintf(nomcol,"%s/%d_%d.col",esc->carpeta,pm->fileid,pm->particion);
+			if(iniColumnar(&colesc,nomcol,pm->npartidas,cnfcarga->formatomov,pm->fileid,pm->particion) == 0)
+				exit(1);
+			for(i=0;i<pm->npartidas;i++)
+				anhadeColumnar(&colesc,&pm->cab[i],pm->movs + pm->offmov[i]);
+			cierraColumnar(&colesc);
+		}
+		else if(cnfcarga->almacen == ALMACEN_KV)
+		{
+			for(i=0;i<pm->npartidas;i++)
+				vuelcaPartKv(esc->basekv,&pm->cab[i],pm->movs + pm->offmov[i],pm->fileid,pm->particion);
+		}
+		else
+		{
+			if(db == NULL)
+			{
+				conectaSqlite(&db,esc->path);
+				if(cnfcarga->cargamasiva)
+					modoCargaMasiva(db);
+			}
+			// en carga masiva las partidas se insertan en el orden de la clave.
+			if((orden = realloc(orden,(pm->npartidas + 1) * sizeof(int))) == NULL)
+				exit(2);
+			for(i=0;i<pm->npartidas;i++)
+				orden[i] = i;
+			if((cnfcarga->cargamasiva) || (pm->ordenada == 0))
+				qsort_r(orden,pm->npartidas,sizeof(int),compaClave,pm->cab);
+			for(j=0;j<pm->npartidas;j++)
+			{
+				i = orden[j];
+				if(nlote == 0)
+					beginTransW(db,&stmt);
+				vuelcaPart(db,stmt,&pm->cab[i],pm->movs + pm->offmov[i],pm->fileid,pm->particion,cnfcarga->formatomov);
+				if(++nlote >= LOTEPARTIDAS)
+				{
+					endTransW(db,stmt);
+					nlote = 0;
+				}
+			}
+		}
+		liberaParticion(pm);
+	}
+	if(nlote)
+		endTransW(db,stmt);
+	free(orden);
+	if((db == NULL) && (cnfcarga->cargamasiva) && (cnfcarga->almacen == ALMACEN_SQLITE) && (cnfcarga->columnar == 0))
+	{
+		conectaSqlite(&db,esc->path);	// base sin particiones.
+		modoCargaMasiva(db);
+	}
+	if((db != NULL) && (cnfcarga->cargamasiva))
+		__sync_add_and_fetch(&errcarga,finCargaMasiva(db,esc->nbase,cnfcarga,cargadas,ncargadas));
+	if(db != NULL)
+		desconectaSqlite(db);
+	if(esc->basekv != NULL)
+		endTransKv(esc->basekv);
+	return NULL;
+}
+
+//-----------------------------------------------------------
+void iniCarga(CONF_BAS_t *cnf,char *carpetabases)
+{
+	int nb,len,kv;
+
+	cnfcarga = cnf;
+	if((esc = calloc(cnf->numbases,sizeof(ESCRITOR_t))) == NULL)
+		exit(2);
+	for(nb=0;nb<cnf->numbases;nb++)
+	{
+		esc[nb].nbase = nb;
+		kv = (cnf->almacen == ALMACEN_KV) && (cnf->columnar == 0);
+		// un path recortado llevaria la carga a otra base.
+		len = snprintf(esc[nb].carpeta,sizeof(esc[nb].carpeta),"%s/base_%01d",carpetabases,nb);
+		if(len < (int)sizeof(esc[nb].carpeta))
+			len = snprintf(esc[nb].path,sizeof(esc[nb].path),"%s/%s%s",esc[nb].carpeta,cnf->nombase,kv ? ".kv" : "");
+		if(len >= (int)sizeof(esc[nb].path))
+		{
+			fprintf(stderr,"Path de la base %d demasiado largo en %s\n",nb,carpetabases);
+			exit(1);
+		}
+		if(kv)
+		{
+			esc[nb].basekv = conectaKv(esc[nb].path);
+			beginTransKv(esc[nb].basekv,cnf->formatomov);
+		}
+		pthread_mutex_init(&esc[nb].mutex,NULL);
+		pthread_cond_init(&esc[nb].cond,NULL);
+		if(pthread_create(&esc[nb].hilo,NULL,escritor,&esc[nb]) != 0)
+		{
+			perror("pthread_create");
+			exit(2);
+		}
+	}
+}
+
+void cargaParticion(PARTMEM_t *pm)
+{
+	ESCRITOR_t *e = &esc[pm->particion % cnfcarga->numbases];
+	int i;
+
+	// anotamos la particion para la tabla master y la comprobacion de la carga masiva.
+	if(ncargadas >= maxcargadas)
+	{
+		maxcargadas = maxcargadas ? maxcargadas * 2 : 256;
+		if((cargadas = realloc(cargadas,maxcargadas * sizeof(PARTCARGA_t))) == NULL)
+			exit(2);
+	}
+	cargadas[ncargadas].fileid = pm->fileid;
+	cargadas[ncargadas].particion = pm->particion;
+	cargadas[ncargadas].esperadas = 0;
+	cargadas[ncargadas].elomin = 0xffff;
+	cargadas[ncargadas].elomax = 0;
+	for(i=0;i<pm->npartidas;i++)
+	{
+		if(pm->cab[i].nmov > 0)
+		{
+			cargadas[ncargadas].esperadas++;
+			if(pm->cab[i].elomed < cargadas[ncargadas].elomin)
+				cargadas[ncargadas].elomin = pm->cab[i].elomed;
+			if(pm->cab[i].elomed > cargadas[ncargadas].elomax)
+				cargadas[ncargadas].elomax = pm->cab[i].elomed;
+		}
+	}
+	ncargadas++;
+
+	pthread_mutex_lock(&e->mutex);
+	while(e->npend >= MAXPENDIENTES)
+		pthread_cond_wait(&e->cond,&e->mutex);
+	pm->sig = NULL;
+	if(e->ultima)
+		e->ultima->sig = pm;
+	else
+		e->primera = pm;
+	e->ultima = pm;
+	e->npend++;
+	pthread_cond_broadcast(&e->cond);
+	pthread_mutex_unlock(&e->mutex);
+}
+
+int finCarga(void)
+{
+	sqlite3 *dbsq3;
+	int nb,i;
+
+	for(nb=0;nb<cnfcarga->numbases;nb++)
+	{
+		pthread_mutex_lock(&esc[nb].mutex);
+		esc[nb].fin = 1;
+		pthread_cond_broadcast(&esc[nb].cond);
+		pthread_mutex_unlock(&esc[nb].mutex);
+	}
+	for(nb=0;nb<cnfcarga->numbases;nb++)
+		pthread_join(esc[nb].hilo,NULL);
+	cierraAlmacenes();
+	// tabla de particiones master en una sola transaccion.
+	conectaSqlite(&dbsq3,cnfcarga->basmaster);
+	sqlite3_exec(dbsq3,"BEGIN TRANSACTION",NULL,NULL,NULL);
+	for(i=0;i<ncargadas;i++)
+		insertaParticion(dbsq3,cargadas[i].fileid,cargadas[i].particion,cargadas[i].particion % cnfcarga->numbases,
+								cargadas[i].elomin,cargadas[i].elomax);
+	sqlite3_exec(dbsq3,"END TRANSACTION",NULL,NULL,NULL);
+	desconectaSqlite(dbsq3);
+	free(esc);
+	free(cargadas);
+	esc = NULL;
+	cargadas = NULL;
+	ncargadas = maxcargadas = 0;
+	return errcarga;
+}
@@ -0,0 +1,77 @@
+// modulo : cargabase.h
+// autor  : Antonio Pardo Redondo
+//
+// Modulo de carga de particiones de partidas en las bases configuradas en base.conf.
+// Lo utilizan fich2sqlite (particiones leidas del fichero indexado) y genbasfich en
+// modo directo (particiones formadas en memoria al interpretar el PGN).
+//
+// Las particiones se forman en memoria (PARTMEM_t) y se pasan a un hilo escritor por
+// base (una base por disco), que las graba en el almacen configurado (SQLITE, ficheros
+// columnares o almacen clave-valor) con transacciones de hasta LOTEPARTIDAS partidas
+// sobre una conexion propia. Al finalizar la carga las particiones se anotan en la
+// tabla de particiones master en una sola transaccion.
+//
+// Las particiones que no vienen ya ordenadas, y todas en carga masiva, se insertan en el
+// orden de la clave (elomed, ganador, partidaid).
+//
+#ifndef CARGABASE_H
+#define CARGABASE_H
+
+#include <stdint.h>
+#include <sqlite3.h>
+#include "ajedrez.h"
+#include "config.h"
+
+#define LOTEPARTIDAS		200000	// partidas por transaccion de los escritores.
+#define MAXPENDIENTES	2			// particiones en memoria en espera por escritor.
+
+// particion cargada en memoria pendiente de grabar.
+typedef struct PARTMEM {
+	int			fileid;
+	int			particion;
+	int			npartidas;
+	int			ordenada;		// partidas ya en el orden de la clave.
+	CPARTIDA_t	*cab;				// cabeceras de las partidas en el orden de la particion.
+	uint32_t		*offmov;			// indice en movs de los movimientos de cada partida.
+	MOVBIN_t		*movs;			// movimientos de todas las partidas.
+	int			maxpartidas;	// capacidad de cab y offmov.
+	int			nmovs;			// movimientos en movs.
+	int			maxmovs;			// capacidad de movs.
+	struct PARTMEM *sig;
+} PARTMEM_t;
+
+// particion entregada a la carga.
+typedef struct {
+	int			fileid;
+	int			particion;
+	int			esperadas;		// partidas con movimientos (comprobacion de la carga masiva).
+	int			elomin;			// rango de elomed de las partidas con movimientos.
+	int			elomax;
+} PARTCARGA_t;
+
+// Funcion que crea una particion vacia en memoria.
+extern PARTMEM_t *nuevaParticionMem(int fileid,int particion);
+
+// Funcion que anhade una partida a una particion en memoria.
+extern void anhadePartidaMem(PARTMEM_t *pm,CPARTIDA_t *cab,MOVBIN_t *movs);
+
+// Funcion que libera una particion en memoria.
+extern void liberaParticion(PARTMEM_t *pm);
+
+// Funcion que finaliza la carga masiva de la base indicada: forma los indices, actualiza
+// las estadisticas del planificador y comprueba el numero de partidas de las particiones
+// de la lista que le corresponden. Retorna el numero de errores.
+extern int finCargaMasiva(sqlite3 *db,int nb,CONF_BAS_t *cnf,PARTCARGA_t *cargadas,int ncargadas);
+
+// Funcion que arranca un hilo escritor por base para las bases de la carpeta indicada.
+extern void iniCarga(CONF_BAS_t *cnf,char *carpetabases);
+
+// Funcion que pasa una particion al escritor de su base, esperando si este tiene ya
+// MAXPENDIENTES particiones en espera. El escritor libera la particion al grabarla.
+extern void cargaParticion(PARTMEM_t *pm);
+
+// Funcion que espera a que los escritores terminen y anota las particiones cargadas en
+// la tabla de particiones master. Retorna el numero de errores de la carga masiva.
+extern int finCarga(void);
+
+#endif // CARGABASE_H
@@ -0,0 +1,550 @@
+// modulo : cargameses.c
+// autor  : Antonio Pardo Redondo
+//
+// Utilidad para anhadir a un fichero indexado un conjunto de ficheros PGN mensuales indicados
+// en un fichero de lista (una linea por fichero PGN, opcionalmente seguido de su fileid).
+//
+// El fileid de cada fichero se obtiene de su nombre: la ultima fecha 'yyyy-mm' que contiene
+// (p.e. lichess_db_standard_rated_2023-01.pgn.zst => 2023*12+1 = 24277).
+//
+// Los meses son independientes, cada uno se interpreta con genbasfich en su propio fichero
+// indexado en una carpeta temporal (<carpetatmp>/<fileid>), ejecutando varios genbasfich a la
+// vez. El paralelismo se limita por CPU ('-jN', genbasfich simultaneos, por defecto el numero
+// de CPUs) y por disco ('-dN', genbasfich simultaneos escribiendo en cada carpeta temporal,
+// por defecto 2). Conviene indicar una carpeta temporal por disco. Las CPUs que sobran se
+// reparten entre los genbasfich como hilos de interpretacion ('-hN').
+// Los ficheros .zst, .bz2, .gz y .xz se descomprimen con su utilidad en una PIPE. El mes solo
+// se da por interpretado si genbasfich y el descompresor terminan bien, si no se borra su carpeta
+// temporal y se marca como erroneo para volver a interpretarlo en la siguiente carga.
+//
+// Al terminar los meses, sus ficheros indexados se mezclan en el fichero indexado destino con
+// una mezcla de k vias de sus indices de particiones por fileid, particion: cada particion se
+// copia con sus indices y su zona de data.bin ya ordenados (copiaParticion), sin reinterpretar
+// ni reordenar. Cada fileid completo se anota en el manifiesto del destino y su carpeta
+// temporal se borra, de forma que repetir una carga interrumpida solo rehace lo que falta: los meses
+// completos en alguna carpeta temporal se mezclan y los incompletos se borran de todas antes de
+// volver a interpretarlos.
+//
+// ejemplo:
+//		ls /datos/lichess/*.pgn.zst > meses.txt
+//		./cargameses -j8 -d2 meses.txt base_fich /disco1/tmp /disco2/tmp
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "ajedrez.h"
+#include "basfichdrv.h"
+
+#define MAXCARPETAS	64		// carpetas temporales.
+
+// estados de un mes.
+#define MES_PENDIENTE	0
+#define MES_ENCURSO		1
+#define MES_HECHO			2		// fichero indexado temporal completo.
+#define MES_ERROR			3
+#define MES_CARGADO		4		// ya esta en el fichero indexado destino.
+
+typedef struct {
+	char		*fich;			// fichero PGN.
+	int		fileid;
+	int		estado;
+	pid_t		pid;				// genbasfich en curso.
+	pid_t		piddesc;			// su descompresor (0 si no hay).
+	int		pendientes;		// procesos del mes sin terminar.
+	int		fallo;			// algun proceso del mes termino con error.
+	int		carpeta;			// carpeta temporal.
+	char		dir[1000];		// fichero indexado temporal.
+} MES_t;
+
+MES_t		*meses;
+int		nmeses = 0;
+char		*carpetas[MAXCARPETAS];
+int		ncarpetas;
+int		encarpeta[MAXCARPETAS];	// genbasfich en curso en cada carpeta.
+char		genbasfich[1000];			// path de genbasfich.
+
+// Funcion que obtiene el fileid de la ultima fecha 'yyyy-mm' del nombre del fichero.
+// retorna -1 si no la contiene.
+int fileidNombre(char *fich)
+{
+	char *nom;
+	char *p;
+	int fileid = -1;
+
+	nom = ((p = strrchr(fich,'/')) != NULL) ? p + 1 : fich;
+	for(p=nom;*p;p++)
+	{
+		if(isdigit(p[0]) && isdigit(p[1]) && isdigit(p[2]) && isdigit(p[3]) && (p[4] == '-') &&
+			isdigit(p[5]) && isdigit(p[6]) && !isdigit(p[7]))
+		{
+			if((((p[5] - '0') * 10 + p[6] - '0') >= 1) && (((p[5] - '0') * 10 + p[6] - '0') <= 12))
+				fileid = atoi(p) * 12 + (p[5] - '0') * 10 + p[6] - '0';
+		}
+	}
+	return fileid;
+}
+
+// Funcion que lee la lista de ficheros mensuales.
+void leeLista(char *lista)
+{
+	FILE *fd;
+	char linea[2000];
+	char fich[2000];
+	int maxmeses = 0;
+	int fileid;
+	int n,i;
+
+	if((fd = fopen(lista,"r")) == NULL)
+	{
+		perror("Falla open lista");
+		exit(1);
+	}
+	while(fgets(linea,sizeof(linea),fd) != NULL)
+	{
+		if((n = sscanf(linea,"%1999s %d",fich,&fileid)) < 1)
+			continue;		// linea vacia.
+		if(fich[0] == '#')
+			continue;		// comentario.
+		if((n == 1) && ((fileid = fileidNombre(fich)) < 0))
+		{
+			fprintf(stderr,"No se puede obtener el fileid de %s\n",fich);
+			exit(1);
+		}
+		for(i=0;i<nmeses;i++)
+		{
+			if(meses[i].fileid == fileid)
+				break;
+		}
+		if(i < nmeses)
+		{
+			fprintf(stderr,"Fileid %d repetido en la lista, se ignora %s\n",fileid,fich);
+			continue;
+		}
+		if(nmeses == maxmeses)
+		{
+			maxmeses = (maxmeses == 0) ? 64 : 2 * maxmeses;
+			if((meses = realloc(meses,maxmeses * sizeof(MES_t))) == NULL)
+				exit(2);
+		}
+		memset(&meses[nmeses],0,sizeof(MES_t));
+		meses[nmeses].fich = strdup(fich);
+		meses[nmeses].fileid = fileid;
+		meses[nmeses].estado = MES_PENDIENTE;
+		nmeses++;
+	}
+	fclose(fd);
+}
+
+// Funcion que retorna el descompresor del fichero segun su extension, NULL si no esta comprimido.
+char *descompresor(char *fich)
+{
+	char *ext;
+
+	if((ext = strrchr(fich,'.')) == NULL)
+		return NULL;
+	if(strcmp(ext,".zst") == 0)
+		return "zstd";
+	if(strcmp(ext,".bz2") == 0)
+		return "bzip2";
+	if(strcmp(ext,".gz") == 0)
+		return "gzip";
+	if(strcmp(ext,".xz") == 0)
+		return "xz";
+	return NULL;
+}
+
+// Funcion que lanza genbasfich para un mes con la entrada en una PIPE desde su descompresor.
+// Ambos son hijos de cargameses, que espera a los dos y comprueba su estado de terminacion.
+// retorna el pid de genbasfich, el del descompresor queda en mes->piddesc (0 si no hay).
+pid_t lanzaMes(MES_t *mes,int hilos)
+{
+	char arghilos[20];
+	char argfileid[20];
+	char *desc;
+	int tubo[2];
+	int fd;
+	pid_t pid;
+
+	sprintf(arghilos,"-h%d",hilos);
+	sprintf(argfileid,"%d",mes->fileid);
+	mes->piddesc = 0;
+	mes->pendientes = 1;
+	mes->fallo = 0;
+	if((desc = descompresor(mes->fich)) != NULL)
+	{
+		if(pipe(tubo) < 0)
+			return -1;
+		if((mes->piddesc = fork()) < 0)
+			return -1;
+		if(mes->piddesc == 0)
+		{
+			dup2(tubo[1],1);
+			close(tubo[0]);
+			close(tubo[1]);
+			execlp(desc,desc,"-dc",mes->fich,(char *)NULL);
+			perror(desc);
+			_exit(1);
+		}
+		mes->pendientes++;
+	}
+	if((pid = fork()) != 0)
+	{
+		// el padre no se queda con la PIPE, si no genbasfich nunca veria su final.
+		if(desc != NULL)
+		{
+			close(tubo[0]);
+			close(tubo[1]);
+		}
+		return pid;
+	}
+	// proceso hijo: entrada estandar desde el fichero o desde su descompresor.
+	if(desc == NULL)
+	{
+		if((fd = open(mes->fich,O_RDONLY)) < 0)
+		{
+			perror(mes->fich);
+			_exit(1);
+		}
+		dup2(fd,0);
+		close(fd);
+	}
+	else
+	{
+		dup2(tubo[0],0);
+		close(tubo[0]);
+		close(tubo[1]);
+	}
+	// la salida de genbasfich (resumen del mes) se descarta, los errores se mantienen.
+	if((fd = open("/dev/null",O_WRONLY)) >= 0)
+	{
+		dup2(fd,1);
+		close(fd);
+	}
+	execl(genbasfich,genbasfich,arghilos,mes->dir,argfileid,(char *)NULL);
+	perror(genbasfich);
+	_exit(1);
+}
+
+// Funcion que borra el fichero indexado temporal de un mes.
+void borraMes(MES_t *mes)
+{
+	char nomtmp[1100];
+	char *comp[] = {"part.id","campos.id","data.bin","manifiesto","manifiesto.tmp"};
+	int i;
+
+	for(i=0;i<(int)(sizeof(comp)/sizeof(comp[0]));i++)
+	{
+		sprintf(nomtmp,"%s/%s",mes->dir,comp[i]);
+		unlink(nomtmp);
+	}
+	rmdir(mes->dir);
+}
+
+// Funcion que retorna 1 si el fichero indexado temporal del mes esta completo.
+int mesCompleto(MES_t *mes)
+{
+	MANIFICH_t man;
+
+	return ultimoManifiesto(mes->dir,&man) && (man.fileid == mes->fileid);
+}
+
+// Funcion que interpreta los meses pendientes con un maximo de 'maxgen' genbasfich simultaneos
+// y 'maxdisco' por carpeta temporal. Retorna el numero de meses con error.
+int interpretaMeses(int maxgen,int maxdisco,int hilos)
+{
+	MES_t *mes;
+	int encurso = 0;
+	int errores = 0;
+	int sig = 0;
+	int st;
+	int c,i;
+	pid_t pid;
+
+	while((sig < nmeses) || (encurso > 0))
+	{
+		// lanza meses mientras haya CPU y una carpeta temporal con disco libre.
+		while((sig < nmeses) && (encurso < maxgen))
+		{
+			mes = &meses[sig];
+			if(mes->estado != MES_PENDIENTE)
+			{
+				sig++;
+				continue;
+			}
+			// completado por una carga anterior interrumpida en alguna carpeta temporal.
+			for(i=0;i<ncarpetas;i++)
+			{
+				sprintf(mes->dir,"%s/%d",carpetas[i],mes->fileid);
+				if(mesCompleto(mes))
+					break;
+			}
+			if(i < ncarpetas)
+			{
+				mes->estado = MES_HECHO;
+				sig++;
+				continue;
+			}
+			// los restos incompletos de una carga anterior se borran en todas las carpetas, el mes
+			// puede relanzarse en otra y no deben quedar dos ficheros indexados del mismo fileid.
+			for(i=0;i<ncarpetas;i++)
+			{
+				sprintf(mes->dir,"%s/%d",carpetas[i],mes->fileid);
+				borraMes(mes);
+			}
+			for(i=0,c=0;i<ncarpetas;i++)
+			{
+				if(encarpeta[i] < encarpeta[c])
+					c = i;
+			}
+			if(encarpeta[c] >= maxdisco)
+				break;
+			mes->carpeta = c;
+			sprintf(mes->dir,"%s/%d",carpetas[c],mes->fileid);
+			if((mkdir(mes->dir,0777) < 0) && (errno != EEXIST))
+			{
+				perror(mes->dir);
+				mes->estado = MES_ERROR;
+				errores++;
+				sig++;
+				continue;
+			}
+			sig++;
+			if((mes->pid = lanzaMes(mes,hilos)) < 0)
+			{
+				perror("fork");
+				exit(2);
+			}
+			mes->estado = MES_ENCURSO;
+			encarpeta[c]++;
+			encurso++;
+			printf("Interpretando %s fileid %d en %s\n",mes->fich,mes->fileid,mes->dir);
+			fflush(stdout);
+		}
+		if(encurso == 0)
+			continue;
+		// espera la terminacion de un genbasfich o de un descompresor.
+		if((pid = wait(&st)) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		for(i=0;i<nmeses;i++)
+		{
+			if((meses[i].estado == MES_ENCURSO) && ((meses[i].pid == pid) || (meses[i].piddesc == pid)))
+				break;
+		}
+		if(i == nmeses)
+			continue;
+		mes = &meses[i];
+		if(!WIFEXITED(st) || (WEXITSTATUS(st) != 0))
+		{
+			fprintf(stderr,"%s de %s termino con error\n",(pid == mes->pid) ? genbasfich : descompresor(mes->fich),mes->fich);
+			mes->fallo = 1;
+		}
+		if(--mes->pendientes > 0)
+			continue;		// falta el otro proceso del mes.
+		encarpeta[mes->carpeta]--;
+		encurso--;
+		// genbasfich solo anota el fileid en el manifiesto si lo completa, pero con una entrada
+		// truncada por el descompresor lo completa igual: el mes se borra para volver a interpretarlo.
+		if(!mes->fallo && mesCompleto(mes))
+			mes->estado = MES_HECHO;
+		else
+		{
+			fprintf(stderr,"Fallo la interpretacion de %s\n",mes->fich);
+			borraMes(mes);
+			mes->estado = MES_ERROR;
+			errores++;
+		}
+	}
+	return errores;
+}
+
+// Funcion que mezcla los ficheros indexados temporales de los meses interpretados en el fichero
+// indexado destino. Mezcla de k vias de sus particiones por fileid, particion. Cada fileid completo
+// se anota en el manifiesto del destino. Retorna el numero de meses con error.
+int mezclaMeses(char *path,BASFICH_t *bd)
+{
+	BASFICH_t *org;
+	int *ind;
+	int *nparts;
+	int *mesorg;
+	MANIFICH_t *manorg;
+	int k = 0;
+	int errores = 0;
+	PARTFICH_t *part,*menor;
+	int fileid = -1;
+	int nparticiones = 0;
+	int npartidas = 0;
+	int i,m;
+
+	if(((org = calloc(nmeses,sizeof(BASFICH_t))) == NULL) || ((ind = calloc(nmeses,sizeof(int))) == NULL) ||
+		((nparts = calloc(nmeses,sizeof(int))) == NULL) || ((mesorg = calloc(nmeses,sizeof(int))) == NULL) ||
+		((manorg = calloc(nmeses,sizeof(MANIFICH_t))) == NULL))
+		exit(2);
+	for(i=0;i<nmeses;i++)
+	{
+		if(meses[i].estado != MES_HECHO)
+			continue;
+		if(basfichOpenR(meses[i].dir,&org[k]) == 0)
+		{
+			fprintf(stderr,"No puedo abrir %s\n",meses[i].dir);
+			meses[i].estado = MES_ERROR;
+			errores++;
+			continue;
+		}
+		nparts[k] = org[k].lenparticiones / sizeof(PARTFICH_t);
+		mesorg[k] = i;
+		ultimoManifiesto(meses[i].dir,&manorg[k]);	// partidas leidas del mes.
+		k++;
+	}
+	for(;;)
+	{
+		// siguiente particion en orden de fileid, particion entre las cabezas de los k ficheros.
+		for(i=0,m=-1,menor=NULL;i<k;i++)
+		{
+			if(ind[i] >= nparts[i])
+				continue;
+			part = &org[i].particiones[ind[i]];
+			if((menor == NULL) || (part->fileid < menor->fileid) ||
+				((part->fileid == menor->fileid) && (part->particion < menor->particion)))
+			{
+				menor = part;
+				m = i;
+			}
+		}
+		if((menor == NULL) || (menor->fileid != fileid))
+		{
+			// fileid completo.
+			if(fileid >= 0)
+			{
+				// las partidas del fileid son las leidas por genbasfich, no solo las grabadas.
+				for(i=0;i<k;i++)
+				{
+					if(manorg[i].fileid == fileid)
+						npartidas = manorg[i].npartidas;
+				}
+				anotaManifiesto(path,bd,fileid,nparticiones,npartidas);
+				printf("Fileid %d => particiones %d partidas %d\n",fileid,nparticiones,npartidas);
+			}
+			if(menor == NULL)
+				break;
+			fileid = menor->fileid;
+			nparticiones = 0;
+			npartidas = 0;
+		}
+		if(copiaParticion(bd,&org[m],menor) == 0)
+		{
+			fprintf(stderr,"Fallo la copia de la particion %d del fileid %d\n",menor->particion,menor->fileid);
+			exit(4);
+		}
+		nparticiones++;
+		npartidas += menor->len / sizeof(PARTIDA_t);
+		ind[m]++;
+	}
+	// los meses anotados en el manifiesto del destino ya no hacen falta.
+	for(i=0;i<k;i++)
+	{
+		basfichClose(&org[i]);
+		meses[mesorg[i]].estado = MES_CARGADO;
+		borraMes(&meses[mesorg[i]]);
+	}
+	free(org);
+	free(ind);
+	free(nparts);
+	free(mesorg);
+	free(manorg);
+	return errores;
+}
+
+void main(int argc, char *argv[])
+{
+	BASFICH_t bd;
+	char *p;
+	int ncpu;
+	int maxgen;
+	int maxdisco = 2;
+	int hilos;
+	int errores;
+	int res;
+	int i;
+
+	// opciones delante de los argumentos: '-jN' genbasfich simultaneos, '-dN' por carpeta temporal.
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if(ncpu < 1)
+		ncpu = 1;
+	maxgen = ncpu;
+	while((argc > 1) && (argv[1][0] == '-') && (argv[1][1] != 0))
+	{
+		if(argv[1][1] == 'j')
+			maxgen = atoi(argv[1] + 2);
+		else if(argv[1][1] == 'd')
+			maxdisco = atoi(argv[1] + 2);
+		else
+			break;
+		argv[1] = argv[0];
+		argv++;
+		argc--;
+	}
+	if((argc < 4) || (argc - 3 > MAXCARPETAS) || (maxgen < 1) || (maxdisco < 1))
+	{
+		fprintf(stderr,"Usage: %s [-jN] [-dN] <lista ficheros pgn> <fichbas> <carpetatmp> [carpetatmp ...]\n",argv[0]);
+		exit(1);
+	}
+	ncarpetas = argc - 3;
+	for(i=0;i<ncarpetas;i++)
+		carpetas[i] = argv[3 + i];
+	// genbasfich se busca junto a este programa.
+	if((p = strrchr(argv[0],'/')) != NULL)
+		sprintf(genbasfich,"%.*s/genbasfich",(int)(p - argv[0]),argv[0]);
+	else
+		strcpy(genbasfich,"genbasfich");
+	leeLista(argv[1]);
+
+	// apertura del fichero indexado destino, descartando lo grabado por una mezcla interrumpida.
+	if(basfichOpenW(argv[2],&bd) == 0)
+	{
+		perror("Falla open fichbase");
+		exit(2);
+	}
+	if((res = preparaManifiesto(argv[2],&bd)) <= 0)
+	{
+		if(res < 0)
+			fprintf(stderr,"El fichero indexado %s tiene particiones sin manifiesto\n",argv[2]);
+		else
+			perror("Falla manifiesto fichbase");
+		exit(2);
+	}
+	// los meses ya anhadidos no se vuelven a interpretar.
+	for(i=0;i<nmeses;i++)
+	{
+		if(fileidCargado(argv[2],meses[i].fileid))
+		{
+			printf("El fileid %d (%s) ya esta en el fichero indexado\n",meses[i].fileid,meses[i].fich);
+			meses[i].estado = MES_CARGADO;
+		}
+	}
+
+	// las CPUs que no ocupan los genbasfich simultaneos se reparten como hilos de interpretacion.
+	if(maxgen > ncarpetas * maxdisco)
+		maxgen = ncarpetas * maxdisco;
+	hilos = (ncpu > maxgen) ? ncpu / maxgen : 1;
+	errores = interpretaMeses(maxgen,maxdisco,hilos);
+	errores += mezclaMeses(argv[2],&bd);
+	basfichClose(&bd);
+	if(errores)
+	{
+		fprintf(stderr,"Carga con %d meses erroneos\n",errores);
+		exit(3);
+	}
+	exit(0);
+}
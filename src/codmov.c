@@ -0,0 +1,425 @@
+// modulo : codmov.c
+// autor  : Antonio Pardo Redondo
+//
+// Modulo de codificacion de la lista de movimientos de una partida.
+//
+// Ademas del formato original (array de MOVBIN_t, 4 bytes por movimiento) se
+// definen dos formatos reducidos:
+//		-FORMATO_COMPACTO => un MOVCOMP_t de 2 bytes por movimiento con origen, destino,
+//								pieza de promocion y color. Las piezas se deducen del tablero.
+//		-FORMATO_ARCHIVO => 1 byte por movimiento con el indice del movimiento en la lista
+//								de movimientos posibles del color que juega. Los movimientos que
+//								no estan en la lista se codifican con el byte ESCAPEMOV seguido
+//								del MOVCOMP_t correspondiente.
+//
+// En ambos casos la decodificacion necesita el tablero virtual de la partida, por lo
+// que se realiza movimiento a movimiento conforme se recrea la partida.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codmov.h"
+
+#define MAXLISTAMOV	400	// maximo numero de movimientos posibles generados.
+
+// desplazamientos (x,y) de los saltos de caballo y de los pasos de rey.
+static const int8_t saltoCaballo[8][2] = {{1,2},{2,1},{-1,2},{-2,1},{1,-2},{2,-1},{-1,-2},{-2,-1}};
+static const int8_t pasoRey[8][2] = {{1,0},{-1,0},{0,1},{0,-1},{1,1},{1,-1},{-1,1},{-1,-1}};
+// direcciones de desplazamiento, las cuatro primeras diagonales y las cuatro ultimas filas y columnas.
+static const int8_t direcciones[8][2] = {{1,1},{1,-1},{-1,1},{-1,-1},{1,0},{-1,0},{0,1},{0,-1}};
+
+// longitud en bytes de una lista de nmov movimientos en formato de tamanho fijo.
+// En FORMATO_ARCHIVO la longitud depende de los movimientos (cuentaMovs), por lo que
+// un formato de tamanho variable o desconocido es un error fatal.
+int lenMovs(int formato,int nmov)
+{
+	switch(formato)
+	{
+		case FORMATO_MOVBIN:
+			return(nmov * sizeof(MOVBIN_t));
+		case FORMATO_COMPACTO:
+			return(nmov * sizeof(MOVCOMP_t));
+		default:
+			fprintf(stderr,"lenMovs: formato de movimientos %d sin longitud fija\n",formato);
+			exit(1);
+	}
+}
+
+// numero de movimientos de una lista codificada de len bytes.
+// En FORMATO_ARCHIVO cada movimiento ocupa un byte salvo los escapes que ocupan tres.
+int cuentaMovs(uint8_t *datos,int len,int formato)
+{
+	int i,nmov;
+
+	switch(formato)
+	{
+		case FORMATO_COMPACTO:
+			return(len/sizeof(MOVCOMP_t));
+		case FORMATO_ARCHIVO:
+			for(i=0,nmov=0;i<len;nmov++)
+			{
+				if(datos[i] == ESCAPEMOV)
+					i += 3;
+				else
+					i++;
+			}
+			return nmov;
+		default:
+			return(len/sizeof(MOVBIN_t));
+	}
+}
+
+// traduce un movimiento binario a movimiento compacto.
+static MOVCOMP_t aCompacto(MOVBIN_t *mov)
+{
+	MOVCOMP_t comp;
+
+	comp = mov->origen | (mov->destino << 6);
+	if((mov->piezadest & 0x7) != (mov->piezaorg & 0x7))	// promocion.
+		comp |= (mov->piezadest & 0x7) << 12;
+	if(mov->piezadest & NEGRA)
+		comp |= 0x8000;
+	return comp;
+}
+
+// traduce un movimiento compacto a binario deduciendo la pieza que mueve del tablero actual.
+static void deCompacto(MOVCOMP_t comp,uint8_t *tab,MOVBIN_t *mov)
+{
+	uint8_t color = (comp >> 12) & NEGRA;
+	uint8_t promo = (comp >> 12) & 0x7;
+
+	mov->origen = comp & 0x3f;
+	mov->destino = (comp >> 6) & 0x3f;
+	mov->piezaorg = tab[mov->origen] & 0x7;
+	if(mov->piezaorg == NADA)	// casilla origen vacia, solo en partidas mal decodificadas.
+		mov->piezaorg = PEON;
+	mov->piezaorg |= color;
+	if(promo != NADA)
+		mov->piezadest = promo | color;
+	else
+		mov->piezadest = mov->piezaorg;
+}
+
+// anhade a la lista un movimiento de peon, con sus cuatro posibles promociones
+// si alcanza la ultima fila.
+static int anhadePeon(MOVCOMP_t *lista,int n,MOVCOMP_t base,int dest)
+{
+	base |= dest << 6;
+	if((dest < 8) || (dest >= 56))
+	{
+		lista[n++] = base | (REINA << 12);
+		lista[n++] = base | (TORRE << 12);
+		lista[n++] = base | (ALFIL << 12);
+		lista[n++] = base | (CABALLO << 12);
+	}
+	else
+		lista[n++] = base;
+	return n;
+}
+
+// genera en orden fijo la lista de movimientos posibles del color indicado.
+// No se comprueba el jaque propio, solo que el destino este vacio o tenga una pieza contraria.
+// Los enroques se anotan como dos movimientos (torre y rey) igual que en la lista de MOVBIN_t.
+static int generaMovs(uint8_t *tab,uint8_t color,MOVCOMP_t *lista)
+{
+	int n = 0;
+	int pos,dest;
+	int x,y,dx,dy;
+	int i,dini,dfin;
+	uint8_t pieza;
+	MOVCOMP_t base;
+
+	for(pos=0;(pos<64) && (n < (MAXLISTAMOV - 30));pos++)
+	{
+		pieza = tab[pos];
+		if((pieza == NADA) || ((pieza & NEGRA) != color))
+			continue;
+		x = pos%8;
+		y = pos/8;
+		base = pos | (color << 12);
+		switch(pieza & 0x7)
+		{
+			case PEON:
+				dy = color ? 1 : -1;
+				if(((y + dy) < 0) || ((y + dy) > 7))
+					break;
+				dest = pos + dy*8;
+				if(tab[dest] == NADA)	// avance de una casilla y salida de dos.
+				{
+					n = anhadePeon(lista,n,base,dest);
+					if(((color == 0) && (y == 6)) || ((color != 0) && (y == 1)))
+					{
+						if(tab[dest + dy*8] == NADA)
+							lista[n++] = base | ((dest + dy*8) << 6);
+					}
+				}
+				for(dx=-1;dx<=1;dx+=2)	// comidas, incluida la comida al paso.
+				{
+					if(((x + dx) < 0) || ((x + dx) > 7))
+						continue;
+					if(((tab[dest + dx] != NADA) && ((tab[dest + dx] & NEGRA) != color)) ||
+						((tab[dest + dx] == NADA) && (tab[pos + dx] == (PEON | (color ^ NEGRA)))))
+						n = anhadePeon(lista,n,base,dest + dx);
+				}
+				break;
+			case CABALLO:
+			case REY:
+				for(i=0;i<8;i++)
+				{
+					if((pieza & 0x7) == CABALLO)
+					{
+						dx = saltoCaballo[i][0];
+						dy = saltoCaballo[i][1];
+					}
+					else
+					{
+						dx = pasoRey[i][0];
+						dy = pasoRey[i][1];
+					}
+					if(((x + dx) < 0) || ((x + dx) > 7) || ((y + dy) < 0) || ((y + dy) > 7))
+						continue;
+					dest = (y + dy)*8 + x + dx;
+					if((tab[dest] == NADA) || ((tab[dest] & NEGRA) != color))
+						lista[n++] = base | (dest << 6);
+				}
+				// movimiento de rey del enroque, la torre ya ha movido.
+				if(((pieza & 0x7) == REY) && (pos == (color ? 4 : 60)))
+				{
+					if(tab[pos + 2] == NADA)
+						lista[n++] = base | ((pos + 2) << 6);
+					if(tab[pos - 2] == NADA)
+						lista[n++] = base | ((pos - 2) << 6);
+				}
+				break;
+			default:	// piezas de desplazamiento: alfil, torre y reina.
+				dini = ((pieza & 0x7) == TORRE) ? 4 : 0;
+				dfin = ((pieza & 0x7) == ALFIL) ? 4 : 8;
+				for(i=dini;i<dfin;i++)
+				{
+					dx = direcciones[i][0];
+					dy = direcciones[i][1];
+					for(dest=pos;;)
+					{
+						if((((dest%8) + dx) < 0) || (((dest%8) + dx) > 7) || (((dest/8) + dy) < 0) || (((dest/8) + dy) > 7))
+							break;
+						dest += dy*8 + dx;
+						if(tab[dest] == NADA)
+						{
+							lista[n++] = base | (dest << 6);
+							continue;
+						}
+						if((tab[dest] & NEGRA) != color)
+							lista[n++] = base | (dest << 6);
+						break;
+					}
+				}
+				break;
+		}
+	}
+	return n;
+}
+
+// determina el color que juega tras el movimiento indicado (tablero previo al movimiento).
+// tras el movimiento de torre de un enroque vuelve a mover el mismo color (el rey).
+static uint8_t colorSiguiente(MOVBIN_t *mov,uint8_t *tab)
+{
+	uint8_t color = mov->piezaorg & NEGRA;
+
+	if((mov->piezaorg & 0x7) == TORRE)
+	{
+		if(color)
+		{
+			if((tab[4] == (REY | NEGRA)) && (((mov->origen == 7) && (mov->destino == 5)) || ((mov->origen == 0) && (mov->destino == 3))))
+				return color;
+		}
+		else
+		{
+			if((tab[60] == REY) && (((mov->origen == 63) && (mov->destino == 61)) || ((mov->origen == 56) && (mov->destino == 59))))
+				return color;
+		}
+	}
+	return(color ^ NEGRA);
+}
+
+// efectua un movimiento en el tablero virtual considerando una posible comida
+// de peon al paso (peon que se mueve en diagonal a una casilla vacia).
+void aplicaMov(MOVBIN_t *mov,uint8_t *tab)
+{
+	if(((mov->piezaorg & 0x7) == PEON) && ((mov->origen %8) != (mov->destino %8)) && (tab[mov->destino] == NADA))
+	{
+		// Eliminamos peon comido al paso.
+		if(mov->piezaorg & NEGRA)
+			tab[mov->destino - 8] = NADA;
+		else
+			tab[mov->destino + 8] = NADA;
+	}
+	tab[mov->origen] = NADA;
+	tab[mov->destino] = mov->piezadest;
+}
+
+// codifica nmov movimientos en el formato indicado sobre dest.
+// retorna el numero de bytes generados.
+int codificaMovs(MOVBIN_t *mov,int nmov,int formato,uint8_t *dest)
+{
+	uint8_t tab[64];
+	MOVCOMP_t lista[MAXLISTAMOV];
+	MOVCOMP_t comp;
+	MOVBIN_t movdec;
+	uint8_t color;
+	int len = 0;
+	int i,j,n;
+
+	switch(formato)
+	{
+		case FORMATO_COMPACTO:
+			for(i=0;i<nmov;i++)
+			{
+				comp = aCompacto(&mov[i]);
+				dest[len++] = comp & 0xff;
+				dest[len++] = comp >> 8;
+			}
+			break;
+		case FORMATO_ARCHIVO:
+			// recreamos la partida para generar en cada movimiento la lista de posibles.
+			memcpy(tab,tablaini,sizeof(tablaini));
+			color = 0;
+			for(i=0;i<nmov;i++)
+			{
+				comp = aCompacto(&mov[i]);
+				n = generaMovs(tab,color,lista);
+				for(j=0;(j<n) && (j<ESCAPEMOV);j++)
+				{
+					if(lista[j] == comp)
+						break;
+				}
+				if((j < n) && (j < ESCAPEMOV))
+					dest[len++] = j;
+				else		// no esta en la lista, se anota completo.
+				{
+					dest[len++] = ESCAPEMOV;
+					dest[len++] = comp & 0xff;
+					dest[len++] = comp >> 8;
+				}
+				// el tablero avanza con el movimiento tal y como se decodificara.
+				deCompacto(comp,tab,&movdec);
+				color = colorSiguiente(&movdec,tab);
+				aplicaMov(&movdec,tab);
+			}
+			break;
+		default:
+			len = nmov * sizeof(MOVBIN_t);
+			memcpy(dest,mov,len);
+			break;
+	}
+	return len;
+}
+
+// inicia el estado de decodificacion de una lista de movimientos en el formato indicado.
+void iniDecMov(DECMOV_t *dec,int formato,uint8_t *datos)
+{
+	dec->datos = datos;
+	dec->pos = 0;
+	dec->formato = formato;
+	dec->color = 0;	// comienzan las blancas.
+}
+
+// decodifica el siguiente movimiento sobre el tablero actual sin aplicarlo.
+// retorna 0 y un movimiento nulo (todo a 0) si la lista no corresponde al tablero.
+int siguienteMov(DECMOV_t *dec,uint8_t *tab,MOVBIN_t *mov)
+{
+	MOVCOMP_t lista[MAXLISTAMOV];
+	MOVCOMP_t comp;
+	uint8_t ind;
+	int n;
+
+	switch(dec->formato)
+	{
+		case FORMATO_COMPACTO:
+			comp = dec->datos[dec->pos] | (dec->datos[dec->pos + 1] << 8);
+			dec->pos += 2;
+			deCompacto(comp,tab,mov);
+			break;
+		case FORMATO_ARCHIVO:
+			ind = dec->datos[dec->pos++];
+			if(ind == ESCAPEMOV)
+			{
+				comp = dec->datos[dec->pos] | (dec->datos[dec->pos + 1] << 8);
+				dec->pos += 2;
+			}
+			else
+			{
+				n = generaMovs(tab,dec->color,lista);
+				if(ind >= n)	// indice fuera de la lista, datos corruptos o de otra partida.
+				{
+					memset(mov,0,sizeof(MOVBIN_t));
+					return 0;
+				}
+				comp = lista[ind];
+			}
+			deCompacto(comp,tab,mov);
+			dec->color = colorSiguiente(mov,tab);
+			break;
+		default:
+			memcpy(mov,dec->datos + dec->pos,sizeof(MOVBIN_t));
+			dec->pos += sizeof(MOVBIN_t);
+			break;
+	}
+	return 1;
+}
+
+// decodifica el siguiente movimiento y lo aplica al tablero en un solo paso.
+// retorna 0 sin tocar el tablero si el movimiento no es valido (siguienteMov).
+int avanzaMov(DECMOV_t *dec,uint8_t *tab,MOVBIN_t *mov)
+{
+	if(siguienteMov(dec,tab,mov) == 0)
+		return 0;
+	aplicaMov(mov,tab);
+	return 1;
+}
+
+// indica si el movimiento es el de rey de un enroque (el rey se desplaza dos casillas
+// desde su posicion inicial), segundo movimiento de la jugada tras el de la torre.
+int reyEnroque(MOVBIN_t *mov)
+{
+	return(((mov->piezaorg & 0x7) == REY) && ((mov->origen == 4) || (mov->origen == 60)) &&
+			(abs(mov->destino - mov->origen) == 2));
+}
+
+// numero de jugadas (medios movimientos) de una lista de nmov movimientos, cada enroque
+// cuenta como una jugada.
+int cuentaJugadas(MOVBIN_t *mov,int nmov)
+{
+	int i,njugadas = 0;
+
+	for(i=0;i<nmov;i++)
+	{
+		if(reyEnroque(&mov[i]) == 0)
+			njugadas++;
+	}
+	return njugadas;
+}
+
+// decodifica nmov movimientos recreando la partida desde la posicion inicial.
+// Los movimientos a partir del primero no valido se dejan nulos.
+void decodificaMovs(uint8_t *datos,int nmov,int formato,MOVBIN_t *mov)
+{
+	uint8_t tab[64];
+	DECMOV_t dec;
+	int i;
+
+	if(formato == FORMATO_MOVBIN)
+	{
+		memmove(mov,datos,nmov * sizeof(MOVBIN_t));
+		return;
+	}
+	memcpy(tab,tablaini,sizeof(tablaini));
+	iniDecMov(&dec,formato,datos);
+	for(i=0;i<nmov;i++)
+	{
+		if(avanzaMov(&dec,tab,&mov[i]) == 0)
+		{
+			memset(&mov[i],0,(nmov - i) * sizeof(MOVBIN_t));
+			return;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+// modulo : codmov.h
+// autor  : Antonio Pardo Redondo
+//
+// Modulo de codificacion de la lista de movimientos de una partida.
+//
+// Ademas del formato original (array de MOVBIN_t, 4 bytes por movimiento) se
+// definen dos formatos reducidos:
+//		-FORMATO_COMPACTO => un MOVCOMP_t de 2 bytes por movimiento con origen, destino,
+//								pieza de promocion y color. Las piezas se deducen del tablero.
+//		-FORMATO_ARCHIVO => 1 byte por movimiento con el indice del movimiento en la lista
+//								de movimientos posibles del color que juega. Los movimientos que
+//								no estan en la lista se codifican con el byte ESCAPEMOV seguido
+//								del MOVCOMP_t correspondiente.
+//
+// En ambos casos la decodificacion necesita el tablero virtual de la partida, por lo
+// que se realiza movimiento a movimiento conforme se recrea la partida.
+//
+#ifndef CODMOV_H
+#define CODMOV_H
+
+#include "ajedrez.h"
+
+#define ESCAPEMOV	0xff	// en FORMATO_ARCHIVO precede a un MOVCOMP_t.
+
+// Estado de decodificacion de la lista de movimientos de una partida.
+typedef struct {
+	uint8_t	*datos;		// lista de movimientos codificada.
+	int		pos;			// posicion del siguiente movimiento en datos.
+	uint8_t	formato;		// formato de codificacion (FORMATO_xxx).
+	uint8_t	color;		// color que se espera que juegue (FORMATO_ARCHIVO).
+} DECMOV_t;
+
+// longitud en bytes de una lista de nmov movimientos en formato de tamanho fijo
+// (FORMATO_MOVBIN o FORMATO_COMPACTO), termina el programa con cualquier otro formato.
+extern int lenMovs(int formato,int nmov);
+
+// numero de movimientos de una lista codificada de len bytes.
+extern int cuentaMovs(uint8_t *datos,int len,int formato);
+
+// codifica nmov movimientos en el formato indicado sobre dest.
+// retorna el numero de bytes generados.
+extern int codificaMovs(MOVBIN_t *mov,int nmov,int formato,uint8_t *dest);
+
+// inicia el estado de decodificacion de una lista de movimientos en el formato indicado.
+extern void iniDecMov(DECMOV_t *dec,int formato,uint8_t *datos);
+
+// decodifica el siguiente movimiento sobre el tablero actual sin aplicarlo.
+// retorna 0 y un movimiento nulo si la lista no corresponde al tablero.
+extern int siguienteMov(DECMOV_t *dec,uint8_t *tab,MOVBIN_t *mov);
+
+// efectua un movimiento en el tablero virtual considerando la comida al paso.
+extern void aplicaMov(MOVBIN_t *mov,uint8_t *tab);
+
+// decodifica el siguiente movimiento y lo aplica al tablero en un solo paso.
+// retorna 0 sin tocar el tablero si el movimiento no es valido.
+extern int avanzaMov(DECMOV_t *dec,uint8_t *tab,MOVBIN_t *mov);
+
+// indica si el movimiento es el de rey de un enroque. En la lista de movimientos el
+// enroque se anota como dos movimientos (torre y rey) que forman una sola jugada.
+extern int reyEnroque(MOVBIN_t *mov);
+
+// numero de jugadas (medios movimientos) de una lista de nmov movimientos, cada enroque
+// cuenta como una jugada.
+extern int cuentaJugadas(MOVBIN_t *mov,int nmov);
+
+// decodifica nmov movimientos recreando la partida desde la posicion inicial.
+// Los movimientos a partir del primero no valido se dejan nulos.
+extern void decodificaMovs(uint8_t *datos,int nmov,int formato,MOVBIN_t *mov);
+
+#endif // CODMOV_H
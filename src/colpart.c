@@ -0,0 +1,338 @@
+// modulo : colpart.c
+// autor  : Antonio Pardo Redondo
+//
+// Modulo que implementa el formato columnar de una particion de partidas.
+//
+// Cada particion se graba en un fichero con los metadatos de sus partidas separados
+// por columnas seguidos del flujo de movimientos. La seleccion de partidas se hace con
+// el mapa de zonas y evaluando el predicado sobre las columnas de 8 en 8 partidas
+// (SSE2 si esta disponible) antes de acceder a los movimientos.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "colpart.h"
+#include "codmov.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// redondea al multiplo de 8 partidas (grupo de evaluacion del predicado).
+#define GRUPO8(n)		(((n) + 7) & ~7)
+// redondea un offset a la alineacion de las columnas.
+#define ALINEA(off)	(((off) + ALINCOL - 1) & ~((uint64_t)ALINCOL - 1))
+
+// calcula los offsets de las secciones del fichero para npartidas.
+static void disponeColumnar(CABCOL_t *cab,int npartidas)
+{
+	uint64_t off;
+	int ngrupo = GRUPO8(npartidas);
+
+	cab->npartidas = npartidas;
+	cab->nzonas = (npartidas + PARTZONA - 1) / PARTZONA;
+	off = ALINEA(sizeof(CABCOL_t));
+	cab->offzonas = off;
+	off = ALINEA(off + cab->nzonas * sizeof(ZONACOL_t));
+	cab->offelomed = off;
+	off = ALINEA(off + ngrupo * sizeof(uint16_t));
+	cab->offganador = off;
+	off = ALINEA(off + ngrupo * sizeof(uint8_t));
+	cab->offpartidaid = off;
+	off = ALINEA(off + ngrupo * sizeof(uint32_t));
+	cab->offnmov = off;
+	off = ALINEA(off + ngrupo * sizeof(uint16_t));
+	cab->offocupacion = off;
+	off = ALINEA(off + ngrupo / 8);
+	cab->offoffmov = off;
+	off = ALINEA(off + (npartidas + 1) * sizeof(uint64_t));
+	cab->offmeta = off;
+	off = ALINEA(off + ngrupo * sizeof(META_t));
+	cab->offdifelo = off;
+	off = ALINEA(off + ngrupo * sizeof(int16_t));
+	cab->offmovs = off;
+}
+
+// Crea el fichero columnar de una particion para un maximo de npartidas partidas.
+// Las columnas se forman en memoria y los movimientos se graban directamente en su
+// posicion del fichero conforme se anhaden las partidas.
+// retorna '1' si ha podido crearse y '0' en caso contrario.
+int iniColumnar(COLESC_t *esc,char *path,int npartidas,int formato,int fileid,int particion)
+{
+	int ngrupo = GRUPO8(npartidas);
+
+	memset(esc,0,sizeof(COLESC_t));
+	if((esc->fd = fopen(path,"w")) == NULL)
+	{
+		perror(path);
+		return 0;
+	}
+	esc->cab.magic = MAGICCOL;
+	esc->cab.version = VERSIONCOL;
+	esc->cab.formato = formato;
+	esc->cab.fileid = fileid;
+	esc->cab.particion = particion;
+	disponeColumnar(&esc->cab,npartidas);
+	esc->nmax = npartidas;
+	esc->elomed = calloc(ngrupo,sizeof(uint16_t));
+	esc->ganador = calloc(ngrupo,sizeof(uint8_t));
+	esc->partidaid = calloc(ngrupo,sizeof(uint32_t));
+	esc->nmov = calloc(ngrupo,sizeof(uint16_t));
+	esc->ocupacion = calloc(ngrupo / 8 + 1,sizeof(uint8_t));
+	esc->offmov = calloc(npartidas + 1,sizeof(uint64_t));
+	esc->meta = calloc(ngrupo,sizeof(META_t));
+	esc->difelo = calloc(ngrupo,sizeof(int16_t));
+	if((esc->elomed == NULL) || (esc->ganador == NULL) || (esc->partidaid == NULL) ||
+		(esc->nmov == NULL) || (esc->ocupacion == NULL) || (esc->offmov == NULL) ||
+		(esc->meta == NULL) || (esc->difelo == NULL))
+	{
+		fprintf(stderr,"Sin memoria para columnas\n");
+		exit(2);
+	}
+	fseeko(esc->fd,esc->cab.offmovs,SEEK_SET);
+	return 1;
+}
+
+// anhade una partida (en el orden de la particion) al fichero columnar.
+void anhadeColumnar(COLESC_t *esc,CPARTIDA_t *cabpar,MOVBIN_t *mov)
+{
+	uint8_t codigo[MAXMOV * sizeof(MOVBIN_t)];
+	uint32_t i;
+	int len = 0;
+
+	if(esc->n >= esc->nmax)
+	{
+		fprintf(stderr,"Particion columnar llena\n");
+		return;
+	}
+	i = esc->n++;
+	esc->elomed[i] = cabpar->elomed;
+	esc->ganador[i] = cabpar->flags.ganablanca + cabpar->flags.gananegra * 2;
+	esc->partidaid[i] = cabpar->ind;
+	esc->nmov[i] = cabpar->nmov;
+	esc->meta[i] = cabpar->meta;
+	esc->difelo[i] = cabpar->difelo;
+	esc->offmov[i] = esc->cab.lenmovs;
+	if(cabpar->nmov > 0)
+	{
+		len = codificaMovs(mov,cabpar->nmov,esc->cab.formato,codigo);
+		fwrite(codigo,1,len,esc->fd);
+		esc->ocupacion[i >> 3] |= 1 << (i & 7);
+	}
+	esc->cab.lenmovs += len;
+	esc->offmov[i + 1] = esc->cab.lenmovs;
+}
+
+// graba una seccion del fichero en su offset.
+static void grabaSeccion(FILE *fd,uint64_t off,void *datos,size_t len)
+{
+	fseeko(fd,off,SEEK_SET);
+	if(fwrite(datos,1,len,fd) != len)
+	{
+		perror("Fichero columnar");
+		exit(2);
+	}
+}
+
+// graba columnas y mapa de zonas y cierra el fichero columnar.
+// Si se han anhadido menos partidas de las previstas las columnas conservan su
+// capacidad y se ajusta el numero de partidas de la cabecera.
+void cierraColumnar(COLESC_t *esc)
+{
+	ZONACOL_t *zonas;
+	ZONACOL_t *zona;
+	uint32_t i;
+	int ngrupo = GRUPO8(esc->nmax);
+
+	esc->cab.npartidas = esc->n;
+	esc->cab.nzonas = (esc->n + PARTZONA - 1) / PARTZONA;
+	zonas = calloc(esc->cab.nzonas + 1,sizeof(ZONACOL_t));
+	for(i=0;i<esc->n;i++)
+	{
+		zona = &zonas[i / PARTZONA];
+		if((esc->ocupacion[i >> 3] & (1 << (i & 7))) == 0)
+			continue;
+		if((zona->nocupadas == 0) || (esc->elomed[i] < zona->elomin))
+			zona->elomin = esc->elomed[i];
+		if((zona->nocupadas == 0) || (esc->elomed[i] > zona->elomax))
+			zona->elomax = esc->elomed[i];
+		zona->ganadores |= 1 << esc->ganador[i];
+		zona->nocupadas++;
+	}
+	grabaSeccion(esc->fd,esc->cab.offzonas,zonas,esc->cab.nzonas * sizeof(ZONACOL_t));
+	grabaSeccion(esc->fd,esc->cab.offelomed,esc->elomed,ngrupo * sizeof(uint16_t));
+	grabaSeccion(esc->fd,esc->cab.offganador,esc->ganador,ngrupo * sizeof(uint8_t));
+	grabaSeccion(esc->fd,esc->cab.offpartidaid,esc->partidaid,ngrupo * sizeof(uint32_t));
+	grabaSeccion(esc->fd,esc->cab.offnmov,esc->nmov,ngrupo * sizeof(uint16_t));
+	grabaSeccion(esc->fd,esc->cab.offocupacion,esc->ocupacion,ngrupo / 8);
+	grabaSeccion(esc->fd,esc->cab.offoffmov,esc->offmov,(esc->nmax + 1) * sizeof(uint64_t));
+	grabaSeccion(esc->fd,esc->cab.offmeta,esc->meta,ngrupo * sizeof(META_t));
+	grabaSeccion(esc->fd,esc->cab.offdifelo,esc->difelo,ngrupo * sizeof(int16_t));
+	grabaSeccion(esc->fd,0,&esc->cab,sizeof(CABCOL_t));
+	fclose(esc->fd);
+	free(zonas);
+	free(esc->elomed);
+	free(esc->ganador);
+	free(esc->partidaid);
+	free(esc->nmov);
+	free(esc->ocupacion);
+	free(esc->offmov);
+	free(esc->meta);
+	free(esc->difelo);
+	esc->fd = NULL;
+}
+
+// Abre para lectura el fichero columnar de una particion proyectandolo en memoria.
+// retorna '1' si existe y es valido y '0' en caso contrario.
+int abreColumnar(COLPART_t *col,char *path)
+{
+	int fd;
+	struct stat st;
+
+	memset(col,0,sizeof(COLPART_t));
+	if((fd = open(path,O_RDONLY)) < 0)
+		return 0;
+	if((fstat(fd,&st) < 0) || (st.st_size < sizeof(CABCOL_t)))
+	{
+		close(fd);
+		return 0;
+	}
+	col->lenmapa = st.st_size;
+	col->mapa = mmap(NULL,col->lenmapa,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(col->mapa == MAP_FAILED)
+	{
+		col->mapa = NULL;
+		return 0;
+	}
+	col->cab = (CABCOL_t *)col->mapa;
+	if((col->cab->magic != MAGICCOL) || (col->cab->version < 1) || (col->cab->version > VERSIONCOL) ||
+		((col->cab->offmovs + col->cab->lenmovs) > col->lenmapa))
+	{
+		fprintf(stderr,"Fichero columnar invalido: %s\n",path);
+		liberaColumnar(col);
+		return 0;
+	}
+	col->zonas = (ZONACOL_t *)(col->mapa + col->cab->offzonas);
+	col->elomed = (uint16_t *)(col->mapa + col->cab->offelomed);
+	col->ganador = col->mapa + col->cab->offganador;
+	col->partidaid = (uint32_t *)(col->mapa + col->cab->offpartidaid);
+	col->nmov = (uint16_t *)(col->mapa + col->cab->offnmov);
+	col->ocupacion = col->mapa + col->cab->offocupacion;
+	col->offmov = (uint64_t *)(col->mapa + col->cab->offoffmov);
+	if(col->cab->version >= 2)
+	{
+		col->meta = (META_t *)(col->mapa + col->cab->offmeta);
+		col->difelo = (int16_t *)(col->mapa + col->cab->offdifelo);
+	}
+	col->movs = col->mapa + col->cab->offmovs;
+	if((col->sel = malloc((col->cab->npartidas + 1) * sizeof(uint32_t))) == NULL)
+	{
+		fprintf(stderr,"Sin memoria para seleccion\n");
+		exit(2);
+	}
+	return 1;
+}
+
+// evalua el predicado sobre 8 partidas consecutivas a partir de ind.
+// retorna la mascara de partidas que lo cumplen (bit i => partida ind+i).
+static inline int predicado8(COLPART_t *col,int ind,int elomin,int elomax,int gana)
+{
+#ifdef __SSE2__
+	__m128i elo,cumple,gan;
+	__m128i cero = _mm_setzero_si128();
+
+	elo = _mm_loadu_si128((__m128i *)(col->elomed + ind));
+	cumple = _mm_and_si128(_mm_cmpgt_epi16(elo,_mm_set1_epi16(elomin)),
+								_mm_cmplt_epi16(elo,_mm_set1_epi16(elomax)));
+	if(gana != 0)
+	{
+		gan = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(col->ganador + ind)),cero);
+		cumple = _mm_and_si128(cumple,_mm_cmpeq_epi16(gan,_mm_set1_epi16(gana)));
+	}
+	return(_mm_movemask_epi8(_mm_packs_epi16(cumple,cero)) & 0xff);
+#else
+	int i,mascara = 0;
+
+	for(i=0;i<8;i++)
+	{
+		mascara |= ((col->elomed[ind + i] > elomin) && (col->elomed[ind + i] < elomax) &&
+						((gana == 0) || (col->ganador[ind + i] == gana))) << i;
+	}
+	return mascara;
+#endif
+}
+
+// Rellena el vector de seleccion (col->sel) con los indices de las partidas que cumplen
+// elomin < elomed < elomax, el ganador (0 => cualquiera) y el filtro de metadatos
+// (NULL => sin filtro), que se evalua solo sobre las partidas que cumplen el resto.
+// retorna el numero de partidas.
+int seleccionaColumnar(COLPART_t *col,int elomin,int elomax,int gana,FILTROMETA_t *filtro)
+{
+	static const META_t sinmeta;	// metadatos de las partidas de la version 1.
+	ZONACOL_t *zona;
+	int z,ind,fin,mascara,i;
+	int nsel = 0;
+
+	// las comparaciones SSE2 son con signo en 16 bits.
+	if(elomin < -1)
+		elomin = -1;
+	if(elomax > 0x7fff)
+		elomax = 0x7fff;
+	for(z=0,zona=col->zonas;z<col->cab->nzonas;z++,zona++)
+	{
+		// descartamos zonas completas por el mapa de zonas.
+		if((zona->nocupadas == 0) || (zona->elomax <= elomin) || (zona->elomin >= elomax))
+			continue;
+		if((gana != 0) && ((zona->ganadores & (1 << gana)) == 0))
+			continue;
+		fin = (z + 1) * PARTZONA;
+		if(fin > col->cab->npartidas)
+			fin = col->cab->npartidas;
+		for(ind=z * PARTZONA;ind<fin;ind+=8)
+		{
+			mascara = predicado8(col,ind,elomin,elomax,gana) & col->ocupacion[ind >> 3];
+			while(mascara)
+			{
+				i = ind + __builtin_ctz(mascara);
+				mascara &= mascara - 1;
+				if((filtro != NULL) && !((col->meta != NULL) ? cumpleMeta(filtro,col->meta[i],col->difelo[i]) :
+																				cumpleMeta(filtro,sinmeta,0)))
+					continue;
+				col->sel[nsel++] = i;
+			}
+		}
+	}
+	return nsel;
+}
+
+// obtiene la cabecera y los movimientos (en el formato grabado) de la partida indicada.
+void partidaColumnar(COLPART_t *col,int ind,CPARTIDA_t *cabpar,MOVBIN_t *mov)
+{
+	memset(cabpar,0,sizeof(CPARTIDA_t));
+	cabpar->formato = col->cab->formato;
+	cabpar->nmov = col->nmov[ind];
+	cabpar->elomed = col->elomed[ind];
+	cabpar->ind = col->partidaid[ind];
+	cabpar->flags.ganablanca = col->ganador[ind] & 1;
+	cabpar->flags.gananegra = (col->ganador[ind] >> 1) & 1;
+	if(col->meta != NULL)
+	{
+		cabpar->meta = col->meta[ind];
+		cabpar->difelo = col->difelo[ind];
+	}
+	memcpy(mov,col->movs + col->offmov[ind],col->offmov[ind + 1] - col->offmov[ind]);
+}
+
+// libera la particion columnar abierta.
+void liberaColumnar(COLPART_t *col)
+{
+	if(col->mapa != NULL)
+		munmap(col->mapa,col->lenmapa);
+	free(col->sel);
+	col->mapa = NULL;
+	col->sel = NULL;
+}
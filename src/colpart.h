@@ -0,0 +1,129 @@
+// modulo : colpart.h
+// autor  : Antonio Pardo Redondo
+//
+// Modulo que implementa el formato columnar de una particion de partidas.
+//
+// Cada particion se graba en un fichero con los metadatos de sus partidas separados
+// por columnas (elomed, ganador, partidaid, nmov, ocupacion, offset de movimientos y, desde
+// la version 2, metadatos META_t y diferencia de elo), seguidos del flujo de movimientos de
+// todas las partidas. Las partidas se mantienen en el orden de la particion (elomed, ganador).
+//
+// Para cada zona de PARTZONA partidas se guarda el elomed minimo y maximo y la mascara
+// de ganadores presentes (mapa de zonas), de forma que la seleccion descarta zonas
+// enteras y evalua el predicado sobre las columnas de las restantes, de 8 en 8 partidas,
+// generando un vector de seleccion sin tocar los movimientos. El filtro de metadatos
+// (FILTROMETA_t) se evalua despues sobre las columnas meta y difelo de las seleccionadas.
+// Los ficheros de la version 1 no tienen estas columnas, sus partidas tienen los
+// metadatos a cero.
+//
+// Disposicion del fichero:
+//		CABCOL_t | ZONACOL_t[nzonas] | elomed | ganador | partidaid | nmov | ocupacion | offmov |
+//		meta | difelo | movimientos
+// Las columnas comienzan alineadas a ALINCOL bytes y tienen capacidad para npartidas
+// redondeado a multiplo de 8. La ocupacion es un bit por partida (1 => partida con movimientos).
+// offmov tiene npartidas+1 entradas, los movimientos de la partida i ocupan [offmov[i],offmov[i+1]).
+//
+#ifndef COLPART_H
+#define COLPART_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ajedrez.h"
+
+#define MAGICCOL		0x50434a41	// "AJCP"
+#define VERSIONCOL	2				// la version 1 no tiene las columnas meta y difelo.
+#define PARTZONA		4096			// partidas por zona del mapa de zonas.
+#define ALINCOL		64				// alineacion de las columnas en el fichero.
+
+// cabecera del fichero columnar.
+typedef struct {
+	uint32_t	magic;
+	uint16_t	version;
+	uint8_t	formato;			// formato de los movimientos (FORMATO_xxx).
+	uint8_t	reser;
+	uint16_t	fileid;
+	uint16_t	particion;
+	uint32_t	npartidas;
+	uint32_t	nzonas;
+	uint64_t	offzonas;		// offsets de las secciones en el fichero.
+	uint64_t	offelomed;
+	uint64_t	offganador;
+	uint64_t	offpartidaid;
+	uint64_t	offnmov;
+	uint64_t	offocupacion;
+	uint64_t	offoffmov;
+	uint64_t	offmovs;
+	uint64_t	lenmovs;			// longitud del flujo de movimientos.
+	uint64_t	offmeta;			// version 2.
+	uint64_t	offdifelo;
+} CABCOL_t;
+
+// entrada del mapa de zonas.
+typedef struct {
+	uint16_t	elomin;			// elomed minimo de las partidas de la zona.
+	uint16_t	elomax;			// elomed maximo de las partidas de la zona.
+	uint8_t	ganadores;		// mascara de ganadores presentes (bit ganador).
+	uint8_t	reser;
+	uint16_t	nocupadas;		// partidas con movimientos en la zona.
+} ZONACOL_t;
+
+// particion columnar abierta para lectura (fichero proyectado en memoria).
+typedef struct {
+	uint8_t		*mapa;			// fichero proyectado.
+	size_t		lenmapa;
+	CABCOL_t		*cab;
+	ZONACOL_t	*zonas;
+	uint16_t		*elomed;
+	uint8_t		*ganador;
+	uint32_t		*partidaid;
+	uint16_t		*nmov;
+	uint8_t		*ocupacion;
+	uint64_t		*offmov;
+	META_t		*meta;			// NULL => fichero sin metadatos (version 1).
+	int16_t		*difelo;
+	uint8_t		*movs;
+	uint32_t		*sel;				// vector de seleccion.
+} COLPART_t;
+
+// particion columnar en construccion.
+typedef struct {
+	FILE			*fd;
+	CABCOL_t		cab;
+	uint32_t		nmax;				// capacidad de las columnas.
+	uint32_t		n;					// partidas anhadidas.
+	uint16_t		*elomed;
+	uint8_t		*ganador;
+	uint32_t		*partidaid;
+	uint16_t		*nmov;
+	uint8_t		*ocupacion;
+	uint64_t		*offmov;
+	META_t		*meta;
+	int16_t		*difelo;
+} COLESC_t;
+
+// Crea el fichero columnar de una particion para un maximo de npartidas partidas.
+// retorna '1' si ha podido crearse y '0' en caso contrario.
+extern int iniColumnar(COLESC_t *esc,char *path,int npartidas,int formato,int fileid,int particion);
+
+// anhade una partida (en el orden de la particion) al fichero columnar.
+extern void anhadeColumnar(COLESC_t *esc,CPARTIDA_t *cabpar,MOVBIN_t *mov);
+
+// graba columnas y mapa de zonas y cierra el fichero columnar.
+extern void cierraColumnar(COLESC_t *esc);
+
+// Abre para lectura el fichero columnar de una particion.
+// retorna '1' si existe y es valido y '0' en caso contrario.
+extern int abreColumnar(COLPART_t *col,char *path);
+
+// Rellena el vector de seleccion (col->sel) con los indices de las partidas que cumplen
+// elomin < elomed < elomax, el ganador (0 => cualquiera) y el filtro de metadatos
+// (NULL => sin filtro). retorna el numero de partidas.
+extern int seleccionaColumnar(COLPART_t *col,int elomin,int elomax,int gana,FILTROMETA_t *filtro);
+
+// obtiene la cabecera y los movimientos (en el formato grabado) de la partida indicada.
+extern void partidaColumnar(COLPART_t *col,int ind,CPARTIDA_t *cabpar,MOVBIN_t *mov);
+
+// libera la particion columnar abierta.
+extern void liberaColumnar(COLPART_t *col);
+
+#endif // COLPART_H
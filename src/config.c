@@ -17,6 +17,13 @@
 // El fichero de configuracion de base 'base.conf' define los siguientes parametros:
 //		-BASENAME= 'nombre de la base'
 //		-BASENUM = Numero de instancias de la base.
+//		-FORMATOMOV = Formato de grabacion de los movimientos (0=MOVBIN_t, 1=Compacto, 2=Archivo). Por defecto 1.
+//		-PARTBLOQUE = Partidas por bloque comprimido (0=una fila por partida). Por defecto 0.
+//		-NIVELCOMP = Nivel de compresion zlib de los bloques (0=sin comprimir ... 9). Por defecto 6.
+//		-COLUMNAR = Graba las particiones en ficheros columnares en lugar de en SQLITE (0/1). Por defecto 0.
+//		-VFSLECTURA = Lectura de las bases con el VFS de lectura secuencial (0=No, 1=Si, 2=Si con O_DIRECT sin proyeccion mmap). Por defecto 0.
+//		-ALMACEN = Almacen de las partidas (0=SQLITE, 1=Clave-valor proyectado en memoria, ver kvdrv.h). Por defecto 0.
+//		-CARGAMASIVA = Carga de las bases SQLITE sin diario e indices al final (0/1). Por defecto 0.
 //
 // El fichero 'job.conf' define los siguientes parametros:
 //		-ELOMIN= valor minimo de ELOMED a considerar en la busqueda.
@@ -25,6 +32,16 @@
 //		-FORMASAL= Formato del resultado de la busqueda (0= Imagen, 1= FEN) 
 //		-PATRON='Path al fichero de patron a buscar compilado'.
 //		-FIFO= 'nombre canal de comunicaciones para notificar progreso de la busqueda'.
+//	y opcionalmente un filtro de metadatos de las partidas (por defecto cualquiera):
+//		-RITMOJUEGO= lista separada por ',' de ritmos admitidos (0=Desconocido, 1=Bala, 2=Relampago,
+//						3=Rapida, 4=Clasica, 5=Correspondencia).
+//		-TERMINACION= lista separada por ',' de terminaciones admitidas (0=Desconocida, 1=Normal,
+//						2=Tiempo, 3=Abandono, 4=Infraccion, 5=Inconclusa).
+//		-ECOMIN= codigo ECO minimo de la apertura (p.e. B20).
+//		-ECOMAX= codigo ECO maximo de la apertura (p.e. B99).
+//						Un codigo ECO invalido (fuera de A00..E99) termina el programa.
+//		-DIFERENCIAMIN= diferencia minima de elo blancas - negras.
+//		-DIFERENCIAMAX= diferencia maxima de elo blancas - negras.
 //
 #include <stdio.h>
 #include <fcntl.h>
@@ -73,6 +90,36 @@ char *getBasFromParticion(char *pathajz,CONF_BAS_t *cnfbas,int particion)
 	return(nombastmp);
 }
 
+// Funcion que determina el path del fichero columnar de la particion indicada,
+// situado en la carpeta de la base que le corresponde.
+char *getColFromParticion(char *pathajz,CONF_BAS_t *cnfbas,int fileid,int particion)
+{
+	char carpetatmp[1000];
+	
+	sprintf(carpetatmp,"%s/base",pathajz);
+	return(getColFromCarpeta(carpetatmp,cnfbas,fileid,particion));
+}
+
+// Funcion que determina el path del fichero columnar de la particion indicada dentro
+// de una carpeta de bases (base_0, base_1..), como la de carga de fich2sqlite.
+char *getColFromCarpeta(char *carpetabases,CONF_BAS_t *cnfbas,int fileid,int particion)
+{
+	static char nomcoltmp[1000];
+	
+	sprintf(nomcoltmp,"%s/base_%01d/%d_%d.col",carpetabases,particion%(cnfbas->numbases),fileid,particion);
+	return(nomcoltmp);
+}
+
+// Funcion que determina el path del almacen clave-valor (carpeta) de la particion
+// indicada, situado en la carpeta de la base que le corresponde.
+char *getKvFromParticion(char *pathajz,CONF_BAS_t *cnfbas,int particion)
+{
+	static char nomkvtmp[1000];
+	
+	sprintf(nomkvtmp,"%s/base/base_%01d/%s.kv",pathajz,particion%(cnfbas->numbases),cnfbas->nombase);
+	return(nomkvtmp);
+}
+
 // Funcion para rellenar los campos de la estructura 'CONF_BAS_t' a partir
 // del fichero de configuracion de base.
 // retorna '1' si la lectura ha sido correcta y '0' en caso contrario.
@@ -86,6 +133,13 @@ int getConfBase(char *fileconf,CONF_BAS_t *cnfbas)
 	char *pchar;
 	
 	nombase[0] = 0;
+	cnfbas->formatomov = FORMATO_COMPACTO;
+	cnfbas->partbloque = 0;
+	cnfbas->nivelcomp = 6;
+	cnfbas->columnar = 0;
+	cnfbas->vfslectura = 0;
+	cnfbas->almacen = ALMACEN_SQLITE;
+	cnfbas->cargamasiva = 0;
 //	sprintf(nametmp,"%s/conf/base.conf",pathajz);
 //	if((fdtmp=fopen(nametmp,"r")) == NULL)
 	if((fdtmp=fopen(fileconf,"r")) == NULL)
@@ -111,6 +165,34 @@ int getConfBase(char *fileconf,CONF_BAS_t *cnfbas)
 		{
 			cnfbas->numbases = atoi(pchar);
 		}
+		else if(strstr(linea,"FORMATOMOV") != NULL)
+		{
+			cnfbas->formatomov = atoi(pchar);
+		}
+		else if(strstr(linea,"PARTBLOQUE") != NULL)
+		{
+			cnfbas->partbloque = atoi(pchar);
+		}
+		else if(strstr(linea,"NIVELCOMP") != NULL)
+		{
+			cnfbas->nivelcomp = atoi(pchar);
+		}
+		else if(strstr(linea,"COLUMNAR") != NULL)
+		{
+			cnfbas->columnar = atoi(pchar);
+		}
+		else if(strstr(linea,"VFSLECTURA") != NULL)
+		{
+			cnfbas->vfslectura = atoi(pchar);
+		}
+		else if(strstr(linea,"ALMACEN") != NULL)
+		{
+			cnfbas->almacen = atoi(pchar);
+		}
+		else if(strstr(linea,"CARGAMASIVA") != NULL)
+		{
+			cnfbas->cargamasiva = atoi(pchar);
+		}
 	}
 	fclose(fdtmp);
 //	sprintf(basmaster,"%s/base/base_0/%s",pathajz,nombase);
@@ -120,6 +202,37 @@ int getConfBase(char *fileconf,CONF_BAS_t *cnfbas)
 	return 0;
 }
 
+// Funcion que retorna el codigo de apertura (ver META_t) de un codigo ECO en texto (p.e. "B20").
+// retorna 0 si no es un codigo ECO valido.
+int codigoEco(char *texto)
+{
+	if((texto[0] < 'A') || (texto[0] > 'E') || (texto[1] < '0') || (texto[1] > '9') ||
+		(texto[2] < '0') || (texto[2] > '9'))
+		return 0;
+	return((texto[0] - 'A') * 100 + (texto[1] - '0') * 10 + (texto[2] - '0') + 1);
+}
+
+// Funcion que convierte una lista de valores (0:7) separados por ',' en una mascara de bits.
+int mascaraLista(char *texto)
+{
+	int mascara = 0;
+	int valor;
+	char *pchar = texto;
+	
+	while(*pchar != 0)
+	{
+		if((*pchar >= '0') && (*pchar <= '9'))
+		{
+			valor = strtol(pchar,&pchar,10);
+			if(valor < 8)
+				mascara |= 1 << valor;
+		}
+		else
+			pchar++;
+	}
+	return mascara;
+}
+
 // Funcion para rellenar los campos de la estructura 'CONF_JOB_t' a partir
 // del fichero 'job.conf'.
 // retorna '1' si la lectura ha sido correcta y '0' en caso contrario.
@@ -143,6 +256,14 @@ int getConfJob(char *pathajz,CONF_JOB_t *cnfjob)
 	cnfjob->ganador = 0;
 	cnfjob->formasal = 0;
 	cnfjob->patron = NULL;
+	// filtro de metadatos que admite cualquier partida.
+	cnfjob->filtro.ritmos = 0xff;
+	cnfjob->filtro.terminaciones = 0xff;
+	cnfjob->filtro.ecomin = 0;
+	cnfjob->filtro.ecomax = ECOMAXIMO;
+	cnfjob->filtro.difmin = -32768;
+	cnfjob->filtro.difmax = 32767;
+	cnfjob->hayfiltro = 0;
 	while(fgets(linea,1000,fdtmp) != NULL)
 	{
 		if(strlen(linea) < 10)
@@ -179,6 +300,46 @@ int getConfJob(char *pathajz,CONF_JOB_t *cnfjob)
 			limpia(fifo);
 			cnfjob->fifo = fifo;
 		}
+		else if(strstr(linea,"RITMOJUEGO") != NULL)
+		{
+			cnfjob->filtro.ritmos = mascaraLista(pchar);
+			cnfjob->hayfiltro = 1;
+		}
+		else if(strstr(linea,"TERMINACION") != NULL)
+		{
+			cnfjob->filtro.terminaciones = mascaraLista(pchar);
+			cnfjob->hayfiltro = 1;
+		}
+		else if(strstr(linea,"ECOMIN") != NULL)
+		{
+			limpia(pchar);
+			if(((cnfjob->filtro.ecomin = codigoEco(pchar)) == 0) || (pchar[3] != 0))
+			{
+				fprintf(stderr,"Codigo ECO invalido en job.conf: %s\n",pchar);
+				exit(1);
+			}
+			cnfjob->hayfiltro = 1;
+		}
+		else if(strstr(linea,"ECOMAX") != NULL)
+		{
+			limpia(pchar);
+			if(((cnfjob->filtro.ecomax = codigoEco(pchar)) == 0) || (pchar[3] != 0))
+			{
+				fprintf(stderr,"Codigo ECO invalido en job.conf: %s\n",pchar);
+				exit(1);
+			}
+			cnfjob->hayfiltro = 1;
+		}
+		else if(strstr(linea,"DIFERENCIAMIN") != NULL)
+		{
+			cnfjob->filtro.difmin = atoi(pchar);
+			cnfjob->hayfiltro = 1;
+		}
+		else if(strstr(linea,"DIFERENCIAMAX") != NULL)
+		{
+			cnfjob->filtro.difmax = atoi(pchar);
+			cnfjob->hayfiltro = 1;
+		}
 	}
 	if((cnfjob->patron != NULL) && (cnfjob->fifo != NULL) && (cnfjob->elomax > 0) && (cnfjob->elomax >= cnfjob->elomin))
 		return 1;
@@ -17,6 +17,13 @@
 // El fichero de configuracion de base 'base.conf' define los siguientes parametros:
 //		-BASENAME= 'nombre de la base'
 //		-BASENUM = Numero de instancias de la base.
+//		-FORMATOMOV = Formato de grabacion de los movimientos (0=MOVBIN_t, 1=Compacto, 2=Archivo). Por defecto 1.
+//		-PARTBLOQUE = Partidas por bloque comprimido (0=una fila por partida). Por defecto 0.
+//		-NIVELCOMP = Nivel de compresion zlib de los bloques (0=sin comprimir ... 9). Por defecto 6.
+//		-COLUMNAR = Graba las particiones en ficheros columnares en lugar de en SQLITE (0/1). Por defecto 0.
+//		-VFSLECTURA = Lectura de las bases con el VFS de lectura secuencial (0=No, 1=Si, 2=Si con O_DIRECT sin proyeccion mmap). Por defecto 0.
+//		-ALMACEN = Almacen de las partidas (0=SQLITE, 1=Clave-valor proyectado en memoria, ver kvdrv.h). Por defecto 0.
+//		-CARGAMASIVA = Carga de las bases SQLITE sin diario e indices al final (0/1). Por defecto 0.
 //
 // El fichero 'job.conf' define los siguientes parametros:
 //		-ELOMIN= valor minimo de ELOMED a considerar en la busqueda.
@@ -25,17 +32,38 @@
 //		-FORMASAL= Formato del resultado de la busqueda (0= Imagen, 1= FEN) 
 //		-PATRON='Path al fichero de patron a buscar compilado'.
 //		-FIFO= 'nombre canal de comunicaciones para notificar progreso de la busqueda'.
+//	y opcionalmente un filtro de metadatos de las partidas (por defecto cualquiera):
+//		-RITMOJUEGO= lista separada por ',' de ritmos admitidos (0=Desconocido, 1=Bala, 2=Relampago,
+//						3=Rapida, 4=Clasica, 5=Correspondencia).
+//		-TERMINACION= lista separada por ',' de terminaciones admitidas (0=Desconocida, 1=Normal,
+//						2=Tiempo, 3=Abandono, 4=Infraccion, 5=Inconclusa).
+//		-ECOMIN= codigo ECO minimo de la apertura (p.e. B20).
+//		-ECOMAX= codigo ECO maximo de la apertura (p.e. B99).
+//						Un codigo ECO invalido (fuera de A00..E99) termina el programa.
+//		-DIFERENCIAMIN= diferencia minima de elo blancas - negras.
+//		-DIFERENCIAMAX= diferencia maxima de elo blancas - negras.
 //
 #ifndef CONFIG_H
 #define CONFIG_H
 
 #include "ajedrez.h"
 
+// Almacenes de partidas.
+#define ALMACEN_SQLITE	0
+#define ALMACEN_KV		1
+
 // Estructura de configuracion de base de datos.
 typedef struct {
 		int numbases;		// Numero de bases.
 		char *nombase;		// Nombre de las bases.
 		char *basmaster;	// Nombre de la base master (base_0).
+		int formatomov;	// Formato de grabacion de los movimientos (FORMATO_xxx).
+		int partbloque;	// Partidas por bloque comprimido (0 => sin bloques).
+		int nivelcomp;		// Nivel de compresion de los bloques.
+		int columnar;		// Particiones en ficheros columnares.
+		int vfslectura;	// VFS de lectura (0=No, 1=Si, 2=O_DIRECT).
+		int almacen;		// Almacen de las partidas (ALMACEN_xxx).
+		int cargamasiva;	// Carga masiva de las bases SQLITE.
 	} CONF_BAS_t;
 
 // Estructura de configuracion del trabajo.
@@ -46,6 +74,8 @@ typedef struct {
 		int formasal;	// formato de salida del resultado.
 		char *patron;	// Path al patron compilado a buscar.
 		char *fifo;		// Nombre canal de comunicaciones progreso.
+		FILTROMETA_t filtro;	// filtro de metadatos de las partidas.
+		int hayfiltro;	// el filtro descarta alguna partida.
 	} CONF_JOB_t;
 
 // Estructura de particion a procesar.	
@@ -60,6 +90,18 @@ typedef struct {
 // indicada.		
 extern char *getBasFromParticion(char *pathajz,CONF_BAS_t *cnfbas,int particion);
 
+// Funcion que determina el path del fichero columnar de la particion indicada,
+// situado en la carpeta de la base que le corresponde.
+extern char *getColFromParticion(char *pathajz,CONF_BAS_t *cnfbas,int fileid,int particion);
+
+// Funcion que determina el path del fichero columnar de la particion indicada dentro
+// de una carpeta de bases (base_0, base_1..).
+extern char *getColFromCarpeta(char *carpetabases,CONF_BAS_t *cnfbas,int fileid,int particion);
+
+// Funcion que determina el path del almacen clave-valor (carpeta) de la particion
+// indicada, situado en la carpeta de la base que le corresponde.
+extern char *getKvFromParticion(char *pathajz,CONF_BAS_t *cnfbas,int particion);
+
 // Funcion para rellenar los campos de la estructura 'CONF_BAS_t' a partir
 // del fichero de configuracion de base.
 // retorna '1' si la lectura ha sido correcta y '0' en caso contrario.
@@ -70,6 +112,14 @@ extern int getConfBase(char *pathajz,CONF_BAS_t *cnfbas);
 // retorna '1' si la lectura ha sido correcta y '0' en caso contrario.
 extern int getConfJob(char *pathajz,CONF_JOB_t *cnfjob);
 
+// Funcion que retorna el codigo de apertura (ver META_t) de un codigo ECO en texto (p.e. "B20").
+// retorna 0 si no es un codigo ECO valido.
+extern int codigoEco(char *texto);
+
+// Funcion que convierte una lista de valores (0:7) separados por ',' en una mascara de bits
+// (p.e. "1,3" => 0x0a).
+extern int mascaraLista(char *texto);
+
 // Funcion para rellenar la estructura 'PARTICION-t' a partir de un string
 // que indica el fileid, la particion y el indice de la base donde reside separadas por ','.
 // Este string es el que suministra el sistema de busqueda al programa buscador.
@@ -63,6 +63,8 @@ nlineas = 1
 # Valores de campos.
 fileidmin = 0
 fileidmax = 0
+elomin = 0
+elomax = 0
 salida = ''
 
 # Creacion-apertura cola de mensajes.
@@ -182,6 +184,8 @@ def es_fecha_valida(fecha_texto):
 def validar(values):
 	global fileidmin
 	global fileidmax
+	global elomin
+	global elomax
 	global salida
 	elomin = 0
 	elomax = 0
@@ -338,11 +342,11 @@ def funstart() :
 	event, values = window.read(timeout = 40)
 	funkill()
 	
-	# query a tabla particiones con fileidmin fileidmax volcando a dat/entrada.txt
+	# query a tabla particiones con fileidmin fileidmax y el rango de elo volcando a dat/entrada.txt
 	window["fase"].update("Determinando Particiones..")
 	event, values = window.read(timeout = 40)
 
-	resultado = subprocess.run('sellistapart ' + PATHAJEDREZ + '/base/base_0/'+ BASENAME + ' ' + str(fileidmin) + ' ' + str(fileidmax) + ' > ' \
+	resultado = subprocess.run('sellistapart ' + PATHAJEDREZ + '/base/base_0/'+ BASENAME + ' ' + str(fileidmin) + ' ' + str(fileidmax) + ' ' + str(elomin) + ' ' + str(elomax) + ' > ' \
 										+ PATHAJEDREZ + '/data/entrada.txt', shell=True,stderr=subprocess.PIPE, text=True)
 	if resultado.returncode == 0:		# Query OK.
 		# contamos n lineas de entrada.txt para luego calcular progreso.
@@ -5,11 +5,21 @@
 //
 // se indica el path de la base a crear y su tipo: 'master' o 'aux'. La base
 // master lleva la tabla adicional 'particiones' que contiene el 'idfile',
-// 'particion' y numero de 'base' de todas las particiones insertadas en todas las bases.
+// 'particion', numero de 'base' y rango de elomed ('elomin', 'elomax') de todas las
+// particiones insertadas en todas las bases.
+//
+// Opcionalmente se indica la version del esquema de partidas: 'v2' (por defecto) crea
+// las tablas agrupadas por clave 'cabpartidas' y 'movpartidas' (ver sqlitedrv.h) y 'v1'
+// la tabla 'partidas' original con sus indices. En ambos casos las partidas llevan sus metadatos
+// (apertura, ritmo, terminacion y diferencia de elo) antes de los movimientos.
+//
+// Con la opcion 'masiva' se crean las tablas sin indices secundarios para la carga
+// masiva (CARGAMASIVA=1 en base.conf), fich2sqlite los forma al final de la carga.
 //
 #include <stdio.h>
 #include <sqlite3.h>
 #include <string.h>
+#include "sqlitedrv.h"
 
 // sentencia SQL para crear la tabla de partidas.
 char createPartidas[] = "CREATE TABLE \"partidas\" (\
@@ -18,21 +28,36 @@ char createPartidas[] = "CREATE TABLE \"partidas\" (\
 	\"elomed\"	INTEGER,\
 	\"ganador\"	INTEGER,\
 	\"partidaid\"	INTEGER,\
+	\"eco\"	INTEGER DEFAULT 0,\
+	\"ritmo\"	INTEGER DEFAULT 0,\
+	\"terminacion\"	INTEGER DEFAULT 0,\
+	\"difelo\"	INTEGER DEFAULT 0,\
 	\"movimientos\"	BLOB)";
 	
-// sentencia SQL para crear la tabla de particiones en modo 'master'.
-char createParticiones[] = "CREATE TABLE \"particiones\" (\
+// sentencia SQL para crear la tabla de bloques comprimidos de partidas.
+char createBloques[] = "CREATE TABLE \"bloques\" (\
 	\"fileid\"	INTEGER,\
 	\"particion\"	INTEGER,\
-	\"base\"	INTEGER)";
+	\"bloque\"	INTEGER,\
+	\"elomin\"	INTEGER,\
+	\"elomax\"	INTEGER,\
+	\"ganadores\"	INTEGER,\
+	\"npartidas\"	INTEGER,\
+	\"lendatos\"	INTEGER,\
+	\"datos\"	BLOB)";
 
-// sentencia SQL para crear el indice por elomed en la tabla de partidas.
-char createIndexElo[] = "CREATE INDEX \"eloid\" ON \"partidas\" (\"elomed\"	ASC)";
+// sentencia SQL para crear la tabla de diccionarios de compresion por 'fileid'.
+char createDiccionarios[] = "CREATE TABLE \"diccionarios\" (\
+	\"fileid\"	INTEGER PRIMARY KEY,\
+	\"datos\"	BLOB)";
 
-// sentencia SQL para crear el indice por 'fileid'-'particion' en la tabla 'partidas'.
-char createIndexPart[] = "CREATE INDEX \"partid\" ON \"partidas\" (\
-	\"fileid\"	ASC,\
-	\"particion\"	ASC)";
+// sentencia SQL para crear la tabla de particiones en modo 'master'.
+char createParticiones[] = "CREATE TABLE \"particiones\" (\
+	\"fileid\"	INTEGER,\
+	\"particion\"	INTEGER,\
+	\"base\"	INTEGER,\
+	\"elomin\"	INTEGER DEFAULT 0,\
+	\"elomax\"	INTEGER DEFAULT 65535)";
 
 // sentencia SQL para crear el indice por 'fileid' en la tabla 'particiones'.
 char createIndexFech[] = "CREATE INDEX \"fechaid\" ON \"particiones\" (\"fileid\"	ASC)";	
@@ -51,11 +76,28 @@ int main(int argc, char **argv){
  sqlite3 *db;
  char *zErrMsg = 0;
  int rc;
+ int version = ESQUEMAV2;
+ int masiva = 0;
+ int i;
 
- if( argc!=3 ){
-	fprintf(stderr, "Usage: %s <pathdatabase> <master/aux>\n", argv[0]);
+ if((argc < 3) || (argc > 5)){
+	fprintf(stderr, "Usage: %s <pathdatabase> <master/aux> [v1/v2] [masiva]\n", argv[0]);
 	return(1);
  }
+ for(i=3;i<argc;i++)
+ {
+	 if(strcmp(argv[i],"v1") == 0)
+		 version = ESQUEMAV1;
+	 else if(strcmp(argv[i],"v2") == 0)
+		 version = ESQUEMAV2;
+	 else if(strcmp(argv[i],"masiva") == 0)
+		 masiva = 1;
+	 else
+	 {
+		 fprintf(stderr,"Opcion invalida=>%s\n",argv[i]);
+		 return(1);
+	 }
+ }
  // debe espeificarse 'master' o 'aux'.
  if((strstr(argv[2],"master") == NULL) && (strstr(argv[2],"aux") == NULL))
  {
@@ -69,20 +111,36 @@ int main(int argc, char **argv){
 	sqlite3_close(db);
 	return(1);
  }
- // creacion tabla 'partidas'.
- rc = sqlite3_exec(db, createPartidas, callback, 0, &zErrMsg);
- if( rc!=SQLITE_OK ){
-	fprintf(stderr, "SQL error: %s\n", zErrMsg);
-	sqlite3_free(zErrMsg);
+ if(version == ESQUEMAV2)
+ {
+	 // creacion tablas 'cabpartidas', 'movpartidas' y vista 'partidas'.
+	 if(creaTablasV2(db) == 0)
+	 {
+		 sqlite3_close(db);
+		 return(1);
+	 }
+ }
+ else
+ {
+	 // creacion tabla 'partidas'.
+	 rc = sqlite3_exec(db, createPartidas, callback, 0, &zErrMsg);
+	 if( rc!=SQLITE_OK ){
+		fprintf(stderr, "SQL error: %s\n", zErrMsg);
+		sqlite3_free(zErrMsg);
+	 }
  }
- // creacion indice ELO.
- rc = sqlite3_exec(db, createIndexElo, callback, 0, &zErrMsg);
+ // creacion tabla 'bloques'.
+ rc = sqlite3_exec(db, createBloques, callback, 0, &zErrMsg);
  if( rc!=SQLITE_OK ){
 	fprintf(stderr, "SQL error: %s\n", zErrMsg);
 	sqlite3_free(zErrMsg);
  }
- // creacion indice fileid-particion
- rc = sqlite3_exec(db, createIndexPart, callback, 0, &zErrMsg);
+ // indices ELO y fileid-particion de 'partidas' (esquema V1) y fileid-particion-bloque
+ // de 'bloques', salvo en carga masiva.
+ if(masiva == 0)
+	 creaIndices(db);
+ // creacion tabla 'diccionarios'.
+ rc = sqlite3_exec(db, createDiccionarios, callback, 0, &zErrMsg);
  if( rc!=SQLITE_OK ){
 	fprintf(stderr, "SQL error: %s\n", zErrMsg);
 	sqlite3_free(zErrMsg);
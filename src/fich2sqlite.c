@@ -18,6 +18,41 @@
 // La tabla de particiones global reside en la base_0 (master) de sqlite.
 // Esta tabla indica a cada fileid-particion en que numero de base se encuentra.
 //
+// Si la configuracion de base indica PARTBLOQUE > 0 las partidas se graban en bloques
+// comprimidos (tabla 'bloques') con un diccionario por fileid formado con una muestra
+// de las partidas de su primera particion.
+//
+// Si la configuracion de base indica COLUMNAR=1 cada particion se graba en un fichero
+// columnar (ver colpart.h) en la carpeta de la base que le corresponde en lugar de en
+// la base SQLITE. La particion se anota igualmente en la tabla de particiones master.
+//
+// Si la configuracion de base indica ALMACEN=1 las partidas se graban en el almacen
+// clave-valor (ver kvdrv.h) de la carpeta de cada base, con una transaccion por base
+// para toda la carga que solo se incorpora al almacen si la carga finaliza. La tabla
+// de particiones sigue en la base master de SQLITE.
+//
+// La carga es paralela (ver cargabase.h): el hilo principal lee las particiones del fichero
+// indexado y las pasa en memoria a un hilo escritor por base (una base por disco), que las graba con
+// transacciones de hasta LOTEPARTIDAS partidas sobre una conexion propia. Las particiones
+// se anotan en la tabla de particiones master en una sola transaccion al final de la
+// carga. Con bloques comprimidos (PARTBLOQUE > 0) la carga es secuencial, ya que el
+// bloque en formacion y el diccionario son unicos.
+//
+// Con CARGAMASIVA=1 (bases creadas con 'creabaseSqlite ... masiva') las conexiones de carga
+// trabajan sin diario y con bloqueo exclusivo, las partidas se insertan en el orden de la
+// clave y al final se forman los indices, se ejecuta ANALYZE y se comprueba que cada
+// particion tiene en su base tantas partidas como movimientos tenian en el fichero indexado.
+//
+// Los datos de cada particion se leen de data.bin con una unica lectura secuencial a memoria
+// (cargaDatos) y se recorren en el orden del indice desde ella. Las particiones mayores que
+// MAXDATOSMEM se leen por lotes de partidas anticipados en orden de offset.
+//
+// En modo incremental (cuarto argumento 'incremental') solo se cargan las particiones del fichero
+// indexado que no estan en la tabla de particiones master, de forma que al anhadir un nuevo mes
+// al fichero indexado el tiempo de carga es proporcional a los datos nuevos. Como las particiones
+// se anotan en la tabla master al final de la carga, una carga interrumpida se repite completa y
+// antes de cargar cada particion nueva se borran de su base los posibles restos.
+//
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -33,59 +68,91 @@
 #include "config.h"
 #include "sqlitedrv.h"
 #include "basfichdrv.h"
+#include "colpart.h"
+#include "kvdrv.h"
+#include "cargabase.h"
 
 int transpend = 0;	// transaccion pendiente.
 int baseopen = 0; 	// base abierta.
+uint8_t dicc[MAXDICC];	// diccionario de compresion del fileid en curso.
+int lendicc = 0;
+int fileiddicc = -1;		// fileid del diccionario.
 
-void main(int argc, char *argv[])
+CONF_BAS_t cnfbas;
+BASFICH_t bdfch;
+PARTCARGA_t *cargadas = NULL;	// particiones de la carga secuencial.
+int ncargadas = 0;
+int errcarga = 0;			// particiones con numero de partidas erroneo.
+uint8_t *nuevas = NULL;	// particiones a cargar en modo incremental (NULL => todas).
+
+//-----------------------------------------------------------
+// Carga secuencial, particion a particion.
+void cargaSerie(BASFICH_t *bdfch,char *carpetabases)
 {
-	CONF_BAS_t cnfbas;
-	char basmaster[1000];
-	BASFICH_t 	bdfch;
 	CPARTIDA_t	cabpartida;
 	MOVBIN_t		movimientos[MAXMOV];
-	PARTFICH_t 	particioncur;
 	PARTFICH_t *partfch;
 	PARTIDA_t *partidafch;
 	sqlite3 		*dbsq3 = NULL;
 	sqlite3_stmt *stmt;
-	int i = 0;
+	COLESC_t colesc;
+	BASEKV_t **basekv = NULL;
+	int i = 0,nb;
+	int npartidas,paso;
 	clock_t slot;
 	char nombastmp[1000];
 	
-	if(argc != 4)
-	{
-		fprintf(stderr,"Usage: %s <pathbasfich> <carpetabases sqlite> <base.conf>\n",argv[0]);
-		exit(1);
-	}
-	// abrimos fichero indexado.
-	if(basfichOpenR(argv[1],&bdfch ) == 0)
-	{
-		fprintf(stderr,"No puedo abrir basfich\n");
-		exit(1);
-	}
-	// cargamos configuracion de bases.
-	if(getConfBase(argv[3],&cnfbas) == 0)
+	if(cnfbas.partbloque > 0)
+		iniBloques(cnfbas.partbloque,cnfbas.nivelcomp,cnfbas.formatomov);
+	// almacen clave-valor, una transaccion de carga por base.
+	if(cnfbas.almacen == ALMACEN_KV)
 	{
-		fprintf(stderr,"Configuracion base invalida\n");
-		exit(1);
+		if((basekv = malloc(cnfbas.numbases * sizeof(BASEKV_t *))) == NULL)
+			exit(2);
+		for(nb=0;nb<cnfbas.numbases;nb++)
+		{
+			sprintf(nombastmp,"%s/base_%01d/%s.kv",carpetabases,nb,cnfbas.nombase);
+			basekv[nb] = conectaKv(nombastmp);
+			beginTransKv(basekv[nb],cnfbas.formatomov);
+		}
 	}
-	sprintf(basmaster,"%s/base_0/%s",argv[2],cnfbas.nombase);
-	cnfbas.basmaster = basmaster;
-	
-	
-//	conectaSqlite(&dbsq3,argv[2]);
-//	beginTransW(dbsq3,&stmt);
 	
 	// iteramos por particiones.
-	for(partfch=bdfch.particiones;((uint8_t *)partfch - (uint8_t *)(bdfch.particiones)) < bdfch.lenparticiones;partfch++)
+	for(partfch=bdfch->particiones;((uint8_t *)partfch - (uint8_t *)(bdfch->particiones)) < bdfch->lenparticiones;partfch++)
 	{
-		cargaPartidas(&bdfch,partfch);
+		// formamos el diccionario del fileid con una muestra de sus partidas.
+		if((cnfbas.partbloque > 0) && (cnfbas.columnar == 0) && (cnfbas.almacen == ALMACEN_SQLITE) && (partfch->fileid != fileiddicc))
+		{
+			cargaPartidas(bdfch,partfch);
+			iniDiccionario();
+			npartidas = bdfch->lenpartidas / sizeof(PARTIDA_t);
+			paso = npartidas / MUESTRADICC + 1;
+			for(partidafch=bdfch->partidas;partidafch < (bdfch->partidas + npartidas);partidafch += paso)
+			{
+				loadPartida(bdfch,partidafch,&cabpartida,movimientos);
+				muestraDiccionario(&cabpartida,movimientos);
+			}
+			lendicc = generaDiccionario(dicc);
+			fileiddicc = partfch->fileid;
+		}
+		// en modo incremental solo se cargan las particiones nuevas.
+		if((nuevas != NULL) && (nuevas[partfch - bdfch->particiones] == 0))
+			continue;
+		cargaPartidas(bdfch,partfch);
+		cargaDatos(bdfch);
+		cargadas[ncargadas].fileid = partfch->fileid;
+		cargadas[ncargadas].particion = partfch->particion;
+		cargadas[ncargadas].esperadas = 0;
+		cargadas[ncargadas].elomin = partfch->elomin;
+		cargadas[ncargadas].elomax = partfch->elomax;
+		ncargadas++;
 		
-		// cerramos posible transaccion y base abierta,anotamos particion en tabla particiones de la base master
-		// abrimos la base correspondiente a la nueva particion y comenzamos nueva transaccion. 
+		// cerramos posible transaccion y base abierta, abrimos la base correspondiente a la nueva
+		// particion y comenzamos nueva transaccion.
 		if(transpend)
 		{
+			if(cnfbas.partbloque > 0)
+				cierraBloque(dbsq3,stmt);
 			endTransW(dbsq3,stmt);
 			transpend = 0;
 		}
@@ -94,21 +161,54 @@ void main(int argc, char *argv[])
 			desconectaSqlite(dbsq3);
 			baseopen = 0;
 		}
-		conectaSqlite(&dbsq3,cnfbas.basmaster);
-		baseopen = 1;
-		insertaParticion(dbsq3,partfch->fileid,partfch->particion,partfch->particion % cnfbas.numbases);
-		desconectaSqlite(dbsq3);
-		baseopen = 0;
-		sprintf(nombastmp,"%s/base_%01d/%s",argv[2],partfch->particion % cnfbas.numbases,cnfbas.nombase);
+		// particion en fichero columnar.
+		if(cnfbas.columnar)
+		{
+			if(iniColumnar(&colesc,getColFromCarpeta(carpetabases,&cnfbas,partfch->fileid,partfch->particion),bdfch->lenpartidas / sizeof(PARTIDA_t),cnfbas.formatomov,partfch->fileid,partfch->particion) == 0)
+				exit(1);
+			for(partidafch=bdfch->partidas;((uint8_t *)partidafch - (uint8_t *)(bdfch->partidas)) < bdfch->lenpartidas;partidafch++)
+			{
+				loadPartida(bdfch,partidafch,&cabpartida,movimientos);
+				anhadeColumnar(&colesc,&cabpartida,movimientos);
+				i++;
+			}
+			cierraColumnar(&colesc);
+			continue;
+		}
+		// particion en el almacen clave-valor de su base.
+		if(cnfbas.almacen == ALMACEN_KV)
+		{
+			for(partidafch=bdfch->partidas;((uint8_t *)partidafch - (uint8_t *)(bdfch->partidas)) < bdfch->lenpartidas;partidafch++)
+			{
+				loadPartida(bdfch,partidafch,&cabpartida,movimientos);
+				vuelcaPartKv(basekv[partfch->particion % cnfbas.numbases],&cabpartida,movimientos,partfch->fileid,partfch->particion);
+				i++;
+			}
+			continue;
+		}
+		sprintf(nombastmp,"%s/base_%01d/%s",carpetabases,partfch->particion % cnfbas.numbases,cnfbas.nombase);
 		conectaSqlite(&dbsq3,nombastmp);
 		baseopen = 1;
-		beginTransW(dbsq3,&stmt);
+		if(cnfbas.cargamasiva)
+			modoCargaMasiva(dbsq3);
+		if(cnfbas.partbloque > 0)
+		{
+			ponDiccionario(dbsq3,partfch->fileid,dicc,lendicc);
+			beginTransB(dbsq3,&stmt);
+		}
+		else
+			beginTransW(dbsq3,&stmt);
 		transpend = 1;
 		// iteramos por las partidas de la particion en curso.
-		for(partidafch=bdfch.partidas;((uint8_t *)partidafch - (uint8_t *)(bdfch.partidas)) < bdfch.lenpartidas;partidafch++)
+		for(partidafch=bdfch->partidas;((uint8_t *)partidafch - (uint8_t *)(bdfch->partidas)) < bdfch->lenpartidas;partidafch++)
 		{
-			loadPartida(&bdfch,partidafch,&cabpartida,movimientos);
-			vuelcaPart(dbsq3,stmt,&cabpartida,movimientos,partfch->fileid,partfch->particion);
+			loadPartida(bdfch,partidafch,&cabpartida,movimientos);
+			if(cabpartida.nmov > 0)
+				cargadas[ncargadas - 1].esperadas++;
+			if(cnfbas.partbloque > 0)
+				vuelcaPartB(dbsq3,stmt,&cabpartida,movimientos,partfch->fileid,partfch->particion);
+			else
+				vuelcaPart(dbsq3,stmt,&cabpartida,movimientos,partfch->fileid,partfch->particion,cnfbas.formatomov);
 			i++;
 			// mostramos periodicamente el progreso.
 			if(TIEMPO != slot)
@@ -122,7 +222,167 @@ void main(int argc, char *argv[])
 	//	beginTransW(dbsq3,&stmt);
 	}
 	// finalizamos la ultima transaccion y cerramos las bases.
-	endTransW(dbsq3,stmt);
+	if(transpend)
+	{
+		if(cnfbas.partbloque > 0)
+			cierraBloque(dbsq3,stmt);
+		endTransW(dbsq3,stmt);
+	}
+	if(baseopen)
+		desconectaSqlite(dbsq3);
+	if(cnfbas.almacen == ALMACEN_KV)
+	{
+		for(nb=0;nb<cnfbas.numbases;nb++)
+			endTransKv(basekv[nb]);
+		cierraAlmacenes();
+		free(basekv);
+	}
+	else if((cnfbas.cargamasiva) && (cnfbas.columnar == 0))
+	{
+		for(nb=0;nb<cnfbas.numbases;nb++)
+		{
+			sprintf(nombastmp,"%s/base_%01d/%s",carpetabases,nb,cnfbas.nombase);
+			conectaSqlite(&dbsq3,nombastmp);
+			modoCargaMasiva(dbsq3);
+			errcarga += finCargaMasiva(dbsq3,nb,&cnfbas,cargadas,ncargadas);
+			desconectaSqlite(dbsq3);
+		}
+	}
+	// anotamos las particiones cargadas en la tabla de particiones master en una sola transaccion.
+	conectaSqlite(&dbsq3,cnfbas.basmaster);
+	sqlite3_exec(dbsq3,"BEGIN TRANSACTION",NULL,NULL,NULL);
+	for(i=0;i<ncargadas;i++)
+		insertaParticion(dbsq3,cargadas[i].fileid,cargadas[i].particion,cargadas[i].particion % cnfbas.numbases,
+								cargadas[i].elomin,cargadas[i].elomax);
+	sqlite3_exec(dbsq3,"END TRANSACTION",NULL,NULL,NULL);
 	desconectaSqlite(dbsq3);
+}
+
+//-----------------------------------------------------------
+// Funcion que carga en memoria las partidas de la particion en curso del fichero indexado.
+PARTMEM_t *leeParticion(BASFICH_t *bdfch,PARTFICH_t *partfch)
+{
+	CPARTIDA_t	cabpartida;
+	MOVBIN_t		movimientos[MAXMOV];
+	PARTMEM_t *pm;
+	PARTIDA_t *partidafch;
+
+	cargaPartidas(bdfch,partfch);
+	cargaDatos(bdfch);	// zona de data.bin de la particion en memoria con una lectura secuencial.
+	pm = nuevaParticionMem(partfch->fileid,partfch->particion);
+	pm->ordenada = 1;		// el fichero indexado ya esta ordenado por elomed, ganador.
+	for(partidafch=bdfch->partidas;((uint8_t *)partidafch - (uint8_t *)(bdfch->partidas)) < bdfch->lenpartidas;partidafch++)
+	{
+		loadPartida(bdfch,partidafch,&cabpartida,movimientos);
+		anhadePartidaMem(pm,&cabpartida,movimientos);
+	}
+	return pm;
+}
+
+//-----------------------------------------------------------
+// Carga paralela, un hilo escritor por base.
+void cargaParalela(BASFICH_t *bdfch,char *carpetabases)
+{
+	PARTFICH_t *partfch;
+	PARTMEM_t *pm;
+	int npart,i = 0;
+	clock_t slot;
+
+	iniCarga(&cnfbas,carpetabases);
+	// el hilo principal lee las particiones y las reparte entre los escritores.
+	slot = TIEMPO;
+	npart = bdfch->lenparticiones / sizeof(PARTFICH_t);
+	for(partfch=bdfch->particiones;partfch < (bdfch->particiones + npart);partfch++)
+	{
+		if((nuevas != NULL) && (nuevas[partfch - bdfch->particiones] == 0))
+			continue;
+		pm = leeParticion(bdfch,partfch);
+		i += pm->npartidas;
+		cargaParticion(pm);
+		// mostramos periodicamente el progreso.
+		if(TIEMPO != slot)
+		{
+			slot = TIEMPO;
+			printf("PART=>%d\r",i);
+			fflush(stdout);
+		}
+	}
+	errcarga += finCarga();
+}
+
+//-----------------------------------------------------------
+// Funcion que marca las particiones del fichero indexado que no estan en la tabla de particiones
+// master (modo incremental) y borra de su base los restos de una posible carga interrumpida.
+// retorna el numero de particiones nuevas.
+int marcaNuevas(BASFICH_t *bdfch,char *carpetabases)
+{
+	PARTFICH_t *partfch;
+	sqlite3 *dbmaster,*dbsq3;
+	char nombastmp[1000];
+	int ind,npart,nnuevas = 0;
+
+	npart = bdfch->lenparticiones / sizeof(PARTFICH_t);
+	if((nuevas = calloc(npart + 1,1)) == NULL)
+		exit(2);
+	conectaSqlite(&dbmaster,cnfbas.basmaster);
+	for(ind=0,partfch=bdfch->particiones;ind<npart;ind++,partfch++)
+	{
+		if(existeParticion(dbmaster,partfch->fileid,partfch->particion))
+			continue;
+		nuevas[ind] = 1;
+		nnuevas++;
+		if((cnfbas.columnar == 0) && (cnfbas.almacen == ALMACEN_SQLITE))
+		{
+			sprintf(nombastmp,"%s/base_%01d/%s",carpetabases,partfch->particion % cnfbas.numbases,cnfbas.nombase);
+			conectaSqlite(&dbsq3,nombastmp);
+			borraParticion(dbsq3,partfch->fileid,partfch->particion);
+			desconectaSqlite(dbsq3);
+		}
+	}
+	desconectaSqlite(dbmaster);
+	return nnuevas;
+}
+
+void main(int argc, char *argv[])
+{
+	char basmaster[1000];
+
+	if((argc != 4) && ((argc != 5) || strcmp(argv[4],"incremental")))
+	{
+		fprintf(stderr,"Usage: %s <pathbasfich> <carpetabases sqlite> <base.conf> [incremental]\n",argv[0]);
+		exit(1);
+	}
+	// abrimos fichero indexado.
+	if(basfichOpenR(argv[1],&bdfch ) == 0)
+	{
+		fprintf(stderr,"No puedo abrir basfich\n");
+		exit(1);
+	}
+	// cargamos configuracion de bases.
+	if(getConfBase(argv[3],&cnfbas) == 0)
+	{
+		fprintf(stderr,"Configuracion base invalida\n");
+		exit(1);
+	}
+	sprintf(basmaster,"%s/base_0/%s",argv[2],cnfbas.nombase);
+	cnfbas.basmaster = basmaster;
+	if((cargadas = calloc(bdfch.lenparticiones / sizeof(PARTFICH_t) + 1,sizeof(PARTCARGA_t))) == NULL)
+		exit(2);
+	// en modo incremental solo se cargan las particiones que no estan en la tabla master.
+	if(argc == 5)
+		printf("Particiones nuevas=>%d de %ju\n",marcaNuevas(&bdfch,argv[2]),(uintmax_t)(bdfch.lenparticiones / sizeof(PARTFICH_t)));
+	// los bloques comprimidos se cargan secuencialmente, igual que si la libreria
+	// SQLITE no admite hilos.
+	if((cnfbas.partbloque > 0) && (cnfbas.columnar == 0) && (cnfbas.almacen == ALMACEN_SQLITE))
+		cargaSerie(&bdfch,argv[2]);
+	else if(sqlite3_threadsafe() == 0)
+		cargaSerie(&bdfch,argv[2]);
+	else
+		cargaParalela(&bdfch,argv[2]);
 	basfichClose(&bdfch);
+	if(errcarga)
+	{
+		fprintf(stderr,"Carga masiva con %d errores\n",errcarga);
+		exit(3);
+	}
 }
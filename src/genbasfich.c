@@ -51,22 +51,60 @@
 // La informacion de salida se graba en un fichero indexado.
 //
 // La información de entrada se divide en particiones que constan de un maximo de un millon de partidas. En explotación
-// cada partición se enviara a un proceso de tratamiento distinto. Se crea un fichero  indice con los campos de fileID
-// y partición para poder hacer busquedas y selecciones por este concepto. Al final de la generacion este fichero esta
-// ordenado por estos conceptos.
+// cada partición se enviara a un proceso de tratamiento distinto. La politica de particion es configurable: numero
+// de partidas ('-pN'), megabytes de datos ('-bN') o miles de movimientos ('-mN') por particion, cerrandose al
+// alcanzar el primer limite; los dos ultimos equilibran el tiempo de tratamiento de las particiones. Con bandas
+// de elo ('-eE1,E2..', p.e. -e1500,2000,2400) las partidas se reparten en particiones por banda de elomed, cada
+// particion anota su rango de elomed y las busquedas por elo solo tratan las particiones que lo cortan.
+// Se crea un fichero  indice con los campos de fileID y partición para poder hacer busquedas y selecciones por este
+// concepto. Al final de la generacion este fichero esta ordenado por estos conceptos.
 //
 // Se crea otro fichero de indices (partidas) con un indice por cada partida que contiene los campos ELO-medio y ganador
 // Estos indices se ordenan por cada particon por estos dos conceptos.
 //
 // El conjunto de los dos ficheros de indices permite buscar y seleccionar una partida por fileid, particion, ELOmed y ganador.
 //
+// De los metadatos se recogen ademas la apertura (ECO), el ritmo de juego (TimeControl), el tipo de terminacion
+// (Termination) y la diferencia de elo entre blancas y negras. Se anotan en la cabecera de partida y en su indice
+// (ver META_t en ajedrez.h) para que las busquedas filtren por ellos sin leer los movimientos.
+//
 // El fichero de indices de particion indica por cada particion el offset en el fichero indice de partida donde
 // comienzan las partidas de esta particion  y la longitud de esta.
 //
 // El fichero de indices de partidas indica el offset en el fichero de datos donde comienza cada partida y su longitud.
 //
 // El fichero de datos contiene en binario por cada partida la cabecera de partida y su lista de movimientos.
+// Al cerrar cada particion sus datos se reescriben en el orden de sus indices para que su lectura sea secuencial.
+//
+// Modo directo: si se indican la carpeta de las bases y su fichero de configuracion, las partidas de la
+// particion en curso se acumulan tambien en memoria y al completarse la particion se entregan al escritor
+// de su base (ver cargabase.h), que las ordena por elomed, ganador y las inserta. La carga de las bases no
+// necesita entonces el paso por fich2sqlite y el fichero indexado es opcional (path '-' => no se genera).
+//
+// El fichero indexado puede contener varios fileid: cada ejecucion anhade el suyo al final sin reescribir
+// lo anterior y al completarlo lo anota en el manifiesto del fichero indexado. Una nueva ejecucion descarta
+// lo grabado por una ejecucion interrumpida y no hace nada si el fileid ya esta anotado en el manifiesto
+// (o en la tabla de particiones master en la carga directa, que antes de repetirse borra de las bases los
+// restos del fileid), de forma que repetirla es inocuo.
+//
+// Modo paralelo ('-hN'): la entrada se corta en trozos de muchas partidas que interpretan N hilos, cada
+// uno con su propio tablero virtual, y se vuelcan en el orden de la entrada (ver interpretaParalelo).
+// '-kN' fija el tamanho minimo de los trozos en N KB (las pruebas lo bajan para tener varios trozos).
+//
+// Filtros de ingesta: las partidas que no interesan a las busquedas (abortadas, sin elo, terminaciones
+// anormales..) pueden descartarse antes de volcarlas: jugadas minimas ('-nN', el enroque cuenta una), elo medio minimo ('-aN'),
+// terminaciones admitidas ('-tT1,T2..', TERMINA_xxx) y ritmos admitidos ('-rR1,R2..', RITMO_xxx). Al final se
+// informa de las partidas descartadas por cada filtro y con '-dfichero' se anota en el fichero una linea por
+// cada partida descartada (indice en el PGN, filtro, movimientos, elo medio, ritmo y terminacion).
+//
+// Las partidas se anhaden al fichero indexado a traves de sus buffers de escritura diferida, que se vuelcan
+// al cerrar cada particion. Con '-s' cada particion cerrada se sincroniza ademas en disco (fdatasync).
+//
+// La entrada se lee por bloques y la seccion de movimientos de cada partida se recorre en el propio
+// buffer de lectura, saltando comentarios, variantes y anotaciones sin copiarlos (ver siguienteElem).
+// Si la CPU dispone de AVX2 la busqueda de finales de movimiento y parentesis compara 32 caracteres a la vez.
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -74,11 +112,113 @@
 #include <errno.h>
 #include <string.h>
 #include <stdint.h>
+#include <pthread.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 #include "ajedrez.h"
 #include "basfichdrv.h"
+#include "codmov.h"
+#include "config.h"
+#include "sqlitedrv.h"
+#include "cargabase.h"
 
 
 #define MAGIC	0x55AA
+#define TAMTROZO	(4*1024*1024)	// tamanho minimo de un trozo de la entrada en modo paralelo.
+#define MAXBANDAS	16					// bandas de elo de las particiones.
+#define LENBLOQUE	(4*1024*1024)	// lectura de la entrada por bloques.
+
+// filtros de ingesta, en el orden en que se comprueban.
+#define DESCARTE_PLIES			0	// menos movimientos que el minimo.
+#define DESCARTE_ELO				1	// elo medio menor que el minimo.
+#define DESCARTE_TERMINACION	2	// terminacion no admitida.
+#define DESCARTE_RITMO			3	// ritmo no admitido.
+#define NDESCARTES				4
+
+#define CASILLA(c)	((uint64_t)1 << (c))				// bit de una casilla del tablero.
+#define COLUMNA(x)	((uint64_t)0x0101010101010101 << (x))	// casillas de una columna.
+#define FILA(y)		((uint64_t)0xff << ((y) * 8))			// casillas de una fila.
+
+// estados de un trozo de la entrada en modo paralelo.
+#define TROZO_LIBRE		0
+#define TROZO_PENDIENTE	1	// pendiente de interpretar.
+#define TROZO_HECHO		2	// interpretado, pendiente de volcar.
+
+// clases de caracteres de la seccion de movimientos.
+#define CAR_SEP	1	// separador de movimientos: blanco y finales de linea.
+#define CAR_ZONA	2	// comienzo de zona a saltar: comentario '{', variante '(' o anotacion '$'.
+#define CAR_PAR	4	// parentesis de variante.
+
+// fuente de lineas PGN: fichero leido por bloques o trozo de la entrada en memoria (fd == NULL).
+typedef struct {
+	FILE		*fd;
+	char		*buf;			// bloques leidos del fichero.
+	int		max;
+	char		*pos;			// siguiente linea.
+	char		*fin;			// final de los datos.
+	int		lenlin;		// longitud de la ultima linea leida.
+} FUENTE_t;
+
+// enroques.
+#define ENROQUE_CORTO	1
+#define ENROQUE_LARGO	2
+
+// movimiento SAN decodificado.
+typedef struct {
+	uint8_t	enroque;		// ENROQUE_xxx (0 => no es enroque).
+	uint8_t	pieza;		// pieza sin color, PEON si no se indica (INVAL => movimiento invalido).
+	uint8_t	orgx,orgy;	// columna y fila de origen indicadas (-1 => no indicada).
+	uint8_t	dest;
+	uint8_t	come;			// el movimiento come una pieza ('x').
+	uint8_t	promo;		// pieza de promocion (0 => no hay, INVAL => invalida).
+} SAN_t;
+
+// seccion de movimientos de una partida, en el buffer de la fuente.
+typedef struct {
+	char		*pos;			// siguiente caracter a analizar.
+	char		*fin;
+} SECMOV_t;
+
+// trozo de la entrada PGN para los interpretes del modo paralelo.
+typedef struct {
+	char		*texto;
+	int		len;
+	int		max;
+	int		base;			// lineas '[Event ' anteriores al trozo.
+	int		elo1,elo2;	// ELOs al comienzo del trozo, los arrastra la partida anterior.
+	uint64_t	nmovs;		// movimientos interpretados.
+	PARTMEM_t	*res;		// partidas interpretadas.
+	int		estado;		// TROZO_xxx.
+} TROZO_t;
+
+TROZO_t	*trozos;				// trozos en curso (modo paralelo).
+int		ntrozos;
+int		tamtrozo = TAMTROZO;	// '-kN' => trozos de al menos N KB.
+int		producidos = 0;	// trozos entregados a los interpretes.
+int		asignados = 0;		// trozos tomados por los interpretes.
+int		finentrada = 0;	// no hay mas trozos.
+pthread_mutex_t mutextrozos = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t condtrozos = PTHREAD_COND_INITIALIZER;
+
+// tablas precalculadas de ataques (ver iniTablas).
+const int saltocab[8][2] = {{1,2},{2,1},{2,-1},{1,-2},{-1,-2},{-2,-1},{-2,1},{-1,2}};	// saltos de caballo (x,y).
+const int dirrayo[8][2] = {{1,0},{0,1},{-1,0},{0,-1},{1,1},{-1,1},{-1,-1},{1,-1}};		// filas y columnas, y diagonales.
+uint64_t	ataquecab[64];		// casillas atacadas por un caballo en cada casilla.
+uint64_t	rayos[8][64];		// casillas desde cada casilla hasta el borde en cada direccion.
+uint64_t	lineatorre[64];	// casillas en la misma fila o columna.
+uint64_t	lineaalfil[64];	// casillas en las mismas diagonales.
+uint64_t	entre[64][64];		// casillas entre dos casillas alineadas (0 => no alineadas o contiguas).
+
+// pieza indicada por cada caracter de un movimiento SAN (0 => no indica pieza).
+const uint8_t piezasan[256] = {['K'] = REY, ['Q'] = REINA, ['R'] = TORRE, ['B'] = ALFIL, ['N'] = CABALLO};
+
+// clase de cada caracter en la seccion de movimientos (CAR_xxx).
+const uint8_t clasecar[256] = {
+	[' '] = CAR_SEP, ['\n'] = CAR_SEP, ['\r'] = CAR_SEP,
+	['{'] = CAR_ZONA, ['$'] = CAR_ZONA, ['('] = CAR_ZONA | CAR_PAR, [')'] = CAR_PAR
+};
+int		conavx2 = 0;		// la CPU dispone de AVX2 para la busqueda en la seccion de movimientos.
 	
 int particion;							// N. particion actual.
 int particionant;						// N. Particion anterior.
@@ -86,19 +226,62 @@ PARTFICH_t particioncur;			// datos particion en curso
 
 // Registro de partida. Consiste en una cabecera de partida seguida por un array de movimientos
 // El numero de movimientos en el array esta indicado en cabpartida.nmov.
-CPARTIDA_t	cabpartida;
-MOVBIN_t		movimientos[MAXMOV];
+// El estado de la partida en interpretacion es propio de cada hilo (modo paralelo).
+__thread CPARTIDA_t	cabpartida;
+__thread MOVBIN_t		movimientos[MAXMOV];
+uint8_t		movcod[MAXMOV * sizeof(MOVBIN_t)];	// movimientos codificados para grabar.
+int			formatomov = FORMATO_COMPACTO;			// formato de grabacion de los movimientos.
+
+int			confich = 1;		// genera el fichero indexado.
+int			directa = 0;		// carga directa de las bases.
+int			sincroniza = 0;	// '-s' => fdatasync del fichero indexado al cerrar cada particion.
+CONF_BAS_t	cnfbas;				// configuracion de las bases (carga directa).
+PARTMEM_t	*pmcur = NULL;		// particion en curso en memoria (carga directa).
+
+BASFICH_t	bd;					// fichero indexado de salida.
+int			fileid;				// identificador del fichero origen.
+// politica de particion: una particion se cierra al alcanzar el primero de los limites. Con bandas de
+// elo cada banda tiene su particion en curso, que se acumula en memoria y se vuelca completa al cerrarla.
+typedef struct {
+	int			npartida;			// partidas en la particion en curso.
+	uint64_t		bytes;				// bytes de data.bin de la particion en curso.
+	uint64_t		plies;				// movimientos de la particion en curso.
+	PARTMEM_t	*pm;					// particion en curso en memoria (solo con bandas).
+} BANDA_t;
+
+int			maxpartidas = 1000000;	// '-pN' partidas por particion.
+uint64_t		maxbytes = 0;				// '-bN' megabytes de data.bin por particion (0 => sin limite).
+uint64_t		maxplies = 0;				// '-mN' miles de movimientos por particion (0 => sin limite).
+int			nbandas = 1;				// '-eE1,E2..' bandas de elomed: < E1, E1..E2-1, .., >= En.
+int			limbanda[MAXBANDAS];		// elomed inicial de las bandas 1..nbandas-1.
+BANDA_t		bandas[MAXBANDAS];
+int			nparticion = 0;			// siguiente numero de particion (con bandas).
+uint64_t		movemitidos = 0;	// movimientos volcados.
+
+// filtros de ingesta: las partidas que no los cumplen no se vuelcan (ver filtraPartida).
+int			minplies = 0;				// '-nN' jugadas (plies) minimas, el enroque cuenta una.
+int			minelo = 0;					// '-aN' elo medio minimo.
+int			terminaadm = 0xff;		// '-tT1,T2..' mascara de terminaciones admitidas (bit TERMINA_xxx).
+int			ritmosadm = 0xff;			// '-rR1,R2..' mascara de ritmos admitidos (bit RITMO_xxx).
+FILE			*fddescarte = NULL;		// '-dfichero' partidas descartadas.
+int			descartes[NDESCARTES];	// partidas descartadas por cada filtro.
+const char	*nomdescarte[NDESCARTES] = {"plies","elo","terminacion","ritmo"};
 
-int partidas = 0;		// Indice de partida en curso.
-int npgn;				// numero de movimiento en partida.
-char gpgn[100];		// texto movimiento
-char gpgna[100];		// texto movimiento anterior.
+__thread int partidas = 0;		// Indice de partida en curso.
+__thread int npgn;				// numero de movimiento en partida.
+#ifdef TRAZAPGN
+__thread char *gpgn;				// texto movimiento (en el buffer de entrada), solo para las trazas.
+__thread int lpgn;
+__thread char *gpgna;			// texto movimiento anterior.
+__thread int lpgna;
+#endif
 
 // inicia las estructuras de partida binaria.
 void iniPart(void)
 {
 	memset(&cabpartida,0,sizeof(cabpartida));
 	cabpartida.magic = MAGIC;
+	cabpartida.formato = formatomov;
 }
 
 // funcion para anhadir un movimiento a la lista de movimientos recodificados
@@ -109,20 +292,44 @@ void anadeMov(MOVBIN_t mov)
 	cabpartida.nmov++;
 }
 
+// funcion para pasar la partida en curso a la particion en memoria de la carga directa. Al cambiar
+// de particion la anterior, ya completa, se entrega al escritor de su base.
+void vuelcaPartMem(int fileid)
+{
+	if((pmcur != NULL) && (pmcur->particion != particion))
+	{
+		cargaParticion(pmcur);
+		pmcur = NULL;
+	}
+	if(pmcur == NULL)
+		pmcur = nuevaParticionMem(fileid,particion);
+	anhadePartidaMem(pmcur,&cabpartida,movimientos);
+}
+
 // funcion para volcar al fichero indexado la partida en curso ya recodificada.
-void vuelcaPart(BASFICH_t *bd,int fileid)
+void vuelcaPartFich(BASFICH_t *bd,int fileid)
 {
 	PARTIDA_t partmp;
 	off_t offtmp;
+	uint64_t offpar,offmov;
+	int lenmov;
 	
 	if(particion != particionant)	// Cambio de particion
 	{
-		offtmp = lseek(bd->fdpartidas,0,SEEK_END);
+		offtmp = bd->finpartidas;	// longitud de campos.id incluido lo pendiente de volcar.
 		if(particionant >= 0)		// No primera particion
 		{
-			particioncur.len = offtmp - particioncur.offset;	// Anota longitud particion
-			anhadeParticion(bd,&particioncur);						// anhade particion
-			ordenaPartidas(bd,fileid,particioncur.particion);	// ordena partidas de esta particion
+			// ordena sus partidas, reordena sus datos en data.bin y la anhade a particiones.
+			if(!cierraParticion(bd,&particioncur))
+			{
+				fprintf(stderr,"Fallo escritura particion %d\n",particioncur.particion);
+				exit(4);
+			}
+			if(sincroniza && !sincronizaBasfich(bd))				// particion en disco.
+			{
+				fprintf(stderr,"Fallo sincronizacion fichero indexado\n");
+				exit(4);
+			}
 		}
 		// inicia nueva particion.
 		particioncur.fileid = fileid;
@@ -144,19 +351,26 @@ void vuelcaPart(BASFICH_t *bd,int fileid)
 	// Rellena datos indice partida actual.
 	partmp.elomed = cabpartida.elomed;
 	partmp.flags = 0;
-	partmp.offset = lseek(bd->fddata,0,SEEK_END);
-	// Escribe datos partida y movimientos.
-	if(write(bd->fddata,&cabpartida,sizeof(cabpartida)) != sizeof(cabpartida))
+	partmp.meta = cabpartida.meta;
+	partmp.difelo = cabpartida.difelo;
+	// Escribe datos partida y movimientos (a traves del buffer de escritura del fichero indexado).
+	if(!anhadeDatos(bd,&cabpartida,sizeof(cabpartida),&offpar))
 	{
 		fprintf(stderr,"Fallo escritura cabpartida\n");
 		exit(4);
 	}
-	if(write(bd->fddata,movimientos,sizeof(MOVBIN_t) * cabpartida.nmov) != (sizeof(MOVBIN_t) * cabpartida.nmov))
+	partmp.offset = offpar;
+	lenmov = codificaMovs(movimientos,cabpartida.nmov,cabpartida.formato,movcod);
+	if(!anhadeDatos(bd,movcod,lenmov,&offmov))
 	{
 		fprintf(stderr,"Fallo escritura movimientos\n");
 		exit(4);
 	}
-	anhadePartida(bd,&partmp);	// Anhade partida a indices partidas.
+	if(!anhadePartida(bd,&partmp))	// Anhade partida a indices partidas.
+	{
+		fprintf(stderr,"Sin memoria para los indices de la particion %d\n",particion);
+		exit(4);
+	}
 }
 
 // Funcion para mostrar trazas de debug.
@@ -168,309 +382,129 @@ void debug(char *mensa,int nivel,MOV_t *mov,TABLERO_t *tab)
 		return;
 	
 	printf("\n%s\n",mensa);
-	printf("Part=>%d, MOV=>%d, %s-%s\n",partidas,npgn,gpgna,gpgn);
+#ifdef TRAZAPGN
+	printf("Part=>%d, MOV=>%d, %.*s-%.*s\n",partidas,npgn,lpgna,gpgna,lpgn,gpgn);
+#else
+	printf("Part=>%d, MOV=>%d\n",partidas,npgn);
+#endif
 	printf("MORG=>%d, MDEST=>%d, PIEZA=>%d\n",mov->org,mov->dest,mov->pieza);
 }
 
-// inicia partida.
-// Inicia las estructuras de posicion de las piezas y el tablero virtual.
-void iniciaJuego(TABLERO_t *tab)
-{
-	memcpy(tab->tab,tablaini,sizeof(tablaini));
-	tab->blancas.rey = 60;
-	tab->blancas.reina[0] = 59;
-	tab->blancas.nreina = 1;
-	tab->blancas.torre[0] = 56;
-	tab->blancas.torre[1] = 63;
-	tab->blancas.ntorre = 2;
-	tab->blancas.alfil[0] = 58;
-	tab->blancas.alfil[1] = 61;
-	tab->blancas.nalfil = 2;
-	tab->blancas.caballo[0] = 57;
-	tab->blancas.caballo[1] = 62;
-	tab->blancas.ncaballo = 2;
-	tab->blancas.peon[0] = 48;
-	tab->blancas.peon[1] = 49;
-	tab->blancas.peon[2] = 50;
-	tab->blancas.peon[3] = 51;
-	tab->blancas.peon[4] = 52;
-	tab->blancas.peon[5] = 53;
-	tab->blancas.peon[6] = 54;
-	tab->blancas.peon[7] = 55;
-	tab->blancas.npeon = 8;
-	
-	tab->negras.rey = 4;
-	tab->negras.reina[0] = 3;
-	tab->negras.nreina = 1;
-	tab->negras.torre[0] = 0;
-	tab->negras.torre[1] = 7;
-	tab->negras.ntorre = 2;
-	tab->negras.alfil[0] = 2;
-	tab->negras.alfil[1] = 5;
-	tab->negras.nalfil = 2;
-	tab->negras.caballo[0] = 1;
-	tab->negras.caballo[1] = 6;
-	tab->negras.ncaballo = 2;
-	tab->negras.peon[0] = 8;
-	tab->negras.peon[1] = 9;
-	tab->negras.peon[2] = 10;
-	tab->negras.peon[3] = 11;
-	tab->negras.peon[4] = 12;
-	tab->negras.peon[5] = 13;
-	tab->negras.peon[6] = 14;
-	tab->negras.peon[7] = 15;
-	tab->negras.npeon = 8;
-}
-
-// Elimina una pieza de las estructuras correspondientes a piezas activas.
-void eliminaPieza(uint8_t pieza,uint8_t posicion,TABLERO_t *tab)
+// Funcion que inicia las tablas precalculadas de ataques: casillas que ataca un caballo, rayos en
+// cada direccion hasta el borde del tablero y casillas entre dos casillas alineadas.
+void iniTablas(void)
 {
-	int i;
-	PIEZAS_t *piezas;
+	int c,d,x,y,i;
+	uint64_t acum;
 	
-	// determina color.
-	if(pieza & NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;
-		
-	// Modifica la lista correspondiente a la pieza eliminada.
-	switch(pieza & 0x7)
-	{
-		case REINA:
-			// localiza la pieza a eliminar en la lista.
-			for(i=0;i<piezas->nreina;i++)
-			{
-				if(piezas->reina[i] == posicion)
-					break;
-			}
-			// la elimina desplazando el resto de piezas de la lista una posicion a la izqu.
-			for(;i<(piezas->nreina - 1);i++)
-				piezas->reina[i] = piezas->reina[i+1];
-			piezas->nreina--;
-			break;
-		case TORRE:
-			for(i=0;i<piezas->ntorre;i++)
-			{
-				if(piezas->torre[i] == posicion)
-					break;
-			}
-			for(;i<(piezas->ntorre - 1);i++)
-				piezas->torre[i] = piezas->torre[i+1];
-			piezas->ntorre--;
-			break;
-		case CABALLO:
-			for(i=0;i<piezas->ncaballo;i++)
-			{
-				if(piezas->caballo[i] == posicion)
-					break;
-			}
-			for(;i<(piezas->ncaballo - 1);i++)
-				piezas->caballo[i] = piezas->caballo[i+1];
-			piezas->ncaballo--;
-			break;
-		case ALFIL:
-			for(i=0;i<piezas->nalfil;i++)
-			{
-				if(piezas->alfil[i] == posicion)
-					break;
-			}
-			for(;i<(piezas->nalfil - 1);i++)
-				piezas->alfil[i] = piezas->alfil[i+1];
-			piezas->nalfil--;
-			break;
-		case PEON:
-			for(i=0;i<piezas->npeon;i++)
-			{
-				if(piezas->peon[i] == posicion)
-					break;
-			}
-			for(;i<(piezas->npeon - 1);i++)
-				piezas->peon[i] = piezas->peon[i+1];
-			piezas->npeon--;
-			break;
-		default:
-			break;
-	}	
-}
-
-// Funcion para actualizar el tablero virtual con el nuevo movimiento.
-void actTablero(MOV_t *mov,TABLERO_t *tab)
-{
-	tab->tab[mov->org] = NADA;			// La pieza desaparece de la posicion origen
-	if(tab->tab[mov->dest] != NADA)	// sustituye pieza.
-	{
-		eliminaPieza(tab->tab[mov->dest],mov->dest,tab);
-	}
-	else
+	for(c=0;c<64;c++)
 	{
-		// movimiento de comida de peon sin pieza en destino => come al paso.
-		if(((mov->pieza & 0x7) == PEON) && (abs(mov->dest - mov->org) != 8) && (abs(mov->dest - mov->org) != 16))
+		for(i=0;i<8;i++)
 		{
-			debug("Come al paso",1,mov,tab);
-			if(mov->pieza & NEGRA)
+			x = c%8 + saltocab[i][0];
+			y = c/8 + saltocab[i][1];
+			if((x >= 0) && (x < 8) && (y >= 0) && (y < 8))
+				ataquecab[c] |= CASILLA(y*8+x);
+		}
+		for(d=0;d<8;d++)
+		{
+			acum = 0;
+			for(x=c%8+dirrayo[d][0],y=c/8+dirrayo[d][1];(x >= 0) && (x < 8) && (y >= 0) && (y < 8);x+=dirrayo[d][0],y+=dirrayo[d][1])
 			{
-				if(tab->tab[mov->dest - 8] == PEON)
-				{
-					eliminaPieza(tab->tab[mov->dest - 8],mov->dest -8,tab);
-					tab->tab[mov->dest - 8] = NADA;
-				}
-				else
-					debug("NO AL PASO",2,mov,tab);
+				entre[c][y*8+x] = acum;
+				acum |= CASILLA(y*8+x);
 			}
+			rayos[d][c] = acum;
+			if(d < 4)
+				lineatorre[c] |= acum;
 			else
-			{
-				if(tab->tab[mov->dest + 8] == PEON | NEGRA)
-				{
-					eliminaPieza(tab->tab[mov->dest + 8],mov->dest +8,tab);
-					tab->tab[mov->dest + 8] = NADA;
-				//	debug("fcome",10,mov,tab);
-				}
-				else
-					debug("NO AL PASO1",2,mov,tab);
-			}
+				lineaalfil[c] |= acum;
 		}
 	}
-	tab->tab[mov->dest] = mov->pieza; // pone pieza en la casilla destino.
 }
 
-// Actualiza las estructuras y tablero virtual por un movimiento de rey.
-void mueveRey(MOV_t *mov,TABLERO_t *tab)
+// casillas atacadas desde c en la direccion d hasta la primera pieza (incluida).
+static inline uint64_t ataqueRayo(int d,int c,uint64_t ocupadas)
 {
-	PIEZAS_t *piezas;
-	
-	// determina la estructura a actualizar en funcion del color de la pieza.
-	if(mov->pieza & NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;	
+	uint64_t rayo = rayos[d][c];
+	uint64_t bloq = rayo & ocupadas;
 	
-	piezas->rey = mov->dest;	// modifica la posicion del rey.
-	actTablero(mov,tab);			// actualiza tablero virtual.
+	if(bloq != 0)	// se corta el rayo tras la primera pieza en la direccion.
+		rayo ^= rayos[d][(d == 0) || (d == 1) || (d == 4) || (d == 5) ? __builtin_ctzll(bloq) : 63 - __builtin_clzll(bloq)];
+	return rayo;
 }
 
-// Actualiza las estructuras y tablero virtual por un movimiento de reina.
-void mueveReina(MOV_t *mov,TABLERO_t *tab)
+// casillas atacadas por una torre y por un alfil en c.
+static inline uint64_t ataqueTorre(int c,uint64_t ocupadas)
 {
-	int i;
-	PIEZAS_t *piezas;
-	
-	// determina la estructura a actualizar en funcion del color de la pieza.
-	if(mov->pieza & NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;		
-
-	// localiza la pieza que se mueve
-	for(i=0;i<piezas->nreina;i++)
-	{
-		if(piezas->reina[i] == mov->org)
-		{
-			piezas->reina[i] = mov->dest;	// actualiza posicion de la pieza
-			break;
-		}
-	}
-	if(i == piezas->nreina)
-		debug("No encontrado reina ORG",3,mov,tab);
-	actTablero(mov,tab);	// actualiza tablero virtual.
+	return ataqueRayo(0,c,ocupadas) | ataqueRayo(1,c,ocupadas) | ataqueRayo(2,c,ocupadas) | ataqueRayo(3,c,ocupadas);
 }
 
-// Actualiza las estructuras y tablero virtual por un movimiento de torre.
-void mueveTorre(MOV_t *mov,TABLERO_t *tab)
+static inline uint64_t ataqueAlfil(int c,uint64_t ocupadas)
 {
-	int i;
-	PIEZAS_t *piezas;
-	
-	if(mov->pieza & NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;		
-
-	for(i=0;i<piezas->ntorre;i++)
-	{
-		if(piezas->torre[i] == mov->org)
-		{
-			piezas->torre[i] = mov->dest;
-			break;
-		}
-	}
-	if(i == piezas->ntorre)
-		debug("No encontrado torre ORG",3,mov,tab);
-	actTablero(mov,tab);
+	return ataqueRayo(4,c,ocupadas) | ataqueRayo(5,c,ocupadas) | ataqueRayo(6,c,ocupadas) | ataqueRayo(7,c,ocupadas);
 }
 
-// Actualiza las estructuras y tablero virtual por un movimiento de alfil.
-void mueveAlfil(MOV_t *mov,TABLERO_t *tab)
+// inicia partida.
+// Inicia el tablero virtual y las casillas de las piezas.
+void iniciaJuego(TABLERO_t *tab)
 {
 	int i;
-	PIEZAS_t *piezas;
 	
-	if(mov->pieza & NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;	
-
-	for(i=0;i<piezas->nalfil;i++)
-	{
-		if(piezas->alfil[i] == mov->org)
-		{
-			piezas->alfil[i] = mov->dest;
-			break;
-		}
-	}
-	if(i == piezas->nalfil)
-		debug("No encontrado alfil ORG",3,mov,tab);
-	actTablero(mov,tab);
+	memcpy(tab->tab,tablaini,sizeof(tablaini));
+	memset(tab->bb,0,sizeof(tab->bb));
+	for(i=0;i<64;i++)
+		tab->bb[tab->tab[i]] |= CASILLA(i);
+	tab->ocupadas = ~tab->bb[NADA];
+	tab->bb[NADA] = 0;
 }
 
-// Actualiza las estructuras y tablero virtual por un movimiento de caballo
-void mueveCaballo(MOV_t *mov,TABLERO_t *tab)
+// Funcion que traslada la pieza de org a dest en el tablero virtual (enroques).
+void trasladaPieza(int org,int dest,TABLERO_t *tab)
 {
-	int i;
-	PIEZAS_t *piezas;
+	uint8_t pieza = tab->tab[org];
 	
-	if(mov->pieza & NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;	
-
-	for(i=0;i<piezas->ncaballo;i++)
-	{
-		if(piezas->caballo[i] == mov->org)
-		{
-			piezas->caballo[i] = mov->dest;
-			break;
-		}
-	}
-	if(i == piezas->ncaballo)
-		debug("No encontrado caballo ORG",3,mov,tab);
-	actTablero(mov,tab);
+	if(pieza == NADA)
+		return;
+	tab->bb[tab->tab[dest]] &= ~CASILLA(dest);
+	tab->bb[pieza] = (tab->bb[pieza] & ~CASILLA(org)) | CASILLA(dest);
+	tab->tab[dest] = pieza;
+	tab->tab[org] = NADA;
+	tab->ocupadas = (tab->ocupadas & ~CASILLA(org)) | CASILLA(dest);
 }
 
-// Actualiza las estructuras y tablero virtual por un movimiento de peon
-void muevePeon(MOV_t *mov,TABLERO_t *tab)
+// Funcion para actualizar el tablero virtual con el nuevo movimiento.
+void actTablero(MOV_t *mov,TABLERO_t *tab)
 {
-	int i;
-	PIEZAS_t *piezas;
+	int alpaso;
 	
-	if(mov->pieza & NEGRA)
-		piezas = &tab->negras;
+	// La pieza desaparece de la posicion origen
+	tab->bb[tab->tab[mov->org]] &= ~CASILLA(mov->org);
+	tab->tab[mov->org] = NADA;
+	if(tab->tab[mov->dest] != NADA)	// sustituye pieza.
+	{
+		tab->bb[tab->tab[mov->dest]] &= ~CASILLA(mov->dest);
+	}
 	else
-		piezas = &tab->blancas;	
-
-	for(i=0;i<piezas->npeon;i++)
 	{
-		if(piezas->peon[i] == mov->org)
+		// movimiento de comida de peon sin pieza en destino => come al paso.
+		if(((mov->pieza & 0x7) == PEON) && (abs(mov->dest - mov->org) != 8) && (abs(mov->dest - mov->org) != 16))
 		{
-			piezas->peon[i] = mov->dest;
-			break;
+			debug("Come al paso",1,mov,tab);
+			alpaso = (mov->pieza & NEGRA) ? mov->dest - 8 : mov->dest + 8;
+			if(tab->tab[alpaso] == (PEON | ((mov->pieza & NEGRA) ^ NEGRA)))
+			{
+				tab->bb[tab->tab[alpaso]] &= ~CASILLA(alpaso);
+				tab->tab[alpaso] = NADA;
+				tab->ocupadas &= ~CASILLA(alpaso);
+			}
+			else
+				debug("NO AL PASO",2,mov,tab);
 		}
 	}
-	if(i == piezas->npeon)
-	{
-		debug("No encontrado peon org",3,mov,tab);
-	}
-	actTablero(mov,tab);
+	tab->tab[mov->dest] = mov->pieza; // pone pieza en la casilla destino.
+	tab->bb[mov->pieza] |= CASILLA(mov->dest);
+	tab->ocupadas = (tab->ocupadas & ~CASILLA(mov->org)) | CASILLA(mov->dest);
 }
 
 // mueve una pieza en el tablero.
@@ -485,28 +519,11 @@ void mueve(MOV_t *mov,TABLERO_t *tab)
 	movimiento.destino = mov->dest;
 	anadeMov(movimiento);	// anhade movimiento binario a la lista de movimientos de salida.
 	
-	// mueve pieza en estructuras de piezas activas y tablero virtual.
-	switch(tab->tab[mov->org] & 0x7)
-	{
-		case REY:
-			mueveRey(mov,tab);
-			break;
-		case REINA:
-			mueveReina(mov,tab);
-			break;
-		case TORRE:
-			mueveTorre(mov,tab);
-			break;
-		case ALFIL:
-			mueveAlfil(mov,tab);
-			break;
-		case CABALLO:
-			mueveCaballo(mov,tab);
-			break;
-		default:
-			muevePeon(mov,tab);
-			break;
-	}
+	if(mov->org >= 64)	// sin origen valido no se modifica el tablero.
+		return;
+	if(tab->tab[mov->org] != mov->pieza)
+		debug("No encontrado pieza ORG",3,mov,tab);
+	actTablero(mov,tab);	// mueve pieza en el tablero virtual.
 }
 
 // transforma posicion geometrica a indice.
@@ -516,948 +533,260 @@ uint8_t transform(uint8_t x,uint8_t y)
 }
 
 // determina si el movimiento de la pieza indicada puede hacer entrar a su rey en jaque
-// lo que indica que esta pieza no puede ser el origen del movimiento.
+// lo que indica que esta pieza no puede ser el origen del movimiento (pieza clavada).
 // se utiliza para resolver la ambiguedad cuando dos piezas pueden ser el origen del
 // movimiento pero una de ellas lo tiene impedido por que pondria a su rey en jaque.
+// La pieza esta clavada si es la unica pieza entre su rey y una torre, alfil o reina
+// contraria en la misma linea, y no se mueve por esa linea ni come al atacante.
 //
 // rey => pos rey,pieza=> pos pieza, color=> color pieza, indest=> destino de la pieza.
 // Retorna cero si no y uno si el movimiento provoca jaque.
 int posiblejaque(int rey,int pieza,int color,int indest,TABLERO_t *tab)
 {
-	int diffx,diffy;
-	int fila,colum,filpieza,columpieza;
-	int i,j;
-	int tipo;
-	int incx;
-	int incy;
-	// posicion destino pieza que se mueve.
-	int destx = indest%8;
-	int desty = indest/8;
-	
-	int sobrepasa;
-	
-	// determina fila y columna en que se encuentra el rey
-	if((npgn == 15) && (color > 0))
-		i = 3;
-	colum = rey % 8;
-	fila = rey/8;
+	uint64_t atacantes;
+	int contrario = color ^ NEGRA;
+	int s;
 	
-	// determina fila y columna en la que se encuentra la pieza.
-	columpieza = pieza % 8;
-	filpieza = pieza/8;
-	
-	// si la pieza que se mueve y el rey estan en la misma fila y el destino
-	// 	de la pieza es tambien la misma fila, no hay cambio de amenaza.
-	// 	si el destino es otra fila y hay una pieza interpuesta tampoco supone amenaza.
-	//		si hay una pieza detras de la que se mueve (en la misma fila) y es de distinto
-	//		color que el rey y se trata de una torre o una reyna hay amenaza.
-	if(fila == filpieza) // pieza y rey en la misma fila.
-	{
-		if(fila == desty) // si la pieza se mueve en la misma fila no genera nueva amenaza.
-			return 0;
-		if(colum > columpieza)	// El rey se encuentra a la derecha de la pieza
-			incx = -1;
-		else
-			incx = 1;
-		sobrepasa = 0;
-		
-		// examinamos las posiciones desde el rey en direccion a la pieza
-		// dentro de los limites del tablero.
-		for(i=colum+incx;((i>= 0) && (i<8));i+=incx)
-		{
-			if(i==columpieza)
-			{
-				sobrepasa = 1;
-				continue;
-			}
-			tipo = tab->tab[fila*8+i];
-			if(tipo != NADA)
-			{
-				if(sobrepasa == 0)	// pieza interpuesta.
-					return 0;
-				if(color != (tipo & NEGRA))
-				{
-					tipo &= 0x7;
-					if((tipo == REINA) || (tipo == TORRE))
-						return 1;	// pieza amenaza.
-					return 0;		// pieza interpuesta.
-				}
-				return 0;	// pieza interpuesta.
-			}
-		}
-		return 0;	// no se encuentra amenaza.
-	}
-	
-	// si la pieza que se mueve y el rey estan en la misma columna y el destino
-	// 	de la pieza es tambien la misma columna, no hay cambio de amenaza.
-	// 	si el destino es otra columna y hay una pieza interpuesta tampoco supone amenaza.
-	//		si hay una pieza detras de la que se mueve (en la misma columna) y es de distinto
-	//		color que el rey y se trata de una torre o una reyna hay amenaza.
-	if(colum == columpieza) // pieza y rey en la misma columna
+	if(((lineatorre[rey] | lineaalfil[rey]) & CASILLA(pieza)) == 0)	// pieza no alineada con su rey.
+		return 0;
+	atacantes = (lineatorre[rey] & (tab->bb[TORRE | contrario] | tab->bb[REINA | contrario])) |
+					(lineaalfil[rey] & (tab->bb[ALFIL | contrario] | tab->bb[REINA | contrario]));
+	for(;atacantes != 0;atacantes &= atacantes - 1)
 	{
-		if(colum == destx)
-			return 0;
-		if(fila > filpieza)
-			incy = -1;
-		else
-			incy = 1;
-		sobrepasa = 0;
-		for(i=fila+incy;((i>= 0) && (i<8));i+= incy)
-		{
-			if(i==filpieza)
-			{
-				sobrepasa = 1;
-				continue;
-			}
-			tipo = tab->tab[i*8+colum];
-			if(tipo != NADA)
-			{
-				if(sobrepasa == 0)	// pieza interpuesta.
-					return 0;
-				if(color != (tipo & NEGRA))
-				{
-					tipo &= 0x7;
-					if((tipo == REINA) || (tipo == TORRE))
-						return 1;	// pieza amenaza.
-					return 0;		// pieza interpuesta.
-				}
-				return 0;	// pieza interpuesta.
-			}
-		}
-		return 0;	// no se encuentra amenaza.
+		s = __builtin_ctzll(atacantes);
+		if(((tab->ocupadas & entre[rey][s]) == CASILLA(pieza)) && (((entre[rey][s] | CASILLA(s)) & CASILLA(indest)) == 0))
+			return 1;	// pieza amenaza.
 	}
+	return 0;
+}
 
-	diffx = abs(colum - columpieza);
-	diffy = abs(fila - filpieza);
+// Funcion que elige el origen entre las casillas candidatas: si hay varias, la primera que no
+// deja a su rey en jaque al moverse.
+uint8_t eligeOrigen(uint64_t posibles,uint8_t indest,uint8_t color,TABLERO_t *tab)
+{
+	int rey;
+	int primera;
 	
-	// si la pieza que se mueve y el rey estan en la misma diagonal y el destino
-	// 	de la pieza es tambien la misma diagonal, no hay cambio de amenaza.
-	// 	si el destino es fuera de la diagonal y hay una pieza interpuesta tampoco supone amenaza.
-	//		si hay una pieza detras de la que se mueve (en la misma diagonal) y es de distinto
-	//		color que el rey y se trata de un alfil o una reyna hay amenaza.
-	if(diffx == diffy)	// pieza en diagonal al rey
+	if(posibles == 0)	// pieza no encontrada.
+		return -1;
+	primera = __builtin_ctzll(posibles);
+	if((posibles & (posibles - 1)) == 0)	// solo una posible.
+		return primera;
+	rey = __builtin_ctzll(tab->bb[REY | color]);
+	for(;posibles != 0;posibles &= posibles - 1)	// desambiguacion por jaque.
 	{
-		// determina incx e incy para moverse por la diagonal, segun la diagonal que se trate.
-		incx = colum - columpieza;
-		incy = fila - filpieza;
-		
-		// el destino esta tambien en una diagonal.
-		if(abs(colum -destx) == abs(fila -desty))
-		{
-			if(incx > 0)
-			{
-				if((colum -destx) > 0)
-				{
-					if(incy > 0)
-					{
-						if((fila - desty) > 0)
-							return 0;	// pieza se mueve en la misma diagonal, no hay cambio de amenaza
-					}
-					else
-					{
-						if((fila - desty) < 0)
-							return 0;	// pieza se mueve en la misma diagonal, no hay cambio de amenaza
-					}
-				}
-			}
-			else
-			{
-				if((colum -destx) < 0)
-				{
-					if(incy > 0)
-					{
-						if((fila - desty) > 0)
-							return 0;	// pieza se mueve en la misma diagonal, no hay cambio de amenaza
-					}
-					else
-					{
-						if((fila - desty) < 0)
-							return 0;	// pieza se mueve en la misma diagonal, no hay cambio de amenaza
-					}
-				}
-			}
-		}
-		
-		//  calculo de los incrementos para seguir sentido de las diagonales.
-		if(fila > filpieza)
-		{
-			incy = -1;
-			if(colum > columpieza)
-				incx = -1;
-			else
-				incx = 1;
-		}
-		else
-		{
-			incy = 1;
-			if(colum > columpieza)
-				incx = -1;
-			else
-				incx = 1;
-		}
-		sobrepasa = 0;
-		// recorremos la diagonal desde el rey en el sentido de la pieza.
-		for(i=fila+incy,j=colum+incx;((i>=0) && (i<8) && (j>=0) && (j<8));i+=incy,j+=incx)
-		{
-			if((i==filpieza) && (j == columpieza))
-			{
-				sobrepasa = 1;	// se alcanza la pieza.
-				continue;
-			}
-			tipo = tab->tab[i*8+j]; // pieza en la casilla considerada
-			if(tipo != NADA)			// hay una pieza
-			{
-				if(sobrepasa == 0)	// pieza interpuesta.
-					return 0;			// no hay amenaza por que hay una pieza interpuesta.
-				if(color != (tipo & NEGRA))
-				{
-					tipo &= 0x7;
-					if((tipo == REINA) || (tipo == ALFIL))
-						return 1;	// pieza amenaza.
-					return 0;		// pieza interpuesta.
-				}
-				return 0;	// pieza interpuesta.
-			}
-		}
-		return 0; //No se encuentra amenaza.
+		if(posiblejaque(rey,__builtin_ctzll(posibles),color,indest,tab) == 0)
+			return __builtin_ctzll(posibles);
 	}
-	return 0;	// la pieza que se mueve no esta ni en fila ni en columna ni en diagonal al rey => no supone amenaza.
+	return primera;	// si ninguna devolvemos la primera. NO DEBERIA OCURRIR
 }
 
 // Funciones para determinar el origen de una pieza que se mueve.
-// si se trata de un rey el origen es la posicion actual anotada en la estructura.
+// si se trata de un rey el origen es la posicion actual.
 uint8_t reymovorg(uint8_t color,TABLERO_t *tab)
 {
-	if(color == NEGRA)
-		return(tab->negras.rey);
-	else
-		return(tab->blancas.rey);
+	return __builtin_ctzll(tab->bb[REY | color]);
 }
 
-// Funcion para determinar la posicion origen del movimiento de una reina.
-// tener en cuenta que puede haber hasta nueve reinas y pudiera darse la circunstancia
-// de que hasta ocho puedan moverse a la posicion destino indicada. Hay que determinar
-// cual es la unica que puede moverse a dicha posicion. Primero tiene que estar en la fila
-// o columna indicadas si se proporcionan estas, luego tiene que estar en la misma fila, columna 
-// o diagonal que el destino, no puede haber piezas interpuestas en su movimiento
-// y por ultimo tiene que ser un movimiento legal, es decir no puede 
-// provocar que su rey entre en jaque.
+// Funcion para determinar la posicion origen del movimiento de una reina, torre, alfil o caballo.
+// Puede haber varias piezas del tipo por promociones: las posibles son las del color que atacan
+// la casilla destino (sin piezas interpuestas), en la fila o columna indicadas si se proporcionan
+// estas, y por ultimo tiene que ser un movimiento legal, es decir no puede provocar que su rey
+// entre en jaque.
 // orgx tiene valor distinto a -1 si en el movimiento se indica la columna origen.
 // orgy tiene valor distinto a -1 si en el movimiento se indica la fila origen.
 // la funcion retorna la posicion origen absoluta del movimiento.
-uint8_t reinamovorg(uint8_t indest,uint8_t orgx,uint8_t orgy,uint8_t color,TABLERO_t *tab)
+uint8_t piezamovorg(uint8_t tipo,uint8_t indest,uint8_t orgx,uint8_t orgy,uint8_t color,TABLERO_t *tab)
 {
-	PIEZAS_t *piezas;
-	int i;
-	int destx = indest%8;	// columna destino
-	int desty = indest/8;	// fila destino.
-	int posible[10];		// lista de posibles candidatas.
-	int nposible = 0;		// numero de posibles candidatas.
-	int posjaque[10];		// lista posibles tras comprobacion jaque
-	int nposjaque = 0;	// numero de posibles tras comprobar jaque.
+	uint64_t posibles;
 	
-	// segun el color selecciona las estructuras de posicion a utilizar.
-	if(color == NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;
-		
-	if((orgx >= 0) && (orgx < 8)) // se proporciona columna.
+	if((orgx < 8) && (orgy < 8))	// la orden de movimiento incluye el origen del mismo.
+		return(orgy*8 + orgx);
+	switch(tipo)
 	{
-		if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
-			return(orgy*8 + orgx); 		// la orden de movimiento incluye el origen del mismo.
-		else  // buscamos reina que esta en la misma columna.
-		{
-			for(i=0;i<piezas->nreina;i++)
-			{
-				if(piezas->reina[i]%8 == orgx)
-				{
-					int diffx = abs(destx - orgx);
-					int diffy = abs(desty - piezas->reina[i]/8);
-					
-					if((diffx == 0) || (diffy == 0) || (diffx == diffy)) // reina en misma columna, anotamos como posible
-					{
-						posible[nposible] = piezas->reina[i];
-						nposible++;
-					}
-				}
-			}
-		}
+		case CABALLO:
+			posibles = ataquecab[indest];
+			break;
+		case ALFIL:
+			posibles = ataqueAlfil(indest,tab->ocupadas);
+			break;
+		case TORRE:
+			posibles = ataqueTorre(indest,tab->ocupadas);
+			break;
+		default:
+			posibles = ataqueTorre(indest,tab->ocupadas) | ataqueAlfil(indest,tab->ocupadas);
+			break;
 	}
-	else if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
-	{
-		for(i=0;i<piezas->nreina;i++)
-		{
-			if(piezas->reina[i]/8 == orgy)
-			{
-				int diffx = abs(destx - piezas->reina[i]%8);
-				int diffy = abs(desty - orgy);
-				
-				if((diffx == 0) || (diffy == 0) || (diffx == diffy)) // reina en la misma fila, anotamos como posible
-				{
-					posible[nposible] = piezas->reina[i];
-					nposible++;
-				}
-			}
-		}
-	}
-	else  // no se proporciona ni fila ni columna.
-	{
-		
-		// tiene que estar en la misma columna o fila o diagonal del destino.
-		// y no tiene que haber piezas interpuestas entre origen y destino.
-		for(i=0;i<piezas->nreina;i++)
-		{
-			int tmpx = piezas->reina[i]%8;	// columna de la reina que consideramos.
-			int tmpy = piezas->reina[i]/8;	// fila de la reina que consideramos.
-			int diffx = abs(destx - tmpx);	// diferencia de columna entre la reina considerada y el destino.
-			int diffy = abs(desty - tmpy);	// diferencia de fila entre la reina considerada y el destino.
-			
-			// posible reina pues esta en la misma fila o columna o en una diagonal
-			// despues hay que verificar que no hay piezas interpuestas.
-			if((diffx == 0) || (diffy == 0) || (diffx == diffy)) // anotamos como posible.
-			{
-				posible[nposible] = piezas->reina[i];
-				nposible++;
-			}
-		}
-	}
-	// eleccion entre las posibles.
-	if(nposible == 0)	// pieza no encontrada.
-		return -1;
-	if(nposible == 1)	// solo uno posible.
-		return(posible[0]);
-	else  // varios posibles, hay que verificar piezas interpuestas.
-	{
-		for(i=0;i<nposible;i++)
-		{
-			int tmpx = posible[i]%8; // columna pieza ensayada
-			int tmpy = posible[i]/8; // fila pieza ensayada
-			int incx;
-			int incy;
-			int x,y;
-			
-			// determinamos el sentido de los incrementos para movernos hacia el destino.
-			if(tmpx == destx)
-			{
-				incx = 0;
-			}
-			else if(tmpx > destx)
-				incx = -1;
-			else
-				incx = 1;
-			if(tmpy == desty)
-				incy = 0;
-			else if(tmpy > desty)
-				incy = -1;
-			else
-				incy = 1;
-
-			for(x=tmpx+incx,y=tmpy+incy;(x != destx) || (y != desty);x+=incx,y+=incy)
-			{
-				if(tab->tab[y*8+x] != NADA)
-					break;
-			}
-			if((x == destx) && (y==desty))	// no ha encontrado piezas inter. la anotamos para verificar que no provoca jaque de su rey al moverse
-			{
-				posjaque[nposjaque] = posible[i];
-				nposjaque++;
-			}
-		}
-		if(nposjaque == 0)
-			return -1;		// no se encuentra ninguna con posibilidades.
-		if(nposjaque == 1)
-			return(posjaque[0]);	// encontrada solo una como posible.
-		else   	// desambiguacion por jaque. simple, la primera que cumpla
-		{
-			for(i=0;i<nposjaque;i++)
-			{
-				if(posiblejaque(piezas->rey,posjaque[i],color,indest,tab) == 0) // pieza no incurre en jaque de su rey al moverse.
-					return(posjaque[i]);
-			}
-			return(posjaque[0]);	// si ninguna devolvemos la primera. NO DEBERIA OCURRIR
-		}
-	}
-	return -1;	// pieza no encontrada !!!!!!!
+	posibles &= tab->bb[tipo | color];
+	if(orgx < 8) // se proporciona columna.
+		posibles &= COLUMNA(orgx);
+	else if(orgy < 8) // se proporciona fila.
+		posibles &= FILA(orgy);
+	return eligeOrigen(posibles,indest,color,tab);
 }
 
-// Funcion para determinar la posicion origen del movimiento de una torre.
-// tener en cuenta que puede haber hasta diez torres y pudiera darse la circunstancia
-// de que hasta cuatro puedan moverse a la posicion destino indicada. Hay que determinar
-// cual es la unica que puede moverse a dicha posicion. Primero tiene que estar en la fila
-// o columna indicadas si se proporcionan estas, luego tiene que estar en la misma fila o columna 
-// que el destino, no puede haber piezas interpuestas en su movimiento y por ultimo tiene que 
-// ser un movimiento legal, es decir no puede provocar que su rey entre en jaque.
+// Funcion para determinar la posicion origen del movimiento un peon.
+// si hay una comida puede haber hasta dos peones que pueden moverse al mismo destino.
+// si no hay comida solo puede haber uno.
 // orgx tiene valor distinto a -1 si en el movimiento se indica la columna origen.
-// orgy tiene valor distinto a -1 si en el movimiento se indica la fila origen.
 // la funcion retorna la posicion origen absoluta del movimiento.
-uint8_t torremovorg(uint8_t indest,uint8_t orgx,uint8_t orgy,uint8_t color,TABLERO_t *tab)
+uint8_t peonmovorg(uint8_t indest,uint8_t orgx,uint8_t come,uint8_t color,TABLERO_t *tab)
 {
-	PIEZAS_t *piezas;
-	int i;
-	int destx = indest%8;	// columna destino
-	int desty = indest/8;	// fila destino
-	int posible[10];			// lista de posibles piezas origen.
-	int nposible = 0;			// numero de posibles piezas origen.
-	int posjaque[10];			// lista posibles piezas a comprobar jaque propio
-	int nposjaque = 0;		// numero de piezas a comprobar jaque propio.
-	
+	int avance = (color == NEGRA) ? -8 : 8;	// del destino al origen.
+	uint64_t posibles;
 	
-	if(color == NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;
-		
-	if((orgx >= 0) && (orgx < 8)) // se proporciona columna.
-	{
-		if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
-			return(orgy*8 + orgx);
-		else  // buscamos torre que esta en la misma columna.
-		{
-			for(i=0;i<piezas->ntorre;i++)
-			{
-				if(piezas->torre[i]%8 == orgx) // ademas debe estar en la misma fila o columna que el destino.
-				{
-					if((destx == orgx) || (desty == piezas->torre[i]/8))
-					{
-						posible[nposible] = piezas->torre[i];	// anotamos posible candidata.
-						nposible++;
-					}
-				}
-			}
-		}
-	}
-	else if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
-	{
-		for(i=0;i<piezas->ntorre;i++)
-		{
-			if(piezas->torre[i]/8 == orgy)
-			{
-				if((desty == orgy) || (destx == piezas->torre[i]%8)) // misma fila, anotamos posible candidata.
-				{
-					posible[nposible] = piezas->torre[i];
-					nposible++;
-				}
-			}
-		}
-	}
-	else  // no se proporciona ni fila ni columna.
-	{
-		
-		// tiene que estar en la misma columna o fila del destino.
-		for(i=0;i<piezas->ntorre;i++)
-		{
-			int tmpx = piezas->torre[i]%8;   // columna de la candidata
-			int tmpy = piezas->torre[i]/8;	// fila de la candidata.
-			
-			if((tmpx == destx) || (tmpy == desty)) // posible torre hay que verificar que no hay piezas interpuestas.
-			{
-				posible[nposible] = piezas->torre[i];	// anotamos posible candidata.
-				nposible++;
-			}
-		}
-	}
-	// eleccion entre las posibles.
-	if(nposible == 0)
-		return -1;	// no se ha encontrado ninguna posible candidata.
-	if(nposible == 1)	// solo uno posible.
-		return(posible[0]);
-	else  // varios posibles, hay que verificar piezas interpuestas.
+	if(((indest + avance) < 0) || ((indest + avance) > 63))	// destino en la fila de salida.
+		return -1;
+	// peon come, se mueve uno en diagonal.
+	if(come)
 	{
-		for(i=0;i<nposible;i++)
-		{
-			int tmpx = posible[i]%8;	// columna de la candidata
-			int tmpy = posible[i]/8;	// fila de la candidata.
-			int incx;
-			int incy;
-			int x,y;
-			
-			// determinamos los incrementos a aplicar para movernos desde el destino a la pieza a ensayar.
-			if(tmpx == destx)
-			{
-				incx = 0;
-				if(tmpy > desty)
-					incy = -1;
-				else
-					incy = 1;
-			}
-			else
-			{
-				incy = 0;
-				if(tmpx > destx)
-					incx = -1;
-				else
-					incx = 1;
-			}
-			// nos movemos desde el destino a la pieza ensayada buscando posibles piezas interpuestas.
-			for(x=tmpx+incx,y=tmpy+incy;(x != destx) || (y != desty);x+=incx,y+=incy)
-			{
-				if(tab->tab[y*8+x] != NADA)
-					break;
-			}
-			if((x == destx) && (y==desty))	// no ha encontrado piezas inter.
-			{
-				posjaque[nposjaque] = posible[i];	// anotamos como posible para comprobar mov ilegal por jaque.
-				nposjaque++;
-			}
-		}
-		if(nposjaque == 0)	// no se ha encontrado ninguna pieza posible.
-			return -1;
-		if(nposjaque == 1)	// se ha encontrado solo una posible.
-			return(posjaque[0]);
-		else   	// desambiguacion por jaque. simple, la primera que cumpla
-		{
-			for(i=0;i<nposjaque;i++)
-			{
-				if(posiblejaque(piezas->rey,posjaque[i],color,indest,tab) == 0) // no provoca jaque propio al moverse
-					return(posjaque[i]);
-			}
-			return(posjaque[0]);	// si ninguna devolvemos la primera. NO DEBERIA OCURRIR
-		}
+		// la fila sera una menos que la fila destino en negras y una mas en blancas.
+		if(orgx < 8) // se proporciona columna origen
+			return(((indest/8)+(avance/8))*8 + orgx);
+		// no se proporciona columna origen, 2 posibilidades excepto que el
+		// destino sea un extremo (a,h) entonces solo hay una posibilidad.
+		posibles = 0;
+		if((indest%8) > 0)
+			posibles |= CASILLA(indest + avance - 1);
+		if((indest%8) < 7)
+			posibles |= CASILLA(indest + avance + 1);
+		return eligeOrigen(posibles & tab->bb[PEON | color],indest,color,tab);
 	}
-	return -1;	// pieza no encontrada !!!!!!!
+	// peon no come, se mantiene en columna y estara 1 o dos posiciones
+	// de distancia
+	if(tab->tab[indest + avance] == (PEON | color))
+		return(indest + avance);
+	return(indest + 2*avance);
 }
 
-// Funcion para determinar la posicion origen del movimiento de alfil.
-// tener en cuenta que puede haber hasta diez alfiles y pudiera darse la circunstancia
-// de que hasta cuatro puedan moverse a la posicion destino indicada. Hay que determinar
-// cual es el unico que puede moverse a dicha posicion. Primero tiene que estar en la fila
-// o columna indicadas si se proporcionan estas, luego tiene que estar en una 
-// diagonal del destino, no puede haber piezas interpuestas en su movimiento
-// y por ultimo tiene que ser un movimiento legal, es decir no puede 
-// provocar que su rey entre en jaque.
-// orgx tiene valor distinto a -1 si en el movimiento se indica la columna origen.
-// orgy tiene valor distinto a -1 si en el movimiento se indica la fila origen.
-// la funcion retorna la posicion origen absoluta del movimiento.
-uint8_t alfilmovorg(uint8_t indest,uint8_t orgx,uint8_t orgy,uint8_t color,TABLERO_t *tab)
+// Funcion que decodifica el movimiento SAN de longitud len en una sola pasada, sin copiarlo:
+// enroque, pieza, indicaciones de origen, destino, captura y promocion. Las 'x' se ignoran
+// (indican captura) y la pieza de promocion es el caracter siguiente al primer '='.
+void decodSan(char *pgn,int len,SAN_t *san)
 {
-	PIEZAS_t *piezas;
-	int i;
-	int destx = indest%8;
-	int desty = indest/8;
-	int posible[10];
-	int nposible = 0;
-	int posjaque[10];
-	int nposjaque = 0;
+	uint8_t car[5];	// caracteres de pieza, origen y destino.
+	int i,n,k,d;
+	int estpromo = 0;	// 0 => sin '=', 1 => tras '=', 2 => pieza de promocion leida.
 	
-	if(color == NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;
-		
-	if((orgx >= 0) && (orgx < 8)) // se proporciona columna.
+	san->come = 0;
+	san->promo = 0;
+	san->enroque = 0;
+	for(i=0,n=0;i<len;i++)
 	{
-		if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
-			return(orgy*8 + orgx);
-		else  // buscamos alfil que esta en la misma columna.
+		switch(pgn[i])
 		{
-			for(i=0;i<piezas->nalfil;i++)
-			{
-				if(piezas->alfil[i]%8 == orgx)
+			case 'O':	// enroque.
+				san->enroque = ((len == 5) && (memcmp(pgn,"O-O-O",5) == 0)) ? ENROQUE_LARGO : ENROQUE_CORTO;
+				return;
+			case 'x':	// captura.
+				san->come = 1;
+				break;
+			default:
+				if(estpromo == 0)
 				{
-					int diffx = abs(destx - orgx);
-					int diffy = abs(desty - piezas->alfil[i]/8);
-					
-					if(diffx == diffy)
+					if(pgn[i] == '=')
+						estpromo = 1;
+					else
 					{
-						posible[nposible] = piezas->alfil[i];
-						nposible++;
+						if(n < 5)
+							car[n] = pgn[i];
+						n++;
 					}
 				}
-			}
-		}
-	}
-	else if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
-	{
-		for(i=0;i<piezas->nalfil;i++)
-		{
-			if(piezas->alfil[i]/8 == orgy)
-			{
-				int diffx = abs(destx - piezas->alfil[i]%8);
-				int diffy = abs(desty - orgy);
-					
-				if(diffx == diffy)
+				else if(estpromo == 1)
 				{
-					posible[nposible] = piezas->alfil[i];
-					nposible++;
+					san->promo = piezasan[(uint8_t)pgn[i]];
+					if((san->promo == 0) || (san->promo == REY))
+						san->promo = INVAL;
+					estpromo = 2;
 				}
-			}
-		}
-	}
-	else  // no se proporciona ni fila ni columna.
-	{		
-		// tiene que estar en una diagonal del destino.
-		for(i=0;i<piezas->nalfil;i++)
-		{
-			int tmpx = piezas->alfil[i]%8;
-			int tmpy = piezas->alfil[i]/8;
-			int diffx = abs(tmpx - destx);
-			int diffy = abs(tmpy - desty);
-			
-			if(diffx == diffy) // posible alfil hay que verificar que no hay piezas interpuestas.
-			{
-				posible[nposible] = piezas->alfil[i];
-				nposible++;
-			}
-		}
-	}
-	// eleccion entre las posibles.
-	if(nposible == 0)
-		return -1;
-	if(nposible == 1)	// solo uno posible.
-		return(posible[0]);
-	else  // varios posibles, hay que verificar piezas interpuestas y ambiguedad jaque
-	{
-		for(i=0;i<nposible;i++)
-		{
-			int tmpx = posible[i]%8;
-			int tmpy = posible[i]/8;
-			int incx;
-			int incy;
-			int x,y;
-			
-			if(tmpx > destx)
-				incx = -1;
-			else
-				incx = 1;
-			if(tmpy > desty)
-				incy = -1;
-			else
-				incy = 1;
-			for(x=tmpx+incx,y=tmpy+incy;x != destx;x+=incx,y+=incy)
-			{
-				if(tab->tab[y*8+x] != NADA)
-					break;
-			}
-			if((x == destx) && (y == desty))	// no ha encontrado piezas inter en la diagonal.
-			{
-				posjaque[nposjaque] = posible[i];
-				nposjaque++;
-			}
-		}
-		if(nposjaque == 0)
-			return -1;
-		if(nposjaque == 1)
-			return(posjaque[0]);
-		else   	// desambiguacion por jaque. simple, la primera que cumpla
-		{
-			for(i=0;i<nposjaque;i++)
-			{
-				if(posiblejaque(piezas->rey,posjaque[i],color,indest,tab) == 0)
-					return(posjaque[i]);
-			}
-			return(posjaque[0]);	// si ninguna devolvemos la primera. NO ES POSIBLE
+				break;
 		}
 	}
-	return -1;	// pieza no encontrada !!!!!!!
-}
-
-// Funcion para determinar la posicion origen del movimiento del caballo.
-// tener en cuenta que puede haber hasta diez caballos y pudiera darse la circunstancia
-// de que hasta ocho puedan moverse a la posicion destino indicada. Hay que determinar
-// cual es el unico que puede moverse a dicha posicion. Primero tiene que estar en la fila
-// o columna indicadas si se proporcionan estas, luego tiene que estar  
-// a distancia de caballo y por ultimo tiene que ser un movimiento legal, es decir no puede 
-// provocar que su rey entre en jaque.
-// orgx tiene valor distinto a -1 si en el movimiento se indica la columna origen.
-// orgy tiene valor distinto a -1 si en el movimiento se indica la fila origen.
-// la funcion retorna la posicion origen absoluta del movimiento.
-uint8_t caballomovorg(uint8_t indest,uint8_t orgx,uint8_t orgy,uint8_t color,TABLERO_t *tab)
-{
-	PIEZAS_t *piezas;
-	int i;
-	int destx,desty;
-	int posjaque[10];
-	int nposjaque = 0;
+	if(estpromo == 1)	// '=' sin pieza.
+		san->promo = INVAL;
 	
-	destx = indest % 8;
-	desty = indest/8;
-	
-	if(color == NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;
-		
-	if((orgx >= 0) && (orgx < 8)) // se proporciona columna.
-	{
-		if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
-			return(orgy*8 + orgx);
-		else  // buscamos caballo que esta en la misma columna y puede acceder a destino.
-		{
-			for(i=0;i<piezas->ncaballo;i++)
-			{
-				if(piezas->caballo[i]%8 == orgx)
-				{
-					int filcab = piezas->caballo[i]/8;
-					int diffx = abs(orgx - destx);
-					int diffy = abs(filcab - desty);
-					
-					if((diffx == 1) && (diffy == 2))
-						return(piezas->caballo[i]);
-					if((diffx == 2) && (diffy == 1))
-						return(piezas->caballo[i]);
-				}
-			}
-		}
-	}
-	else if((orgy >= 0) && (orgy < 8)) // se proporciona fila.
+	// El primer caracter indica el tipo de pieza, excepto en peon
+	if((n < 2) || (n > 5))	// movimiento invalido.
 	{
-		for(i=0;i<piezas->ncaballo;i++)
-		{
-			if(piezas->caballo[i]/8 == orgy)
-			{
-				int colcab = piezas->caballo[i]%8;
-				int diffx = abs(colcab - destx);
-				int diffy = abs(orgy - desty);
-				
-				if((diffx == 1) && (diffy == 2))
-					return(piezas->caballo[i]);
-				if((diffx == 2) && (diffy == 1))
-					return(piezas->caballo[i]);
-			}
-		}
+		san->pieza = INVAL;
+		return;
 	}
-	else  // no se proporciona ni fila ni columna.
+	if((san->pieza = piezasan[car[0]]) != 0)
+		k = 1;
+	else
 	{
-		for(i=0;i<piezas->ncaballo;i++)
-		{
-			int diffx = abs((piezas->caballo[i]%8) - destx);
-			int diffy = abs((piezas->caballo[i]/8) - desty);
-			
-			// puede haber ambiguedad por jaque
-			if((diffx == 1) && (diffy == 2))
-			{
-				posjaque[nposjaque] = piezas->caballo[i];
-				nposjaque++;
-			}
-			else if((diffx == 2) && (diffy == 1))
-			{
-				posjaque[nposjaque] = piezas->caballo[i];
-				nposjaque++;
-			}
-		}
-		if(nposjaque == 0)
-			return -1;
-		if(nposjaque == 1)
-			return(posjaque[0]);
-		for(i=0;i<nposjaque;i++)
-		{
-			if(posiblejaque(piezas->rey,posjaque[i],color,indest,tab) == 0)
-				return(posjaque[i]);
-		}
-		return(posjaque[0]);	// si ninguna devolvemos la primera.
+		san->pieza = PEON;
+		k = 0;
 	}
-	return -1;
-}
-
-// Funcion para determinar la posicion origen del movimiento un peon.
-// si hay una comida puede haber hasta dos peones que pueden moverse al mismo destino.
-// si no hay comida solo puede haber uno.
-// orgx tiene valor distinto a -1 si en el movimiento se indica la columna origen.
-// orgy tiene valor distinto a -1 si en el movimiento se indica la fila origen.
-// la funcion retorna la posicion origen absoluta del movimiento.
-uint8_t peonmovorg(uint8_t indest,uint8_t orgx,uint8_t come,uint8_t color,TABLERO_t *tab)
-{
-	PIEZAS_t *piezas;
-	int posjaque[10];
-	int nposjaque = 0;
-	int i;
-	
-	// peon come, se mueve uno en diagonal.
-	if(come)
+	switch(n - k)
 	{
-		if(color == NEGRA)
-		{
-			// la fila sera una menos que la fila destino.
-			if((orgx >=0) && (orgx<8)) // se proporciona columna origen
-				return(((indest/8)-1)*8 + orgx);
-			else 
+		case 2:	// solo se indica posicion destino
+			d = k;
+			san->orgx = -1;
+			san->orgy = -1;
+			break;
+		case 3:	// se indica fila o columna destino
+			d = k + 1;
+			if(car[k] >='a')
 			{
-				// no se proporciona columna origen, 2 posibilidades.
-				// excepto que el destino sea un extremo (a,h) entonces
-				// solo hay una posibilidad.
-				if((indest%8) == 0)
-					return(indest-7);
-				if((indest%8) == 7)
-					return(indest-9);
-				// puede haber ambiguedad....
-				if(tab->tab[indest -9] == PEON | NEGRA)
-				{
-					posjaque[nposjaque] = indest -9;
-					nposjaque++;
-				}
-				else if(tab->tab[indest -7] == PEON | NEGRA)
-				{
-					posjaque[nposjaque] = indest -7;
-					nposjaque++;
-				}
+				san->orgx = car[k] -'a';
+				san->orgy = -1;
 			}
-		}
-		else  // blancas.
-		{
-			// la fila sera una mas que la fila destino.
-			if((orgx >=0) && (orgx<8)) // se proporciona columna origen
-				return(((indest/8)+1)*8 + orgx);
-			else  // no se proporciona columna origen, 2 posibilidades.
+			else
 			{
-				// no se proporciona columna origen, 2 posibilidades.
-				// excepto que el destino sea un extremo (a,h) entonces
-				// solo hay una posibilidad.
-				if((indest%8) == 0)
-					return(indest+9);
-				if((indest%8) == 7)
-					return(indest+7);
-				// puede haber ambiguedad.
-				if(tab->tab[indest +9] == PEON)
-				{
-					posjaque[nposjaque] = indest +9;
-					nposjaque++;
-				}
-				else if(tab->tab[indest +7] == PEON)
-				{
-					posjaque[nposjaque] = indest +7;
-					nposjaque++;
-				}
+				san->orgx = -1;
+				san->orgy = 8+ '0'-car[k];
 			}
-		}
-	}
-	// peon no come, se mantiene en columna y estara 1 o dos posiciones
-	// de distancia
-	else 
-	{
-		if(color == NEGRA)
-		{
-			if(tab->tab[indest -8] == (PEON | NEGRA))
-				return(indest -8);
-			else
-				return(indest -16);
-		}
-		else
-		{
-			if(tab->tab[indest +8] == PEON)
-				return(indest +8);
-			else
-				return(indest +16);	
-		}
+			break;
+		case 1:	// pieza sin destino.
+			san->pieza = INVAL;
+			return;
+		default: // se indica origen y destino
+			d = k + 2;
+			i = transform(car[k],car[k+1]);
+			san->orgx = i%8;
+			san->orgy = i/8;
+			break;
 	}
-	if(nposjaque == 0) // ninguno cumple condiciones
-		return -1;
-	if(nposjaque == 1) // solo uno cumple condiciones.
-		return(posjaque[0]);
-		
-	if(color == NEGRA)
-		piezas = &tab->negras;
+	if((car[d] < 'a') || (car[d] > 'h') || (car[d+1] < '1') || (car[d+1] > '8'))	// destino fuera del tablero.
+		san->pieza = INVAL;
 	else
-		piezas = &tab->blancas;
-	
-	// comprobacion de que el movimiento es legal		
-	for(i=0;i<nposjaque;i++)
-	{
-		if(posiblejaque(piezas->rey,posjaque[i],color,indest,tab) == 0)
-			return(posjaque[i]);
-	}
-	return(posjaque[0]);
+		san->dest = transform(car[d],car[d+1]);
 }
 
-// calcula tipo, origen y destino del movimiento y mueve pieza.
-// pgn => string de movimiento.
-// color => color del movimiento.
-// come => indicacion de que este movimiento come una pieza.
-// mv => movimiento decodificado resultado de la funcion.
-// tab => situacion actual de las piezas.
-void muevePieza(uint8_t *pgn, uint8_t color,int come,MOV_t *mov,TABLERO_t *tab)
+// Funcion que mueve la pieza del movimiento decodificado determinando su origen.
+void muevePieza(SAN_t *san,uint8_t color,MOV_t *mov,TABLERO_t *tab)
 {
 	uint8_t orgx;
 	uint8_t orgy;
 	uint8_t pieza;
-	int len;
 	
-	len = strlen(pgn);
-	if((len > 5) || (len < 2)) // movimiento invalido.
+	if(san->pieza == INVAL) // movimiento invalido.
 	{
 		debug("MOV-INVAL",4,mov,tab);
 		mov->pieza = INVAL;
 		return;
 	}
-	switch(pgn[0])  // El primer caracter indica el tipo de pieza, excepto en peon
-	{
-		case 'K':
-			pieza = REY | color;
-			pgn++;
-			break;
-		case 'Q':
-			pieza = REINA | color;
-			pgn++;
-			break;
-		case 'R':
-			pieza = TORRE | color;
-			pgn++;
-			break;
-		case 'B':
-			pieza = ALFIL | color;
-			pgn++;
-			break;
-		case 'N':
-			pieza = CABALLO | color;
-			pgn++;
-			break;
-		default:
-			pieza = PEON | color;
-			len++;
-			break;
-	}
+	pieza = san->pieza | color;
 	mov->pieza = pieza;
-	len--;
-	switch(len)
-	{
-		case 2:	// solo se indica posicion destino
-			mov->dest = transform(pgn[0],pgn[1]);
-			orgx = -1;
-			orgy = -1;
-			break;
-		case 3:	// se indica fila o columna destino
-			mov->dest = transform(pgn[1],pgn[2]);
-			if(pgn[0] >='a')
-			{
-				orgx = pgn[0] -'a';
-				orgy = -1;
-			}
-			else
-			{
-				orgx = -1;
-				orgy = 8+ '0'-pgn[0];
-			}
-			break;
-		default: // se indica origen y destino
-			mov->dest = transform(pgn[2],pgn[3]);
-			mov->org = transform(pgn[0],pgn[1]);
-			orgx = mov->org%8;
-			orgy = mov->org/8;
-			break;
-	}
+	mov->dest = san->dest;
+	orgx = san->orgx;
+	orgy = san->orgy;
 	// calculamos el origen en funcion de la pieza, destino, color e indicaciones de origen
 	switch(pieza & 0x7)	// pieza sin color.
 	{
 		case REY :
 			mov->org = reymovorg(pieza & NEGRA,tab);
 			break;
-		case REINA:
-			mov->org = reinamovorg(mov->dest,orgx,orgy,pieza & 0x8,tab);
-			break;
-		case TORRE:
-			mov->org = torremovorg(mov->dest,orgx,orgy,pieza & 0x8,tab);
-			break;
-		case ALFIL:
-			mov->org = alfilmovorg(mov->dest,orgx,orgy,pieza & 0x8,tab);
-			break;
-		case CABALLO:
-			mov->org = caballomovorg(mov->dest,orgx,orgy,pieza & 0x8,tab);
+		case PEON:
+			mov->org = peonmovorg(mov->dest,orgx,san->come,pieza & 0x8,tab);
 			break;
 		default:
-			mov->org = peonmovorg(mov->dest,orgx,come,pieza & 0x8,tab);
+			mov->org = piezamovorg(pieza & 0x7,mov->dest,orgx,orgy,pieza & 0x8,tab);
 			break;
 	}
-	if(mov->org == -1)	// no se ha encontrado origen valido
+	if(mov->org >= 64)	// no se ha encontrado origen valido
 	{
 		debug("deterORG inval",5,mov,tab);
 	}
@@ -1467,7 +796,6 @@ void muevePieza(uint8_t *pgn, uint8_t color,int come,MOV_t *mov,TABLERO_t *tab)
 // funcion que realiza un enrroque largo.
 void enroquel(TABLERO_t *tab,uint8_t color)
 {
-	int i;
 	MOVBIN_t movimiento;
 	
 	if(color == NEGRA)
@@ -1483,19 +811,8 @@ void enroquel(TABLERO_t *tab,uint8_t color)
 		movimiento.destino = 2;
 		anadeMov(movimiento);
 		
-		tab->tab[4] = NADA;
-		tab->tab[2] = REY | NEGRA;
-		tab->tab[0] = NADA;
-		tab->tab[3] = TORRE | NEGRA;
-		tab->negras.rey = 2;
-		for(i=0;i<tab->negras.ntorre;i++)
-		{
-			if(tab->negras.torre[i] == 0)
-			{
-				tab->negras.torre[i] = 3;
-				return;
-			}
-		}
+		trasladaPieza(4,2,tab);
+		trasladaPieza(0,3,tab);
 	}
 	else
 	{
@@ -1510,26 +827,14 @@ void enroquel(TABLERO_t *tab,uint8_t color)
 		movimiento.destino = 58;
 		anadeMov(movimiento);
 		
-		tab->tab[60] = NADA;
-		tab->tab[58] = REY;
-		tab->tab[56] = NADA;
-		tab->tab[59] = TORRE;
-		tab->blancas.rey = 58;
-		for(i=0;i<tab->blancas.ntorre;i++)
-		{
-			if(tab->blancas.torre[i] == 56)
-			{
-				tab->blancas.torre[i] = 59;
-				return;
-			}
-		}
+		trasladaPieza(60,58,tab);
+		trasladaPieza(56,59,tab);
 	}
 }
 
 // funcion que realiza un enroque corto.
 void enroquec(TABLERO_t *tab,uint8_t color)
 {
-	int i;
 	MOVBIN_t movimiento;
 	
 	if(color == NEGRA)
@@ -1545,19 +850,8 @@ void enroquec(TABLERO_t *tab,uint8_t color)
 		movimiento.destino = 6;
 		anadeMov(movimiento);
 		
-		tab->tab[4] = NADA;
-		tab->tab[6] = REY | NEGRA;
-		tab->tab[7] = NADA;
-		tab->tab[5] = TORRE | NEGRA;
-		tab->negras.rey = 6;
-		for(i=0;i<tab->negras.ntorre;i++)
-		{
-			if(tab->negras.torre[i] == 7)
-			{
-				tab->negras.torre[i] = 5;
-				return;
-			}
-		}
+		trasladaPieza(4,6,tab);
+		trasladaPieza(7,5,tab);
 	}
 	else
 	{
@@ -1572,19 +866,8 @@ void enroquec(TABLERO_t *tab,uint8_t color)
 		movimiento.destino = 62;
 		anadeMov(movimiento);
 		
-		tab->tab[60] = NADA;
-		tab->tab[62] = REY;
-		tab->tab[63] = NADA;
-		tab->tab[61] = TORRE;
-		tab->blancas.rey = 62;
-		for(i=0;i<tab->blancas.ntorre;i++)
-		{
-			if(tab->blancas.torre[i] == 63)
-			{
-				tab->blancas.torre[i] = 61;
-				return;
-			}
-		}
+		trasladaPieza(60,62,tab);
+		trasladaPieza(63,61,tab);
 	}
 }
 
@@ -1592,8 +875,6 @@ void enroquec(TABLERO_t *tab,uint8_t color)
 // solo sustituir el peon en mov->dest por pieza de promocion mov->pieza.
 void promoPieza(MOV_t *mov,TABLERO_t *tab)
 {
-	int i;
-	PIEZAS_t *piezas;
 	MOVBIN_t movimiento;
 	
 	cabpartida.nmov--; // anulamos ultimo movimiento anotado.
@@ -1604,173 +885,329 @@ void promoPieza(MOV_t *mov,TABLERO_t *tab)
 	movimiento.destino = mov->dest;
 	anadeMov(movimiento);
 	
-	// sustituir pieza en el tablero.
+	// sustituir pieza en el tablero: baja del peon involucrado y alta de la pieza sustituida.
+	tab->bb[tab->tab[mov->dest]] &= ~CASILLA(mov->dest);
 	tab->tab[mov->dest] = mov->pieza;
-	// dar de baja peon involucrado.
-	if(mov->pieza & NEGRA)
-		piezas = &tab->negras;
-	else
-		piezas = &tab->blancas;
-		
-	// Eliminacion del peon.	
-	for(i=0;i<piezas->npeon;i++)	// localizamos peon involucrado
+	tab->bb[mov->pieza] |= CASILLA(mov->dest);
+	tab->ocupadas |= CASILLA(mov->dest);
+}
+
+
+// analiza el movimiento SAN (pgn de longitud len, sin terminar en 0) y procesa movimientos
+// especiales como enrroque y promocion. efectua movimiento de la pieza.
+void determov(char *pgn,int len,uint8_t color,MOV_t *mov,TABLERO_t *tab)
+{
+	SAN_t san;
+	
+	decodSan(pgn,len,&san);
+	// procesamiento de enrroque.
+	if(san.enroque == ENROQUE_LARGO)
 	{
-		if(piezas->peon[i] == mov->dest)
-			break;
+		enroquel(tab,color);
+		return;
 	}
-	for(i++;i<piezas->npeon;i++)	// desplazamos el resto de peones de la lista
+	if(san.enroque == ENROQUE_CORTO)
 	{
-		piezas->peon[i-1] = piezas->peon[i];
+		enroquec(tab,color);
+		return;
 	}
-	piezas->npeon--;
-	
-	// damos de alta la pieza sustituida.	
-	switch(mov->pieza & 0x7)
+	if(san.promo == 0)
 	{
-		case REINA:
-			piezas->reina[piezas->nreina] = mov->dest;
-			piezas->nreina++;
-			break;
-		case TORRE:
-			piezas->torre[piezas->ntorre] = mov->dest;
-			piezas->ntorre++;
-			break;
-		case ALFIL:
-			piezas->alfil[piezas->nalfil] = mov->dest;
-			piezas->nalfil++;
-			break;
-		case CABALLO:
-			piezas->caballo[piezas->ncaballo] = mov->dest;
-			piezas->ncaballo++;
-			break;
-		default:
-			debug("Promociona pieza invalida",6,mov,tab);
+		muevePieza(&san,color,mov,tab);
+		return;
+	}
+	// procesamiento promocion.
+	if(san.promo == INVAL)	// pieza de promocion invalida, queda el movimiento del peon.
+	{
+		debug("Determov pieza invalida",7,mov,tab);
+		muevePieza(&san,color,mov,tab);
+		return;
 	}
+	muevePieza(&san,color,mov,tab); // mueve peon
+	mov->pieza = san.promo | color;
+	promoPieza(mov,tab);	// promociona peon
 }
 
 
-// analiza string de movimiento y procesa movimientos especiales
-// como enrroque y promocion.
-// filtra signos especiales y efectua movimiento de la pieza.
-void determov(uint8_t *pgn, uint8_t color,MOV_t *mov,TABLERO_t *tab)
+// Funcion que lee un nuevo bloque del fichero de la fuente conservando los datos desde *desde,
+// que se mueven al principio del buffer (se actualizan *desde, pos y fin).
+// retorna el numero de bytes leidos (0 => final de fichero).
+int leeBloque(FUENTE_t *f,char **desde)
 {
-	uint8_t pgntmp[20],pgntmp1[20];
-	int come;
-	int pieza;
-	int i,j;
+	int conservar,despl;
+	size_t leidos;
+	char *buf;
 	
-	// procesamiento de enrroque.
-	if(strchr(pgn,'O') != NULL)
+	conservar = f->fin - *desde;
+	if((conservar + LENBLOQUE) > f->max)
 	{
-		if(strcmp(pgn,"O-O-O") == 0)
-			enroquel(tab,color);
-		else
-			enroquec(tab,color);
-		return;
+		f->max = conservar + LENBLOQUE;
+		if((buf = (char *)malloc(f->max)) == NULL)
+		{
+			fprintf(stderr,"Sin memoria para la entrada\n");
+			exit(2);
+		}
+		memcpy(buf,*desde,conservar);
+		free(f->buf);
+	}
+	else
+	{
+		buf = f->buf;
+		memmove(buf,*desde,conservar);
+	}
+	despl = *desde - f->buf;
+	f->pos = buf + (f->pos - f->buf - despl);
+	f->buf = buf;
+	*desde = buf;
+	f->fin = buf + conservar;
+	leidos = fread(f->fin,1,LENBLOQUE,f->fd);
+	f->fin += leidos;
+	return leidos;
+}
+
+// lectura de una linea de la fuente, como fgets.
+char *leeLinea(char *buf,int n,FUENTE_t *f)
+{
+	char *fin;
+	int len;
+	
+	while(1)
+	{
+		len = f->fin - f->pos;
+		if(len > (n - 1))
+			len = n - 1;
+		if((fin = memchr(f->pos,'\n',len)) != NULL)
+		{
+			len = fin - f->pos + 1;
+			break;
+		}
+		if((len == (n - 1)) || (f->fd == NULL) || (leeBloque(f,&f->pos) == 0))
+			break;
 	}
-	// anotacion pieza comida y supresion indicacion ('x')de string.
-	if(strchr(pgn,'x') != NULL)
+	if(len == 0)
+		return NULL;
+	memcpy(buf,f->pos,len);
+	buf[len] = 0;
+	f->pos += len;
+	f->lenlin = len;
+	return buf;
+}
+
+// Funcion que delimita la seccion de movimientos que comienza en la ultima linea leida de la
+// fuente: esa linea y las siguientes hasta una linea corta (menos de 5 caracteres) o sin final
+// de linea, que se incluye sin su terminador. La seccion queda en el buffer de la fuente, sin
+// copiarla, y la fuente avanza tras ella.
+void seccionMovs(FUENTE_t *f,SECMOV_t *sec)
+{
+	char *ini,*lin,*fin;
+	int desp;
+	
+	ini = f->pos - f->lenlin;
+	lin = ini;
+	while(1)
 	{
-		come = 1;
-		for(i=0,j=0;pgn[i] != 0;i++)
+		fin = memchr(lin,'\n',f->fin - lin);
+		if((fin == NULL) && (f->fd != NULL))
 		{
-			if(pgn[i] != 'x')
+			desp = lin - ini;
+			if(leeBloque(f,&ini) > 0)
 			{
-				pgntmp[j] = pgn[i];
-				j++;
+				lin = ini + desp;
+				continue;
 			}
+			lin = ini + desp;
 		}
-		pgntmp[j] = 0;
+		fin = (fin == NULL) ? f->fin : fin + 1;
+		if(((fin - lin) < 5) || (fin[-1] != '\n'))	// linea corta o sin final, acaba la seccion.
+			break;
+		lin = fin;
 	}
-	else
+	f->pos = fin;
+	while((fin > lin) && ((fin[-1] == '\n') || (fin[-1] == '\r')))
+		fin--;
+	sec->pos = ini;
+	sec->fin = fin;
+}
+
+// Funciones de busqueda del primer caracter de las clases indicadas a partir de p. retornan
+// fin si no lo hay. Con AVX2 se comparan 32 caracteres a la vez.
+char *buscaClaseEsc(char *p,char *fin,int clase)
+{
+	while((p < fin) && ((clasecar[(uint8_t)*p] & clase) == 0))
+		p++;
+	return p;
+}
+
+#ifdef __x86_64__
+__attribute__((target("avx2")))
+char *buscaFinMovAvx2(char *p,char *fin)
+{
+	__m256i v,m;
+	uint32_t bits;
+	
+	for(;(fin - p) >= 32;p += 32)
 	{
-		come = 0;
-		strcpy(pgntmp,pgn);
+		v = _mm256_loadu_si256((__m256i *)p);
+		m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8(' ')),
+												_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\n'))),
+								_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\r')));
+		m = _mm256_or_si256(m,_mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('{')),
+												_mm256_cmpeq_epi8(v,_mm256_set1_epi8('$'))));
+		m = _mm256_or_si256(m,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('(')));
+		if((bits = _mm256_movemask_epi8(m)) != 0)
+			return p + __builtin_ctz(bits);
 	}
-	// procesamiento promocion.
-	if(strchr(pgn,'=') != NULL)
+	return buscaClaseEsc(p,fin,CAR_SEP | CAR_ZONA);
+}
+
+__attribute__((target("avx2")))
+char *buscaParentesisAvx2(char *p,char *fin)
+{
+	__m256i v,m;
+	uint32_t bits;
+	
+	for(;(fin - p) >= 32;p += 32)
+	{
+		v = _mm256_loadu_si256((__m256i *)p);
+		m = _mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('(')),
+								_mm256_cmpeq_epi8(v,_mm256_set1_epi8(')')));
+		if((bits = _mm256_movemask_epi8(m)) != 0)
+			return p + __builtin_ctz(bits);
+	}
+	return buscaClaseEsc(p,fin,CAR_PAR);
+}
+#endif
+
+// final del movimiento: separador o comienzo de zona.
+static inline char *buscaFinMov(char *p,char *fin)
+{
+#ifdef __x86_64__
+	if(conavx2)
+		return buscaFinMovAvx2(p,fin);
+#endif
+	return buscaClaseEsc(p,fin,CAR_SEP | CAR_ZONA);
+}
+
+// siguiente parentesis de variante.
+static inline char *buscaParentesis(char *p,char *fin)
+{
+#ifdef __x86_64__
+	if(conavx2)
+		return buscaParentesisAvx2(p,fin);
+#endif
+	return buscaClaseEsc(p,fin,CAR_PAR);
+}
+
+// Funcion que obtiene el siguiente elemento (movimiento o numero de movimiento) de la seccion de
+// movimientos, saltando separadores, comentarios '{}', variantes '()' con anidamiento (dentro solo
+// cuentan los parentesis) y anotaciones '$' hasta el siguiente separador.
+// retorna su longitud (0 => no quedan), en *elem su comienzo y en *sep si le sigue un separador
+// o una zona dentro de la seccion.
+int siguienteElem(SECMOV_t *sec,char **elem,int *sep)
+{
+	char *p,*fin;
+	int nivel;
+	
+	p = sec->pos;
+	fin = sec->fin;
+	while(p < fin)
 	{
-		for(i=0;i<strlen(pgntmp);i++)
+		if(clasecar[(uint8_t)*p] & CAR_SEP)
+			p++;
+		else if(*p == '{')	// comentario hasta '}'.
 		{
-			if(pgntmp[i] == '=')
-			{
-				pgntmp1[i] = 0;
-				break;
-			}
+			if((p = memchr(p + 1,'}',fin - p - 1)) == NULL)
+				p = fin;
 			else
-				pgntmp1[i] = pgntmp[i];
+				p++;
 		}
-		switch(pgntmp[i+1])
+		else if(*p == '(')	// variante hasta su ')'.
 		{
-			case 'Q':
-			pieza = REINA | color;
-			break;
-		case 'R':
-			pieza = TORRE | color;
-			break;
-		case 'B':
-			pieza = ALFIL | color;
-			break;
-		case 'N':
-			pieza = CABALLO | color;
-			break;
-		default:
-			debug("Determov pieza invalida",7,mov,tab);
+			for(nivel = 1,p++;(nivel > 0) && ((p = buscaParentesis(p,fin)) < fin);p++)
+				nivel += (*p == '(') ? 1 : -1;
 		}
-		muevePieza(pgntmp1,color,come,mov,tab); // mueve peon
-		mov->pieza = pieza;
-		promoPieza(mov,tab);	// promociona peon
-		return;
+		else if(*p == '$')	// anotacion hasta el separador, incluido.
+		{
+			if((p = buscaClaseEsc(p + 1,fin,CAR_SEP)) < fin)
+				p++;
+		}
+		else
+			break;
+	}
+	if(p >= fin)
+	{
+		sec->pos = fin;
+		return 0;
 	}
-	muevePieza(pgntmp,color,come,mov,tab);
+	*elem = p;
+	sec->pos = buscaFinMov(p,fin);
+	*sep = (sec->pos < fin);
+	return sec->pos - p;
 }
 
+// Funcion que determina el ritmo de juego (RITMO_xxx) de la linea TimeControl del PGN,
+// con el formato 'base+incremento' en segundos o '-' sin control de tiempo.
+int ritmoPgn(char *linea)
+{
+	char *punte;
+	int duracion;
+	
+	if((punte = strchr(linea,'"')) == NULL)
+		return RITMO_DESCONOCIDO;
+	punte++;
+	if(*punte == '-')
+		return RITMO_CORRESPONDENCIA;
+	if((*punte < '0') || (*punte > '9'))
+		return RITMO_DESCONOCIDO;
+	duracion = atoi(punte);
+	if((punte = strchr(punte,'+')) != NULL)
+		duracion += 40 * atoi(punte + 1);
+	if(duracion < 180)
+		return RITMO_BALA;
+	if(duracion < 480)
+		return RITMO_RELAMPAGO;
+	if(duracion < 1500)
+		return RITMO_RAPIDA;
+	return RITMO_CLASICA;
+}
 
-void main(int argc, char *argv[])
+// Funcion que determina el tipo de terminacion (TERMINA_xxx) de la linea Termination del PGN.
+int terminacionPgn(char *linea)
+{
+	if(strstr(linea,"Normal") != NULL)
+		return TERMINA_NORMAL;
+	if(strstr(linea,"Time forfeit") != NULL)
+		return TERMINA_TIEMPO;
+	if(strstr(linea,"Abandoned") != NULL)
+		return TERMINA_ABANDONO;
+	if(strstr(linea,"Rules infraction") != NULL)
+		return TERMINA_INFRACCION;
+	if(strstr(linea,"Unterminated") != NULL)
+		return TERMINA_INCONCLUSA;
+	return TERMINA_DESCONOCIDA;
+}
+
+// Funcion que interpreta las partidas PGN de la fuente indicada. Por cada partida interpretada
+// (en cabpartida y movimientos) llama a 'vuelca' con el argumento indicado. elo1 y elo2 son los
+// valores de ELO con los que comienza (los de la partida anterior a la fuente).
+// retorna el numero de movimientos interpretados.
+uint64_t interpretaPgn(FUENTE_t *f,int elo1,int elo2,void (*vuelca)(void *),void *arg)
 {
 	TABLERO_t tablero;
 	MOV_t	mov;
-	uint8_t *linea;
 	uint8_t *lineain;
 	int color;
-	uint64_t  movimientos = 0;
-	char *punte,*punte1,*punte2;
-	int elo1,elo2;
-	int fileid;
-	int npartida;
-	off_t offtmp;
-	BASFICH_t bd;
-	int estado;
-	int nivelpar;
+	uint64_t nmovs = 0;
+	char *punte;
+	SECMOV_t sec;
+	char *elem;
+	int len,sep;
 
-	// la invocacion es con el nombre del comando, el path a la carpeta del fichero
-	// indexado de salida y el identificador de fichero origen (fecha=>yyyy*12+mm).
-	// la entrada de datos se supone que se efectua por STDIN que proviene de una PIPE.
-	// ejemplo:
-	//  zstdcat file_png.zst | ./genbasfich base_fich 24277
-	if(argc != 3)
-	{
-		fprintf(stderr,"Usage: %s <fichbas> <fileid> < fileorg\n",argv[0]);
-		exit(1);
-	}
-	// apertura del fichero indexado para escritura.
-	if(basfichOpenW(argv[1],&bd) == 0)
-	{
-		perror("Falla open fichbase");
-		exit(2);
-	}
-	fileid = atoi(argv[2]);
-	particionant = -1;
-	particion = 0;
-	partidas = 0;
-	npartida = 0;
-	linea = (uint8_t *)malloc(100*1024);
 	lineain = (uint8_t *)malloc(100*1024);
 	
-	// Los datos de entrada se reciben en lineain. Una vez se detecta las lineas
-	// de movimiento, se filtran y se copian a linea.
-	// al final, en linea tenemos una unica linea de movimientos filtrada.
-	while(fgets(lineain,100*1024,stdin) != NULL)	// lectura linea a linea hasta que no haya mas.
+	// Las lineas de cabecera se reciben en lineain. La seccion de movimientos se
+	// interpreta directamente en el buffer de la fuente.
+	while(leeLinea(lineain,100*1024,f) != NULL)	// lectura linea a linea hasta que no haya mas.
 	{
 		if(memcmp(lineain,"[Event ",7) == 0)	// linea comienzo de partida.
 		{
@@ -1778,7 +1215,7 @@ void main(int argc, char *argv[])
 
 			iniciaJuego(&tablero);	// inicia las estructuras del tablero virtual
 			iniPart();					// inicia las estructuras binarias de salida.
-			while(fgets(lineain,100*1024,stdin) != NULL)	// sigue leyendo lineas.
+			while(leeLinea(lineain,100*1024,f) != NULL)	// sigue leyendo lineas.
 			{
 				if(memcmp(lineain,"[Event ",7) == 0)	// comienzo de nueva partida.
 				{
@@ -1819,212 +1256,614 @@ void main(int argc, char *argv[])
 					}
 					else if(memcmp(lineain,"[Termination",7) == 0)	// Terminacion de la partida.
 					{
-						if(strstr(lineain,"Normal") != NULL)	// teminacion normal
+						cabpartida.meta.terminacion = terminacionPgn((char *)lineain);
+						if(cabpartida.meta.terminacion == TERMINA_NORMAL)	// teminacion normal
 							cabpartida.flags.tnormal = 1;
 					}
+					else if(memcmp(lineain,"[TimeControl",12) == 0)	// ritmo de juego.
+						cabpartida.meta.ritmo = ritmoPgn((char *)lineain);
+					else if(memcmp(lineain,"[ECO ",5) == 0)	// codigo de apertura.
+					{
+						punte = strchr(lineain,'"'); // el dato esta entre comillas.
+						if(punte != NULL)
+							cabpartida.meta.eco = codigoEco(punte + 1);
+					}
 					continue;
 				}
 				// Linea de movimientos..
 				cabpartida.ind = partidas;
 				cabpartida.elomed = (elo1+elo2)/2;
+				cabpartida.difelo = elo1 - elo2;
 
-				// fusionamos lineas hasta encontrar linea en blanco.
-				punte = lineain;
-				while(1)
-				{
-					if(strlen(punte) < 5) // linea en blanco finaliza mov.
-						break;
-					// limpiamos terminadores.
-					punte = strchr(punte,'\n');
-					if(punte == NULL)
-						break;
-					while((*punte == '\n') || (*punte == '\r'))
-					{
-						*punte = 0;
-						punte--;
-					}
-					if(*punte != ' ')	// si no termina en blanco la terminamos en blanco.
-					{
-						punte++;
-						*punte = ' ';
-					}
-					punte++;
-					if(fgets(punte,100*1024,stdin) == NULL) // leemos siguiente linea.
-						break;
-				}
-				
-				// filtramos comentarios y anotaciones '{' y '('. copiando
-				// datos de lineain a linea.
-				// los parentesis pueden tener anidamiento. 
-				
-				// acelerador si no hay parentesis ni $
-				if(strpbrk(lineain,"()$") == NULL)
+				// recorremos la seccion de movimientos en el buffer de entrada, elemento a elemento,
+				// sin copiarla. Los movimientos se filtran de comentarios y anotaciones.
+				seccionMovs(f,&sec);
+#ifdef TRAZAPGN
+				gpgn = "";
+				lpgn = 0;
+#endif
+				while((len = siguienteElem(&sec,&elem,&sep)) > 0)
 				{
-					punte = lineain;
-					linea[0] = 0;
-					while((punte1 = strchr(punte,'{')) != NULL)	// buscamos comienzo anotaciones
+					if((*elem >= '0') && (*elem <= '9'))	// indicacion de numero de movimiento.
 					{
-						*punte1 = 0;	// termina el string en el comienzo de anotaciones.
-						strcat(linea,punte);	// copiamos a linea filtrada.
-						
-						punte = punte1;
-						punte1 = strchr(punte1+1,'}'); // buscamos final anotaciones
-						if(punte1 != NULL)
-						{
-							punte = punte1+1;	// siguiente movimiento.
-							continue;
-						}
-						else
-							break; // no hay mas movimientos.
-					}
-					strcat(linea,punte); // copiamos cola.
-					punte1 = &linea[strlen(linea)];	// apuntamos al final de la linea.
-				}
-				else  		// hay parentesis o $ metodo largo.
-				{
-					// recorremos la linea de entrada.
-					for(punte=lineain,punte1=linea,estado = 0; *punte != 0;punte++)
-					{
-						switch(estado)
-						{
-							case 0:	// estado normal.
-								if(*punte == '(')	// comienza zona '('.
-								{
-									estado = 1;
-									nivelpar = 1;
-									break;
-								}
-								if(*punte == '{')	// comienza zona '{'.
-								{
-									estado = 2;
-									break;
-								}
-								if(*punte == '$')	// comienza zona '$'.
-								{
-									estado = 3;
-									break;
-								}
-								*punte1 = *punte;
-								punte1++;
-								break;
-							case 1:	// zona '(' esperamos cierre ')'.
-								if(*punte == ')')	// final zona '('.
-								{
-									nivelpar--;
-									if(nivelpar == 0)
-										estado = 0;
-									break;
-								}
-								if(*punte == '(')	// comienza nueva zona '('.
-								{
-									nivelpar++;
-									break;
-								}
-								break;
-							case 2:	// zona '{' esperamos cierre '}'.
-								if(*punte == '}')	// final zona '{'.
-								{
-									estado = 0;
-									break;
-								}
-								break;
-							case 3: // zona '$' esperamos cierre ' '.
-								if(*punte == ' ')	// final zona '$'.
-								{
-									estado = 0;
-									break;
-								}
-								break;
-							default:
-								fprintf(stderr,"Estado invalido\n");
-								exit(3);
-						}
-					}
-				}
-				*punte1 = 0;
-				
-				// recorremos la linea filtrada movimiento a movimiento.
-				punte1 = linea;
-				while(1)
-				{
-					punte = punte1;
-					// al final punte1 debe apuntar al siguiente movimiento
-					// tmp contiene el movimiento actual.
-					// punte contiene el principio del movimiento y punte2 el final.
-					if((*punte1 >= '0') && (*punte1 <= '9'))	// indicacion de numero de movimiento.
-					{
-						punte1 = strchr(punte,' ');	// blanco separa numero de movimiento.
-						if(punte1 == NULL)
+						if(sep == 0)	// blanco separa numero de movimiento.
 							break;
-						*punte1 = 0;
-						npgn = atoi(punte);	// Numero de movimiento
+						npgn = atoi(elem);	// Numero de movimiento
 						// determinamos color del movimiento.(blancas=>'.' Negras=>'...')
-						if(strstr(punte,"...") != NULL)
+						if(memmem(elem,len,"...",3) != NULL)
 							color = NEGRA;
 						else
 							color = 0;
-						punte1++;
-						// quitamos blancos anteriores al movimiento
-						while(*punte1 == ' ') punte1++;
-						punte = punte1;		// principio del movimiento.
+						if((len = siguienteElem(&sec,&elem,&sep)) == 0)	// movimiento.
+							break;
 					}
 					else  		// No hay numero de movimiento(notacion Nm Mbl Mneg), juegan negras.
 					{
 						color = NEGRA;
 					}
-					punte1 = strchr(punte1,' ');	// siguiente blanco final mov.
-					if(punte1 == NULL)
+					if(sep == 0)	// el movimiento debe terminar en blanco.
 						break;
-					*punte1 = 0;
-					punte2 = punte1;		// punte2 final movimiento.
-					punte1++;
-					while(*punte1 == ' ') punte1++; 	// principio siguiente movimiento.
 					// filtrado de anotaciones al final del movimiento. Simbolos de jaque y similares.
-					for(punte2 = punte2-1;punte2 != punte;punte2--)
+					for(;len > 1;len--)
 					{
-						if((*punte2 >= '0') && (*punte2 <= '9'))
+						if((elem[len-1] >= '0') && (elem[len-1] <= '9'))
 							break;
-						if((*punte2 == 'O') || (*punte2 == 'Q') || (*punte2 == 'R') | (*punte2 == 'N') || (*punte2 == 'B'))
+						if((elem[len-1] == 'O') || (elem[len-1] == 'Q') || (elem[len-1] == 'R') || (elem[len-1] == 'N') || (elem[len-1] == 'B'))
 							break;
-						*punte2 = 0;
 					}
-					if(punte2 == punte)
+					if(len == 1)
 						break;
-					strcpy(gpgna,gpgn);	// salvamos movimiento anterior (para debug).
-					strcpy(gpgn,punte);	// copiamos movimiento actual filtrado.
-					movimientos++;
+#ifdef TRAZAPGN
+					gpgna = gpgn;	// salvamos movimiento anterior (para debug).
+					lpgna = lpgn;
+					gpgn = elem;
+					lpgn = len;
+#endif
+					nmovs++;
 					
 					// determina totalmente movimiento, anota en tablero virtual y en salida.
-					determov(gpgn,color,&mov,&tablero);
-					
-					// trazas de progreso.
-					if((partidas%100)== 0)
-					{
-						printf("ind=>%d, mov=>%ju         \r",partidas,movimientos);
-						fflush(stdout);
-					}
-					punte = punte1;
+					determov(elem,len,color,&mov,&tablero);
+				}
+				break;
+			}
+			vuelca(arg);	// Vuelca partida traducida.
+		}
+	}
+	free(lineain);
+	return nmovs;
+}
+
+// Funcion que cierra una particion completa de una banda de elo: le asigna el siguiente numero de
+// particion y vuelca sus partidas al fichero indexado y/o la entrega a la carga directa.
+// Utiliza cabpartida y movimientos, la partida en curso ya debe estar anotada.
+void cierraBanda(PARTMEM_t *pm)
+{
+	int i;
+	
+	if(pm == NULL)
+		return;
+	if(pm->npartidas == 0)
+	{
+		liberaParticion(pm);
+		return;
+	}
+	particion = nparticion++;
+	if(confich)
+	{
+		for(i=0;i<pm->npartidas;i++)
+		{
+			cabpartida = pm->cab[i];
+			memcpy(movimientos,pm->movs + pm->offmov[i],cabpartida.nmov * sizeof(MOVBIN_t));
+			vuelcaPartFich(&bd,fileid);
+		}
+	}
+	if(directa)
+	{
+		pm->particion = particion;
+		cargaParticion(pm);	// el escritor la libera al grabarla.
+	}
+	else
+		liberaParticion(pm);
+}
+
+// Funcion que aplica los filtros de ingesta a la partida en curso. Las jugadas minimas se
+// comparan con las de la partida (cuentaJugadas), no con los movimientos de la lista.
+// retorna el primer filtro que no cumple (DESCARTE_xxx) o -1 si los cumple todos.
+int filtraPartida(void)
+{
+	if((minplies > 0) && (cuentaJugadas(movimientos,cabpartida.nmov) < minplies))
+		return DESCARTE_PLIES;
+	if(cabpartida.elomed < minelo)
+		return DESCARTE_ELO;
+	if(((terminaadm >> cabpartida.meta.terminacion) & 1) == 0)
+		return DESCARTE_TERMINACION;
+	if(((ritmosadm >> cabpartida.meta.ritmo) & 1) == 0)
+		return DESCARTE_RITMO;
+	return -1;
+}
+
+// Funcion que vuelca la partida interpretada en curso (cabpartida, movimientos) en el orden de la
+// entrada: si cumple los filtros de ingesta determina su particion y la pasa al fichero indexado
+// y/o a la carga directa.
+void emitePartida(void *arg)
+{
+	BANDA_t *ba;
+	PARTMEM_t *pmant = NULL;
+	uint64_t len;
+	int corte;
+	int b;
+	
+	if((b = filtraPartida()) >= 0)	// partida descartada.
+	{
+		descartes[b]++;
+		if(fddescarte != NULL)
+			fprintf(fddescarte,"%u %s %d %d %d %d\n",cabpartida.ind,nomdescarte[b],cabpartida.nmov,
+						cabpartida.elomed,cabpartida.meta.ritmo,cabpartida.meta.terminacion);
+		return;
+	}
+	// banda de elo de la partida.
+	for(b=1;(b < nbandas) && (cabpartida.elomed >= limbanda[b]);b++)
+		;
+	ba = &bandas[b - 1];
+	len = sizeof(CPARTIDA_t) + lenMovs(cabpartida.formato,cabpartida.nmov);
+	corte = (++ba->npartida >= maxpartidas);
+	if((maxbytes > 0) && (ba->bytes > 0) && ((ba->bytes + len) > maxbytes))
+		corte = 1;
+	if((maxplies > 0) && (ba->plies > 0) && ((ba->plies + cabpartida.nmov) > maxplies))
+		corte = 1;
+	if(corte)	// Nueva particion.
+	{
+		if(nbandas > 1)
+		{
+			pmant = ba->pm;	// se cierra despues de anotar la partida en curso.
+			ba->pm = NULL;
+		}
+		else
+			particion++;
+		ba->npartida = 0;
+		ba->bytes = 0;
+		ba->plies = 0;
+	}
+	ba->bytes += len;
+	ba->plies += cabpartida.nmov;
+	if(nbandas > 1)
+	{
+		// se acumula en la particion en curso de su banda.
+		if(ba->pm == NULL)
+			ba->pm = nuevaParticionMem(fileid,0);
+		anhadePartidaMem(ba->pm,&cabpartida,movimientos);
+	}
+	else
+	{
+		if(confich)
+			vuelcaPartFich(&bd,fileid);	// Vuelca partida traducida a fichero indexado.
+		if(directa)
+			vuelcaPartMem(fileid);			// y a la particion en memoria de la carga directa.
+	}
+	// trazas de progreso.
+	movemitidos += cabpartida.nmov;
+	if((cabpartida.ind % 100) == 0)
+	{
+		printf("ind=>%d, mov=>%ju         \r",cabpartida.ind,movemitidos);
+		fflush(stdout);
+	}
+	if(pmant != NULL)
+		cierraBanda(pmant);
+}
+
+//-----------------------------------------------------------
+// Modo paralelo.
+//
+// El hilo principal corta la entrada en trozos de al menos TAMTROZO bytes ('-kN' => N KB), siempre delante de
+// una linea '[Event ' en la que el interprete estaria esperando una nueva partida, y los pasa a
+// 'hilos' interpretes que los decodifican con su propio tablero en una particion en memoria.
+// El hilo principal vuelca los trozos interpretados en el orden de la entrada, de forma que el
+// indice de las partidas y los cortes de particion son los mismos que en modo secuencial.
+
+// Funcion que anota la partida interpretada en la particion en memoria de su trozo.
+void anotaTrozo(void *arg)
+{
+	anhadePartidaMem((PARTMEM_t *)arg,&cabpartida,movimientos);
+}
+
+// Hilo interprete de trozos.
+void *interprete(void *arg)
+{
+	TROZO_t *t;
+	FUENTE_t f;
+	
+	while(1)
+	{
+		pthread_mutex_lock(&mutextrozos);
+		while((asignados == producidos) && (finentrada == 0))
+			pthread_cond_wait(&condtrozos,&mutextrozos);
+		if(asignados == producidos)
+		{
+			pthread_mutex_unlock(&mutextrozos);
+			break;
+		}
+		t = &trozos[asignados % ntrozos];
+		asignados++;
+		pthread_mutex_unlock(&mutextrozos);
+		
+		partidas = t->base;
+		memset(&f,0,sizeof(f));
+		f.pos = t->texto;
+		f.fin = t->texto + t->len;
+		t->res = nuevaParticionMem(0,0);
+		t->nmovs = interpretaPgn(&f,t->elo1,t->elo2,anotaTrozo,t->res);
+		
+		pthread_mutex_lock(&mutextrozos);
+		t->estado = TROZO_HECHO;
+		pthread_cond_broadcast(&condtrozos);
+		pthread_mutex_unlock(&mutextrozos);
+	}
+	return NULL;
+}
+
+// Funcion que espera a que el trozo este interpretado y vuelca sus partidas.
+uint64_t emiteTrozo(TROZO_t *t)
+{
+	PARTMEM_t *res;
+	int i;
+	
+	pthread_mutex_lock(&mutextrozos);
+	while(t->estado != TROZO_HECHO)
+		pthread_cond_wait(&condtrozos,&mutextrozos);
+	pthread_mutex_unlock(&mutextrozos);
+	res = t->res;
+	for(i=0;i<res->npartidas;i++)
+	{
+		cabpartida = res->cab[i];
+		memcpy(movimientos,res->movs + res->offmov[i],cabpartida.nmov * sizeof(MOVBIN_t));
+		emitePartida(NULL);
+	}
+	liberaParticion(res);
+	t->res = NULL;
+	t->len = 0;
+	t->estado = TROZO_LIBRE;
+	return t->nmovs;
+}
+
+// Funcion que interpreta la entrada estandar con el numero de hilos indicado.
+// retorna el numero de movimientos interpretados.
+uint64_t interpretaParalelo(int hilos)
+{
+	pthread_t *hilo;
+	TROZO_t *t;
+	FUENTE_t entrada;
+	char *lin;
+	int i,len;
+	int estado = 0;		// estado del interprete: 0 => espera partida, 1 => cabecera, 2 => movimientos.
+	int elo1 = 0,elo2 = 0;
+	uint64_t nmovs = 0;
+	
+	ntrozos = 2 * hilos + 2;
+	if(((trozos = calloc(ntrozos,sizeof(TROZO_t))) == NULL) || ((hilo = calloc(hilos,sizeof(pthread_t))) == NULL))
+		exit(2);
+	lin = (char *)malloc(100*1024);
+	for(i=0;i<hilos;i++)
+	{
+		if(pthread_create(&hilo[i],NULL,interprete,NULL) != 0)
+		{
+			perror("pthread_create");
+			exit(2);
+		}
+	}
+	t = &trozos[0];
+	partidas = 0;
+	memset(&entrada,0,sizeof(entrada));
+	entrada.fd = stdin;
+	while(leeLinea(lin,100*1024,&entrada) != NULL)
+	{
+		len = strlen(lin);
+		if((estado == 0) && (memcmp(lin,"[Event ",7) == 0) && (t->len >= tamtrozo))
+		{
+			// entregamos el trozo a los interpretes y pasamos al siguiente, volcando antes
+			// el que lo ocupaba.
+			pthread_mutex_lock(&mutextrozos);
+			t->estado = TROZO_PENDIENTE;
+			producidos++;
+			pthread_cond_broadcast(&condtrozos);
+			pthread_mutex_unlock(&mutextrozos);
+			t = &trozos[producidos % ntrozos];
+			if(t->estado != TROZO_LIBRE)
+				nmovs += emiteTrozo(t);
+			t->base = partidas;
+			t->elo1 = elo1;
+			t->elo2 = elo2;
+		}
+		if((t->len + len) > t->max)
+		{
+			t->max = (t->len + len) * 2;
+			if((t->texto = realloc(t->texto,t->max)) == NULL)
+				exit(2);
+		}
+		memcpy(t->texto + t->len,lin,len);
+		t->len += len;
+		// seguimos el estado en que el interprete leeria la linea.
+		switch(estado)
+		{
+			case 0:	// espera comienzo de partida.
+				if(memcmp(lin,"[Event ",7) == 0)
+				{
+					partidas++;
+					estado = 1;
+				}
+				break;
+			case 1:	// cabecera de partida.
+				if(memcmp(lin,"[Event ",7) == 0)
+				{
+					elo1 = 0;
+					elo2 = 0;
+					partidas++;
 				}
+				if(lin[0] == '1')	// linea de movimientos, se fusionan las siguientes hasta una corta.
+					estado = ((len >= 5) && (lin[len - 1] == '\n')) ? 2 : 0;
+				else if((memcmp(lin,"[WhiteElo",9) == 0) && (strchr(lin,'"') != NULL))
+					elo1 = atoi(strchr(lin,'"') + 1);
+				else if((memcmp(lin,"[BlackElo",9) == 0) && (strchr(lin,'"') != NULL))
+					elo2 = atoi(strchr(lin,'"') + 1);
+				break;
+			case 2:	// lineas de movimientos.
+				if((len < 5) || (lin[len - 1] != '\n'))
+					estado = 0;
 				break;
+		}
+	}
+	// ultimo trozo.
+	pthread_mutex_lock(&mutextrozos);
+	t->estado = TROZO_PENDIENTE;
+	producidos++;
+	finentrada = 1;
+	pthread_cond_broadcast(&condtrozos);
+	pthread_mutex_unlock(&mutextrozos);
+	// volcamos los trozos pendientes en orden.
+	for(i=producidos-ntrozos;i<producidos;i++)
+	{
+		if((i >= 0) && (trozos[i % ntrozos].estado != TROZO_LIBRE))
+			nmovs += emiteTrozo(&trozos[i % ntrozos]);
+	}
+	for(i=0;i<hilos;i++)
+		pthread_join(hilo[i],NULL);
+	for(i=0;i<ntrozos;i++)
+		free(trozos[i].texto);
+	free(trozos);
+	free(hilo);
+	free(lin);
+	free(entrada.buf);
+	return nmovs;
+}
+
+void main(int argc, char *argv[])
+{
+	FUENTE_t entrada;
+	uint64_t  movimientos = 0;
+	int hilos = 1;
+	int i;
+	char *p;
+	char basmaster[1000];
+	char nombase[1000];
+	sqlite3 *dbmaster;
+	int res;
+
+	// la invocacion es con el nombre del comando, el path a la carpeta del fichero
+	// indexado de salida y el identificador de fichero origen (fecha=>yyyy*12+mm).
+	// opcionalmente el formato de grabacion de movimientos (0=>MOVBIN_t, 1=>compacto, por defecto)
+	// y para la carga directa la carpeta de las bases y su fichero de configuracion.
+	// la entrada de datos se supone que se efectua por STDIN que proviene de una PIPE.
+	// ejemplos:
+	//  zstdcat file_png.zst | ./genbasfich base_fich 24277
+	//  zstdcat file_png.zst | ./genbasfich - 24277 1 base conf/base.conf
+	// opciones delante de los argumentos: '-hN' => la entrada se interpreta con N hilos (con
+	// '-kN' en trozos de N KB en lugar de TAMTROZO),
+	// '-s' => cada particion cerrada se sincroniza en disco, '-pN' '-bN' '-mN' '-eE1,E2..' =>
+	// politica de particion (ver BANDA_t), '-nN' '-aN' '-tT1,T2..' '-rR1,R2..' => filtros de ingesta
+	// y '-dfichero' => fichero de partidas descartadas.
+	while((argc > 1) && (argv[1][0] == '-') && (argv[1][1] != 0))
+	{
+		if(memcmp(argv[1],"-h",2) == 0)
+		{
+			if((hilos = atoi(argv[1] + 2)) < 1)
+				hilos = 1;
+		}
+		else if(strcmp(argv[1],"-s") == 0)
+			sincroniza = 1;
+		else if(argv[1][1] == 'k')
+		{
+			if((tamtrozo = atoi(argv[1] + 2) * 1024) < 1024)
+				tamtrozo = 1024;
+		}
+		else if(argv[1][1] == 'p')
+			maxpartidas = atoi(argv[1] + 2);
+		else if(argv[1][1] == 'b')
+			maxbytes = (uint64_t)atoi(argv[1] + 2) * 1024 * 1024;
+		else if(argv[1][1] == 'm')
+			maxplies = (uint64_t)atoi(argv[1] + 2) * 1000;
+		else if(argv[1][1] == 'n')
+			minplies = atoi(argv[1] + 2);
+		else if(argv[1][1] == 'a')
+			minelo = atoi(argv[1] + 2);
+		else if(argv[1][1] == 't')
+			terminaadm = mascaraLista(argv[1] + 2);
+		else if(argv[1][1] == 'r')
+			ritmosadm = mascaraLista(argv[1] + 2);
+		else if(argv[1][1] == 'd')
+		{
+			if((fddescarte = fopen(argv[1] + 2,"w")) == NULL)
+			{
+				perror(argv[1] + 2);
+				exit(1);
 			}
-			npartida++;
-			
-			if(npartida >= 1000000)	// Nueva particion.
+		}
+		else if(argv[1][1] == 'e')
+		{
+			// limites de las bandas de elo en orden creciente.
+			for(p=argv[1]+2,nbandas=1;(*p != 0) && (nbandas < MAXBANDAS);nbandas++)
 			{
-				particion++;
-				npartida = 0;
+				limbanda[nbandas] = strtol(p,&p,10);
+				if((limbanda[nbandas] <= limbanda[nbandas - 1]) || ((*p != ',') && (*p != 0)))
+				{
+					fprintf(stderr,"Bandas de elo invalidas: %s\n",argv[1] + 2);
+					exit(1);
+				}
+				if(*p == ',')
+					p++;
 			}
-			vuelcaPart(&bd,fileid);	// Vuelca partida traducida a fichero indexado.
+		}
+		else
+			break;
+		argv[1] = argv[0];
+		argv++;
+		argc--;
+	}
+	if(((argc != 3) && (argc != 4) && (argc != 6)) || (maxpartidas < 1))
+	{
+		fprintf(stderr,"Usage: %s [-hN] [-kN] [-s] [-pN] [-bN] [-mN] [-eE1,E2..] [-nN] [-aN] [-tT1,T2..] [-rR1,R2..] [-dfichero] <fichbas|-> <fileid> [formatomov [carpetabases base.conf]] < fileorg\n",argv[0]);
+		exit(1);
+	}
+	if(argc >= 4)
+	{
+		formatomov = atoi(argv[3]);
+		if((formatomov != FORMATO_MOVBIN) && (formatomov != FORMATO_COMPACTO))
+		{
+			fprintf(stderr,"Formato de movimientos invalido=>%d\n",formatomov);
+			exit(1);
 		}
 	}
+	confich = strcmp(argv[1],"-");
+	fileid = atoi(argv[2]);
+	if((argc != 6) && (confich == 0))
+	{
+		fprintf(stderr,"Sin fichero indexado es necesaria la carga directa\n");
+		exit(1);
+	}
+	if(confich)
+	{
+		// apertura del fichero indexado para escritura (se anhade al final).
+		if(basfichOpenW(argv[1],&bd) == 0)
+		{
+			perror("Falla open fichbase");
+			exit(2);
+		}
+		// descartamos lo grabado por una ejecucion interrumpida despues del ultimo fileid completo
+		// (o creamos el manifiesto antes de grabar nada si es la primera ejecucion).
+		if((res = preparaManifiesto(argv[1],&bd)) <= 0)
+		{
+			if(res < 0)
+				fprintf(stderr,"El fichero indexado %s tiene particiones sin manifiesto\n",argv[1]);
+			else
+				perror("Falla manifiesto fichbase");
+			exit(2);
+		}
+		// un fileid ya anhadido no se vuelve a anhadir.
+		if(fileidCargado(argv[1],fileid))
+		{
+			fprintf(stderr,"El fileid %d ya esta en el fichero indexado\n",fileid);
+			basfichClose(&bd);
+			exit(0);
+		}
+	}
+	if(argc == 6)
+	{
+		// carga directa de las bases.
+		if(getConfBase(argv[5],&cnfbas) == 0)
+		{
+			fprintf(stderr,"Configuracion base invalida\n");
+			exit(1);
+		}
+		if((cnfbas.partbloque > 0) && (cnfbas.columnar == 0) && (cnfbas.almacen == ALMACEN_SQLITE))
+		{
+			fprintf(stderr,"La carga directa no admite bloques comprimidos, utilizar fich2sqlite\n");
+			exit(1);
+		}
+		if(sqlite3_threadsafe() == 0)
+		{
+			fprintf(stderr,"La libreria SQLITE no admite hilos, utilizar fich2sqlite\n");
+			exit(1);
+		}
+		sprintf(basmaster,"%s/base_0/%s",argv[4],cnfbas.nombase);
+		cnfbas.basmaster = basmaster;
+		// un fileid ya anotado en la tabla de particiones master no se vuelve a cargar.
+		conectaSqlite(&dbmaster,basmaster);
+		if(existeParticion(dbmaster,fileid,-1))
+		{
+			fprintf(stderr,"El fileid %d ya esta cargado en las bases\n",fileid);
+			exit(0);
+		}
+		desconectaSqlite(dbmaster);
+		// las particiones se anotan en la tabla master al final de la carga, una carga directa
+		// interrumpida deja partidas del fileid en las bases que se borran antes de repetirla.
+		// (el almacen clave-valor no incorpora una carga interrumpida y los ficheros columnares
+		// se reescriben completos).
+		if((cnfbas.columnar == 0) && (cnfbas.almacen == ALMACEN_SQLITE))
+		{
+			for(i=0;i<cnfbas.numbases;i++)
+			{
+				sprintf(nombase,"%s/base_%01d/%s",argv[4],i,cnfbas.nombase);
+				conectaSqlite(&dbmaster,nombase);
+				borraParticion(dbmaster,fileid,-1);
+				desconectaSqlite(dbmaster);
+			}
+		}
+		iniCarga(&cnfbas,argv[4]);
+		directa = 1;
+	}
+	particionant = -1;
+	particion = 0;
+	partidas = 0;
+#ifdef __x86_64__
+	conavx2 = __builtin_cpu_supports("avx2");
+#endif
+	iniTablas();
 	
-	// anota longitud en indices de actual particion.
-	offtmp = lseek(bd.fdpartidas,0,SEEK_END);
-	particioncur.len = offtmp - particioncur.offset;
-	anhadeParticion(&bd,&particioncur);	// anahade particion actual.
-	ordenaPartidas(&bd,fileid,particioncur.particion);	// ordena partidas de particion actual.
-	basfichClose(&bd);	// cierra fichero indexado.
+	if(hilos > 1)
+		movimientos = interpretaParalelo(hilos);
+	else
+	{
+		memset(&entrada,0,sizeof(entrada));
+		entrada.fd = stdin;
+		movimientos = interpretaPgn(&entrada,0,0,emitePartida,NULL);
+		free(entrada.buf);
+	}
+	// con bandas de elo quedan en memoria las particiones en curso de cada banda.
+	for(i=0;i<nbandas;i++)
+	{
+		cierraBanda(bandas[i].pm);
+		bandas[i].pm = NULL;
+	}
+	
+	if(confich)
+	{
+		// cierra la particion actual: ordena sus partidas, reordena sus datos y la anhade a particiones.
+		// sin partidas en la entrada no hay particion que cerrar.
+		if((particionant >= 0) && !cierraParticion(&bd,&particioncur))
+		{
+			fprintf(stderr,"Fallo escritura particion %d\n",particioncur.particion);
+			exit(4);
+		}
+		anotaManifiesto(argv[1],&bd,fileid,particion + 1,partidas);	// fileid completo.
+		basfichClose(&bd);	// cierra fichero indexado.
+	}
+	if(directa)
+	{
+		// entrega la ultima particion y espera a que se graben todas.
+		if(pmcur != NULL)
+			cargaParticion(pmcur);
+		if(finCarga())
+		{
+			fprintf(stderr,"Carga de las bases con errores\n");
+			exit(3);
+		}
+	}
 	fprintf(stderr,"\nFINAL====Partidas=>%d, MOV=>%ju\n",partidas,movimientos);
+	fprintf(stderr,"Descartadas=>");
+	for(i=0;i<NDESCARTES;i++)
+		fprintf(stderr," %s:%d",nomdescarte[i],descartes[i]);
+	fprintf(stderr,"\n");
+	if((fddescarte != NULL) && (fclose(fddescarte) != 0))
+		perror("Fichero de partidas descartadas");
 //	close(fd);
 	printf("\n");
+	exit(0);		// cargameses comprueba el estado de terminacion.
 }
@@ -0,0 +1,440 @@
+// modulo : kvdrv.c
+// autor  : Antonio Pardo Redondo
+//
+// Modulo que implementa el almacen clave-valor de partidas proyectado en memoria
+// (ver kvdrv.h).
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "kvdrv.h"
+#include "codmov.h"
+
+#define MAXALMACENES	16		// almacenes abiertos simultaneamente.
+
+static BASEKV_t *almacenes[MAXALMACENES];
+
+// codifica la clave de una partida en big endian.
+static void ponClave(uint8_t *clave,int fileid,int particion,int elomed,int ganador,uint32_t partidaid)
+{
+	clave[0] = fileid >> 8;
+	clave[1] = fileid;
+	clave[2] = particion >> 8;
+	clave[3] = particion;
+	clave[4] = elomed >> 8;
+	clave[5] = elomed;
+	clave[6] = ganador;
+	clave[7] = partidaid >> 24;
+	clave[8] = partidaid >> 16;
+	clave[9] = partidaid >> 8;
+	clave[10] = partidaid;
+}
+
+// compara dos entradas por su clave (qsort).
+static int compaEntrada(const void *a,const void *b)
+{
+	return(memcmp(((ENTRADAKV_t *)a)->clave,((ENTRADAKV_t *)b)->clave,LENCLAVEKV));
+}
+
+// retorna la primera entrada del segmento con clave >= la indicada.
+static uint32_t buscaClave(SEGKV_t *seg,uint8_t *clave)
+{
+	uint32_t ini = 0,fin = seg->cab->nentradas,med;
+
+	while(ini < fin)
+	{
+		med = (ini + fin) / 2;
+		if(memcmp(seg->entradas[med].clave,clave,LENCLAVEKV) < 0)
+			ini = med + 1;
+		else
+			fin = med;
+	}
+	return ini;
+}
+
+// proyecta en memoria el segmento indicado. retorna '1' si es valido.
+static int abreSegmento(BASEKV_t *base,int num,SEGKV_t *seg)
+{
+	char path[1100];
+	struct stat st;
+	int fd;
+
+	memset(seg,0,sizeof(SEGKV_t));
+	seg->num = num;
+	sprintf(path,"%s/%08d.seg",base->path,num);
+	if((fd = open(path,O_RDONLY)) < 0)
+	{
+		perror(path);
+		return 0;
+	}
+	if((fstat(fd,&st) < 0) || (st.st_size < sizeof(CABKV_t)))
+	{
+		close(fd);
+		return 0;
+	}
+	seg->lenmapa = st.st_size;
+	seg->mapa = mmap(NULL,seg->lenmapa,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(seg->mapa == MAP_FAILED)
+	{
+		seg->mapa = NULL;
+		return 0;
+	}
+	seg->cab = (CABKV_t *)seg->mapa;
+	if((seg->cab->magic != MAGICKV) || (seg->cab->version < 1) || (seg->cab->version > VERSIONKV) ||
+		((seg->cab->offentradas + seg->cab->nentradas * sizeof(ENTRADAKV_t)) > seg->lenmapa))
+	{
+		fprintf(stderr,"Segmento invalido: %s\n",path);
+		munmap(seg->mapa,seg->lenmapa);
+		seg->mapa = NULL;
+		return 0;
+	}
+	seg->entradas = (ENTRADAKV_t *)(seg->mapa + seg->cab->offentradas);
+	return 1;
+}
+
+// anhade un segmento a la lista de segmentos vigentes del almacen.
+static void anhadeSegmento(BASEKV_t *base,int num)
+{
+	if((base->seg = realloc(base->seg,(base->nseg + 1) * sizeof(SEGKV_t))) == NULL)
+	{
+		fprintf(stderr,"Sin memoria para segmentos\n");
+		exit(2);
+	}
+	if(abreSegmento(base,num,&base->seg[base->nseg]) == 0)
+		exit(2);
+	base->nseg++;
+	if(num >= base->sigseg)
+		base->sigseg = num + 1;
+}
+
+// reescribe el MANIFEST con los segmentos vigentes mas el nuevo de forma atomica.
+static void grabaManifest(BASEKV_t *base,int nuevo)
+{
+	char path[1100],pathtmp[1100];
+	FILE *fd;
+	int i;
+
+	sprintf(path,"%s/%s",base->path,MANIFESTKV);
+	sprintf(pathtmp,"%s/%s.tmp",base->path,MANIFESTKV);
+	if((fd = fopen(pathtmp,"w")) == NULL)
+	{
+		perror(pathtmp);
+		exit(2);
+	}
+	for(i=0;i<base->nseg;i++)
+		fprintf(fd,"%d\n",base->seg[i].num);
+	fprintf(fd,"%d\n",nuevo);
+	fflush(fd);
+	fsync(fileno(fd));
+	fclose(fd);
+	if(rename(pathtmp,path) < 0)
+	{
+		perror(path);
+		exit(2);
+	}
+}
+
+// Funcion para abrir el almacen de la carpeta indicada (se crea si no existe).
+// Los almacenes se cachean por path, una segunda llamada retorna el ya abierto.
+BASEKV_t *conectaKv(char *path)
+{
+	BASEKV_t *base;
+	char linea[1100];
+	FILE *fd;
+	int i,libre = -1;
+
+	for(i=0;i<MAXALMACENES;i++)
+	{
+		if((almacenes[i] != NULL) && (strcmp(almacenes[i]->path,path) == 0))
+			return(almacenes[i]);
+		if((almacenes[i] == NULL) && (libre < 0))
+			libre = i;
+	}
+	if(libre < 0)
+	{
+		fprintf(stderr,"Demasiados almacenes abiertos\n");
+		exit(2);
+	}
+	if((mkdir(path,0777) < 0) && (errno != EEXIST))
+	{
+		perror(path);
+		exit(2);
+	}
+	if((base = calloc(1,sizeof(BASEKV_t))) == NULL)
+	{
+		fprintf(stderr,"Sin memoria para almacen\n");
+		exit(2);
+	}
+	strncpy(base->path,path,sizeof(base->path) - 1);
+	// segmentos vigentes segun el MANIFEST.
+	sprintf(linea,"%s/%s",path,MANIFESTKV);
+	if((fd = fopen(linea,"r")) != NULL)
+	{
+		while(fgets(linea,sizeof(linea),fd) != NULL)
+		{
+			if(strlen(linea) > 1)
+				anhadeSegmento(base,atoi(linea));
+		}
+		fclose(fd);
+	}
+	almacenes[libre] = base;
+	return base;
+}
+
+// Funcion para cerrar un almacen y liberar sus segmentos.
+void desconectaKv(BASEKV_t *base)
+{
+	int i;
+
+	for(i=0;i<MAXALMACENES;i++)
+	{
+		if(almacenes[i] == base)
+			almacenes[i] = NULL;
+	}
+	for(i=0;i<base->nseg;i++)
+		munmap(base->seg[i].mapa,base->seg[i].lenmapa);
+	free(base->seg);
+	free(base->pend);
+	free(base);
+}
+
+// Funcion para cerrar todos los almacenes abiertos.
+void cierraAlmacenes(void)
+{
+	int i;
+
+	for(i=0;i<MAXALMACENES;i++)
+	{
+		if(almacenes[i] != NULL)
+			desconectaKv(almacenes[i]);
+	}
+}
+
+// Funcion para comenzar una transaccion de carga. Los valores se graban en un segmento
+// temporal a continuacion de la cabecera conforme se anhaden las partidas.
+void beginTransKv(BASEKV_t *base,int formato)
+{
+	char path[1100];
+	CABKV_t cab;
+
+	sprintf(path,"%s/%08d.seg.tmp",base->path,base->sigseg);
+	if((base->fd = fopen(path,"w")) == NULL)
+	{
+		perror(path);
+		exit(2);
+	}
+	memset(&cab,0,sizeof(CABKV_t));
+	fwrite(&cab,sizeof(CABKV_t),1,base->fd);
+	base->off = sizeof(CABKV_t);
+	base->npend = 0;
+	base->formato = formato;
+}
+
+// Funcion para anhadir una partida a la transaccion en curso.
+void vuelcaPartKv(BASEKV_t *base,CPARTIDA_t *cabpar,MOVBIN_t *mov,int fileid,int particion)
+{
+	uint8_t datos[MAXMOV * sizeof(MOVBIN_t)];
+	VALORKV_t valor;
+	ENTRADAKV_t *ent;
+	uint8_t ganador;
+
+	if(cabpar->nmov == 0)
+		return;
+	if(base->npend == base->maxpend)
+	{
+		base->maxpend = base->maxpend ? base->maxpend * 2 : 65536;
+		if((base->pend = realloc(base->pend,base->maxpend * sizeof(ENTRADAKV_t))) == NULL)
+		{
+			fprintf(stderr,"Sin memoria para claves\n");
+			exit(2);
+		}
+	}
+	// codificacion de ganador (0=NADA, 1=>blancas, 2=>negras, 3=tablas).
+	ganador = cabpar->flags.ganablanca;
+	ganador += cabpar->flags.gananegra * 2;
+	ent = &base->pend[base->npend++];
+	ponClave(ent->clave,fileid,particion,cabpar->elomed,ganador,cabpar->ind);
+	ent->reser = 0;
+	ent->offvalor = base->off;
+	memset(&valor,0,sizeof(VALORKV_t));
+	valor.formato = base->formato;
+	valor.nmov = cabpar->nmov;
+	valor.lenmov = codificaMovs(mov,cabpar->nmov,base->formato,datos);
+	valor.meta = cabpar->meta;
+	valor.difelo = cabpar->difelo;
+	fwrite(&valor,sizeof(VALORKV_t),1,base->fd);
+	fwrite(datos,valor.lenmov,1,base->fd);
+	base->off += sizeof(VALORKV_t) + valor.lenmov;
+}
+
+// Funcion para finalizar la transaccion en curso. Se graba el indice ordenado y la
+// cabecera, se sincroniza el segmento y se incorpora al MANIFEST.
+void endTransKv(BASEKV_t *base)
+{
+	char path[1100],pathtmp[1100];
+	CABKV_t cab;
+	int num = base->sigseg;
+
+	if(base->fd == NULL)
+		return;
+	memset(&cab,0,sizeof(CABKV_t));
+	cab.magic = MAGICKV;
+	cab.version = VERSIONKV;
+	cab.nentradas = base->npend;
+	cab.offentradas = base->off;
+	if(base->npend > 0)
+	{
+		qsort(base->pend,base->npend,sizeof(ENTRADAKV_t),compaEntrada);
+		memcpy(cab.clavemin,base->pend[0].clave,LENCLAVEKV);
+		memcpy(cab.clavemax,base->pend[base->npend - 1].clave,LENCLAVEKV);
+		fwrite(base->pend,sizeof(ENTRADAKV_t),base->npend,base->fd);
+	}
+	fseek(base->fd,0,SEEK_SET);
+	fwrite(&cab,sizeof(CABKV_t),1,base->fd);
+	fflush(base->fd);
+	fsync(fileno(base->fd));
+	fclose(base->fd);
+	base->fd = NULL;
+	sprintf(pathtmp,"%s/%08d.seg.tmp",base->path,num);
+	if(base->npend == 0)	// transaccion vacia.
+	{
+		unlink(pathtmp);
+		return;
+	}
+	sprintf(path,"%s/%08d.seg",base->path,num);
+	if(rename(pathtmp,path) < 0)
+	{
+		perror(path);
+		exit(2);
+	}
+	grabaManifest(base,num);
+	anhadeSegmento(base,num);
+	base->npend = 0;
+}
+
+// Funcion para lanzar un QUERY de partidas de fileid y particion con elomin < elomed < elomax
+// y el ganador indicado (0 => cualquiera). Se descartan los segmentos cuyo rango de claves
+// no alcanza al del QUERY y en el resto se localiza el rango por busqueda binaria.
+// El filtro de metadatos se aplica al leer cada partida.
+void lanzaQueryKv(BASEKV_t *base,QUERYKV_t *q,int fileid,int particion,int elomin,int elomax,int gana,FILTROMETA_t *filtro)
+{
+	uint8_t desde[LENCLAVEKV],hasta[LENCLAVEKV];
+	CURSORKV_t *cur;
+	SEGKV_t *seg;
+	int i;
+
+	ponClave(desde,fileid,particion,elomin + 1,0,0);
+	ponClave(hasta,fileid,particion,elomax,0,0);
+	if((q->cur = malloc((base->nseg + 1) * sizeof(CURSORKV_t))) == NULL)
+	{
+		fprintf(stderr,"Sin memoria para QUERY\n");
+		exit(2);
+	}
+	q->ncur = 0;
+	q->gana = gana;
+	q->filtro = filtro;
+	if(elomin + 1 >= elomax)
+		return;
+	// del segmento mas reciente al mas antiguo para que prevalezca el mas reciente.
+	for(i=base->nseg - 1;i>=0;i--)
+	{
+		seg = &base->seg[i];
+		if((seg->cab->nentradas == 0) || (memcmp(seg->cab->clavemax,desde,LENCLAVEKV) < 0) ||
+			(memcmp(seg->cab->clavemin,hasta,LENCLAVEKV) >= 0))
+			continue;
+		cur = &q->cur[q->ncur];
+		cur->seg = seg;
+		cur->pos = buscaClave(seg,desde);
+		cur->fin = buscaClave(seg,hasta);
+		if(cur->pos < cur->fin)
+			q->ncur++;
+	}
+}
+
+// Funcion que indica si todos los segmentos del QUERY tienen metadatos.
+// retorna '1' si los tienen y '0' si alguno es de la version 1.
+int metadatosQueryKv(QUERYKV_t *q)
+{
+	int i;
+
+	for(i=0;i<q->ncur;i++)
+	{
+		if(q->cur[i].seg->cab->version < 2)
+			return 0;
+	}
+	return 1;
+}
+
+// Funcion para obtener la siguiente partida del QUERY en el orden de la clave, mezclando
+// los cursores de los segmentos. Los movimientos se copian del segmento proyectado tal y
+// como estan grabados, detras de la cabecera del valor de la version del segmento.
+int nextPartidaKv(QUERYKV_t *q,CPARTIDA_t *cabpar,MOVBIN_t *mov)
+{
+	CURSORKV_t *cur,*min;
+	ENTRADAKV_t *ent;
+	VALORKV_t *valor;
+	uint8_t *clave;
+	int lenvalor;
+	int i;
+
+	while(1)
+	{
+		// cursor con la menor clave, en caso de igualdad el del segmento mas reciente.
+		for(i=0,min=NULL;i<q->ncur;i++)
+		{
+			cur = &q->cur[i];
+			if(cur->pos >= cur->fin)
+				continue;
+			if((min == NULL) || (memcmp(cur->seg->entradas[cur->pos].clave,min->seg->entradas[min->pos].clave,LENCLAVEKV) < 0))
+				min = cur;
+		}
+		if(min == NULL)
+			return 0;	// no hay mas partidas en el QUERY.
+		ent = &min->seg->entradas[min->pos];
+		clave = ent->clave;
+		// se descartan las claves repetidas del resto de segmentos.
+		for(i=0;i<q->ncur;i++)
+		{
+			cur = &q->cur[i];
+			while((cur->pos < cur->fin) && (memcmp(cur->seg->entradas[cur->pos].clave,clave,LENCLAVEKV) == 0))
+				cur->pos++;
+		}
+		if((q->gana != 0) && (clave[6] != q->gana))
+			continue;
+		// rellena cabpartida y movimientos.
+		memset(cabpar,0,sizeof(CPARTIDA_t));
+		cabpar->elomed = (clave[4] << 8) | clave[5];
+		cabpar->ind = ((uint32_t)clave[7] << 24) | (clave[8] << 16) | (clave[9] << 8) | clave[10];
+		cabpar->flags.ganablanca = clave[6] & 1;
+		cabpar->flags.gananegra = (clave[6] >> 1) & 1;
+		valor = (VALORKV_t *)(min->seg->mapa + ent->offvalor);
+		lenvalor = LENVALORKV1;
+		if(min->seg->cab->version >= 2)
+		{
+			cabpar->meta = valor->meta;
+			cabpar->difelo = valor->difelo;
+			lenvalor = sizeof(VALORKV_t);
+		}
+		if((q->filtro != NULL) && !cumpleMeta(q->filtro,cabpar->meta,cabpar->difelo))
+			continue;
+		cabpar->formato = valor->formato;
+		cabpar->nmov = valor->nmov;
+		memcpy(mov,(uint8_t *)valor + lenvalor,valor->lenmov);
+		return 1;
+	}
+}
+
+// Funcion para liberar el QUERY.
+void liberaQueryKv(QUERYKV_t *q)
+{
+	free(q->cur);
+	q->cur = NULL;
+	q->ncur = 0;
+}
@@ -0,0 +1,145 @@
+// modulo : kvdrv.h
+// autor  : Antonio Pardo Redondo
+//
+// Modulo que implementa un almacen clave-valor proyectado en memoria como alternativa a
+// SQLITE para las partidas de una base (ALMACEN=1 en base.conf). Ofrece las mismas
+// operaciones que sqlitedrv.h: conexion, transaccion de carga, volcado de partida, QUERY
+// por fileid, particion, rango de elomed y ganador, y lectura de la siguiente partida.
+//
+// La clave de cada partida es (fileid, particion, elomed, ganador, partidaid) codificada
+// en big endian, de forma que el orden de memcmp es el de la clave. El valor es una
+// cabecera VALORKV_t (con los metadatos META_t y la diferencia de elo de la partida)
+// seguida de la lista de movimientos en el formato de grabacion. Los segmentos de la
+// version 1 tienen una cabecera de LENVALORKV1 bytes sin metadatos y se siguen leyendo,
+// sus partidas tienen los metadatos a cero.
+//
+// El almacen es una carpeta con segmentos inmutables ordenados por clave y un fichero
+// MANIFEST con la lista de segmentos vigentes. Cada transaccion de carga graba un segmento
+// nuevo (valores seguidos del indice de claves ordenado) en un fichero temporal, lo
+// sincroniza y lo incorpora reescribiendo el MANIFEST con 'rename', de forma que una
+// carga interrumpida no deja rastro en el almacen.
+//
+// La lectura proyecta los segmentos con mmap y localiza el rango de claves del QUERY con
+// busqueda binaria sobre el indice, sin decodificar filas. Si varios segmentos contienen
+// la misma clave prevalece el mas reciente.
+//
+// Disposicion de un segmento:
+//		CABKV_t | (VALORKV_t + movimientos)[nentradas] | ENTRADAKV_t[nentradas]
+//
+#ifndef KVDRV_H
+#define KVDRV_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ajedrez.h"
+
+#define MAGICKV		0x564b4a41	// "AJKV"
+#define VERSIONKV		2
+#define LENVALORKV1	8				// longitud de VALORKV_t en la version 1 (sin metadatos).
+#define LENCLAVEKV	11				// fileid(2) particion(2) elomed(2) ganador(1) partidaid(4).
+#define MANIFESTKV	"MANIFEST"
+
+// cabecera de un segmento.
+typedef struct {
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	reser;
+	uint32_t	nentradas;					// claves del segmento.
+	uint64_t	offentradas;				// offset del indice de claves.
+	uint8_t	clavemin[LENCLAVEKV];	// rango de claves del segmento.
+	uint8_t	clavemax[LENCLAVEKV];
+} __attribute__((packed)) CABKV_t;
+
+// entrada del indice de claves de un segmento.
+typedef struct {
+	uint8_t	clave[LENCLAVEKV];
+	uint8_t	reser;
+	uint64_t	offvalor;					// offset del valor en el segmento.
+} __attribute__((packed)) ENTRADAKV_t;
+
+// cabecera del valor de una partida.
+typedef struct {
+	uint8_t	formato;						// formato de los movimientos (FORMATO_xxx).
+	uint8_t	reser;
+	uint16_t	nmov;							// numero de movimientos.
+	uint32_t	lenmov;						// longitud en bytes de los movimientos.
+	META_t	meta;							// version 2.
+	int16_t	difelo;
+} __attribute__((packed)) VALORKV_t;
+
+// segmento proyectado en memoria.
+typedef struct {
+	int			num;							// numero de segmento.
+	uint8_t		*mapa;
+	size_t		lenmapa;
+	CABKV_t		*cab;
+	ENTRADAKV_t	*entradas;
+} SEGKV_t;
+
+// almacen abierto.
+typedef struct {
+	char			path[1000];					// carpeta del almacen.
+	int			nseg;							// segmentos vigentes (del mas antiguo al mas reciente).
+	SEGKV_t		*seg;
+	int			sigseg;						// numero del siguiente segmento.
+	// transaccion de carga en curso.
+	FILE			*fd;
+	uint64_t		off;							// offset del siguiente valor.
+	ENTRADAKV_t	*pend;						// claves de la transaccion.
+	int			npend;
+	int			maxpend;
+	int			formato;						// formato de grabacion de los movimientos.
+} BASEKV_t;
+
+// cursor de un segmento dentro de un QUERY.
+typedef struct {
+	SEGKV_t		*seg;
+	uint32_t		pos;							// siguiente entrada.
+	uint32_t		fin;							// primera entrada fuera del rango.
+} CURSORKV_t;
+
+// QUERY en curso sobre un almacen.
+typedef struct {
+	int			ncur;
+	CURSORKV_t	*cur;
+	int			gana;							// ganador buscado (0 => cualquiera).
+	FILTROMETA_t	*filtro;					// filtro de metadatos (NULL => sin filtro).
+} QUERYKV_t;
+
+// Funcion para abrir el almacen de la carpeta indicada (se crea si no existe).
+// Los almacenes se cachean por path, una segunda llamada retorna el ya abierto.
+extern BASEKV_t *conectaKv(char *path);
+
+// Funcion para cerrar un almacen y liberar sus segmentos.
+extern void desconectaKv(BASEKV_t *base);
+
+// Funcion para cerrar todos los almacenes abiertos.
+extern void cierraAlmacenes(void);
+
+// Funcion para comenzar una transaccion de carga, los movimientos se graban en el
+// formato indicado (FORMATO_xxx).
+extern void beginTransKv(BASEKV_t *base,int formato);
+
+// Funcion para anhadir una partida a la transaccion en curso.
+extern void vuelcaPartKv(BASEKV_t *base,CPARTIDA_t *cabpar,MOVBIN_t *mov,int fileid,int particion);
+
+// Funcion para finalizar la transaccion en curso incorporando su segmento al almacen.
+extern void endTransKv(BASEKV_t *base);
+
+// Funcion para lanzar un QUERY de partidas de fileid y particion con elomin < elomed < elomax,
+// el ganador indicado (0 => cualquiera) y el filtro de metadatos (NULL => sin filtro).
+extern void lanzaQueryKv(BASEKV_t *base,QUERYKV_t *q,int fileid,int particion,int elomin,int elomax,int gana,FILTROMETA_t *filtro);
+
+// Funcion que indica si todos los segmentos del QUERY tienen metadatos.
+// retorna '1' si los tienen y '0' si alguno es de la version 1.
+extern int metadatosQueryKv(QUERYKV_t *q);
+
+// Funcion para obtener la siguiente partida del QUERY en el orden de la clave. Devuelve la
+// cabecera y los movimientos en el formato grabado (cabpar->formato).
+// Si no quedan mas, retorna '0' en caso contrario retorna '1'.
+extern int nextPartidaKv(QUERYKV_t *q,CPARTIDA_t *cabpar,MOVBIN_t *mov);
+
+// Funcion para liberar el QUERY.
+extern void liberaQueryKv(QUERYKV_t *q);
+
+#endif // KVDRV_H
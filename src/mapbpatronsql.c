@@ -66,18 +66,16 @@
 #include "funaux.h"
 #include "config.h"
 #include "sqlitedrv.h"
+#include "codmov.h"
+#include "colpart.h"
+#include "patron.h"
+#include "kvdrv.h"
 
 // datos de la partida en curso de analisis.
 CPARTIDA_t	cabpartida;				// cabecera de partida.
-MOVBIN_t		movimientos[MAXMOV];	// lista de movimientos.
+MOVBIN_t		movimientos[MAXMOV];	// lista de movimientos en el formato grabado (cabpartida.formato).
 
-PATRON_t patronbin;	// patron compilado a buscar.
-
-// acelerador de busqueda con la mascara de posiciones del tablero de interes.
-// y contenido que deben tener dichas posiciones.
-// son aquellas que deben tener un determinado contenido. Es lo mas facil de comprobar.
-uint8_t 	mascara[64];	// mascara del tablero virtual 
-uint8_t	spatron[64];	// contenido que debe poseer las posiciones de interes.
+PATRONC_t patronc;	// patron compilado a buscar con su mascara de aceleracion.
 
 char basmaster[1000];	// path de la base master de SQLITE (la que contiene tabla de particiones y partidas)
 CONF_BAS_t confbase;		// configuracion de las bases SQLITE.
@@ -90,686 +88,79 @@ char *pathajedrez = NULL;	// PATH del sistema de busqueda.
 sqlite3 *db = NULL; 	//base
 sqlite3_stmt *stmt;	// cursor del query en curso
 
-//-----------------------------------------------------------
-// Funcion que carga la descripcion del patron a buscar y genera la mascara
-// y contenido de interes del tablero para acelerar la busqueda. 
-void iniPatron(char *filepatbin)
-{
-	int fdpat,i;
-	RELAPIEZA_t *rela;
-	int res;
-	
-	// lee el fichero del patron compilado sobre la estructura de descripcion del patron.
-	if((fdpat=open(filepatbin,O_RDONLY)) < 0)
-	{
-		perror("Filepatbin\n");
-		exit(2);
-	}
-	res = read(fdpat,&patronbin,sizeof(patronbin));
-	close(fdpat);
-	// formamos mascara de aceleracion.
-	memset(mascara,0,sizeof(mascara));
-	memset(spatron,0,sizeof(spatron));
-	
-	for(i=0,rela = &patronbin.relaand.relaciones[0];i<patronbin.relaand.nelementos;i++,rela++)
-	{
-		// No interesan las posiciones TABOO.
-		if(rela->pieza_tar == TABOO)
-			continue;
-		// Tampoco interesan las relaciones a casilla.
-		if((rela->pieza_ataque != NADA) && (rela->pieza_tar == NADA))
-			continue;
-		// indicaciones de posicion de piezas y relaciones a piezas.
-		mascara[rela->pos] = 0xff;
-		spatron[rela->pos] = rela->pieza_tar;	
-	}
-}
-
+//================ COLUMNAR ==========================================
+// particion en formato columnar (si existe su fichero se usa en lugar de SQLITE).
+int columnar = 0;		// particion en curso en formato columnar.
+COLPART_t colpart;	// particion columnar abierta.
+int nsel;				// partidas seleccionadas de la particion columnar.
+int isel;				// siguiente partida seleccionada a procesar.
 
-// inicia partida.
-// carga el tablero virtual con la situacion inicial de todas las piezas.
-void iniciaJuego(uint8_t *tab)
-{
-	memcpy(tab,tablaini,sizeof(tablaini));
-}
+//================ CLAVE-VALOR =======================================
+// almacen clave-valor de la base de la particion en curso (ALMACEN=1).
+BASEKV_t *basekv = NULL;
+QUERYKV_t querykv;
 
-// Efectua un movimiento en el tablero virtual considerando una posible comida
-// de peon al paso. En el resto de comidas no hay problema pues la pieza
-// origen sustituye a la que se encuentra en la casilla destino.
-void mueve(MOVBIN_t mov,uint8_t *tab)
+//-----------------------------------------------------------
+// Funcion para obtener la siguiente partida de la particion en curso, sea del vector de
+// seleccion columnar, del QUERY del almacen clave-valor o del QUERY de SQLITE.
+// retorna '0' si no quedan mas partidas y '1' en caso contrario.
+int leePartida(void)
 {
-	// se trata de un peon que se mueve en diagonal y la casilla destino esta vacia
-	if(((mov.piezadest & 0x7) == PEON) && 			// peon come al paso
-		((mov.origen %8) != (mov.destino %8)) &&
-		(tab[mov.destino] != NADA))
+	if(columnar)
 	{
-		// Eliminamos peon comido al paso.
-		if(mov.piezadest & NEGRA)
-			tab[mov.destino - 8] = NADA;
-		else
-			tab[mov.destino + 8] = NADA;
-	}
-	// movimiento propiamente dicho en el tablero.
-	tab[mov.origen] = NADA;		// vaciamos la casilla origen
-	tab[mov.destino] = mov.piezadest;	// sustituimos la casilla destino
-}
-
-// comprobacion de amenazas particulares.
-//=======================================
-
-// si existe la amenaza retorna 1, en caso contrario 0.
-
-// hay un rey del color especificado en alguna de las 8 casillas
-// que rodean a la ensayada.
-int amenazaRey(uint8_t posicion,uint8_t color,uint8_t *tab)
-{
-	int x = posicion%8;
-	int y = posicion/8;
-	uint8_t pieza = REY | color;
-	
-	if((x<7) && (tab[posicion+1] == pieza))
-		return 1;
-	if((x>0) && (tab[posicion-1] == pieza))
-		return 1;
-	if((y<7) && (tab[posicion+8] == pieza))
-		return 1;
-	if((y>0) && (tab[posicion-8] == pieza))
-		return 1;
-	if((y<7) && (x<7) &&(tab[posicion+9] == pieza))
-		return 1;
-	if((y<7) && (x>0) && (tab[posicion+7] == pieza))
-		return 1;
-	if((y>0) && (x<7) && (tab[posicion-7] == pieza))
-		return 1;
-	if((y>0) && (x>0) && (tab[posicion-9] == pieza))
+		if(isel >= nsel)
+			return 0;
+		partidaColumnar(&colpart,colpart.sel[isel++],&cabpartida,movimientos);
 		return 1;
-	return 0;	// no hay amenaza de rey.
-}
-
-// hay una reina del color especificado en la diagonal, fila o
-// columna de la posicion ensayada sin piezas interpuestas de otro color.
-// o del propio que no supongan amenaza.
-int amenazaReina(uint8_t posicion,uint8_t color,uint8_t *tab)
-{
-	int i;
-	int x = posicion%8;
-	int y = posicion/8;
-	int postmp;
-	
-	// Examinamos las cuatro diagonales.
-	// diagonal en cuadrante positivo +x+y
-	// *
-	//  *
-	for(i=1;i<8;i++)
-	{
-		if(((x+i) > 7) || ((y+i) > 7))
-			break;  // salimos del tablero.
-		postmp = (y+i)*8 + x+i;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	// diagonal en cuadrante +x-y
-	//  *
-	// *
-	for(i=1;i<8;i++)
-	{
-		if(((x+i) > 7) || ((y-i) < 0))
-			break;  // salimos del tablero.
-		postmp = (y-i)*8 + x+i;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	// diagonal en cuadrante -x-y
-	//  *
-	// *
-	for(i=1;i<8;i++)
-	{
-		if(((x-i) < 0) || ((y-i) < 0))
-			break;  // salimos del tablero.
-		postmp = (y-i)*8 + x-i;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	// diagonal en cuadrante -x+y
-	//  *
-	// *
-	for(i=1;i<8;i++)
-	{
-		if(((x-i) < 0) || ((y+i) > 7))
-			break;  // salimos del tablero.
-		postmp = (y+i)*8 + x-i;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	// fila y columna en ambos sentidos.
-	
-	// fila en x+
-	for(i=1;i<8;i++)
-	{
-		if((x+i) > 7)
-			break;  // salimos del tablero.
-		postmp = y*8 + x+i;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	// fila en x-
-	for(i=1;i<8;i++)
-	{
-		if((x-i) < 0)
-			break;  // salimos del tablero.
-		postmp = y*8 + x-i;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	// columna en y+
-	for(i=1;i<8;i++)
-	{
-		if((y+i) > 7)
-			break;  // salimos del tablero.
-		postmp = (y+i)*8 + x;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	// columna en y-
-	for(i=1;i<8;i++)
-	{
-		if((y-i) < 0)
-			break;  // salimos del tablero.
-		postmp = (y-i)*8 + x;
-		if(tab[postmp] == (REINA | color))
-			return 1;	// hay una reina en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	return 0;	// No se ha encontrado reina amenazante.
-}
-
-// hay un ALFIL del color especificado en la diagonal
-// de la posicion ensayada sin piezas interpuestas de otro color,
-// o del propio que no supongan amenaza.
-int amenazaAlfil(uint8_t posicion,uint8_t color,uint8_t *tab)
-{
-	int i;
-	int x = posicion%8;
-	int y = posicion/8;
-	int postmp;
-	
-	// Examinamos las cuatro diagonales.
-	// diagonal en cuadrante positivo +x+y
-	// *
-	//  *
-	for(i=1;i<8;i++)
-	{
-		if(((x+i) > 7) || ((y+i) > 7))
-			break;  // salimos del tablero.
-		postmp = (y+i)*8 + x+i;
-		if(tab[postmp] == (ALFIL | color))
-			return 1;	// hay un alfil en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	// diagonal en cuadrante +x-y
-	//  *
-	// *
-	for(i=1;i<8;i++)
-	{
-		if(((x+i) > 7) || ((y-i) < 0))
-			break;  // salimos del tablero.
-		postmp = (y-i)*8 + x+i;
-		if(tab[postmp] == (ALFIL | color))
-			return 1;	// hay un alfil en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	// diagonal en cuadrante -x-y
-	//  *
-	// *
-	for(i=1;i<8;i++)
-	{
-		if(((x-i) < 0) || ((y-i) < 0))
-			break;  // salimos del tablero.
-		postmp = (y-i)*8 + x-i;
-		if(tab[postmp] == (ALFIL | color))
-			return 1;	// hay un alfil en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	// diagonal en cuadrante -x+y
-	//  *
-	// *
-	for(i=1;i<8;i++)
-	{
-		if(((x-i) < 0) || ((y+i) > 7))
-			break;  // salimos del tablero.
-		postmp = (y+i)*8 + x-i;
-		if(tab[postmp] == (ALFIL | color))
-			return 1;	// hay un alfil en esta diagonal.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	return 0;	// No se ha encontrado alfil.
-}
-
-// hay una torre del color especificado en la misma fila o columna
-// de la posicion ensayada sin piezas interpuestas de otro color.
-// o del propio que no supongan amenaza.
-int amenazaTorre(uint8_t posicion,uint8_t color,uint8_t *tab)
-{
-	int i;
-	int x = posicion%8;
-	int y = posicion/8;
-	int postmp;
-	
-	// fila y columna en ambos sentidos.
-	
-	// fila en x+
-	for(i=1;i<8;i++)
-	{
-		if((x+i) > 7)
-			break;  // salimos del tablero.
-		postmp = y*8 + x+i;
-		if(tab[postmp] == (TORRE | color))
-			return 1;	// hay una torre en esta fila.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	// fila en x-
-	for(i=1;i<8;i++)
-	{
-		if((x-i) < 0)
-			break;  // salimos del tablero.
-		postmp = y*8 + x-i;
-		if(tab[postmp] == (TORRE | color))
-			return 1;	// hay una torre en esta fila.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	// columna en y+
-	for(i=1;i<8;i++)
-	{
-		if((y+i) > 7)
-			break;  // salimos del tablero.
-		postmp = (y+i)*8 + x;
-		if(tab[postmp] == (TORRE | color))
-			return 1;	// hay una torre en esta fila.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
-	}
-	
-	// columna en y-
-	for(i=1;i<8;i++)
-	{
-		if((y-i) < 0)
-			break;  // salimos del tablero.
-		postmp = (y-i)*8 + x;
-		if(tab[postmp] == (TORRE | color))
-			return 1;	// hay una torre en esta fila.
-		if(tab[postmp] != NADA)	// pieza interpuesta.
-		{
-			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
-				continue;
-			else
-				break;
-		}
 	}
-	
-	return 0;	// No se ha encontrado torre.
+	if(confbase.almacen == ALMACEN_KV)
+		return(nextPartidaKv(&querykv,&cabpartida,movimientos));
+	return(nextPartida(db,stmt,&cabpartida,movimientos));
 }
 
-// hay un caballo del color especificado que puede alcanzar
-// la posicion ensayada.
-int amenazaCaballo(uint8_t posicion,uint8_t color,uint8_t *tab)
+// Funcion que indica si las partidas de la particion en curso tienen metadatos.
+// retorna '1' si los tienen y '0' si estan grabadas en un formato anterior a ellos.
+int metadatosParticion(void)
 {
-	int x = posicion%8;
-	int y = posicion/8;
-	uint8_t pieza = CABALLO | color;
-	
-	if((y>1) && (x<7) && (tab[posicion-15] == pieza)) // +1,-2
-			return 1;
-	if((y>0) && (x<6) && (tab[posicion-6] == pieza)) // +2,-1
-			return 1;
-	if((y<7) && (x<6) && (tab[posicion+10] == pieza)) // +2,+1
-			return 1;
-	if((y<6) && (x<7) && (tab[posicion+17] == pieza)) // +1,+2
-			return 1;
-	if((y<6) && (x>0) && (tab[posicion+15] == pieza)) // -1,+2
-			return 1;
-	if((y<7) && (x>1) && (tab[posicion+6] == pieza)) // -2,+1
-			return 1;
-	if((y>0) && (x>1) && (tab[posicion-10] == pieza)) // -2,-1
-			return 1;
-	if((y>1) && (x>0) && (tab[posicion-17] == pieza)) // -1,-2
-			return 1;
-	
-	return 0;	// No hay caballo que pueda alcanzar la posicion.
+	if(columnar)
+		return(colpart.meta != NULL);
+	if(confbase.almacen == ALMACEN_KV)
+		return(metadatosQueryKv(&querykv));
+	return(metadatosQuery(stmt));
 }
 
-// hay un peon del color especificado que puede alcanzar la posicion
-// especificada.
-// solo hay dos casillas posibles segun el color del peon.
-int amenazaPeon(uint8_t posicion,uint8_t color,uint8_t *tab)
+// Funcion para obtener la siguiente partida de la particion en curso que cumple los
+// criterios de busqueda. El filtro de metadatos se aplica en la seleccion de cada
+// almacen; aqui se comprueba de nuevo para las bases SQLITE sin columnas de metadatos,
+// cuyo QUERY no lo aplica (sus partidas tienen los metadatos a cero).
+// retorna '0' si no quedan mas partidas y '1' en caso contrario.
+int siguientePartida(void)
 {
-	int x = posicion%8;
-	int y = posicion/8;
-	uint8_t pieza = PEON | color;
-	
-	if(color) // negra=> y-1, x+-1
+	while(leePartida())
 	{
-		if((y>0) && (x<7) && (tab[posicion-7] == pieza))
-			return 0;
-		if((y>0) && (x>0) && (tab[posicion-9] == pieza))
+		if((confjob.hayfiltro == 0) || cumpleMeta(&confjob.filtro,cabpartida.meta,cabpartida.difelo))
 			return 1;
 	}
-	else     	// blanca=> y+1,x+-1
-	{
-		if((y<7) && (x<7) && (tab[posicion+9] == pieza))
-			return 1;
-		if((y<7) && (x>0) && (tab[posicion+7] == pieza))
-			return 1;
-	}
-	return 0;
-}
-
-
-// Funciones para verificar TABOO.
-//================================
-// una posicion es taboo si el rey de color indicado
-// puede acceder a ella (distancia 1) pero la casilla esta ocupada
-// por una pieza de su color o amenazada por alguna pieza contraria.
-int veriTaboo(uint8_t posicion,uint8_t color,uint8_t *tab)
-{
-	int x = posicion%8;
-	int y = posicion/8;
-	uint8_t colamenaza;
-	int postmp;
-	int i;
-	
-	// Primero comprobamos si la casilla es accesible por el rey
-	// del color indicado.
-	if(amenazaRey(posicion,color,tab) == 0)
-		return 0;	// El rey no puede alcanzar la casilla.
-	// La casilla esta ocupada por una pieza del mismo color.
-	if((tab[posicion] != NADA) && ((tab[posicion] & NEGRA) == color))
-		return 1;	// taboo por casilla ocupada por pieza mismo color.
-	
-	// La menaza tiene que ser de color contrario.
-	if(color)
-		colamenaza = 0;
-	else
-		colamenaza = NEGRA;
-	if(amenazaReina(posicion,colamenaza,tab))
-		return 1;
-	if(amenazaAlfil(posicion,colamenaza,tab))
-		return 1;
-	if(amenazaTorre(posicion,colamenaza,tab))
-		return 1;
-	if(amenazaCaballo(posicion,colamenaza,tab))
-		return 1;
-	if(amenazaPeon(posicion,colamenaza,tab))
-		return 1;
-	if(amenazaRey(posicion,colamenaza,tab))
-		return 1;
 	return 0;
 }
 
-//====================================================================
-// Funcion para comprobar si el tablero virtual actual cumple con el patron
-// especificado. Retorna '1' si cumple y '0' si no cumple.
-int compruebaPatron(uint8_t color,uint8_t *tab)
+//-----------------------------------------------------------
+// Funcion que carga la descripcion del patron a buscar y genera la mascara
+// y contenido de interes del tablero para acelerar la busqueda. 
+void iniPatron(char *filepatbin)
 {
-	int i,j,res=0;
-//	uint8_t pieza;
-	uint32_t *ptab,*pmasc,*pspat;
-	RELAPIEZA_t *rela;
-	uint32_t tmp;
-	uint8_t colortab;
-	
-	if(color == patronbin.color)	// no ha movido el color esperado por el patron.
-		return 0;
-		
-	// comprobacion posiciones patron.
-	// comprobamos mascara aceleracion.
-	for(i=0,ptab=(uint32_t *)tab,pmasc=(uint32_t *)mascara,pspat = (uint32_t *)spatron;i<16;i++)
-	{
-		tmp = (*ptab & *pmasc)^*pspat;
-		if(tmp)
-		{
-			return 0;	// no cumple mascara de aceleracion.
-		}
-		ptab++;
-		pmasc++;
-		pspat++;
-	}
-	// posiciones AND, las amenazas a posicion no deben tener una pieza del mismo color.
-	for(i=0,rela = &patronbin.relaand.relaciones[0];i<patronbin.relaand.nelementos;i++,rela++)
-	{
-		if(rela->pieza_tar == TABOO)
-			continue;
-		if((rela->pieza_ataque != NADA) && (rela->pieza_tar == NADA) && (tab[rela->pos] != NADA) && ((tab[rela->pos] & NEGRA) == (rela->pieza_ataque & NEGRA)))
-			return 0;	// No cumple amenazas AND.
-	}
-	// comprobacion posiciones OR, al menos debe cumplirse una por cada lista de OR
-	// En las amenazas a posicion esta no deb tener una pieza del mismo color.
-	for(i=0;i<patronbin.nrelaor;i++)
-	{
-		rela = &patronbin.relaor[i].relaciones[0];
-		for(j=0;j<patronbin.relaor[i].nelementos;j++,rela++)
-		{
-			if(rela->pieza_tar == TABOO)
-				break;
-			if(rela->pieza_tar == tab[rela->pos])
-				break;
-			// amenaza aposicion.
-			else if((rela->pieza_ataque != NADA) && (rela->pieza_tar == NADA) && (tab[rela->pos] != NADA) && ((tab[rela->pos] & NEGRA) != (rela->pieza_ataque & NEGRA)))
-				break;
-		}
-		if(j == patronbin.relaor[i].nelementos)	// No verifica ninguna.
-			return 0;
-	}
-	// verifica posiciones, comprobamos relaciones y TABOO.
-	
-	// comprobacion relaciones y TABOO  AND.
-	for(i=0,rela = &patronbin.relaand.relaciones[0];i<patronbin.relaand.nelementos;i++,rela++)
-	{
-		if(rela->pieza_ataque != NADA)
-		{
-			switch(rela->pieza_ataque & 0x7)
-			{
-				case REY:
-					if(amenazaRey(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
-						return 0;
-					break;
-				case REINA:
-					if(amenazaReina(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
-						return 0;
-					break;
-				case TORRE:
-					if(amenazaTorre(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
-						return 0;
-					break;
-				case ALFIL:
-					if(amenazaAlfil(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
-						return 0;
-					break;
-				case CABALLO:
-					if(amenazaCaballo(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
-						return 0;
-					break;
-				case PEON:
-					if(amenazaPeon(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
-						return 0;
-					break;
-				default:
-					return 0;
-			}
-		}
-		else if(rela->pieza_tar == TABOO)
-		{
-			if(patronbin.color)
-				colortab = 0;
-			else
-				colortab = NEGRA;
-			if(veriTaboo(rela->pos,colortab,tab) == 0)
-				return 0;
-		}
-	}
+	int fdpat;
+	int res;
 	
-	// comprobacion relaciones y posiciones TABOO OR, aqui hay que verificar que alguna se cumpla	
-	for(i=0;i<patronbin.nrelaor;i++)
+	// lee el fichero del patron compilado sobre la estructura de descripcion del patron.
+	if((fdpat=open(filepatbin,O_RDONLY)) < 0)
 	{
-		rela = &patronbin.relaor[i].relaciones[0];
-		res = 0;
-		for(j=0;j<patronbin.relaor[i].nelementos;j++,rela++)
-		{
-			if(rela->pieza_ataque != NADA)
-			{
-				switch(rela->pieza_ataque & 0x7)
-				{
-					case REY:
-						if(amenazaRey(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
-							res++;
-						break;
-					case REINA:
-						if(amenazaReina(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
-							res++;
-						break;
-					case TORRE:
-						if(amenazaTorre(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
-							res++;
-						break;
-					case ALFIL:
-						if(amenazaAlfil(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
-							res++;
-						break;
-					case CABALLO:
-						if(amenazaCaballo(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
-							res++;
-						break;
-					case PEON:
-						if(amenazaPeon(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
-							res++;
-						break;
-					default:
-						res=0;
-				}
-				if(res)
-					break;
-			}
-			else if(rela->pieza_tar == TABOO)
-			{
-				if(patronbin.color)
-					colortab = 0;
-				else
-					colortab = NEGRA;
-				if(veriTaboo(rela->pos,colortab,tab) != 0)
-					break;
-			}
-			else
-			{
-				if(rela->pieza_tar == tab[rela->pos])
-					break;
-			}
-		}
-		if(j == patronbin.relaor[i].nelementos)	// No verifica ninguna.
-			return 0;
+		perror("Filepatbin\n");
+		exit(2);
 	}
-	return 1;	// cumple patron.
+	res = read(fdpat,&patronc.patron,sizeof(PATRON_t));
+	close(fdpat);
+	compilaPatron(&patronc,&patronc.patron);
 }
 
 // Funcion para traducir un movimiento a formato PGN.
@@ -821,7 +212,10 @@ void main()
 	mqd_t fdmq;
 	
 	FILE *fdsal;
-	MOVBIN_t *mov;
+	MOVBIN_t movact;		// movimiento en curso.
+	MOVBIN_t movsig;		// siguiente movimiento (para la salida).
+	DECMOV_t decmov;		// estado de decodificacion de los movimientos.
+	DECMOV_t decsig;
 	PARTICION_t part;
 	int i,len,nread;
 	int movpartida;
@@ -849,6 +243,9 @@ void main()
 	}
 	sprintf(basmaster,"%s/base/base_0/%s",pathajedrez,confbase.nombase);
 	confbase.basmaster = basmaster;
+	// VFS de lectura secuencial de las bases.
+	if(confbase.vfslectura)
+		registraVfsLectura(confbase.vfslectura == 2);
 	
 	// Cargamos configuracion de trabajo.
 	if(getConfJob(pathajedrez,&confjob) == 0)
@@ -900,10 +297,28 @@ void main()
 			continue;
 		}
 		
-		// conectamos la base que contiene la particion a procesar.
-		conectaSqlite(&db,getBasFromParticion(pathajedrez,&confbase,part.particion));
-		// lanzamos QUERY con las restricciiones de la busqueda.
-		lanzaQueryR(db,&stmt,part.fileid,part.particion,confjob.elomin,confjob.elomax,confjob.ganador);
+		// si la particion esta en formato columnar seleccionamos sus partidas con las columnas,
+		// en caso contrario conectamos la base que la contiene y lanzamos QUERY con las
+		// restricciones de la busqueda.
+		columnar = abreColumnar(&colpart,getColFromParticion(pathajedrez,&confbase,part.fileid,part.particion));
+		if(columnar)
+		{
+			nsel = seleccionaColumnar(&colpart,confjob.elomin,confjob.elomax,confjob.ganador,
+											&confjob.filtro);
+			isel = 0;
+		}
+		else if(confbase.almacen == ALMACEN_KV)
+		{
+			basekv = conectaKv(getKvFromParticion(pathajedrez,&confbase,part.particion));
+			lanzaQueryKv(basekv,&querykv,part.fileid,part.particion,confjob.elomin,confjob.elomax,confjob.ganador,
+							&confjob.filtro);
+		}
+		else
+		{
+			db = conectaSqliteR(getBasFromParticion(pathajedrez,&confbase,part.particion));
+			lanzaQueryR(db,&stmt,part.fileid,part.particion,confjob.elomin,confjob.elomax,confjob.ganador,
+							&confjob.filtro);
+		}
 
 		// indicaciones de progreso.
 		slot = TIEMPO;
@@ -912,10 +327,10 @@ void main()
 		inchallados = 0;
 		
 		// iteramos por las partidas resultado del QUERY.
-		while(nextPartida(db,stmt,&cabpartida,movimientos))
+		while(siguientePartida())
 		{
 			iniciaJuego(tablero);	// iniciamos tablero virtual.
-			mov = (MOVBIN_t *)movimientos;
+			iniDecMov(&decmov,cabpartida.formato,(uint8_t *)movimientos);
 			// Iniciamos indicadores para FEN.
 			ultcolor = NEGRA;
 			movpartida = 0;
@@ -930,8 +345,14 @@ void main()
 			// iteramos por los movimientos de la partida.
 			for(i=0;i<cabpartida.nmov;i++)
 			{
+				// decodificamos el movimiento sobre el tablero actual.
+				if(siguienteMov(&decmov,tablero,&movact) == 0)
+				{
+					fprintf(stderr,"Movimientos no validos en partida %d de la particion %d:%d\n",cabpartida.ind,part.fileid,part.particion);
+					break;
+				}
 				// actualizamos indicadores FEN.
-				if((mov[i].piezadest & NEGRA) == 0)
+				if((movact.piezadest & NEGRA) == 0)
 				{
 					if( ultcolor == NEGRA)
 					{
@@ -944,28 +365,28 @@ void main()
 					if(ultcolor != NEGRA)
 						hmov++;
 				}
-				ultcolor = mov[i].piezadest & NEGRA;
+				ultcolor = movact.piezadest & NEGRA;
 				if(confjob.formasal == 1)	// salida FEN
 				{
 					// mueve peon o come pieza.
-					if((tablero[mov[i].destino] != NADA) || ((mov[i].piezaorg & 0x7) == PEON))
+					if((tablero[movact.destino] != NADA) || ((movact.piezaorg & 0x7) == PEON))
 						hmov = 0;
 					// salida de peon posible come al paso.
-					if(((mov[i].piezaorg & 0x7) == PEON) && (abs(mov[i].origen - mov[i].destino) == 16))
+					if(((movact.piezaorg & 0x7) == PEON) && (abs(movact.origen - movact.destino) == 16))
 					{
-						if(mov[i].origen > mov[i].destino)
-							paso = mov[i].origen -8;
+						if(movact.origen > movact.destino)
+							paso = movact.origen -8;
 						else
-							paso = mov[i].origen +8;
+							paso = movact.origen +8;
 					}
 					else
 						paso = 0;
 					// castling.
 					if((*((uint8_t *)&castling) & 0xf) != 0)	// aun queda alguno por resolver.
 					{
-						if((mov[i].piezaorg & 0x7) == REY)
+						if((movact.piezaorg & 0x7) == REY)
 						{
-							if(mov[i].piezaorg & NEGRA)
+							if(movact.piezaorg & NEGRA)
 							{
 								castling.reinab = 0;
 								castling.reyb = 0;
@@ -976,20 +397,20 @@ void main()
 								castling.reyw = 0;
 							}
 						}
-						else if((mov[i].piezaorg & 0x7) == TORRE)
+						else if((movact.piezaorg & 0x7) == TORRE)
 						{
-							if(mov[i].piezaorg & NEGRA)
+							if(movact.piezaorg & NEGRA)
 							{
-								if(mov[i].origen == 0)
+								if(movact.origen == 0)
 									castling.reinab = 0;
-								else if(mov[i].origen == 7)
+								else if(movact.origen == 7)
 									castling.reyb = 0;
 							}
 							else
 							{
-								if(mov[i].origen == 56)
+								if(movact.origen == 56)
 									castling.reinaw = 0;
-								else if(mov[i].origen == 63)
+								else if(movact.origen == 63)
 									castling.reyw = 0;
 							}
 						}
@@ -998,15 +419,21 @@ void main()
 				else
 					hmov = 0;
 				// efectua el movimiento en el tablero virtual.	
-				mueve(mov[i],tablero);
+				aplicaMov(&movact,tablero);
 				// comprueba si cumple el patron.
-				if(compruebaPatron(mov[i].piezadest & NEGRA,tablero))
+				if(compruebaPatron(&patronc,movact.piezadest & NEGRA,tablero))
 				{
-					// genera linea de info resultado.
+					// genera linea de info resultado con el siguiente movimiento.
 					inchallados++;
+					memset(&movsig,0,sizeof(MOVBIN_t));
+					if((i + 1) < cabpartida.nmov)
+					{
+						decsig = decmov;
+						siguienteMov(&decsig,tablero,&movsig);
+					}
 				//	encontrados++;
 					fprintf(fdsal,"[FileId=%d,Particion=%d,PartId=%d,Mov=%d,Elomed=>%d,Flags=>%d,NextMov=>%s]\n",
-							part.fileid,part.particion,cabpartida.ind,movpartida,cabpartida.elomed,*((uint8_t *)&cabpartida.flags),mov2pgn(&mov[i+1]));
+							part.fileid,part.particion,cabpartida.ind,movpartida,cabpartida.elomed,*((uint8_t *)&cabpartida.flags),mov2pgn(&movsig));
 					// genera imagen o FEN segun configuracion.
 					if(confjob.formasal == 0)	// salida IMG
 						showtab(fdsal,tablero);
@@ -1039,16 +466,30 @@ void main()
 				}
 			}
 		}
+		// el filtro de metadatos sobre partidas grabadas sin ellos se evalua con los metadatos
+		// a cero, se avisa para no confundirlo con una particion sin partidas halladas.
+		if(confjob.hayfiltro && (metadatosParticion() == 0))
+			fprintf(stderr,"Aviso: particion %d:%d grabada sin metadatos, el filtro se evalua con los metadatos a cero\n",
+					part.fileid,part.particion);
 		// final de particion, se envia informe de progreso final.
 		sprintf(msg,"%d,%d,%d\n",incparticion,incpartidas,inchallados);
 		mq_send(fdmq,msg,strlen(msg),0);
-		// cirre del fichero de salida y de la base de datos.
+		// cierre del fichero de salida y del QUERY, la conexion a la base queda
+		// abierta para las siguientes particiones de la misma base.
 		fclose(fdsal);
-		liberaQuery(stmt);
-		desconectaSqlite(db);
+		if(columnar)
+			liberaColumnar(&colpart);
+		else if(confbase.almacen == ALMACEN_KV)
+			liberaQueryKv(&querykv);
+		else
+			liberaQuery(stmt);
 	}
-	// cierra canal de comunicaciones.	
+	// cierra las bases y el canal de comunicaciones.
+	cierraConexiones();
+	cierraAlmacenes();
 	mq_close(fdmq);
 	fprintf(stderr,"IND=> %d\n",ind);
+	if(confbase.vfslectura)
+		muestraEstVfs(stderr);
 	exit(0);
 }
@@ -0,0 +1,143 @@
+// modulo : migraSqlite.c
+// autor  : Antonio Pardo Redondo
+//
+// Utilidad para migrar una base SQLITE de partidas del esquema V1 (tabla 'partidas'
+// con rowid e indices separados) al esquema V2 (tablas 'cabpartidas' y 'movpartidas'
+// agrupadas por clave, ver sqlitedrv.h).
+//
+// Si solo se indica la base se migra sobre si misma y se compacta con VACUUM al final.
+// Si se indica una base destino, se copia compactada con 'VACUUM INTO' y se migra la
+// copia, dejando la base original intacta.
+//
+// Tras la migracion se ejecuta ANALYZE para que el planificador disponga de estadisticas
+// de la clave (sqlite_stat1 y sqlite_stat4 si la libreria se ha compilado con
+// SQLITE_ENABLE_STAT4). Se comprueba que el numero de partidas no varia.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include "sqlitedrv.h"
+
+// ejecuta una sentencia SQL, en caso de error lo muestra y termina.
+void ejecutaSql(sqlite3 *db,char *sql)
+{
+	int rc;
+	char *error_message = 0;
+
+	rc = sqlite3_exec(db, sql, NULL, 0, &error_message);
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "SQL error: %s\n=>%s\n", error_message,sql);
+		sqlite3_free(error_message);
+		sqlite3_close(db);
+		exit(2);
+	}
+}
+
+// retorna el resultado entero de una consulta de una sola fila y columna.
+int64_t cuentaSql(sqlite3 *db,char *sql)
+{
+	int64_t cuenta = -1;
+	sqlite3_stmt *stmt1;
+
+	if(sqlite3_prepare(db, sql, -1, &stmt1, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
+		sqlite3_close(db);
+		exit(2);
+	}
+	if(sqlite3_step(stmt1) == SQLITE_ROW)
+		cuenta = sqlite3_column_int64(stmt1, 0);
+	sqlite3_finalize(stmt1);
+	return cuenta;
+}
+
+int main(int argc, char **argv)
+{
+	sqlite3 *db;
+	char sql[2000];
+	char *pathbase;
+	int64_t npartidas,nmigradas;
+
+	if((argc != 2) && (argc != 3))
+	{
+		fprintf(stderr, "Usage: %s <pathdatabase> [pathdatabase destino]\n", argv[0]);
+		return(1);
+	}
+	if(sqlite3_open(argv[1], &db) != SQLITE_OK)
+	{
+		fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return(1);
+	}
+	if(versionSqlite(db) >= ESQUEMAV2)
+	{
+		fprintf(stderr,"La base %s ya tiene esquema V2\n",argv[1]);
+		sqlite3_close(db);
+		return(0);
+	}
+	pathbase = argv[1];
+	// migracion sobre una copia compactada.
+	if(argc == 3)
+	{
+		if(access(argv[2],F_OK) == 0)
+		{
+			fprintf(stderr,"La base destino %s ya existe\n",argv[2]);
+			sqlite3_close(db);
+			return(1);
+		}
+		sprintf(sql,"VACUUM INTO '%s'",argv[2]);
+		ejecutaSql(db,sql);
+		sqlite3_close(db);
+		pathbase = argv[2];
+		if(sqlite3_open(pathbase, &db) != SQLITE_OK)
+		{
+			fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+			sqlite3_close(db);
+			return(1);
+		}
+	}
+	ejecutaSql(db,"PRAGMA synchronous = 0");
+	ejecutaSql(db,"PRAGMA cache_size = -262144");
+	npartidas = cuentaSql(db,"SELECT count(*) FROM partidas");
+	// se renombra la tabla original (sus indices la acompanhan) y se crean las del esquema V2.
+	ejecutaSql(db,"BEGIN TRANSACTION");
+	ejecutaSql(db,"ALTER TABLE partidas RENAME TO partidasv1");
+	if(creaTablasV2(db) == 0)
+	{
+		sqlite3_close(db);
+		return(2);
+	}
+	// se copian las partidas en el orden de la clave para que la insercion sea secuencial, con
+	// sus metadatos si la base original los tiene.
+	if(cuentaSql(db,"SELECT count(*) FROM pragma_table_info('partidasv1') WHERE name = 'eco'") > 0)
+		ejecutaSql(db,"INSERT OR IGNORE INTO cabpartidas SELECT fileid,particion,elomed,ganador,partidaid,"
+						"eco,ritmo,terminacion,difelo FROM partidasv1 ORDER BY fileid,particion,elomed,ganador,partidaid");
+	else
+		ejecutaSql(db,"INSERT OR IGNORE INTO cabpartidas(fileid,particion,elomed,ganador,partidaid)"
+						" SELECT fileid,particion,elomed,ganador,partidaid"
+						" FROM partidasv1 ORDER BY fileid,particion,elomed,ganador,partidaid");
+	ejecutaSql(db,"INSERT OR IGNORE INTO movpartidas SELECT fileid,particion,elomed,ganador,partidaid,movimientos"
+					" FROM partidasv1 ORDER BY fileid,particion,elomed,ganador,partidaid");
+	nmigradas = cuentaSql(db,"SELECT count(*) FROM partidas");
+	if(nmigradas != npartidas)
+	{
+		fprintf(stderr,"Partidas migradas %lld de %lld (claves repetidas), se anula la migracion\n",
+					(long long)nmigradas,(long long)npartidas);
+		ejecutaSql(db,"ROLLBACK");
+		sqlite3_close(db);
+		if(argc == 3)
+			unlink(pathbase);
+		return(2);
+	}
+	ejecutaSql(db,"DROP TABLE partidasv1");
+	ejecutaSql(db,"END TRANSACTION");
+	// estadisticas para el planificador y compactacion de la base migrada en su sitio.
+	ejecutaSql(db,"ANALYZE");
+	if(argc == 2)
+		ejecutaSql(db,"VACUUM");
+	sqlite3_close(db);
+	printf("%s: %lld partidas migradas a esquema V2\n",pathbase,(long long)nmigradas);
+	return 0;
+}
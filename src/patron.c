@@ -0,0 +1,665 @@
+// modulo : patron.c
+// autor  : Antonio Pardo Redondo
+//
+// Modulo de comprobacion de un patron compilado sobre el tablero virtual
+// de una partida. Lo utilizan el mapper de busqueda y la extension SQLITE.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ajedrez.h"
+#include "patron.h"
+
+//-----------------------------------------------------------
+// Funcion que copia la descripcion del patron a buscar y genera la mascara
+// y contenido de interes del tablero para acelerar la busqueda.
+void compilaPatron(PATRONC_t *pc,PATRON_t *pat)
+{
+	int i;
+	RELAPIEZA_t *rela;
+	
+	if(pat != &pc->patron)
+		memcpy(&pc->patron,pat,sizeof(PATRON_t));
+	// formamos mascara de aceleracion.
+	memset(pc->mascara,0,sizeof(pc->mascara));
+	memset(pc->spatron,0,sizeof(pc->spatron));
+	
+	for(i=0,rela = &pc->patron.relaand.relaciones[0];i<pc->patron.relaand.nelementos;i++,rela++)
+	{
+		// No interesan las posiciones TABOO.
+		if(rela->pieza_tar == TABOO)
+			continue;
+		// Tampoco interesan las relaciones a casilla.
+		if((rela->pieza_ataque != NADA) && (rela->pieza_tar == NADA))
+			continue;
+		// indicaciones de posicion de piezas y relaciones a piezas.
+		pc->mascara[rela->pos] = 0xff;
+		pc->spatron[rela->pos] = rela->pieza_tar;	
+	}
+}
+
+// inicia partida.
+// carga el tablero virtual con la situacion inicial de todas las piezas.
+void iniciaJuego(uint8_t *tab)
+{
+	memcpy(tab,tablaini,sizeof(tablaini));
+}
+
+// comprobacion de amenazas particulares.
+//=======================================
+
+// si existe la amenaza retorna 1, en caso contrario 0.
+
+// hay un rey del color especificado en alguna de las 8 casillas
+// que rodean a la ensayada.
+int amenazaRey(uint8_t posicion,uint8_t color,uint8_t *tab)
+{
+	int x = posicion%8;
+	int y = posicion/8;
+	uint8_t pieza = REY | color;
+	
+	if((x<7) && (tab[posicion+1] == pieza))
+		return 1;
+	if((x>0) && (tab[posicion-1] == pieza))
+		return 1;
+	if((y<7) && (tab[posicion+8] == pieza))
+		return 1;
+	if((y>0) && (tab[posicion-8] == pieza))
+		return 1;
+	if((y<7) && (x<7) &&(tab[posicion+9] == pieza))
+		return 1;
+	if((y<7) && (x>0) && (tab[posicion+7] == pieza))
+		return 1;
+	if((y>0) && (x<7) && (tab[posicion-7] == pieza))
+		return 1;
+	if((y>0) && (x>0) && (tab[posicion-9] == pieza))
+		return 1;
+	return 0;	// no hay amenaza de rey.
+}
+
+// hay una reina del color especificado en la diagonal, fila o
+// columna de la posicion ensayada sin piezas interpuestas de otro color.
+// o del propio que no supongan amenaza.
+int amenazaReina(uint8_t posicion,uint8_t color,uint8_t *tab)
+{
+	int i;
+	int x = posicion%8;
+	int y = posicion/8;
+	int postmp;
+	
+	// Examinamos las cuatro diagonales.
+	// diagonal en cuadrante positivo +x+y
+	// *
+	//  *
+	for(i=1;i<8;i++)
+	{
+		if(((x+i) > 7) || ((y+i) > 7))
+			break;  // salimos del tablero.
+		postmp = (y+i)*8 + x+i;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	// diagonal en cuadrante +x-y
+	//  *
+	// *
+	for(i=1;i<8;i++)
+	{
+		if(((x+i) > 7) || ((y-i) < 0))
+			break;  // salimos del tablero.
+		postmp = (y-i)*8 + x+i;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	// diagonal en cuadrante -x-y
+	//  *
+	// *
+	for(i=1;i<8;i++)
+	{
+		if(((x-i) < 0) || ((y-i) < 0))
+			break;  // salimos del tablero.
+		postmp = (y-i)*8 + x-i;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	// diagonal en cuadrante -x+y
+	//  *
+	// *
+	for(i=1;i<8;i++)
+	{
+		if(((x-i) < 0) || ((y+i) > 7))
+			break;  // salimos del tablero.
+		postmp = (y+i)*8 + x-i;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (ALFIL | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	// fila y columna en ambos sentidos.
+	
+	// fila en x+
+	for(i=1;i<8;i++)
+	{
+		if((x+i) > 7)
+			break;  // salimos del tablero.
+		postmp = y*8 + x+i;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	// fila en x-
+	for(i=1;i<8;i++)
+	{
+		if((x-i) < 0)
+			break;  // salimos del tablero.
+		postmp = y*8 + x-i;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	// columna en y+
+	for(i=1;i<8;i++)
+	{
+		if((y+i) > 7)
+			break;  // salimos del tablero.
+		postmp = (y+i)*8 + x;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	// columna en y-
+	for(i=1;i<8;i++)
+	{
+		if((y-i) < 0)
+			break;  // salimos del tablero.
+		postmp = (y-i)*8 + x;
+		if(tab[postmp] == (REINA | color))
+			return 1;	// hay una reina en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (TORRE | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	return 0;	// No se ha encontrado reina amenazante.
+}
+
+// hay un ALFIL del color especificado en la diagonal
+// de la posicion ensayada sin piezas interpuestas de otro color,
+// o del propio que no supongan amenaza.
+int amenazaAlfil(uint8_t posicion,uint8_t color,uint8_t *tab)
+{
+	int i;
+	int x = posicion%8;
+	int y = posicion/8;
+	int postmp;
+	
+	// Examinamos las cuatro diagonales.
+	// diagonal en cuadrante positivo +x+y
+	// *
+	//  *
+	for(i=1;i<8;i++)
+	{
+		if(((x+i) > 7) || ((y+i) > 7))
+			break;  // salimos del tablero.
+		postmp = (y+i)*8 + x+i;
+		if(tab[postmp] == (ALFIL | color))
+			return 1;	// hay un alfil en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	// diagonal en cuadrante +x-y
+	//  *
+	// *
+	for(i=1;i<8;i++)
+	{
+		if(((x+i) > 7) || ((y-i) < 0))
+			break;  // salimos del tablero.
+		postmp = (y-i)*8 + x+i;
+		if(tab[postmp] == (ALFIL | color))
+			return 1;	// hay un alfil en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	// diagonal en cuadrante -x-y
+	//  *
+	// *
+	for(i=1;i<8;i++)
+	{
+		if(((x-i) < 0) || ((y-i) < 0))
+			break;  // salimos del tablero.
+		postmp = (y-i)*8 + x-i;
+		if(tab[postmp] == (ALFIL | color))
+			return 1;	// hay un alfil en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	// diagonal en cuadrante -x+y
+	//  *
+	// *
+	for(i=1;i<8;i++)
+	{
+		if(((x-i) < 0) || ((y+i) > 7))
+			break;  // salimos del tablero.
+		postmp = (y+i)*8 + x-i;
+		if(tab[postmp] == (ALFIL | color))
+			return 1;	// hay un alfil en esta diagonal.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	return 0;	// No se ha encontrado alfil.
+}
+
+// hay una torre del color especificado en la misma fila o columna
+// de la posicion ensayada sin piezas interpuestas de otro color.
+// o del propio que no supongan amenaza.
+int amenazaTorre(uint8_t posicion,uint8_t color,uint8_t *tab)
+{
+	int i;
+	int x = posicion%8;
+	int y = posicion/8;
+	int postmp;
+	
+	// fila y columna en ambos sentidos.
+	
+	// fila en x+
+	for(i=1;i<8;i++)
+	{
+		if((x+i) > 7)
+			break;  // salimos del tablero.
+		postmp = y*8 + x+i;
+		if(tab[postmp] == (TORRE | color))
+			return 1;	// hay una torre en esta fila.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	// fila en x-
+	for(i=1;i<8;i++)
+	{
+		if((x-i) < 0)
+			break;  // salimos del tablero.
+		postmp = y*8 + x-i;
+		if(tab[postmp] == (TORRE | color))
+			return 1;	// hay una torre en esta fila.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	// columna en y+
+	for(i=1;i<8;i++)
+	{
+		if((y+i) > 7)
+			break;  // salimos del tablero.
+		postmp = (y+i)*8 + x;
+		if(tab[postmp] == (TORRE | color))
+			return 1;	// hay una torre en esta fila.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	// columna en y-
+	for(i=1;i<8;i++)
+	{
+		if((y-i) < 0)
+			break;  // salimos del tablero.
+		postmp = (y-i)*8 + x;
+		if(tab[postmp] == (TORRE | color))
+			return 1;	// hay una torre en esta fila.
+		if(tab[postmp] != NADA)	// pieza interpuesta.
+		{
+			if(tab[postmp] == (REINA | color)) // interpuesta mismo col supone amenaza.
+				continue;
+			else
+				break;
+		}
+	}
+	
+	return 0;	// No se ha encontrado torre.
+}
+
+// hay un caballo del color especificado que puede alcanzar
+// la posicion ensayada.
+int amenazaCaballo(uint8_t posicion,uint8_t color,uint8_t *tab)
+{
+	int x = posicion%8;
+	int y = posicion/8;
+	uint8_t pieza = CABALLO | color;
+	
+	if((y>1) && (x<7) && (tab[posicion-15] == pieza)) // +1,-2
+			return 1;
+	if((y>0) && (x<6) && (tab[posicion-6] == pieza)) // +2,-1
+			return 1;
+	if((y<7) && (x<6) && (tab[posicion+10] == pieza)) // +2,+1
+			return 1;
+	if((y<6) && (x<7) && (tab[posicion+17] == pieza)) // +1,+2
+			return 1;
+	if((y<6) && (x>0) && (tab[posicion+15] == pieza)) // -1,+2
+			return 1;
+	if((y<7) && (x>1) && (tab[posicion+6] == pieza)) // -2,+1
+			return 1;
+	if((y>0) && (x>1) && (tab[posicion-10] == pieza)) // -2,-1
+			return 1;
+	if((y>1) && (x>0) && (tab[posicion-17] == pieza)) // -1,-2
+			return 1;
+	
+	return 0;	// No hay caballo que pueda alcanzar la posicion.
+}
+
+// hay un peon del color especificado que puede alcanzar la posicion
+// especificada.
+// solo hay dos casillas posibles segun el color del peon.
+int amenazaPeon(uint8_t posicion,uint8_t color,uint8_t *tab)
+{
+	int x = posicion%8;
+	int y = posicion/8;
+	uint8_t pieza = PEON | color;
+	
+	if(color) // negra=> y-1, x+-1
+	{
+		if((y>0) && (x<7) && (tab[posicion-7] == pieza))
+			return 0;
+		if((y>0) && (x>0) && (tab[posicion-9] == pieza))
+			return 1;
+	}
+	else     	// blanca=> y+1,x+-1
+	{
+		if((y<7) && (x<7) && (tab[posicion+9] == pieza))
+			return 1;
+		if((y<7) && (x>0) && (tab[posicion+7] == pieza))
+			return 1;
+	}
+	return 0;
+}
+
+
+// Funciones para verificar TABOO.
+//================================
+// una posicion es taboo si el rey de color indicado
+// puede acceder a ella (distancia 1) pero la casilla esta ocupada
+// por una pieza de su color o amenazada por alguna pieza contraria.
+int veriTaboo(uint8_t posicion,uint8_t color,uint8_t *tab)
+{
+	int x = posicion%8;
+	int y = posicion/8;
+	uint8_t colamenaza;
+	int postmp;
+	int i;
+	
+	// Primero comprobamos si la casilla es accesible por el rey
+	// del color indicado.
+	if(amenazaRey(posicion,color,tab) == 0)
+		return 0;	// El rey no puede alcanzar la casilla.
+	// La casilla esta ocupada por una pieza del mismo color.
+	if((tab[posicion] != NADA) && ((tab[posicion] & NEGRA) == color))
+		return 1;	// taboo por casilla ocupada por pieza mismo color.
+	
+	// La menaza tiene que ser de color contrario.
+	if(color)
+		colamenaza = 0;
+	else
+		colamenaza = NEGRA;
+	if(amenazaReina(posicion,colamenaza,tab))
+		return 1;
+	if(amenazaAlfil(posicion,colamenaza,tab))
+		return 1;
+	if(amenazaTorre(posicion,colamenaza,tab))
+		return 1;
+	if(amenazaCaballo(posicion,colamenaza,tab))
+		return 1;
+	if(amenazaPeon(posicion,colamenaza,tab))
+		return 1;
+	if(amenazaRey(posicion,colamenaza,tab))
+		return 1;
+	return 0;
+}
+
+//====================================================================
+// Funcion para comprobar si el tablero virtual actual cumple con el patron
+// especificado. Retorna '1' si cumple y '0' si no cumple.
+int compruebaPatron(PATRONC_t *pc,uint8_t color,uint8_t *tab)
+{
+	int i,j,res=0;
+//	uint8_t pieza;
+	uint32_t *ptab,*pmasc,*pspat;
+	RELAPIEZA_t *rela;
+	uint32_t tmp;
+	uint8_t colortab;
+	
+	if(color == pc->patron.color)	// no ha movido el color esperado por el patron.
+		return 0;
+		
+	// comprobacion posiciones patron.
+	// comprobamos mascara aceleracion.
+	for(i=0,ptab=(uint32_t *)tab,pmasc=(uint32_t *)pc->mascara,pspat = (uint32_t *)pc->spatron;i<16;i++)
+	{
+		tmp = (*ptab & *pmasc)^*pspat;
+		if(tmp)
+		{
+			return 0;	// no cumple mascara de aceleracion.
+		}
+		ptab++;
+		pmasc++;
+		pspat++;
+	}
+	// posiciones AND, las amenazas a posicion no deben tener una pieza del mismo color.
+	for(i=0,rela = &pc->patron.relaand.relaciones[0];i<pc->patron.relaand.nelementos;i++,rela++)
+	{
+		if(rela->pieza_tar == TABOO)
+			continue;
+		if((rela->pieza_ataque != NADA) && (rela->pieza_tar == NADA) && (tab[rela->pos] != NADA) && ((tab[rela->pos] & NEGRA) == (rela->pieza_ataque & NEGRA)))
+			return 0;	// No cumple amenazas AND.
+	}
+	// comprobacion posiciones OR, al menos debe cumplirse una por cada lista de OR
+	// En las amenazas a posicion esta no deb tener una pieza del mismo color.
+	for(i=0;i<pc->patron.nrelaor;i++)
+	{
+		rela = &pc->patron.relaor[i].relaciones[0];
+		for(j=0;j<pc->patron.relaor[i].nelementos;j++,rela++)
+		{
+			if(rela->pieza_tar == TABOO)
+				break;
+			if(rela->pieza_tar == tab[rela->pos])
+				break;
+			// amenaza aposicion.
+			else if((rela->pieza_ataque != NADA) && (rela->pieza_tar == NADA) && (tab[rela->pos] != NADA) && ((tab[rela->pos] & NEGRA) != (rela->pieza_ataque & NEGRA)))
+				break;
+		}
+		if(j == pc->patron.relaor[i].nelementos)	// No verifica ninguna.
+			return 0;
+	}
+	// verifica posiciones, comprobamos relaciones y TABOO.
+	
+	// comprobacion relaciones y TABOO  AND.
+	for(i=0,rela = &pc->patron.relaand.relaciones[0];i<pc->patron.relaand.nelementos;i++,rela++)
+	{
+		if(rela->pieza_ataque != NADA)
+		{
+			switch(rela->pieza_ataque & 0x7)
+			{
+				case REY:
+					if(amenazaRey(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
+						return 0;
+					break;
+				case REINA:
+					if(amenazaReina(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
+						return 0;
+					break;
+				case TORRE:
+					if(amenazaTorre(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
+						return 0;
+					break;
+				case ALFIL:
+					if(amenazaAlfil(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
+						return 0;
+					break;
+				case CABALLO:
+					if(amenazaCaballo(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
+						return 0;
+					break;
+				case PEON:
+					if(amenazaPeon(rela->pos,rela->pieza_ataque & NEGRA,tab) == 0)
+						return 0;
+					break;
+				default:
+					return 0;
+			}
+		}
+		else if(rela->pieza_tar == TABOO)
+		{
+			if(pc->patron.color)
+				colortab = 0;
+			else
+				colortab = NEGRA;
+			if(veriTaboo(rela->pos,colortab,tab) == 0)
+				return 0;
+		}
+	}
+	
+	// comprobacion relaciones y posiciones TABOO OR, aqui hay que verificar que alguna se cumpla	
+	for(i=0;i<pc->patron.nrelaor;i++)
+	{
+		rela = &pc->patron.relaor[i].relaciones[0];
+		res = 0;
+		for(j=0;j<pc->patron.relaor[i].nelementos;j++,rela++)
+		{
+			if(rela->pieza_ataque != NADA)
+			{
+				switch(rela->pieza_ataque & 0x7)
+				{
+					case REY:
+						if(amenazaRey(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
+							res++;
+						break;
+					case REINA:
+						if(amenazaReina(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
+							res++;
+						break;
+					case TORRE:
+						if(amenazaTorre(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
+							res++;
+						break;
+					case ALFIL:
+						if(amenazaAlfil(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
+							res++;
+						break;
+					case CABALLO:
+						if(amenazaCaballo(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
+							res++;
+						break;
+					case PEON:
+						if(amenazaPeon(rela->pos,rela->pieza_ataque & NEGRA,tab) != 0)
+							res++;
+						break;
+					default:
+						res=0;
+				}
+				if(res)
+					break;
+			}
+			else if(rela->pieza_tar == TABOO)
+			{
+				if(pc->patron.color)
+					colortab = 0;
+				else
+					colortab = NEGRA;
+				if(veriTaboo(rela->pos,colortab,tab) != 0)
+					break;
+			}
+			else
+			{
+				if(rela->pieza_tar == tab[rela->pos])
+					break;
+			}
+		}
+		if(j == pc->patron.relaor[i].nelementos)	// No verifica ninguna.
+			return 0;
+	}
+	return 1;	// cumple patron.
+}
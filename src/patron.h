@@ -0,0 +1,46 @@
+// modulo : patron.h
+// autor  : Antonio Pardo Redondo
+//
+// Modulo de comprobacion de un patron compilado (PATRON_t generado por gpatronbin)
+// sobre el tablero virtual de una partida.
+//
+// El patron se acompanha de una mascara de aceleracion con las posiciones del tablero
+// que deben tener un determinado contenido, que es lo mas facil de comprobar y descarta
+// la mayoria de los tableros antes de evaluar relaciones y posiciones TABOO.
+//
+#ifndef PATRON_H
+#define PATRON_H
+
+#include <stdint.h>
+#include "ajedrez.h"
+
+// patron compilado con su mascara de aceleracion.
+typedef struct {
+	PATRON_t	patron;			// descripcion del patron.
+	uint8_t	mascara[64];	// mascara del tablero virtual.
+	uint8_t	spatron[64];	// contenido que debe poseer las posiciones de interes.
+} PATRONC_t;
+
+// copia el patron (si no es ya el de pc) y genera su mascara de aceleracion.
+extern void compilaPatron(PATRONC_t *pc,PATRON_t *pat);
+
+// carga el tablero virtual con la situacion inicial de todas las piezas.
+extern void iniciaJuego(uint8_t *tab);
+
+// comprobacion de amenazas a una posicion por una pieza del color indicado.
+// si existe la amenaza retorna 1, en caso contrario 0.
+extern int amenazaRey(uint8_t posicion,uint8_t color,uint8_t *tab);
+extern int amenazaReina(uint8_t posicion,uint8_t color,uint8_t *tab);
+extern int amenazaAlfil(uint8_t posicion,uint8_t color,uint8_t *tab);
+extern int amenazaTorre(uint8_t posicion,uint8_t color,uint8_t *tab);
+extern int amenazaCaballo(uint8_t posicion,uint8_t color,uint8_t *tab);
+extern int amenazaPeon(uint8_t posicion,uint8_t color,uint8_t *tab);
+
+// retorna 1 si la posicion es TABOO para el rey del color indicado.
+extern int veriTaboo(uint8_t posicion,uint8_t color,uint8_t *tab);
+
+// comprueba si el tablero, tras mover el color indicado, cumple el patron.
+// Retorna '1' si cumple y '0' si no cumple.
+extern int compruebaPatron(PATRONC_t *pc,uint8_t color,uint8_t *tab);
+
+#endif // PATRON_H
@@ -0,0 +1,248 @@
+// modulo : patronext.c
+// autor  : Antonio Pardo Redondo
+//
+// Extension cargable de SQLITE que permite buscar patrones directamente con una
+// sentencia SELECT sobre la columna 'movimientos' de la tabla de partidas, sin
+// copiar las filas a la aplicacion. Utiliza el mismo codigo de recreacion de la
+// partida (codmov) y de comprobacion del patron (patron) que el mapper.
+//
+// Funciones SQL registradas:
+//		-pattern_match(movimientos,patron) => numero de jugada (medio movimiento, desde 1)
+//				en la que la partida cumple el patron por primera vez o NULL si no lo cumple.
+//		-board_at(movimientos,jugada) => tablero tras la jugada indicada (0 => posicion
+//				inicial) en notacion FEN (posicion de las piezas y color que juega) o NULL
+//				si la partida tiene menos jugadas.
+//
+// Las jugadas se cuentan sobre la partida, no sobre la lista de movimientos: el enroque
+// se anota en la lista como dos movimientos (torre y rey) pero es una sola jugada, y el
+// tablero nunca se examina entre sus dos movimientos.
+//		-pattern_count(movimientos,patron) => agregado con el numero de partidas que
+//				cumplen el patron.
+//
+// 'patron' es el BLOB del fichero generado por gpatronbin (un PATRON_t), y 'movimientos'
+// el BLOB grabado por fich2sqlite (tabla 'partidas' o vista del esquema V2) en cualquiera
+// de los formatos de movimientos. Las particiones en bloques comprimidos no se admiten.
+//
+// Ejemplo desde el shell de sqlite3:
+//		.load ./patronext
+//		SELECT partidaid,pattern_match(movimientos,readfile('patron.bin')) AS jugada
+//			FROM partidas WHERE jugada IS NOT NULL;
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#include "ajedrez.h"
+#include "sqlitedrv.h"
+#include "codmov.h"
+#include "patron.h"
+
+// estado del agregado pattern_count.
+typedef struct {
+	int			compilado;	// patron ya compilado.
+	int64_t		cuenta;		// partidas que cumplen el patron.
+	PATRONC_t	patronc;
+} CUENTAPAT_t;
+
+// Funcion para interpretar el BLOB de movimientos de una partida, inicia su estado
+// de decodificacion y retorna el numero de movimientos.
+static int iniBlob(sqlite3_value *valor,DECMOV_t *dec)
+{
+	uint8_t *datos = (uint8_t *)sqlite3_value_blob(valor);
+	int len = sqlite3_value_bytes(valor);
+
+	if(datos == NULL)
+		len = 0;
+	if((len >= 2) && (datos[0] == MARCAFORMATO))	// formato reducido.
+	{
+		iniDecMov(dec,datos[1],datos + 2);
+		return(cuentaMovs(datos + 2,len - 2,datos[1]));
+	}
+	iniDecMov(dec,FORMATO_MOVBIN,datos);
+	return(len / sizeof(MOVBIN_t));
+}
+
+// Funcion que compila el patron recibido como BLOB. retorna '0' si no es un patron valido.
+static int cargaPatronBlob(sqlite3_value *valor,PATRONC_t *pc)
+{
+	if((sqlite3_value_type(valor) != SQLITE_BLOB) || (sqlite3_value_bytes(valor) != sizeof(PATRON_t)))
+		return 0;
+	compilaPatron(pc,(PATRON_t *)sqlite3_value_blob(valor));
+	return 1;
+}
+
+// Funcion que recrea la partida y retorna la primera jugada (desde 1) que cumple el
+// patron o '0' si no lo cumple en ninguna. El tablero de una jugada se comprueba al
+// decodificar el movimiento siguiente, cuando se sabe que no es el de rey de un enroque.
+static int buscaPatron(sqlite3_value *valor,PATRONC_t *pc)
+{
+	DECMOV_t dec;
+	MOVBIN_t mov;
+	uint8_t tablero[64];
+	uint8_t color = NEGRA;	// color de la ultima jugada efectuada.
+	int i,nmov,jugada = 0;
+
+	nmov = iniBlob(valor,&dec);
+	iniciaJuego(tablero);
+	for(i=0;i<nmov;i++)
+	{
+		if(siguienteMov(&dec,tablero,&mov) == 0)
+			return 0;	// lista de movimientos corrupta.
+		if(reyEnroque(&mov) == 0)
+		{
+			if((jugada > 0) && compruebaPatron(pc,color,tablero))
+				return jugada;
+			jugada++;
+		}
+		aplicaMov(&mov,tablero);
+		color = mov.piezadest & NEGRA;
+	}
+	if((jugada > 0) && compruebaPatron(pc,color,tablero))
+		return jugada;
+	return 0;
+}
+
+// pattern_match(movimientos,patron)
+// el patron compilado se conserva entre filas mientras el argumento sea constante.
+static void patternMatch(sqlite3_context *ctx,int argc,sqlite3_value **argv)
+{
+	PATRONC_t *pc;
+	int jugada,nuevo = 0;
+
+	if(sqlite3_value_type(argv[0]) == SQLITE_NULL)
+		return;	// resultado NULL.
+	if((pc = (PATRONC_t *)sqlite3_get_auxdata(ctx,1)) == NULL)
+	{
+		if((pc = (PATRONC_t *)sqlite3_malloc(sizeof(PATRONC_t))) == NULL)
+		{
+			sqlite3_result_error_nomem(ctx);
+			return;
+		}
+		if(cargaPatronBlob(argv[1],pc) == 0)
+		{
+			sqlite3_free(pc);
+			sqlite3_result_error(ctx,"pattern_match: patron invalido",-1);
+			return;
+		}
+		nuevo = 1;
+	}
+	if((jugada = buscaPatron(argv[0],pc)) != 0)
+		sqlite3_result_int(ctx,jugada);
+	// SQLITE puede liberar el patron en el propio set_auxdata, no se usa despues.
+	if(nuevo)
+		sqlite3_set_auxdata(ctx,1,pc,sqlite3_free);
+}
+
+// board_at(movimientos,jugada)
+static void boardAt(sqlite3_context *ctx,int argc,sqlite3_value **argv)
+{
+	static const char letras[] = " PNBRQK?";
+	DECMOV_t dec;
+	MOVBIN_t mov;
+	uint8_t tablero[64];
+	uint8_t color = NEGRA;	// color de la ultima jugada efectuada.
+	char fen[100];
+	int i,j,nmov,jugada,njugadas,vacios,len;
+
+	if((sqlite3_value_type(argv[0]) == SQLITE_NULL) || (sqlite3_value_type(argv[1]) == SQLITE_NULL))
+		return;
+	jugada = sqlite3_value_int(argv[1]);
+	nmov = iniBlob(argv[0],&dec);
+	if((jugada < 0) || (jugada > nmov))
+		return;
+	// se efectuan las jugadas pedidas completando el enroque de la ultima.
+	iniciaJuego(tablero);
+	for(i=0,njugadas=0;i<nmov;i++)
+	{
+		if(siguienteMov(&dec,tablero,&mov) == 0)
+			return;	// lista de movimientos corrupta, resultado NULL.
+		if(reyEnroque(&mov) == 0)
+		{
+			if(njugadas == jugada)
+				break;
+			njugadas++;
+		}
+		aplicaMov(&mov,tablero);
+		color = mov.piezadest & NEGRA;
+	}
+	if(njugadas < jugada)
+		return;	// la partida tiene menos jugadas.
+	// posicion de las piezas.
+	for(i=0,len=0;i<8;i++)
+	{
+		for(j=0,vacios=0;j<8;j++)
+		{
+			if(tablero[(i*8)+j] == NADA)
+			{
+				vacios++;
+				continue;
+			}
+			if(vacios)
+				fen[len++] = '0' + vacios;
+			vacios = 0;
+			fen[len] = letras[tablero[(i*8)+j] & 0x7];
+			if(tablero[(i*8)+j] & NEGRA)
+				fen[len] += 'a' - 'A';
+			len++;
+		}
+		if(vacios)
+			fen[len++] = '0' + vacios;
+		if(i<7)
+			fen[len++] = '/';
+	}
+	// color que juega.
+	fen[len++] = ' ';
+	fen[len++] = color ? 'w' : 'b';
+	sqlite3_result_text(ctx,fen,len,SQLITE_TRANSIENT);
+}
+
+// pattern_count(movimientos,patron), paso del agregado.
+static void patternCountPaso(sqlite3_context *ctx,int argc,sqlite3_value **argv)
+{
+	CUENTAPAT_t *cp;
+
+	if((cp = (CUENTAPAT_t *)sqlite3_aggregate_context(ctx,sizeof(CUENTAPAT_t))) == NULL)
+	{
+		sqlite3_result_error_nomem(ctx);
+		return;
+	}
+	if(sqlite3_value_type(argv[0]) == SQLITE_NULL)
+		return;
+	if(cp->compilado == 0)
+	{
+		if(cargaPatronBlob(argv[1],&cp->patronc) == 0)
+		{
+			sqlite3_result_error(ctx,"pattern_count: patron invalido",-1);
+			return;
+		}
+		cp->compilado = 1;
+	}
+	if(buscaPatron(argv[0],&cp->patronc))
+		cp->cuenta++;
+}
+
+// pattern_count(movimientos,patron), resultado del agregado.
+static void patternCountFin(sqlite3_context *ctx)
+{
+	CUENTAPAT_t *cp;
+
+	cp = (CUENTAPAT_t *)sqlite3_aggregate_context(ctx,0);
+	sqlite3_result_int64(ctx,(cp == NULL) ? 0 : cp->cuenta);
+}
+
+// Punto de entrada de la extension (sqlite3_load_extension o '.load' del shell).
+int sqlite3_patronext_init(sqlite3 *db,char **pzErrMsg,const sqlite3_api_routines *pApi)
+{
+	int rc;
+	int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+
+	SQLITE_EXTENSION_INIT2(pApi);
+	rc = sqlite3_create_function(db,"pattern_match",2,flags,NULL,patternMatch,NULL,NULL);
+	if(rc == SQLITE_OK)
+		rc = sqlite3_create_function(db,"board_at",2,flags,NULL,boardAt,NULL,NULL);
+	if(rc == SQLITE_OK)
+		rc = sqlite3_create_function(db,"pattern_count",2,flags,NULL,NULL,patternCountPaso,patternCountFin);
+	return rc;
+}
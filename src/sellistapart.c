@@ -8,6 +8,8 @@
 // recibe como parametros fileidmin y fileidmaxla salida se genera por 'stdout'.
 // si fileidmax es cero selecciona desde fileidmin hasta el maximo registrado en la base,
 // ambos a cero indica toda la base sin restricciones.
+// opcionalmente elomin y elomax de la busqueda: solo se seleccionan las particiones cuyo
+// rango de elomed lo corta (en bases sin rango de elomed en particiones se ignoran).
 //
 #include <stdio.h>
 #include <sqlite3.h>
@@ -26,16 +28,29 @@ static int callback(void *NotUsed, int argc, char **argv, char **azColName){
  return 0;
 }
 
+// Funcion que anhade al WHERE de la sentencia la condicion de rango de elomed. Las columnas van
+// sin comillas: en una tabla sin ellas SQLITE tomaria "elomin" como una cadena en lugar de fallar.
+static void anhadeElo(char *sql,int elomin,int elomax){
+ char *fin;
+
+ fin = sql + strlen(sql) - 1;	// ';' final.
+ if(strstr(sql,"WHERE") != NULL)
+	sprintf(fin," AND elomax >= %d AND elomin <= %d;",elomin,elomax);
+ else
+	sprintf(fin," WHERE elomax >= %d AND elomin <= %d;",elomin,elomax);
+}
+
 int main(int argc, char **argv){
  sqlite3 *db;
  char *zErrMsg = 0;
  int rc;
- char sql[200];
+ char sql[300];
+ char sqlelo[300];
  int fileidmin;
  int fileidmax;
 
- if( argc!=4 ){
-	fprintf(stderr, "Usage: %s <pathdatabase> <fileidmin> <fileidmax>\n", argv[0]);
+ if( (argc!=4) && (argc!=6) ){
+	fprintf(stderr, "Usage: %s <pathdatabase> <fileidmin> <fileidmax> [elomin elomax]\n", argv[0]);
 	return(1);
  }
  fileidmin = atoi(argv[2]);
@@ -59,7 +74,20 @@ int main(int argc, char **argv){
  else
 	sprintf(sql,"SELECT * FROM \"particiones\" WHERE \"fileid\" >= %d AND \"fileid\" <= %d;",fileidmin,fileidmax);
  
- rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
+ if( argc==6 ){
+	// seleccion por rango de elomed. Si la tabla no lo tiene (error al preparar la sentencia,
+	// antes de obtener filas) se seleccionan todas.
+	strcpy(sqlelo,sql);
+	anhadeElo(sqlelo,atoi(argv[4]),atoi(argv[5]));
+	rc = sqlite3_exec(db, sqlelo, callback, 0, &zErrMsg);
+	if( rc!=SQLITE_OK ){
+		sqlite3_free(zErrMsg);
+		zErrMsg = 0;
+		rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
+	}
+ }
+ else
+	rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
 
  sqlite3_close(db);
  return 0;
@@ -10,7 +10,607 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
 #include "sqlitedrv.h"
+#include "codmov.h"
+
+// Formacion del diccionario: se cuentan los prefijos de las listas de movimientos
+// codificadas de las partidas de muestra con distintas longitudes en plies.
+#define MAXPREFIJO	64			// longitud maxima en bytes de un prefijo.
+#define NPREFIJOS		65536		// entradas de la tabla hash de prefijos (potencia de 2).
+#define SONDEOPREF	8			// entradas consecutivas a probar en la tabla hash.
+
+// prefijo de apertura contado en la muestra.
+typedef struct {
+	uint32_t	cuenta;					// veces que aparece en la muestra.
+	uint8_t	len;						// longitud en bytes.
+	uint8_t	datos[MAXPREFIJO];	// movimientos codificados.
+} PREFIJO_t;
+
+// longitudes en plies de los prefijos considerados.
+static const int pliesPrefijo[] = {4,6,8,10,12,16,20,24,30};
+static PREFIJO_t *prefijos = NULL;	// tabla hash de prefijos.
+
+// parametros y estado del bloque en construccion.
+static int partbloque = 0;			// partidas por bloque.
+static int formatobloque = FORMATO_COMPACTO;
+static uint8_t dicbloque[MAXDICC];	// diccionario del fileid en curso.
+static int lendicbloque = 0;
+static CABBLOQUE_t *cabbloque = NULL;	// cabeceras de las partidas del bloque.
+static METABLOQUE_t *metabloque = NULL;	// metadatos de las partidas del bloque.
+static uint8_t *movbloque = NULL;		// movimientos de las partidas del bloque.
+static uint8_t *datbloque = NULL;		// bloque sin comprimir (cabeceras + metadatos + movimientos).
+static uint8_t *zbloque = NULL;			// bloque comprimido.
+static int lenzbloque = 0;
+static int npartbloque = 0;		// partidas en el bloque.
+static int lenmovbloque = 0;		// bytes de movimientos en el bloque.
+static int fileidbloque = -1;		// fileid y particion del bloque.
+static int particionbloque = -1;
+static int numbloque = 0;			// numero de bloque dentro de la particion.
+static z_stream zcomp;				// compresor zlib.
+static int zcompini = 0;
+
+// estado de la lectura de una particion grabada en bloques.
+typedef struct {
+	sqlite3_stmt *stmt;		// cursor del QUERY de bloques (NULL si no hay lectura en curso).
+	uint8_t *arena;			// bloque descomprimido, se reutiliza entre bloques.
+	int lenarena;
+	CABBLOQUE_t *cab;			// cabeceras del bloque en curso.
+	METABLOQUE_t *meta;		// metadatos del bloque en curso (NULL si no los tiene).
+	uint8_t *mov;				// siguiente lista de movimientos del bloque en curso.
+	int npart;					// partidas del bloque en curso.
+	int ind;						// siguiente partida a examinar del bloque en curso.
+	int elomin;					// criterios de busqueda.
+	int elomax;
+	int gana;
+	FILTROMETA_t *filtro;	// filtro de metadatos (NULL => sin filtro).
+	int sinmeta;				// se ha leido algun bloque sin metadatos.
+	uint8_t dicc[MAXDICC];	// diccionario del fileid de la particion.
+	int lendicc;
+	z_stream z;					// descompresor zlib.
+	int zini;
+} LECBLOQUE_t;
+
+static LECBLOQUE_t lecbloque;
+
+// Cache de conexiones de lectura. Cada base_N se abre una sola vez en solo lectura y
+// sus sentencias de consulta se preparan una vez y se reutilizan con sqlite3_reset.
+#define MAXCONEXIONES	16							// bases abiertas como maximo.
+#define MMAPSQLITE		(1024LL*1024*1024)	// bytes de la base proyectados en memoria.
+#define MMAPVFS			(64LL*1024*1024)		// proyectados con el VFS de lectura, el resto por su ventana.
+#define CACHESQLITE		65536						// KB de cache de paginas por conexion.
+
+// sentencias de consulta cacheadas por conexion.
+#define SENTFILAS			0	// partidas por filas (esquema V1) sin y con ganador.
+#define SENTFILASG		1
+#define SENTFILAS2		2	// partidas por filas (esquema V2) sin y con ganador.
+#define SENTFILASG2		3
+#define SENTHAYBLOQ		4	// existencia de bloques de la particion.
+#define SENTDICC			5	// diccionario del fileid.
+#define SENTBLOQ			6	// bloques de la particion sin y con ganador.
+#define SENTBLOQG			7
+#define SENTFILASM		8	// partidas por filas con metadatos (esquema V1) sin y con ganador.
+#define SENTFILASGM		9
+#define SENTFILAS2M		10	// partidas por filas con metadatos (esquema V2) sin y con ganador.
+#define SENTFILASG2M		11
+#define NSENTENCIAS		12
+
+typedef struct {
+	char				path[1000];						// path de la base.
+	sqlite3			*db;								// conexion abierta.
+	int				version;							// version del esquema.
+	sqlite3_stmt	*sent[NSENTENCIAS];			// sentencias preparadas.
+	uint8_t			fallida[NSENTENCIAS];		// sentencia que no puede prepararse (tabla inexistente).
+} CONEXION_t;
+
+static CONEXION_t conexiones[MAXCONEXIONES];
+static int nconexiones = 0;
+
+//================ VFS de lectura ====================================
+// VFS de solo lectura para los recorridos secuenciales de las particiones. Envuelve al
+// VFS por defecto y solo sustituye el acceso a las bases principales abiertas en solo
+// lectura. Las lecturas de SQLITE (una pagina) se sirven desde una ventana de la base
+// leida con un solo pread en un buffer alineado. Si las lecturas son secuenciales la
+// ventana se duplica hasta LECTURAMAX y se anticipa la siguiente con posix_fadvise;
+// si no lo son la ventana vuelve a LECTURAMIN. Los buffers forman un pool compartido
+// por todas las bases abiertas; si se agotan se reutiliza el usado hace mas tiempo.
+// Opcionalmente las bases se abren con O_DIRECT para no duplicar en la cache de paginas
+// del sistema los datos que ya guardan el pool y la cache de SQLITE.
+// El VFS mantiene la proyeccion en memoria de las conexiones de lectura (mmap_size): las
+// paginas dentro de la proyeccion se sirven con xFetch sin copia y solo las demas pasan por
+// la ventana. Con el VFS la proyeccion se limita a MMAPVFS (el comienzo de la base, con el
+// esquema y las raices de los indices) para que los recorridos de las particiones de bases
+// algo mayores vayan por la ventana. Con O_DIRECT no se proyecta la base, que pasaria por
+// la cache del sistema.
+#define NOMBREVFS		"ajzlectura"
+#define ALINVFS		4096				// alineacion de offsets, longitudes y buffers.
+#define LECTURAMIN	(16*1024)		// ventana de lectura en accesos no secuenciales.
+#define LECTURAMAX	(1024*1024)		// ventana maxima en accesos secuenciales.
+#define NBUFVFS		8					// buffers del pool.
+#define NTAMVFS		10					// tramos del histograma de tamanhos de lectura (ESTVFS_t).
+
+// buffer del pool.
+typedef struct {
+	uint8_t	*datos;		// buffer alineado de LECTURAMAX bytes.
+	void		*duenho;		// fichero que lo usa.
+	uint64_t	uso;			// marca del ultimo uso.
+} BUFVFS_t;
+
+// fichero abierto por el VFS de lectura.
+typedef struct {
+	sqlite3_file	base;			// debe ser el primer campo.
+	int				fd;
+	int				directo;		// abierto con O_DIRECT.
+	int				buf;			// indice del buffer del pool (-1 => ninguno).
+	int64_t			iniven;		// offset de la ventana leida en el buffer.
+	int				lenven;		// bytes validos de la ventana.
+	int				ventana;		// tamanho de la proxima ventana.
+	int64_t			finultima;	// final de la ultima lectura pedida por SQLITE.
+	uint8_t			*mapa;		// proyeccion en memoria de la base (NULL => sin proyectar).
+	int64_t			lenmapa;		// bytes proyectados.
+	int64_t			maxmapa;		// limite de la proyeccion (mmap_size).
+	int				nfetch;		// paginas de la proyeccion en uso por SQLITE.
+} FICHVFS_t;
+
+static sqlite3_vfs vfslec;					// VFS de lectura.
+static sqlite3_vfs *vfsorg = NULL;		// VFS por defecto envuelto.
+static int vfsdirecto = 0;					// usar O_DIRECT.
+static BUFVFS_t poolvfs[NBUFVFS];
+static uint64_t usovfs = 0;
+static ESTVFS_t estvfs;						// contadores.
+
+// obtiene un buffer del pool para el fichero, reutilizando el menos usado si no hay libres.
+static int bufferVfs(FICHVFS_t *f)
+{
+	int i,elegido = 0;
+
+	if((f->buf >= 0) && (poolvfs[f->buf].duenho == f))
+	{
+		poolvfs[f->buf].uso = ++usovfs;
+		return(f->buf);
+	}
+	for(i=0;i<NBUFVFS;i++)
+	{
+		if(poolvfs[i].duenho == NULL)
+		{
+			elegido = i;
+			break;
+		}
+		if(poolvfs[i].uso < poolvfs[elegido].uso)
+			elegido = i;
+	}
+	if(poolvfs[elegido].datos == NULL)
+	{
+		if(posix_memalign((void **)&poolvfs[elegido].datos,ALINVFS,LECTURAMAX) != 0)
+		{
+			fprintf(stderr,"Sin memoria para buffers VFS\n");
+			exit(2);
+		}
+	}
+	poolvfs[elegido].duenho = f;
+	poolvfs[elegido].uso = ++usovfs;
+	f->buf = elegido;
+	f->lenven = 0;	// la ventana de su anterior duenho no vale.
+	return elegido;
+}
+
+// lectura de len bytes en offset con pread reintentando las lecturas parciales.
+static int leeVfs(FICHVFS_t *f,uint8_t *datos,int len,int64_t offset)
+{
+	int n,total = 0;
+	int i;
+
+	while(total < len)
+	{
+		n = pread(f->fd,datos + total,len - total,offset + total);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		if(n == 0)
+			break;
+		total += n;
+		if(f->directo && ((n % ALINVFS) != 0))	// final de fichero con O_DIRECT.
+			break;
+	}
+	estvfs.nlecturas++;
+	estvfs.bytesleidos += total;
+	for(i=0;(i < NTAMVFS - 1) && ((LECTURAMIN >> 2) << i) < len;i++)
+		;
+	estvfs.tamanhos[i]++;
+	return total;
+}
+
+static int cierraFichVfs(sqlite3_file *pf)
+{
+	FICHVFS_t *f = (FICHVFS_t *)pf;
+
+	if((f->buf >= 0) && (poolvfs[f->buf].duenho == f))
+		poolvfs[f->buf].duenho = NULL;
+	if(f->mapa != NULL)
+		munmap(f->mapa,f->lenmapa);
+	close(f->fd);
+	return SQLITE_OK;
+}
+
+static int leeFichVfs(sqlite3_file *pf,void *datos,int amt,sqlite3_int64 offset)
+{
+	FICHVFS_t *f = (FICHVFS_t *)pf;
+	int secuencial,len,n,disp,i;
+	int64_t ini;
+
+	estvfs.bytespedidos += amt;
+	i = bufferVfs(f);
+	// servida desde la ventana actual.
+	if((f->lenven > 0) && (offset >= f->iniven) && ((offset + amt) <= (f->iniven + f->lenven)))
+	{
+		memcpy(datos,poolvfs[i].datos + (offset - f->iniven),amt);
+		estvfs.aciertos++;
+		f->finultima = offset + amt;
+		return SQLITE_OK;
+	}
+	// nueva ventana, mayor cuanto mas secuencial es el acceso. Se considera secuencial
+	// la lectura que avanza como mucho LECTURAMIN bytes sobre el final de la anterior
+	// (en un recorrido de la clave se intercalan paginas interiores del arbol).
+	secuencial = (offset >= f->finultima) && ((offset - f->finultima) <= LECTURAMIN);
+	if(secuencial)
+	{
+		f->ventana *= 2;
+		if(f->ventana > LECTURAMAX)
+			f->ventana = LECTURAMAX;
+	}
+	else
+		f->ventana = LECTURAMIN;
+	ini = offset & ~((int64_t)ALINVFS - 1);
+	len = f->ventana;
+	if((offset + amt - ini) > len)
+		len = (offset + amt - ini + ALINVFS - 1) & ~(ALINVFS - 1);
+	if(len > LECTURAMAX)	// lectura mayor que un buffer, directa sin ventana.
+	{
+		n = pread(f->fd,datos,amt,offset);
+		estvfs.nlecturas++;
+		estvfs.bytesleidos += (n > 0) ? n : 0;
+		if(n == amt)
+			return SQLITE_OK;
+		if(n < 0)
+			return SQLITE_IOERR_READ;
+		memset((uint8_t *)datos + n,0,amt - n);
+		return SQLITE_IOERR_SHORT_READ;
+	}
+	n = leeVfs(f,poolvfs[i].datos,len,ini);
+	if(n < 0)
+	{
+		f->lenven = 0;
+		return SQLITE_IOERR_READ;
+	}
+	f->iniven = ini;
+	f->lenven = n;
+	f->finultima = offset + amt;
+	if(secuencial && !f->directo)	// anticipamos la siguiente ventana.
+		posix_fadvise(f->fd,ini + n,f->ventana,POSIX_FADV_WILLNEED);
+	disp = n - (offset - ini);
+	if(disp >= amt)
+	{
+		memcpy(datos,poolvfs[i].datos + (offset - ini),amt);
+		return SQLITE_OK;
+	}
+	if(disp < 0)
+		disp = 0;
+	memcpy(datos,poolvfs[i].datos + (offset - ini),disp);
+	memset((uint8_t *)datos + disp,0,amt - disp);
+	return SQLITE_IOERR_SHORT_READ;
+}
+
+static int escribeFichVfs(sqlite3_file *pf,const void *datos,int amt,sqlite3_int64 offset)
+{
+	(void)pf;
+	(void)datos;
+	(void)amt;
+	(void)offset;
+	return SQLITE_READONLY;
+}
+
+static int truncaFichVfs(sqlite3_file *pf,sqlite3_int64 size)
+{
+	(void)pf;
+	(void)size;
+	return SQLITE_READONLY;
+}
+
+static int syncFichVfs(sqlite3_file *pf,int flags)
+{
+	(void)pf;
+	(void)flags;
+	return SQLITE_OK;
+}
+
+static int tamanhoFichVfs(sqlite3_file *pf,sqlite3_int64 *size)
+{
+	struct stat st;
+
+	if(fstat(((FICHVFS_t *)pf)->fd,&st) < 0)
+		return SQLITE_IOERR_FSTAT;
+	*size = st.st_size;
+	return SQLITE_OK;
+}
+
+// las bases son inmutables durante la busqueda, no se necesitan bloqueos.
+static int bloqueaFichVfs(sqlite3_file *pf,int nivel)
+{
+	(void)pf;
+	(void)nivel;
+	return SQLITE_OK;
+}
+
+static int reservadoFichVfs(sqlite3_file *pf,int *reservado)
+{
+	(void)pf;
+	*reservado = 0;
+	return SQLITE_OK;
+}
+
+static int controlFichVfs(sqlite3_file *pf,int op,void *arg)
+{
+	FICHVFS_t *f = (FICHVFS_t *)pf;
+	int64_t limite;
+
+	if(op != SQLITE_FCNTL_MMAP_SIZE)
+		return SQLITE_NOTFOUND;
+	// nuevo limite de la proyeccion, se retorna el anterior.
+	limite = *(int64_t *)arg;
+	*(int64_t *)arg = f->maxmapa;
+	if((limite >= 0) && (limite != f->maxmapa) && (f->nfetch == 0))
+	{
+		f->maxmapa = limite;
+		if(f->mapa != NULL)	// se vuelve a proyectar con el nuevo limite en el siguiente xFetch.
+		{
+			munmap(f->mapa,f->lenmapa);
+			f->mapa = NULL;
+			f->lenmapa = 0;
+		}
+	}
+	return SQLITE_OK;
+}
+
+static int sectorFichVfs(sqlite3_file *pf)
+{
+	(void)pf;
+	return ALINVFS;
+}
+
+static int dispositivoFichVfs(sqlite3_file *pf)
+{
+	(void)pf;
+	return SQLITE_IOCAP_IMMUTABLE;
+}
+
+// pagina desde la proyeccion en memoria de la base, que se forma en la primera peticion con
+// el tamanho de la base hasta maxmapa. *pp = NULL => SQLITE la lee con leeFichVfs.
+static int fetchFichVfs(sqlite3_file *pf,sqlite3_int64 offset,int amt,void **pp)
+{
+	FICHVFS_t *f = (FICHVFS_t *)pf;
+	struct stat st;
+	void *mapa;
+
+	*pp = NULL;
+	if((f->maxmapa <= 0) || f->directo)
+		return SQLITE_OK;
+	if((f->mapa == NULL) && (fstat(f->fd,&st) == 0) && (st.st_size > 0))
+	{
+		f->lenmapa = (st.st_size < f->maxmapa) ? st.st_size : f->maxmapa;
+		if((mapa = mmap(NULL,f->lenmapa,PROT_READ,MAP_SHARED,f->fd,0)) == MAP_FAILED)
+		{
+			f->maxmapa = 0;	// sin proyeccion, todas las lecturas por la ventana.
+			f->lenmapa = 0;
+			return SQLITE_OK;
+		}
+		f->mapa = mapa;
+	}
+	if((f->mapa != NULL) && ((offset + amt) <= f->lenmapa))
+	{
+		*pp = f->mapa + offset;
+		f->nfetch++;
+		estvfs.proyectadas++;
+	}
+	return SQLITE_OK;
+}
+
+// libera una pagina de la proyeccion. p = NULL => SQLITE pide deshacer la proyeccion.
+static int unfetchFichVfs(sqlite3_file *pf,sqlite3_int64 offset,void *p)
+{
+	FICHVFS_t *f = (FICHVFS_t *)pf;
+
+	(void)offset;
+	if(p != NULL)
+		f->nfetch--;
+	else if((f->mapa != NULL) && (f->nfetch == 0))
+	{
+		munmap(f->mapa,f->lenmapa);
+		f->mapa = NULL;
+		f->lenmapa = 0;
+	}
+	return SQLITE_OK;
+}
+
+static const sqlite3_io_methods metodosVfs = {
+	3,
+	cierraFichVfs,
+	leeFichVfs,
+	escribeFichVfs,
+	truncaFichVfs,
+	syncFichVfs,
+	tamanhoFichVfs,
+	bloqueaFichVfs,
+	bloqueaFichVfs,
+	reservadoFichVfs,
+	controlFichVfs,
+	sectorFichVfs,
+	dispositivoFichVfs,
+	NULL,					// sin memoria compartida (WAL), las bases son inmutables.
+	NULL,
+	NULL,
+	NULL,
+	fetchFichVfs,
+	unfetchFichVfs
+};
+
+// apertura de ficheros: las bases principales en solo lectura las gestiona el VFS de
+// lectura, el resto se delegan en el VFS por defecto.
+static int abreVfs(sqlite3_vfs *vfs,const char *nombre,sqlite3_file *pf,int flags,int *flagsout)
+{
+	FICHVFS_t *f = (FICHVFS_t *)pf;
+
+	(void)vfs;
+	if((nombre == NULL) || ((flags & SQLITE_OPEN_MAIN_DB) == 0) || ((flags & SQLITE_OPEN_READONLY) == 0))
+		return(vfsorg->xOpen(vfsorg,nombre,pf,flags,flagsout));
+	memset(f,0,sizeof(FICHVFS_t));
+	f->fd = -1;
+#ifdef O_DIRECT
+	if(vfsdirecto)
+	{
+		f->fd = open(nombre,O_RDONLY | O_DIRECT);
+		f->directo = (f->fd >= 0);
+	}
+#endif
+	if(f->fd < 0)
+		f->fd = open(nombre,O_RDONLY);
+	if(f->fd < 0)
+		return SQLITE_CANTOPEN;
+	f->buf = -1;
+	f->ventana = LECTURAMIN;
+	f->finultima = -1;
+	if(flagsout != NULL)
+		*flagsout = flags;
+	pf->pMethods = &metodosVfs;
+	return SQLITE_OK;
+}
+
+static int borraVfs(sqlite3_vfs *vfs,const char *nombre,int sync)
+{
+	(void)vfs;
+	return(vfsorg->xDelete(vfsorg,nombre,sync));
+}
+
+static int accesoVfs(sqlite3_vfs *vfs,const char *nombre,int flags,int *res)
+{
+	(void)vfs;
+	return(vfsorg->xAccess(vfsorg,nombre,flags,res));
+}
+
+static int pathVfs(sqlite3_vfs *vfs,const char *nombre,int n,char *salida)
+{
+	(void)vfs;
+	return(vfsorg->xFullPathname(vfsorg,nombre,n,salida));
+}
+
+static int aleatorioVfs(sqlite3_vfs *vfs,int n,char *salida)
+{
+	(void)vfs;
+	return(vfsorg->xRandomness(vfsorg,n,salida));
+}
+
+static int esperaVfs(sqlite3_vfs *vfs,int micros)
+{
+	(void)vfs;
+	return(vfsorg->xSleep(vfsorg,micros));
+}
+
+static int horaVfs(sqlite3_vfs *vfs,double *hora)
+{
+	(void)vfs;
+	return(vfsorg->xCurrentTime(vfsorg,hora));
+}
+
+static int errorVfs(sqlite3_vfs *vfs,int n,char *salida)
+{
+	(void)vfs;
+	return(vfsorg->xGetLastError(vfsorg,n,salida));
+}
+
+// Funcion para registrar el VFS de lectura. Las conexiones de lectura (conectaSqliteR)
+// abiertas despues lo utilizan. directo indica si las bases se abren con O_DIRECT.
+void registraVfsLectura(int directo)
+{
+	vfsdirecto = directo;
+	if(vfsorg != NULL)
+		return;
+	if((vfsorg = sqlite3_vfs_find(NULL)) == NULL)
+		return;
+	memset(&vfslec,0,sizeof(vfslec));
+	vfslec.iVersion = 1;
+	vfslec.szOsFile = (vfsorg->szOsFile > sizeof(FICHVFS_t)) ? vfsorg->szOsFile : sizeof(FICHVFS_t);
+	vfslec.mxPathname = vfsorg->mxPathname;
+	vfslec.zName = NOMBREVFS;
+	vfslec.xOpen = abreVfs;
+	vfslec.xDelete = borraVfs;
+	vfslec.xAccess = accesoVfs;
+	vfslec.xFullPathname = pathVfs;
+	vfslec.xRandomness = aleatorioVfs;
+	vfslec.xSleep = esperaVfs;
+	vfslec.xCurrentTime = horaVfs;
+	vfslec.xGetLastError = errorVfs;
+	if(sqlite3_vfs_register(&vfslec,0) != SQLITE_OK)
+	{
+		fprintf(stderr,"No puedo registrar el VFS de lectura\n");
+		vfsorg = NULL;
+	}
+}
+
+// Funcion para obtener los contadores del VFS de lectura.
+void estadisticasVfs(ESTVFS_t *est)
+{
+	*est = estvfs;
+}
+
+// Funcion para mostrar los contadores del VFS de lectura.
+void muestraEstVfs(FILE *fd)
+{
+	int i;
+
+	fprintf(fd,"VFS=> pedidos %llu bytes, leidos %llu bytes en %llu lecturas, %llu aciertos, %llu proyectadas\n",
+				(unsigned long long)estvfs.bytespedidos,(unsigned long long)estvfs.bytesleidos,
+				(unsigned long long)estvfs.nlecturas,(unsigned long long)estvfs.aciertos,
+				(unsigned long long)estvfs.proyectadas);
+	fprintf(fd,"VFS=> lecturas por tamanho:");
+	for(i=0;i<NTAMVFS;i++)
+	{
+		if(i < NTAMVFS - 1)
+			fprintf(fd," <=%dK:%llu",((LECTURAMIN >> 2) << i) / 1024,(unsigned long long)estvfs.tamanhos[i]);
+		else
+			fprintf(fd," >%dK:%llu",((LECTURAMIN >> 2) << (i - 1)) / 1024,(unsigned long long)estvfs.tamanhos[i]);
+	}
+	fprintf(fd,"\n");
+}
+
+// recodifica el ganador (0=NADA, 1=>blancas, 2=>negras, 3=tablas) en los flags de la partida.
+static void ponGanador(CPARTIDA_t *cabpar,uint8_t ganador)
+{
+	switch(ganador)
+	{
+		case 1:
+			cabpar->flags.ganablanca = 1;
+			cabpar->flags.gananegra = 0;
+			break;
+		case 2:
+			cabpar->flags.ganablanca = 0;
+			cabpar->flags.gananegra = 1;
+			break;
+		case 3:
+			cabpar->flags.ganablanca = 1;
+			cabpar->flags.gananegra = 1;
+			break;
+		default:
+			cabpar->flags.ganablanca = 0;
+			cabpar->flags.gananegra = 0;
+			break;
+	}
+}
 
 // funcion para conectar con la base de datos indicada por su path.
 // pone la base en modo asincrono para ganar velocidad.
@@ -35,22 +635,267 @@ void conectaSqlite(sqlite3 **db,char *basename)
    sqlite3_finalize(stmt1);
 }
 
+// busca la conexion cacheada de una base por su descriptor, NULL si no esta cacheada.
+static CONEXION_t *buscaConexion(sqlite3 *db)
+{
+	int i;
+
+	for(i=0;i<nconexiones;i++)
+	{
+		if(conexiones[i].db == db)
+			return(&conexiones[i]);
+	}
+	return NULL;
+}
+
+// cierra una conexion cacheada finalizando sus sentencias y la quita de la cache.
+static void cierraConexion(CONEXION_t *con)
+{
+	int i;
+
+	for(i=0;i<NSENTENCIAS;i++)
+	{
+		if(con->sent[i] != NULL)
+			sqlite3_finalize(con->sent[i]);
+	}
+	sqlite3_close(con->db);
+	*con = conexiones[--nconexiones];
+}
+
 // Funcion para desconectar de la base de datos indicada por su descriptor.
+// Si es una conexion cacheada se quita de la cache.
 void desconectaSqlite(sqlite3 *db)
 {
+	CONEXION_t *con;
+
+	if((con = buscaConexion(db)) != NULL)
+	{
+		cierraConexion(con);
+		return;
+	}
 	sqlite3_close(db);
 	db = NULL;
 }
 
+// Funcion para obtener la conexion de lectura a la base indicada por su path.
+// La primera vez abre la base en solo lectura como inmutable, con proyeccion en memoria,
+// cache de paginas amplia y query_only. Las siguientes retorna la conexion ya abierta.
+sqlite3 *conectaSqliteR(char *basename)
+{
+	int i,rc;
+	char uri[3100];
+	char pragmas[200];
+	char *pchar;
+	char *error_message = 0;
+	CONEXION_t *con;
+
+	for(i=0;i<nconexiones;i++)
+	{
+		if(strcmp(conexiones[i].path,basename) == 0)
+			return(conexiones[i].db);
+	}
+	if(nconexiones >= MAXCONEXIONES)	// cache llena, se libera la mas antigua.
+		cierraConexion(&conexiones[0]);
+	con = &conexiones[nconexiones];
+	memset(con,0,sizeof(CONEXION_t));
+	strncpy(con->path,basename,sizeof(con->path) - 1);
+	// URI con los caracteres reservados escapados.
+	strcpy(uri,"file:");
+	for(pchar=basename,i=strlen(uri);(*pchar != 0) && (i < sizeof(uri) - 40);pchar++)
+	{
+		if((*pchar == '%') || (*pchar == '?') || (*pchar == '#'))
+			i += sprintf(uri + i,"%%%02X",(uint8_t)*pchar);
+		else
+			uri[i++] = *pchar;
+	}
+	strcpy(uri + i,"?mode=ro&immutable=1");
+	rc = sqlite3_open_v2(uri, &con->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI,
+								(vfsorg != NULL) ? NOMBREVFS : NULL);
+	if( rc ){
+		fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(con->db));
+		sqlite3_close(con->db);
+		exit(1);
+	}
+	sprintf(pragmas,"PRAGMA mmap_size = %lld; PRAGMA cache_size = -%d; PRAGMA query_only = 1",
+				(vfsorg != NULL) ? MMAPVFS : MMAPSQLITE,CACHESQLITE);
+	rc = sqlite3_exec(con->db, pragmas, NULL, 0, &error_message);
+	if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error al cambiar pragma: %s\n", error_message);
+        sqlite3_free(error_message);
+   }
+	nconexiones++;
+	con->version = versionSqlite(con->db);
+	return(con->db);
+}
+
+// Funcion para cerrar todas las conexiones de lectura cacheadas.
+void cierraConexiones(void)
+{
+	while(nconexiones > 0)
+		cierraConexion(&conexiones[nconexiones - 1]);
+}
+
+// obtiene la sentencia ind preparada de la conexion. En las conexiones cacheadas se prepara
+// la primera vez y despues se reinicia; en las demas se prepara siempre (se finaliza al soltarla).
+// retorna NULL si la sentencia no puede prepararse.
+static sqlite3_stmt *preparaSentencia(sqlite3 *db,int ind,const char *sql)
+{
+	sqlite3_stmt *stmt1 = NULL;
+	CONEXION_t *con;
+
+	if((con = buscaConexion(db)) == NULL)
+	{
+		if(sqlite3_prepare(db, sql, -1, &stmt1, NULL) != SQLITE_OK)
+			return NULL;
+		return stmt1;
+	}
+	if(con->sent[ind] != NULL)
+	{
+		sqlite3_reset(con->sent[ind]);
+		sqlite3_clear_bindings(con->sent[ind]);
+		return(con->sent[ind]);
+	}
+	if(con->fallida[ind])
+		return NULL;
+	if(sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt1, NULL) != SQLITE_OK)
+	{
+		con->fallida[ind] = 1;
+		return NULL;
+	}
+	con->sent[ind] = stmt1;
+	return stmt1;
+}
+
+// suelta una sentencia obtenida con preparaSentencia: si es cacheada se reinicia
+// y en caso contrario se finaliza.
+static void sueltaSentencia(sqlite3_stmt *stmt)
+{
+	CONEXION_t *con;
+	int i;
+
+	if((con = buscaConexion(sqlite3_db_handle(stmt))) != NULL)
+	{
+		for(i=0;i<NSENTENCIAS;i++)
+		{
+			if(con->sent[i] == stmt)
+			{
+				sqlite3_reset(stmt);
+				return;
+			}
+		}
+	}
+	sqlite3_finalize(stmt);
+}
+
+// Funcion que retorna la version del esquema de la base (ESQUEMAVx).
+// Las bases anteriores al esquema V2 no tienen user_version (vale 0).
+int versionSqlite(sqlite3 *db)
+{
+	int version = 0;
+	sqlite3_stmt *stmt1;
+	CONEXION_t *con;
+
+	if(((con = buscaConexion(db)) != NULL) && (con->version != 0))
+		return(con->version);
+	if(sqlite3_prepare(db, "PRAGMA user_version", -1, &stmt1, NULL) == SQLITE_OK)
+	{
+		if(sqlite3_step(stmt1) == SQLITE_ROW)
+			version = sqlite3_column_int(stmt1, 0);
+		sqlite3_finalize(stmt1);
+	}
+	if(version < ESQUEMAV2)
+		return ESQUEMAV1;
+	return version;
+}
+
+// Funcion para crear las tablas de partidas del esquema V2 y marcar la base con su version.
+// La base no debe tener tabla ni vista 'partidas'. retorna '1' si es correcto y '0' en caso contrario.
+int creaTablasV2(sqlite3 *db)
+{
+	int rc;
+	char *error_message = 0;
+	const char *esquema =
+		"CREATE TABLE cabpartidas (fileid INTEGER, particion INTEGER, elomed INTEGER, ganador INTEGER,"
+		" partidaid INTEGER, eco INTEGER DEFAULT 0, ritmo INTEGER DEFAULT 0, terminacion INTEGER DEFAULT 0,"
+		" difelo INTEGER DEFAULT 0, PRIMARY KEY(fileid,particion,elomed,ganador,partidaid)) WITHOUT ROWID;"
+		"CREATE TABLE movpartidas (fileid INTEGER, particion INTEGER, elomed INTEGER, ganador INTEGER,"
+		" partidaid INTEGER, datos BLOB, PRIMARY KEY(fileid,particion,elomed,ganador,partidaid)) WITHOUT ROWID;"
+		"CREATE VIEW partidas AS SELECT c.fileid AS fileid, c.particion AS particion, c.elomed AS elomed,"
+		" c.ganador AS ganador, c.partidaid AS partidaid, m.datos AS movimientos, c.eco AS eco, c.ritmo AS ritmo,"
+		" c.terminacion AS terminacion, c.difelo AS difelo FROM cabpartidas c"
+		" JOIN movpartidas m ON m.fileid = c.fileid AND m.particion = c.particion AND m.elomed = c.elomed"
+		" AND m.ganador = c.ganador AND m.partidaid = c.partidaid;"
+		"CREATE TRIGGER inspartidas INSTEAD OF INSERT ON partidas BEGIN"
+		" INSERT INTO cabpartidas VALUES(NEW.fileid,NEW.particion,NEW.elomed,NEW.ganador,NEW.partidaid,"
+		"coalesce(NEW.eco,0),coalesce(NEW.ritmo,0),coalesce(NEW.terminacion,0),coalesce(NEW.difelo,0));"
+		" INSERT INTO movpartidas VALUES(NEW.fileid,NEW.particion,NEW.elomed,NEW.ganador,NEW.partidaid,NEW.movimientos);"
+		" END;"
+		"PRAGMA user_version = 2;";
+
+	rc = sqlite3_exec(db, esquema, NULL, 0, &error_message);
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "Error al crear esquema V2: %s\n", error_message);
+		sqlite3_free(error_message);
+		return 0;
+	}
+	return 1;
+}
+
+// Funcion para crear los indices secundarios de las tablas de partidas (esquema V1) y bloques
+// si no existen. retorna '1' si es correcto y '0' en caso contrario.
+int creaIndices(sqlite3 *db)
+{
+	int rc;
+	char *error_message = 0;
+	const char *indpartidas =
+		"CREATE INDEX IF NOT EXISTS eloid ON partidas (elomed ASC);"
+		"CREATE INDEX IF NOT EXISTS partid ON partidas (fileid ASC,particion ASC);";
+	const char *indbloques =
+		"CREATE INDEX IF NOT EXISTS bloqid ON bloques (fileid ASC,particion ASC,bloque ASC);";
+
+	// en el esquema V2 las partidas estan agrupadas por su clave primaria.
+	if(versionSqlite(db) < ESQUEMAV2)
+		rc = sqlite3_exec(db, indpartidas, NULL, 0, &error_message);
+	else
+		rc = SQLITE_OK;
+	if(rc == SQLITE_OK)
+		rc = sqlite3_exec(db, indbloques, NULL, 0, &error_message);
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "Error al crear indices: %s\n", error_message);
+		sqlite3_free(error_message);
+		return 0;
+	}
+	return 1;
+}
+
+// Funcion para poner la conexion en modo de carga masiva.
+void modoCargaMasiva(sqlite3 *db)
+{
+	char *error_message = 0;
+	const char *pragmas =
+		"PRAGMA journal_mode = OFF;"
+		"PRAGMA locking_mode = EXCLUSIVE;"
+		"PRAGMA cache_size = -262144;"
+		"PRAGMA temp_store = MEMORY;";
+
+	if(sqlite3_exec(db, pragmas, NULL, 0, &error_message) != SQLITE_OK) {
+		fprintf(stderr, "Error al cambiar pragma: %s\n", error_message);
+		sqlite3_free(error_message);
+	}
+}
+
 // Funcion para indicar el comienzo de una transaccion de escritura en la base.
 // en la tabla de partidas.
 // se indican el descriptor de la base y el descriptor del cursor a usar en las insercciones.
+// Las bases anteriores a los metadatos de las partidas no tienen sus columnas y se insertan sin ellos.
 void beginTransW(sqlite3 *db,sqlite3_stmt **stmt)
 {
 	int rc;
 	sqlite3_stmt *stmt1;
 	const char* btrans = "BEGIN TRANSACTION";
-	const char *query = "INSERT INTO partidas(fileid,particion,elomed,ganador,partidaid,movimientos) VALUES(?,?,?,?,?,?)";
+	const char *query = "INSERT INTO partidas(fileid,particion,elomed,ganador,partidaid,movimientos,eco,ritmo,terminacion,difelo)"
+								" VALUES(?,?,?,?,?,?,?,?,?,?)";
+	const char *queryant = "INSERT INTO partidas(fileid,particion,elomed,ganador,partidaid,movimientos) VALUES(?,?,?,?,?,?)";
 	
 	rc = sqlite3_prepare(db, btrans, -1, &stmt1, NULL);
 	rc = sqlite3_step(stmt1);
@@ -59,6 +904,8 @@ void beginTransW(sqlite3 *db,sqlite3_stmt **stmt)
    }
    sqlite3_finalize(stmt1);
 	rc = sqlite3_prepare(db, query, -1, stmt, NULL);
+	if (rc != SQLITE_OK)
+		rc = sqlite3_prepare(db, queryant, -1, stmt, NULL);
 	if (rc != SQLITE_OK) {
 	  fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
 	  sqlite3_close(db);
@@ -85,11 +932,13 @@ void endTransW(sqlite3 *db,sqlite3_stmt *stmt)
 
 // Funcion para volcar una partida indicada por su cabecera y lista de movimientos al cursor de inserccion
 // actual en la base de datos. Se indican el descriptor de la base, el cursor de inserccion, el identificador
-// del fichero de partidas original y el numero de particion en proceso.
-void vuelcaPart(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,MOVBIN_t *mov,int fileid,int particion)
+// del fichero de partidas original, el numero de particion en proceso y el formato de grabacion de los movimientos.
+void vuelcaPart(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,MOVBIN_t *mov,int fileid,int particion,int formato)
 {
 	int i,rc;
 	uint8_t ganador;
+	uint8_t blob[2 + MAXMOV * sizeof(MOVBIN_t)];
+	int lenblob;
 
 
 	if(cabpar->nmov == 0)
@@ -105,7 +954,22 @@ void vuelcaPart(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,MOVBIN_t *mov,
 	sqlite3_bind_int(stmt, 3, cabpar->elomed);
 	sqlite3_bind_int(stmt, 4, ganador);
 	sqlite3_bind_int(stmt, 5, cabpar->ind);
-	sqlite3_bind_blob(stmt, 6, (char *)mov, cabpar->nmov * 4, SQLITE_STATIC);
+	if(sqlite3_bind_parameter_count(stmt) > 6)	// metadatos de la partida.
+	{
+		sqlite3_bind_int(stmt, 7, cabpar->meta.eco);
+		sqlite3_bind_int(stmt, 8, cabpar->meta.ritmo);
+		sqlite3_bind_int(stmt, 9, cabpar->meta.terminacion);
+		sqlite3_bind_int(stmt, 10, cabpar->difelo);
+	}
+	if(formato == FORMATO_MOVBIN)
+		sqlite3_bind_blob(stmt, 6, (char *)mov, cabpar->nmov * 4, SQLITE_STATIC);
+	else
+	{
+		blob[0] = MARCAFORMATO;
+		blob[1] = formato;
+		lenblob = 2 + codificaMovs(mov,cabpar->nmov,formato,blob + 2);
+		sqlite3_bind_blob(stmt, 6, (char *)blob, lenblob, SQLITE_STATIC);
+	}
 	rc = sqlite3_step(stmt);	// efectua inserccion en base.
 	if (rc != SQLITE_DONE) {
         fprintf(stderr, "Error al insertar fila: %s\n", sqlite3_errmsg(db));
@@ -115,19 +979,519 @@ void vuelcaPart(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,MOVBIN_t *mov,
    sqlite3_reset(stmt);
 }
 
+// Funcion para fijar los parametros de grabacion en bloques: partidas por bloque, nivel de
+// compresion zlib (0=>sin comprimir ... 9) y formato de los movimientos.
+void iniBloques(int npartidas,int nivel,int formato)
+{
+	if(npartidas > MAXPARTBLOQUE)
+		npartidas = MAXPARTBLOQUE;
+	partbloque = npartidas;
+	formatobloque = formato;
+	npartbloque = 0;
+	lenmovbloque = 0;
+	fileidbloque = -1;
+	particionbloque = -1;
+	free(cabbloque);
+	free(metabloque);
+	free(movbloque);
+	free(datbloque);
+	free(zbloque);
+	cabbloque = malloc(npartidas * sizeof(CABBLOQUE_t));
+	metabloque = malloc(npartidas * sizeof(METABLOQUE_t));
+	movbloque = malloc(npartidas * (2 + MAXMOV * sizeof(MOVBIN_t)));
+	datbloque = malloc(npartidas * (sizeof(CABBLOQUE_t) + sizeof(METABLOQUE_t) + 2 + MAXMOV * sizeof(MOVBIN_t)));
+	if(zcompini)
+		deflateEnd(&zcomp);
+	memset(&zcomp,0,sizeof(zcomp));
+	if(deflateInit(&zcomp,nivel) != Z_OK)
+	{
+		fprintf(stderr,"Error al iniciar zlib\n");
+		exit(2);
+	}
+	zcompini = 1;
+	lenzbloque = deflateBound(&zcomp,npartidas * (sizeof(CABBLOQUE_t) + sizeof(METABLOQUE_t) + 2 + MAXMOV * sizeof(MOVBIN_t)));
+	zbloque = malloc(lenzbloque);
+	if((cabbloque == NULL) || (metabloque == NULL) || (movbloque == NULL) || (datbloque == NULL) || (zbloque == NULL))
+	{
+		fprintf(stderr,"Sin memoria para bloques\n");
+		exit(2);
+	}
+}
+
+// Funcion para iniciar la muestra de partidas con la que se forma el diccionario.
+void iniDiccionario(void)
+{
+	if(prefijos == NULL)
+	{
+		if((prefijos = malloc(NPREFIJOS * sizeof(PREFIJO_t))) == NULL)
+		{
+			fprintf(stderr,"Sin memoria para diccionario\n");
+			exit(2);
+		}
+	}
+	memset(prefijos,0,NPREFIJOS * sizeof(PREFIJO_t));
+}
+
+// Funcion para anhadir una partida a la muestra. Se cuentan sus prefijos codificados
+// en el formato de grabacion de los bloques.
+void muestraDiccionario(CPARTIDA_t *cabpar,MOVBIN_t *mov)
+{
+	uint8_t codigo[MAXMOV * sizeof(MOVBIN_t)];
+	uint32_t hash;
+	int i,j,k,len;
+	PREFIJO_t *pref;
+
+	for(i=0;i<sizeof(pliesPrefijo)/sizeof(pliesPrefijo[0]);i++)
+	{
+		if(pliesPrefijo[i] > cabpar->nmov)
+			break;
+		// la codificacion es secuencial, el prefijo de la lista es la lista del prefijo.
+		len = codificaMovs(mov,pliesPrefijo[i],formatobloque,codigo);
+		if(len > MAXPREFIJO)
+			break;
+		// hash FNV-1a del prefijo.
+		for(j=0,hash=2166136261u;j<len;j++)
+			hash = (hash ^ codigo[j]) * 16777619u;
+		for(k=0;k<SONDEOPREF;k++)
+		{
+			pref = &prefijos[(hash + k) & (NPREFIJOS - 1)];
+			if(pref->cuenta == 0)
+			{
+				pref->cuenta = 1;
+				pref->len = len;
+				memcpy(pref->datos,codigo,len);
+				break;
+			}
+			if((pref->len == len) && (memcmp(pref->datos,codigo,len) == 0))
+			{
+				pref->cuenta++;
+				break;
+			}
+		}
+	}
+}
+
+// ahorro estimado de un prefijo en el diccionario, se ordenan de mayor a menor.
+static int compaPrefijo(const void *a,const void *b)
+{
+	PREFIJO_t *pa = *(PREFIJO_t **)a;
+	PREFIJO_t *pb = *(PREFIJO_t **)b;
+	uint32_t ahorroa = (pa->cuenta - 1) * pa->len;
+	uint32_t ahorrob = (pb->cuenta - 1) * pb->len;
+
+	if(ahorroa > ahorrob)
+		return -1;
+	if(ahorroa < ahorrob)
+		return 1;
+	return 0;
+}
+
+// Funcion para generar el diccionario con los prefijos de la muestra que mas se repiten.
+// Los prefijos contenidos al comienzo de otro ya elegido se descartan. Los de mayor ahorro
+// se colocan al final del diccionario, donde zlib los referencia con distancias menores.
+// retorna la longitud del diccionario generado.
+int generaDiccionario(uint8_t *dicc)
+{
+	PREFIJO_t **lista;
+	PREFIJO_t **elegidos;
+	int i,j,n,nelegidos,pos;
+
+	if((lista = malloc(NPREFIJOS * sizeof(PREFIJO_t *))) == NULL)
+		return 0;
+	elegidos = malloc(NPREFIJOS * sizeof(PREFIJO_t *));
+	for(i=0,n=0;i<NPREFIJOS;i++)
+	{
+		if(prefijos[i].cuenta > 1)
+			lista[n++] = &prefijos[i];
+	}
+	qsort(lista,n,sizeof(PREFIJO_t *),compaPrefijo);
+	pos = MAXDICC;
+	for(i=0,nelegidos=0;i<n;i++)
+	{
+		if(lista[i]->len > pos)
+			continue;
+		for(j=0;j<nelegidos;j++)
+		{
+			if((elegidos[j]->len >= lista[i]->len) && (memcmp(elegidos[j]->datos,lista[i]->datos,lista[i]->len) == 0))
+				break;
+		}
+		if(j < nelegidos)
+			continue;
+		elegidos[nelegidos++] = lista[i];
+		pos -= lista[i]->len;
+		memcpy(dicc + pos,lista[i]->datos,lista[i]->len);
+	}
+	memmove(dicc,dicc + pos,MAXDICC - pos);
+	free(lista);
+	free(elegidos);
+	return(MAXDICC - pos);
+}
+
+// Funcion para grabar el diccionario del fileid en la base y usarlo en los bloques siguientes.
+void ponDiccionario(sqlite3 *db,int fileid,uint8_t *dicc,int lendicc)
+{
+	int rc;
+	sqlite3_stmt *stmt1;
+	const char *query = "INSERT OR REPLACE INTO diccionarios(fileid,datos) VALUES(?,?)";
+
+	memcpy(dicbloque,dicc,lendicc);
+	lendicbloque = lendicc;
+	rc = sqlite3_prepare(db, query, -1, &stmt1, NULL);
+	if (rc != SQLITE_OK) {
+	  fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
+	  sqlite3_close(db);
+	  exit(2);
+	}
+	sqlite3_bind_int(stmt1, 1, fileid);
+	sqlite3_bind_blob(stmt1, 2, (char *)dicc, lendicc, SQLITE_STATIC);
+	rc = sqlite3_step(stmt1);
+	if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error al insertar fila: %s\n", sqlite3_errmsg(db));
+   }
+   sqlite3_finalize(stmt1);
+}
+
+// Funcion para indicar el comienzo de una transaccion de escritura en la tabla de bloques.
+// se indican el descriptor de la base y el descriptor del cursor a usar en las insercciones.
+void beginTransB(sqlite3 *db,sqlite3_stmt **stmt)
+{
+	int rc;
+	sqlite3_stmt *stmt1;
+	const char* btrans = "BEGIN TRANSACTION";
+	const char *query = "INSERT INTO bloques(fileid,particion,bloque,elomin,elomax,ganadores,npartidas,lendatos,datos) VALUES(?,?,?,?,?,?,?,?,?)";
+
+	rc = sqlite3_prepare(db, btrans, -1, &stmt1, NULL);
+	rc = sqlite3_step(stmt1);
+	if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error BEGIN TRANSACTION: %s\n", sqlite3_errmsg(db));
+   }
+   sqlite3_finalize(stmt1);
+	rc = sqlite3_prepare(db, query, -1, stmt, NULL);
+	if (rc != SQLITE_OK) {
+	  fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
+	  sqlite3_close(db);
+	  exit(2);
+	}
+}
+
+// Funcion para grabar el bloque pendiente. Se forma el bloque sin comprimir con las
+// cabeceras seguidas de los metadatos y los movimientos, se comprime y se inserta junto
+// con el rango de elomed y la mascara de ganadores de sus partidas.
+void cierraBloque(sqlite3 *db,sqlite3_stmt *stmt)
+{
+	int i,rc,lendatos;
+	int elomin,elomax,ganadores;
+
+	if(npartbloque == 0)
+		return;
+	elomin = cabbloque[0].elomed;
+	elomax = cabbloque[0].elomed;
+	ganadores = 0;
+	for(i=0;i<npartbloque;i++)
+	{
+		if(cabbloque[i].elomed < elomin)
+			elomin = cabbloque[i].elomed;
+		if(cabbloque[i].elomed > elomax)
+			elomax = cabbloque[i].elomed;
+		ganadores |= 1 << cabbloque[i].ganador;
+	}
+	lendatos = npartbloque * sizeof(CABBLOQUE_t);
+	memcpy(datbloque,cabbloque,lendatos);
+	memcpy(datbloque + lendatos,metabloque,npartbloque * sizeof(METABLOQUE_t));
+	lendatos += npartbloque * sizeof(METABLOQUE_t);
+	memcpy(datbloque + lendatos,movbloque,lenmovbloque);
+	lendatos += lenmovbloque;
+	// compresion con el diccionario del fileid.
+	deflateReset(&zcomp);
+	if(lendicbloque > 0)
+		deflateSetDictionary(&zcomp,dicbloque,lendicbloque);
+	zcomp.next_in = datbloque;
+	zcomp.avail_in = lendatos;
+	zcomp.next_out = zbloque;
+	zcomp.avail_out = lenzbloque;
+	if(deflate(&zcomp,Z_FINISH) != Z_STREAM_END)
+	{
+		fprintf(stderr,"Error al comprimir bloque\n");
+		exit(2);
+	}
+	sqlite3_bind_int(stmt, 1, fileidbloque);
+	sqlite3_bind_int(stmt, 2, particionbloque);
+	sqlite3_bind_int(stmt, 3, numbloque);
+	sqlite3_bind_int(stmt, 4, elomin);
+	sqlite3_bind_int(stmt, 5, elomax);
+	sqlite3_bind_int(stmt, 6, ganadores);
+	sqlite3_bind_int(stmt, 7, npartbloque);
+	sqlite3_bind_int(stmt, 8, lendatos);
+	sqlite3_bind_blob(stmt, 9, (char *)zbloque, zcomp.total_out, SQLITE_STATIC);
+	rc = sqlite3_step(stmt);	// efectua inserccion en base.
+	if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error al insertar fila: %s\n", sqlite3_errmsg(db));
+   }
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+	numbloque++;
+	npartbloque = 0;
+	lenmovbloque = 0;
+}
+
+// Funcion para anhadir una partida al bloque en construccion. Cuando el bloque se llena o
+// cambia la particion se comprime y se inserta con el cursor de insercion de bloques.
+void vuelcaPartB(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,MOVBIN_t *mov,int fileid,int particion)
+{
+	CABBLOQUE_t *cab;
+
+	if(cabpar->nmov == 0)
+		return;
+	if((fileid != fileidbloque) || (particion != particionbloque))
+	{
+		cierraBloque(db,stmt);
+		fileidbloque = fileid;
+		particionbloque = particion;
+		numbloque = 0;
+	}
+	cab = &cabbloque[npartbloque];
+	cab->partidaid = cabpar->ind;
+	cab->elomed = cabpar->elomed;
+	cab->ganador = cabpar->flags.ganablanca + cabpar->flags.gananegra * 2;
+	cab->formato = formatobloque;
+	cab->nmov = cabpar->nmov;
+	cab->lenmov = codificaMovs(mov,cabpar->nmov,formatobloque,movbloque + lenmovbloque);
+	metabloque[npartbloque].meta = cabpar->meta;
+	metabloque[npartbloque].difelo = cabpar->difelo;
+	lenmovbloque += cab->lenmov;
+	npartbloque++;
+	if(npartbloque >= partbloque)
+		cierraBloque(db,stmt);
+}
+
 // Funcion para lanzar un QUERY de consulta a la base, se indica fileid, particion, elomin, elomax y ganador
 // como criterios de busqueda. Se indica ademas el descriptor de la base y el cursor a usar para el resultado
 // del QUERY.
-void lanzaQueryR(sqlite3 *db,sqlite3_stmt **stmt,int fileid, int particion,int elomin,int elomax,int gana)
+// Funcion para lanzar el QUERY de una particion grabada en bloques. Comprueba si la
+// particion tiene bloques (las bases sin tabla de bloques se consultan por filas), carga el
+// diccionario de su fileid y lanza el QUERY de los bloques cuyo rango de elomed y ganadores
+// pueden contener partidas que cumplan los criterios. El filtro de metadatos se aplica al
+// leer cada partida.
+// retorna '1' si la particion esta grabada en bloques y '0' en caso contrario.
+static int lanzaQueryB(sqlite3 *db,sqlite3_stmt **stmt,int fileid, int particion,int elomin,int elomax,int gana,FILTROMETA_t *filtro)
 {
 	int rc;
-	const char* query = "SELECT * FROM partidas WHERE fileid = ? and particion = ? and elomed > ?  and elomed < ? and ganador = ?";
-	const char* queryr = "SELECT * FROM partidas WHERE fileid = ? and particion = ? and elomed > ? and elomed < ?";
-	
+	sqlite3_stmt *stmt1;
+	const char* queryhay = "SELECT 1 FROM bloques WHERE fileid = ? and particion = ? LIMIT 1";
+	const char* querydic = "SELECT datos FROM diccionarios WHERE fileid = ?";
+	const char* query = "SELECT npartidas,lendatos,datos FROM bloques WHERE fileid = ? and particion = ? and elomax > ? and elomin < ? and (ganadores & ?) != 0 ORDER BY bloque";
+	const char* queryr = "SELECT npartidas,lendatos,datos FROM bloques WHERE fileid = ? and particion = ? and elomax > ? and elomin < ? ORDER BY bloque";
+
+	if((stmt1 = preparaSentencia(db, SENTHAYBLOQ, queryhay)) == NULL)
+		return 0;
+	sqlite3_bind_int(stmt1, 1, fileid);
+	sqlite3_bind_int(stmt1, 2, particion);
+	rc = sqlite3_step(stmt1);
+	sueltaSentencia(stmt1);
+	if(rc != SQLITE_ROW)
+		return 0;
+	// diccionario del fileid.
+	lecbloque.lendicc = 0;
+	if((stmt1 = preparaSentencia(db, SENTDICC, querydic)) != NULL)
+	{
+		sqlite3_bind_int(stmt1, 1, fileid);
+		if(sqlite3_step(stmt1) == SQLITE_ROW)
+		{
+			lecbloque.lendicc = sqlite3_column_bytes(stmt1, 0);
+			if(lecbloque.lendicc > MAXDICC)
+				lecbloque.lendicc = MAXDICC;
+			memcpy(lecbloque.dicc,sqlite3_column_blob(stmt1, 0),lecbloque.lendicc);
+		}
+		sueltaSentencia(stmt1);
+	}
+	if(lecbloque.zini == 0)
+	{
+		memset(&lecbloque.z,0,sizeof(lecbloque.z));
+		if(inflateInit(&lecbloque.z) != Z_OK)
+		{
+			fprintf(stderr,"Error al iniciar zlib\n");
+			exit(2);
+		}
+		lecbloque.zini = 1;
+	}
 	if(gana == 0)	// si el ganador no importa reducimos el QUERY.
-		rc = sqlite3_prepare(db, queryr, -1, stmt, NULL);
+		*stmt = preparaSentencia(db, SENTBLOQ, queryr);
 	else
-		rc = sqlite3_prepare(db, query, -1, stmt, NULL);
+		*stmt = preparaSentencia(db, SENTBLOQG, query);
+	sqlite3_bind_int(*stmt, 1, fileid);
+	sqlite3_bind_int(*stmt, 2, particion);
+	sqlite3_bind_int(*stmt, 3, elomin);
+	sqlite3_bind_int(*stmt, 4, elomax);
+	if(gana != 0)
+		sqlite3_bind_int(*stmt, 5, 1 << gana);
+	lecbloque.stmt = *stmt;
+	lecbloque.npart = 0;
+	lecbloque.ind = 0;
+	lecbloque.elomin = elomin;
+	lecbloque.elomax = elomax;
+	lecbloque.gana = gana;
+	lecbloque.filtro = filtro;
+	lecbloque.sinmeta = 0;
+	return 1;
+}
+
+// Funcion para cargar en la arena el siguiente bloque del QUERY de bloques. Los bloques
+// sin metadatos miden exactamente las cabeceras mas los movimientos.
+// retorna '0' si no quedan mas bloques y '1' en caso contrario.
+static int cargaBloque(sqlite3 *db)
+{
+	int rc,lendatos,lenmovs,i;
+
+	while((rc = sqlite3_step(lecbloque.stmt)) == SQLITE_ROW)
+	{
+		lendatos = sqlite3_column_int(lecbloque.stmt, 1);
+		if(lendatos > lecbloque.lenarena)
+		{
+			free(lecbloque.arena);
+			if((lecbloque.arena = malloc(lendatos)) == NULL)
+			{
+				fprintf(stderr,"Sin memoria para bloques\n");
+				exit(2);
+			}
+			lecbloque.lenarena = lendatos;
+		}
+		// descompresion con el diccionario del fileid.
+		inflateReset(&lecbloque.z);
+		lecbloque.z.next_in = (uint8_t *)sqlite3_column_blob(lecbloque.stmt, 2);
+		lecbloque.z.avail_in = sqlite3_column_bytes(lecbloque.stmt, 2);
+		lecbloque.z.next_out = lecbloque.arena;
+		lecbloque.z.avail_out = lendatos;
+		rc = inflate(&lecbloque.z,Z_FINISH);
+		if(rc == Z_NEED_DICT)
+		{
+			inflateSetDictionary(&lecbloque.z,lecbloque.dicc,lecbloque.lendicc);
+			rc = inflate(&lecbloque.z,Z_FINISH);
+		}
+		if(rc != Z_STREAM_END)
+		{
+			fprintf(stderr, "Bloque invalido: %s\n", lecbloque.z.msg ? lecbloque.z.msg : "");
+			continue;
+		}
+		lecbloque.npart = sqlite3_column_int(lecbloque.stmt, 0);
+		lecbloque.cab = (CABBLOQUE_t *)lecbloque.arena;
+		lecbloque.mov = lecbloque.arena + lecbloque.npart * sizeof(CABBLOQUE_t);
+		for(i=0,lenmovs=0;i<lecbloque.npart;i++)
+			lenmovs += lecbloque.cab[i].lenmov;
+		lecbloque.meta = NULL;
+		if(lendatos == (lecbloque.npart * (sizeof(CABBLOQUE_t) + sizeof(METABLOQUE_t)) + lenmovs))
+		{
+			lecbloque.meta = (METABLOQUE_t *)lecbloque.mov;
+			lecbloque.mov += lecbloque.npart * sizeof(METABLOQUE_t);
+		}
+		else
+			lecbloque.sinmeta = 1;
+		lecbloque.ind = 0;
+		return 1;
+	}
+	return 0;
+}
+
+// Funcion para obtener la siguiente partida de los bloques del QUERY que cumpla los criterios.
+static int nextPartidaB(sqlite3 *db,CPARTIDA_t *cabpar,MOVBIN_t *mov)
+{
+	CABBLOQUE_t *cab;
+	METABLOQUE_t *meta;
+
+	while(1)
+	{
+		if(lecbloque.ind >= lecbloque.npart)
+		{
+			if(cargaBloque(db) == 0)
+				return 0;	// no hay mas partidas en el QUERY.
+			continue;
+		}
+		memset(cabpar,0,sizeof(CPARTIDA_t));	// rellena a cero cabpartida.
+		meta = (lecbloque.meta != NULL) ? &lecbloque.meta[lecbloque.ind] : NULL;
+		cab = &lecbloque.cab[lecbloque.ind++];
+		if(meta != NULL)
+		{
+			cabpar->meta = meta->meta;
+			cabpar->difelo = meta->difelo;
+		}
+		if((cab->elomed > lecbloque.elomin) && (cab->elomed < lecbloque.elomax) &&
+			((lecbloque.gana == 0) || (cab->ganador == lecbloque.gana)) &&
+			((lecbloque.filtro == NULL) || cumpleMeta(lecbloque.filtro,cabpar->meta,cabpar->difelo)))
+		{
+			cabpar->elomed = cab->elomed;
+			cabpar->ind = cab->partidaid;
+			cabpar->formato = cab->formato;
+			cabpar->nmov = cab->nmov;
+			memcpy(mov,lecbloque.mov,cab->lenmov);
+			ponGanador(cabpar,cab->ganador);
+			lecbloque.mov += cab->lenmov;
+			return 1;
+		}
+		lecbloque.mov += cab->lenmov;
+	}
+}
+
+void lanzaQueryR(sqlite3 *db,sqlite3_stmt **stmt,int fileid, int particion,int elomin,int elomax,int gana,FILTROMETA_t *filtro)
+{
+	int rc;
+	const char* query = "SELECT fileid,particion,elomed,ganador,partidaid,movimientos FROM partidas"
+		" WHERE fileid = ? and particion = ? and elomed > ?  and elomed < ? and ganador = ?";
+	const char* queryr = "SELECT fileid,particion,elomed,ganador,partidaid,movimientos FROM partidas"
+		" WHERE fileid = ? and particion = ? and elomed > ? and elomed < ?";
+	// esquema V2: rango sobre la clave de cabpartidas y acceso por clave a movpartidas.
+	const char* query2 = "SELECT c.fileid,c.particion,c.elomed,c.ganador,c.partidaid,m.datos FROM cabpartidas c"
+		" JOIN movpartidas m USING(fileid,particion,elomed,ganador,partidaid)"
+		" WHERE c.fileid = ? and c.particion = ? and c.elomed > ? and c.elomed < ? and c.ganador = ?"
+		" ORDER BY c.elomed,c.ganador,c.partidaid";
+	const char* query2r = "SELECT c.fileid,c.particion,c.elomed,c.ganador,c.partidaid,m.datos FROM cabpartidas c"
+		" JOIN movpartidas m USING(fileid,particion,elomed,ganador,partidaid)"
+		" WHERE c.fileid = ? and c.particion = ? and c.elomed > ? and c.elomed < ?"
+		" ORDER BY c.elomed,c.ganador,c.partidaid";
+	// con metadatos: el filtro (parametros 6 a 11) se evalua sobre las columnas de metadatos, en el
+	// esquema V2 sobre cabpartidas antes de acceder a movpartidas.
+	const char* querym = "SELECT fileid,particion,elomed,ganador,partidaid,movimientos,eco,ritmo,terminacion,difelo"
+		" FROM partidas WHERE fileid = ?1 and particion = ?2 and elomed > ?3  and elomed < ?4 and ganador = ?5"
+		" and (?6 >> ritmo) & 1 and (?7 >> terminacion) & 1 and eco BETWEEN ?8 AND ?9 and difelo BETWEEN ?10 AND ?11";
+	const char* queryrm = "SELECT fileid,particion,elomed,ganador,partidaid,movimientos,eco,ritmo,terminacion,difelo"
+		" FROM partidas WHERE fileid = ?1 and particion = ?2 and elomed > ?3 and elomed < ?4"
+		" and (?6 >> ritmo) & 1 and (?7 >> terminacion) & 1 and eco BETWEEN ?8 AND ?9 and difelo BETWEEN ?10 AND ?11";
+	const char* query2m = "SELECT c.fileid,c.particion,c.elomed,c.ganador,c.partidaid,m.datos,c.eco,c.ritmo,c.terminacion,c.difelo"
+		" FROM cabpartidas c JOIN movpartidas m USING(fileid,particion,elomed,ganador,partidaid)"
+		" WHERE c.fileid = ?1 and c.particion = ?2 and c.elomed > ?3 and c.elomed < ?4 and c.ganador = ?5"
+		" and (?6 >> c.ritmo) & 1 and (?7 >> c.terminacion) & 1 and c.eco BETWEEN ?8 AND ?9 and c.difelo BETWEEN ?10 AND ?11"
+		" ORDER BY c.elomed,c.ganador,c.partidaid";
+	const char* query2rm = "SELECT c.fileid,c.particion,c.elomed,c.ganador,c.partidaid,m.datos,c.eco,c.ritmo,c.terminacion,c.difelo"
+		" FROM cabpartidas c JOIN movpartidas m USING(fileid,particion,elomed,ganador,partidaid)"
+		" WHERE c.fileid = ?1 and c.particion = ?2 and c.elomed > ?3 and c.elomed < ?4"
+		" and (?6 >> c.ritmo) & 1 and (?7 >> c.terminacion) & 1 and c.eco BETWEEN ?8 AND ?9 and c.difelo BETWEEN ?10 AND ?11"
+		" ORDER BY c.elomed,c.ganador,c.partidaid";
+	
+	// particion grabada en bloques.
+	lecbloque.stmt = NULL;
+	if(lanzaQueryB(db,stmt,fileid,particion,elomin,elomax,gana,filtro))
+		return;
+	// las bases anteriores a los metadatos no tienen sus columnas y se consultan sin ellos.
+	if(versionSqlite(db) >= ESQUEMAV2)
+	{
+		if(gana == 0)
+		{
+			if((*stmt = preparaSentencia(db, SENTFILAS2M, query2rm)) == NULL)
+				*stmt = preparaSentencia(db, SENTFILAS2, query2r);
+		}
+		else if((*stmt = preparaSentencia(db, SENTFILASG2M, query2m)) == NULL)
+			*stmt = preparaSentencia(db, SENTFILASG2, query2);
+	}
+	else if(gana == 0)	// si el ganador no importa reducimos el QUERY.
+	{
+		if((*stmt = preparaSentencia(db, SENTFILASM, queryrm)) == NULL)
+			*stmt = preparaSentencia(db, SENTFILAS, queryr);
+	}
+	else if((*stmt = preparaSentencia(db, SENTFILASGM, querym)) == NULL)
+		*stmt = preparaSentencia(db, SENTFILASG, query);
+	if(*stmt == NULL)
+	{
+		fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
+		exit(2);
+	}
 	// Relleno del cursor de datos del QUERY.
 	sqlite3_bind_int(*stmt, 1, fileid);
 	sqlite3_bind_int(*stmt, 2, particion);
@@ -135,17 +1499,29 @@ void lanzaQueryR(sqlite3 *db,sqlite3_stmt **stmt,int fileid, int particion,int e
 	sqlite3_bind_int(*stmt, 4, elomax);
 	if(gana != 0)
 		sqlite3_bind_int(*stmt, 5, gana);
+	if(sqlite3_bind_parameter_count(*stmt) > 5)	// filtro de metadatos, sin filtro admite cualquiera.
+	{
+		sqlite3_bind_int(*stmt, 6, filtro ? filtro->ritmos : 0xff);
+		sqlite3_bind_int(*stmt, 7, filtro ? filtro->terminaciones : 0xff);
+		sqlite3_bind_int(*stmt, 8, filtro ? filtro->ecomin : 0);
+		sqlite3_bind_int(*stmt, 9, filtro ? filtro->ecomax : ECOMAXIMO);
+		sqlite3_bind_int(*stmt, 10, filtro ? filtro->difmin : -32768);
+		sqlite3_bind_int(*stmt, 11, filtro ? filtro->difmax : 32767);
+	}
 }
 
 // Funcion para obtener la siguiente partida resultado del QUERY anteriormente
 // lanzado. Se pasa el descriptor de la base y el cursor del QUERY. devuelve
-// la cabecera de partida y su lista de movimientos. Si no quedan mas, retorna '0'
+// la cabecera de partida y su lista de movimientos tal y como esta grabada, en el
+// formato indicado en cabpar->formato (decodificar con DECMOV_t). Si no quedan mas, retorna '0'
 // en caso contrario retorna '1'.
 int nextPartida(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,MOVBIN_t *mov)
 {
 	int rc;
 	uint8_t ganador;
 	
+	if((stmt == lecbloque.stmt) && (stmt != NULL))	// QUERY sobre bloques.
+		return(nextPartidaB(db,cabpar,mov));
 	memset(cabpar,0,sizeof(CPARTIDA_t));	// rellena a cero cabpartida.
 	rc = sqlite3_step(stmt);	// siguiente posicion del cursor del QUERY.
 	if (rc == SQLITE_ROW) {
@@ -153,51 +1529,71 @@ int nextPartida(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,MOVBIN_t *mov)
 	  cabpar->elomed = sqlite3_column_int(stmt, 2);
 	  cabpar->ind = sqlite3_column_int(stmt, 4);
 	  ganador = sqlite3_column_int(stmt, 3);
-	  const void *datos_resultado = sqlite3_column_blob(stmt, 5);
+	  const uint8_t *datos_resultado = sqlite3_column_blob(stmt, 5);
 	  int tamano_resultado = sqlite3_column_bytes(stmt, 5);
-	  cabpar->nmov = tamano_resultado/4;
+	  if((tamano_resultado >= 2) && (datos_resultado[0] == MARCAFORMATO))	// formato reducido.
+	  {
+		  cabpar->formato = datos_resultado[1];
+		  datos_resultado += 2;
+		  tamano_resultado -= 2;
+		  cabpar->nmov = cuentaMovs((uint8_t *)datos_resultado,tamano_resultado,cabpar->formato);
+	  }
+	  else
+	  {
+		  cabpar->formato = FORMATO_MOVBIN;
+		  cabpar->nmov = tamano_resultado/4;
+	  }
 	  memcpy(mov,datos_resultado,tamano_resultado);
-	  // recodifica ganador.
-	  switch(ganador)
-      {
-			case 1:
-				cabpar->flags.ganablanca = 1;
-				cabpar->flags.gananegra = 0;
-				break;
-			case 2:
-				cabpar->flags.ganablanca = 0;
-				cabpar->flags.gananegra = 1;
-				break;
-			case 3:
-				cabpar->flags.ganablanca = 1;
-				cabpar->flags.gananegra = 1;
-				break;
-			default:
-				cabpar->flags.ganablanca = 0;
-				cabpar->flags.gananegra = 0;
-				break;
-		}
+	  ponGanador(cabpar,ganador);
+	  if(sqlite3_column_count(stmt) > 6)	// metadatos de la partida.
+	  {
+		  cabpar->meta.eco = sqlite3_column_int(stmt, 6);
+		  cabpar->meta.ritmo = sqlite3_column_int(stmt, 7);
+		  cabpar->meta.terminacion = sqlite3_column_int(stmt, 8);
+		  cabpar->difelo = sqlite3_column_int(stmt, 9);
+	  }
 		return 1;	// retorna OK.
     } else {
         return 0;	// no hay mas partidas en el QUERY.
     }
 }
 
+// Funcion que indica si las partidas leidas con el cursor del QUERY tienen metadatos. En las
+// particiones grabadas en bloques se refiere a los bloques leidos hasta el momento.
+// retorna '1' si los tienen y '0' en caso contrario.
+int metadatosQuery(sqlite3_stmt *stmt)
+{
+	if((stmt == lecbloque.stmt) && (stmt != NULL))	// QUERY sobre bloques.
+		return(lecbloque.sinmeta == 0);
+	return(sqlite3_column_count(stmt) > 6);
+}
+
 // libera el cursor usado en el QUERY.
 void liberaQuery(sqlite3_stmt *stmt)
 {
-	sqlite3_finalize(stmt);
+	if(stmt == lecbloque.stmt)
+		lecbloque.stmt = NULL;
+	sueltaSentencia(stmt);
 }
 
 // Funcion para insertar un registro en la tabla de particiones de la base master.
-// la base se supone ya abierta e indicada por su descriptor.
-void insertaParticion(sqlite3 *db,int fileid,int particion,int base)
+// la base se supone ya abierta e indicada por su descriptor. Las bases anteriores al rango de
+// elomed de las particiones no tienen sus columnas y se anota sin el.
+void insertaParticion(sqlite3 *db,int fileid,int particion,int base,int elomin,int elomax)
 {
 	int rc;
 	sqlite3_stmt *stmt1;
-	const char *query = "INSERT INTO particiones(fileid,particion,base) VALUES(?,?,?)";
+	const char *query = "INSERT INTO particiones(fileid,particion,base,elomin,elomax) VALUES(?,?,?,?,?)";
+	const char *queryant = "INSERT INTO particiones(fileid,particion,base) VALUES(?,?,?)";
 	
 	rc = sqlite3_prepare(db, query, -1, &stmt1, NULL);
+	if (rc != SQLITE_OK)
+		rc = sqlite3_prepare(db, queryant, -1, &stmt1, NULL);
+	else
+	{
+		sqlite3_bind_int(stmt1, 4, elomin);
+		sqlite3_bind_int(stmt1, 5, elomax);
+	}
 	if (rc != SQLITE_OK) {
 	  fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
 	  sqlite3_close(db);
@@ -213,3 +1609,47 @@ void insertaParticion(sqlite3 *db,int fileid,int particion,int base)
    sqlite3_finalize(stmt1);
 }
 
+
+// Funcion que consulta si la particion indicada (particion < 0 => cualquiera del fileid) esta
+// en la tabla de particiones de la base master. retorna '1' si esta y '0' si no esta.
+int existeParticion(sqlite3 *db,int fileid,int particion)
+{
+	int rc,existe = 0;
+	sqlite3_stmt *stmt1;
+	const char *query = "SELECT 1 FROM particiones WHERE fileid = ? AND (particion = ? OR ? < 0) LIMIT 1";
+	
+	rc = sqlite3_prepare(db, query, -1, &stmt1, NULL);
+	if (rc != SQLITE_OK) {
+	  fprintf(stderr, "Error al preparar la consulta: %s\n", sqlite3_errmsg(db));
+	  exit(2);
+	}
+	sqlite3_bind_int(stmt1, 1, fileid);
+	sqlite3_bind_int(stmt1, 2, particion);
+	sqlite3_bind_int(stmt1, 3, particion);
+	if(sqlite3_step(stmt1) == SQLITE_ROW)
+		existe = 1;
+	sqlite3_finalize(stmt1);
+	return existe;
+}
+
+// Funcion para borrar de la base las partidas y bloques de una particion (particion < 0 => todas
+// las del fileid), restos de una carga interrumpida antes de anotarla en la tabla de particiones.
+void borraParticion(sqlite3 *db,int fileid,int particion)
+{
+	char sql[400];
+	char cond[100];
+	
+	if(particion < 0)
+		sprintf(cond,"fileid = %d",fileid);
+	else
+		sprintf(cond,"fileid = %d AND particion = %d",fileid,particion);
+	if(versionSqlite(db) >= ESQUEMAV2)
+		sprintf(sql,"DELETE FROM cabpartidas WHERE %s;DELETE FROM movpartidas WHERE %s;",cond,cond);
+	else
+		sprintf(sql,"DELETE FROM partidas WHERE %s;",cond);
+	if(sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK)
+		fprintf(stderr, "Error al borrar particion %d-%d: %s\n", fileid, particion, sqlite3_errmsg(db));
+	// las bases anteriores a los bloques comprimidos no tienen la tabla.
+	sprintf(sql,"DELETE FROM bloques WHERE %s;",cond);
+	sqlite3_exec(db, sql, NULL, NULL, NULL);
+}
@@ -9,16 +9,119 @@
 #ifndef SQLITEDRV_H
 #define SQLITEDRV_H
 
+#include <stdio.h>
 #include "ajedrez.h"
 #include <sqlite3.h>
 
+// Las listas de movimientos en formato reducido se graban en el BLOB precedidas
+// de dos bytes: MARCAFORMATO y el formato. El formato original (MOVBIN_t) no lleva
+// cabecera, su primer byte es una pieza y nunca puede valer MARCAFORMATO.
+#define MARCAFORMATO	0xff
+
+// Opcionalmente las partidas de una particion se graban agrupadas en bloques comprimidos
+// (tabla 'bloques') en lugar de una fila por partida (tabla 'partidas'). Cada bloque contiene
+// hasta un numero fijo de partidas consecutivas de la particion, que al estar ordenadas por
+// elomed permiten descartar bloques enteros con el rango de elomed del bloque.
+//
+// El contenido del bloque descomprimido es un array de CABBLOQUE_t (una por partida), un
+// array de METABLOQUE_t con los metadatos de las partidas y las listas de movimientos de las
+// partidas en el mismo orden. Los bloques grabados antes de los metadatos no tienen el array
+// METABLOQUE_t, se reconocen por la longitud del bloque y sus partidas tienen los metadatos
+// a cero. Se comprime con
+// zlib usando un diccionario preestablecido por fileid (tabla 'diccionarios') formado con
+// las aperturas mas repetidas de una muestra de sus partidas.
+#define MAXPARTBLOQUE	4096			// numero maximo de partidas por bloque.
+#define MAXDICC			(32*1024)	// longitud maxima del diccionario (ventana de zlib).
+#define MUESTRADICC		4096			// partidas de muestra para formar el diccionario.
+
+// cabecera de partida dentro de un bloque.
+typedef struct {
+	uint32_t	partidaid;	// indice de la partida en el fichero PGN original.
+	uint16_t	elomed;		// elo media de los jugadores.
+	uint8_t	ganador;		// ganador (0=NADA, 1=>blancas, 2=>negras, 3=tablas).
+	uint8_t	formato;		// formato de los movimientos (FORMATO_xxx).
+	uint16_t	nmov;			// numero de movimientos.
+	uint16_t	lenmov;		// longitud en bytes de la lista de movimientos.
+} __attribute__((packed)) CABBLOQUE_t;
+
+// metadatos de partida dentro de un bloque.
+typedef struct {
+	META_t	meta;			// eco, ritmo y terminacion.
+	int16_t	difelo;		// diferencia de elo (blancas - negras).
+} __attribute__((packed)) METABLOQUE_t;
+
+// Las tablas de partidas llevan ademas los metadatos de la partida ('eco', 'ritmo', 'terminacion' y
+// 'difelo', ver META_t) para filtrar por ellos. Las bases anteriores no tienen estas columnas, se
+// cargan y consultan sin ellas.
+//
+// Versiones del esquema de la tabla de partidas (PRAGMA user_version de la base).
+//		-ESQUEMAV1 => tabla 'partidas' con rowid e indices separados por elomed y por
+//						fileid-particion. Es el esquema de las bases sin user_version.
+//		-ESQUEMAV2 => tabla 'cabpartidas' WITHOUT ROWID agrupada por la clave
+//						(fileid,particion,elomed,ganador,partidaid) con los metadatos de la partida
+//						y tabla 'movpartidas' WITHOUT ROWID con la misma clave y los movimientos.
+//						'partidas' es una vista que las une con las columnas del esquema V1 y admite
+//						inserciones mediante un trigger, por lo que la carga no distingue versiones.
+#define ESQUEMAV1		1
+#define ESQUEMAV2		2
+
 // funcion para conectar con la base de datos indicada por su path.
 // pone la base en modo asincrono para ganar velocidad.
 extern void conectaSqlite(sqlite3 **db,char *basename);
 
 // Funcion para desconectar de la base de datos indicada por su descriptor.
+// Si es una conexion de lectura cacheada se quita de la cache.
 extern void desconectaSqlite(sqlite3 *db);
 
+// Funcion para obtener la conexion de lectura a la base indicada por su path.
+// Las conexiones de lectura se cachean por base: se abren una sola vez en solo lectura
+// (URI mode=ro&immutable=1) con mmap_size, cache_size amplia y query_only, y las
+// sentencias de consulta (lanzaQueryR) se preparan una vez y se reutilizan.
+// liberaQuery reinicia las sentencias cacheadas en lugar de finalizarlas.
+extern sqlite3 *conectaSqliteR(char *basename);
+
+// Funcion para cerrar todas las conexiones de lectura cacheadas.
+extern void cierraConexiones(void);
+
+// Contadores del VFS de lectura.
+typedef struct {
+	uint64_t	bytespedidos;	// bytes pedidos por SQLITE.
+	uint64_t	bytesleidos;	// bytes leidos del disco.
+	uint64_t	nlecturas;		// lecturas (pread) efectuadas.
+	uint64_t	aciertos;		// peticiones servidas desde la ventana en memoria.
+	uint64_t	proyectadas;	// paginas servidas desde la proyeccion en memoria (mmap_size).
+	uint64_t	tamanhos[10];	// lecturas por tamanho (<=4K, <=8K, ... <=1M, >1M).
+} ESTVFS_t;
+
+// Funcion para registrar el VFS de lectura de las bases. Detecta los accesos secuenciales
+// y los agrupa en lecturas grandes sobre un pool de buffers alineados, anticipando la
+// siguiente lectura. directo indica si las bases se abren con O_DIRECT. Las conexiones
+// de lectura (conectaSqliteR) abiertas despues del registro lo utilizan. Sin O_DIRECT se
+// mantiene su proyeccion en memoria (mmap_size, reducida a los primeros 64 MB de la base) y la
+// ventana solo lee las paginas de fuera.
+extern void registraVfsLectura(int directo);
+
+// Funciones para obtener y para mostrar los contadores del VFS de lectura.
+extern void estadisticasVfs(ESTVFS_t *est);
+extern void muestraEstVfs(FILE *fd);
+
+// Funcion que retorna la version del esquema de la base (ESQUEMAVx).
+extern int versionSqlite(sqlite3 *db);
+
+// Funcion para crear las tablas de partidas del esquema V2 y marcar la base con su version.
+// La base no debe tener tabla ni vista 'partidas'. retorna '1' si es correcto y '0' en caso contrario.
+extern int creaTablasV2(sqlite3 *db);
+
+// Funcion para crear los indices secundarios de las tablas de partidas (esquema V1) y bloques
+// si no existen. En la carga masiva las bases se crean sin ellos y se forman al final.
+// retorna '1' si es correcto y '0' en caso contrario.
+extern int creaIndices(sqlite3 *db);
+
+// Funcion para poner la conexion en modo de carga masiva: sin diario (journal_mode=OFF),
+// bloqueo exclusivo hasta cerrar la conexion y cache amplia. Una carga interrumpida
+// en este modo deja la base inservible y debe repetirse desde cero.
+extern void modoCargaMasiva(sqlite3 *db);
+
 // Funcion para indicar el comienzo de una transaccion de escritura en la base.
 // se indican el descriptor de la base y el descriptor del cursor a usar en las insercciones.
 extern void beginTransW(sqlite3 *db,sqlite3_stmt **stmt);
@@ -29,28 +132,69 @@ extern void endTransW(sqlite3 *db,sqlite3_stmt *stmt);
 
 // Funcion para volcar una partida indicada por su cabecera y lista de movimientos al cursor de inserccion
 // actual en la base de datos. Se indican el descriptor de la base, el cursor de inserccion, el identificador
-// del fichero de partidas original y el numero de particion en proceso.
+// del fichero de partidas original, el numero de particion en proceso y el formato (FORMATO_xxx)
+// con el que se graban los movimientos en el BLOB.
 extern void vuelcaPart(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,
+								MOVBIN_t *mov,int fileid,int particion,int formato);
+
+// Funcion para fijar los parametros de grabacion en bloques: partidas por bloque, nivel de
+// compresion zlib (0=>sin comprimir ... 9) y formato de los movimientos.
+extern void iniBloques(int npartidas,int nivel,int formato);
+
+// Funciones para formar el diccionario de un fileid. Se inicia la muestra, se anhaden
+// partidas a la muestra y se genera el diccionario sobre dicc (MAXDICC bytes como maximo).
+// generaDiccionario retorna la longitud del diccionario generado.
+extern void iniDiccionario(void);
+extern void muestraDiccionario(CPARTIDA_t *cabpar,MOVBIN_t *mov);
+extern int generaDiccionario(uint8_t *dicc);
+
+// Funcion para grabar el diccionario del fileid en la base y usarlo en los bloques siguientes.
+extern void ponDiccionario(sqlite3 *db,int fileid,uint8_t *dicc,int lendicc);
+
+// Funcion para indicar el comienzo de una transaccion de escritura en la tabla de bloques.
+extern void beginTransB(sqlite3 *db,sqlite3_stmt **stmt);
+
+// Funcion para anhadir una partida al bloque en construccion. Cuando el bloque se llena o
+// cambia la particion se comprime y se inserta con el cursor de insercion de bloques.
+extern void vuelcaPartB(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,
 								MOVBIN_t *mov,int fileid,int particion);
 
-// Funcion para lanzar un QUERY de consulta a la base, se indica fileid, particion, elomin, elomax y ganador
-// como criterios de busqueda. Se indica ademas el descriptor de la base y el cursor a usar para el resultado
-// del QUERY.						
+// Funcion para grabar el bloque pendiente. Debe llamarse antes de endTransW.
+extern void cierraBloque(sqlite3 *db,sqlite3_stmt *stmt);
+
+// Funcion para lanzar un QUERY de consulta a la base, se indica fileid, particion, elomin, elomax, ganador
+// y filtro de metadatos (NULL => sin filtro) como criterios de busqueda. Se indica ademas el descriptor de
+// la base y el cursor a usar para el resultado del QUERY. El filtro de metadatos se aplica en el QUERY
+// sobre las columnas de metadatos de las partidas y en las particiones grabadas en bloques al leer cada
+// partida; en las bases y bloques que no los tienen las partidas se retornan con los metadatos a cero.
 extern void lanzaQueryR(sqlite3 *db,sqlite3_stmt **stmt,int fileid,
-								int particion,int elomin,int elomax,int gana);
+								int particion,int elomin,int elomax,int gana,FILTROMETA_t *filtro);
 
 // Funcion para obtener la siguiente partida resultado del QUERY anteriormente
 // lanzado. Se pasa el descriptor de la base y el cursor del QUERY. devuelve
-// la cabecera de partida y su lista de movimientos. Si no quedan mas, retorna '0'
-// en caso contrario retorna '1'.						
+// la cabecera de partida y su lista de movimientos en el formato grabado (cabpar->formato).
+// Si no quedan mas, retorna '0' en caso contrario retorna '1'.						
 extern int nextPartida(sqlite3 *db,sqlite3_stmt *stmt,CPARTIDA_t *cabpar,
 								MOVBIN_t *mov);
 
+// Funcion que indica si las partidas leidas con el cursor del QUERY tienen metadatos. En las
+// particiones grabadas en bloques se refiere a los bloques leidos hasta el momento.
+// retorna '1' si los tienen y '0' en caso contrario.
+extern int metadatosQuery(sqlite3_stmt *stmt);
+
 // libera el cursor usado en el QUERY.								
 extern void liberaQuery(sqlite3_stmt *stmt);
 
-// Funcion para insertar un registro en la tabla de particiones de la base master.
-// la base se supone ya abierta e indicada por su descriptor.
-extern void insertaParticion(sqlite3 *db,int fileid,int particion,int base);
+// Funcion para insertar un registro en la tabla de particiones de la base master con el rango de
+// elomed de sus partidas. la base se supone ya abierta e indicada por su descriptor.
+extern void insertaParticion(sqlite3 *db,int fileid,int particion,int base,int elomin,int elomax);
+
+// Funcion que consulta si la particion indicada (particion < 0 => cualquiera del fileid) esta
+// en la tabla de particiones de la base master. retorna '1' si esta y '0' si no esta.
+extern int existeParticion(sqlite3 *db,int fileid,int particion);
+
+// Funcion para borrar de la base las partidas y bloques de una particion (particion < 0 => todas
+// las del fileid), restos de una carga interrumpida antes de anotarla en la tabla de particiones.
+extern void borraParticion(sqlite3 *db,int fileid,int particion);
 
 #endif //SQLITEDRV_H